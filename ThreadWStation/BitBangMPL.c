@@ -296,16 +296,6 @@ void readTemperature(thread_data_t *MPL3115A2_Data)
 	   The fractional component is located in bits 7-4 of RawData[4]. Bits 3-0 of OUT_T_LSB are not used. */
 	MPL3115A2_Data->MPL3115A2temperature = (float) ((short)((tData[0] << 8) | (tData[1] & 0xF0)) >> 4) * 0.0625;
 
-	/* Get the minimum and maximum values */
-	if(MPL3115A2_Data->MPL3115A2temperature < MPL3115A2_Data->minMPL3115A2temperature) {
-		MPL3115A2_Data->minMPL3115A2temperature = MPL3115A2_Data->MPL3115A2temperature;
-		//printf("Min temperature: %0.2f\n", MPL3115A2_Data->minMPL3115A2temperature);
-
-	}
-	if(MPL3115A2_Data->MPL3115A2temperature > MPL3115A2_Data->maxMPL3115A2temperature) {
-		MPL3115A2_Data->maxMPL3115A2temperature = MPL3115A2_Data->MPL3115A2temperature;
-		//printf("Max temperature: %0.2f\n", MPL3115A2_Data->maxMPL3115A2temperature);
-	}
 }
 
 void readAltitude(float *altitude)
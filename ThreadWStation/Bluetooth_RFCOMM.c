@@ -4,12 +4,25 @@
  * This library is used for communicate with Android phone through Bluetooth RFCOMM Server and Client connections.
  */
 #include "Bluetooth_RFCOMM.h"
-#include "LCD.h"
+#include "LCDRenderer.h"
 #include "SerializeDeserialize.h"
+#include "CommandParser.h"
+#include "WeatherFrame.h"
+#include <poll.h>
 
 /* Static function declarations */
 static int bluetoothRFCOMM_ClientConnect(const char *target_addr, const uint8_t svc_uuid_int[], thread_data_t *sensorData);
 static sdp_session_t *registerService(const uint8_t rfcomm_channel);
+static int serveCommands(const int socket, thread_data_t *sensorData);
+static int handleCommand(const int socket, const command_t *command, frame_session_t *session, thread_data_t *sensorData);
+
+/* Payload lengths of the Bluetooth commands, the rest of the commands are a single byte */
+static const command_rule_t bluetoothCommandRules[] =
+{
+	{ RANDOM_TEXT,	COMMAND_PAYLOAD_TEXT },
+	{ READ_BATCH,	1 },
+	{ NEGOTIATE_FRAME_FORMAT, 1 },
+};
 
 /***********************************************************************************************/
 /* This function scans the nearby Bluetooth devices and lets the user choose which device      */
@@ -126,12 +139,10 @@ int bluetoothRFCOMM_Client(thread_data_t *sensorData)
 
 static int bluetoothRFCOMM_ClientConnect(const char *target_addr, const uint8_t svc_uuid_int[], thread_data_t *sensorData)
 {
-	int bytes_read, bytes_sent, s, channel = 0, status = 0;
+	int s, channel = 0, status = 0;
     uuid_t svc_uuid;
     sdp_list_t *response_list = NULL, *search_list, *attrid_list;
     sdp_session_t *session = 0;
-	unsigned char *serializationLengthPtr;
-	bool socketCloseFlag = false;
 	struct sockaddr_rc addr = { 0 };
 
     str2ba( target_addr, &addr.rc_bdaddr );
@@ -231,103 +242,10 @@ static int bluetoothRFCOMM_ClientConnect(const char *target_addr, const uint8_t
     printConnect();
 
 	/*
-	 * Wait for data until the socketCloseFlag is set to end the transaction and close the socket connection
+	 * Serve the pipelined commands until the server closes the socket connection
 	 */
-	while(!socketCloseFlag) {
-
-		unsigned char recvBuffer[128] = { 0 };
-		unsigned char sendBuffer[128] = { 0 };
-
-		printf("Waiting bytes to read.............\n");
-		bytes_read = read(s, recvBuffer, sizeof(recvBuffer));
-		if(bytes_read <= 0) {
-			perror("read() failed: \n");
-			socketCloseFlag = true;
-			return -1;
-		}
-		else
-			printf("Bytes received: %d	command: %X\n", bytes_read, recvBuffer[0]);
-
-		switch(recvBuffer[0]) {
-
-			case BLUETOOTH_SOCKET_CLOSE:
-
-				socketCloseFlag = true;
-				printDisconnect();
-				printf("Closing the socket...\n");
-				break;
-
-			case PRINT_HELLO:
-
-				; //Empty statement needed here
-				char strng[] = "Hello from the Samsung GalaxyS5!";
-				size_t l = strlen(strng);
-				printLongString_LCD(strng, l);
-				sleep(1);
-				clear_LCD();
-				break;
-
-			case READ_SENSOR_DATA:
-
-				/* Serialize the data and send it through the socket */
-				pthread_mutex_lock(&sensorData->mutex1);
-				pthread_mutex_lock(&sensorData->mutex5);
-				serializationLengthPtr = serializeStruct(sendBuffer, sensorData);
-				pthread_mutex_unlock(&sensorData->mutex1);
-				pthread_mutex_unlock(&sensorData->mutex5);
-				sendBuffer[8] = FRAME_END_CHAR;
-				bytes_sent = write(s, sendBuffer, serializationLengthPtr - sendBuffer + 1);
-				if(bytes_sent <= 0) {
-					perror("Write failed!\n");
-					socketCloseFlag = true;
-					break;
-				}
-				else{
-					printf("Bytes sent: %d\n", bytes_sent);
-
-					int k;
-					for(k = 0 ; k <= 9 ; k++) {
-						printf("buf[%d]: %X \t", k, sendBuffer[k]);
-					}
-						printf("\n");
-				}
-				break;
-
-			/*
-			 * Read random text from the Android end and print it to the LCD display
-			 */
-			case RANDOM_TEXT:
-
-				bytes_read = read(s, recvBuffer, sizeof(recvBuffer));
-				if(bytes_read <= 0) {
-					perror("read() failed: \n");
-					socketCloseFlag = true;
-					break;
-				}
-				else {
-					printf("Bytes received: %d \n", bytes_read);
-
-					/* Print it to a LCD screen */
-					printLongString_LCD((char*)recvBuffer, bytes_read);
-
-					if(bytes_read < 32) {
-						sleep(1);
-					}
-					else
-						sleep(2);
-					clear_LCD();
-				}
-				break;
-
-			case CLEAR_SCREEN:
-				clear_LCD();
-				break;
-
-			default:
-				//Do nothing
-				break;
-		}//Switch
-	}//While
+	if(serveCommands(s, sensorData) < 0)
+		return -1;
 
 	printDisconnect();
     sdp_close(session);
@@ -337,12 +255,10 @@ static int bluetoothRFCOMM_ClientConnect(const char *target_addr, const uint8_t
 
 int bluetoothRFCOMM_Server(thread_data_t *sensorData)
 {
-	int port = 3, result, sock, client, bytes_read, bytes_sent, retValue;
+	int port = 3, result, sock, client, retValue;
 	struct sockaddr_rc loc_addr = { 0 }, rem_addr = { 0 };
 	char buffer[1024] = { 0 };
 	socklen_t opt = sizeof(rem_addr);
-	unsigned char *serializationLengthPtr;
-	bool socketCloseFlag = false;
 
 	/* Set the timeout value to 30 seconds for the select function */
 	struct timeval timeOut;
@@ -428,110 +344,153 @@ int bluetoothRFCOMM_Server(thread_data_t *sensorData)
 	fcntl(sock, F_SETFL, flags &~ O_NONBLOCK);
 
 	/*
-	 * Wait for data until the socketCloseFlag is set to end the transaction and close the socket connection
+	 * Serve the pipelined commands until the client closes the socket connection
 	 */
-	while(!socketCloseFlag) {
+	if(serveCommands(client, sensorData) < 0)
+		return -1;
 
-		unsigned char recvBuffer[128] = { 0 };
-		unsigned char sendBuffer[128] = { 0 };
+	printDisconnect();
+	sdp_close(session);
+	close(client);
+	return 0;
+}
+
+/*
+ * Reads the socket until the connection is closed and handles every command of each read. A command
+ * split between two reads is completed by the next read.
+ * Returns 0 when the peer asked to close the connection and -1 on failure.
+ */
+static int serveCommands(const int socket, thread_data_t *sensorData)
+{
+	command_parser_t parser;
+	command_t command;
+	frame_session_t session;
+	unsigned char *recvBuffer;
+	size_t space;
+	int bytes_read, status;
+
+	initCommandParser(&parser, bluetoothCommandRules, sizeof(bluetoothCommandRules) / sizeof(bluetoothCommandRules[0]));
+	initFrameSession(&session);
+
+	while(1) {
+
+		/* Print the unterminated text of an older client once the socket goes idle */
+		if(commandParserPending(&parser)) {
+			struct pollfd pfd = { socket, POLLIN, 0 };
+
+			if(poll(&pfd, 1, TEXT_IDLE_TIMEOUT_MS) == 0 && flushTextCommand(&parser, &command)) {
+				printf("Command: %X	payload: %d bytes\n", command.opcode, (int)command.payloadLength);
+				if(handleCommand(socket, &command, &session, sensorData) != 0)
+					break;
+				continue;
+			}
+		}
 
 		printf("Waiting bytes to read.............\n");
-		bytes_read = read(client, recvBuffer, sizeof(recvBuffer));
+		recvBuffer = commandParserReadBuffer(&parser, &space);
+		bytes_read = read(socket, recvBuffer, space);
 		if(bytes_read <= 0) {
 			perror("read() failed: \n");
-			socketCloseFlag = true;
 			return -1;
 		}
-		else
-			printf("Bytes received: %d	command: %X\n", bytes_read, recvBuffer[0]);
+		printf("Bytes received: %d\n", bytes_read);
+		commandParserCommit(&parser, bytes_read);
+
+		/* Handle all the complete commands of this read */
+		while(nextCommand(&parser, &command)) {
+			printf("Command: %X	payload: %d bytes\n", command.opcode, (int)command.payloadLength);
+			status = handleCommand(socket, &command, &session, sensorData);
+			if(status < 0)
+				return -1;
+			if(status > 0)
+				return 0;
+		}
+	}
+	return 0;
+}
 
-		switch(recvBuffer[0]) {
+/*
+ * Handles one command. Returns 1 when the socket should be closed, -1 on failure and 0 otherwise.
+ */
+static int handleCommand(const int socket, const command_t *command, frame_session_t *session, thread_data_t *sensorData)
+{
+	unsigned char sendBuffer[128] = { 0 };
+	size_t length = 0;
+	int bytes_sent, k;
+
+	switch(command->opcode) {
+
+		case BLUETOOTH_SOCKET_CLOSE:
+
+			printf("Closing the socket...\n");
+			return 1;
 
-			case BLUETOOTH_SOCKET_CLOSE:
+		case PRINT_HELLO:
 
-				socketCloseFlag = true;
-				printf("Closing the socket...\n");
-				break;
+			; //Empty statement needed here
+			char strng[] = "Hello from the Samsung GalaxyS5!";
+			size_t l = strlen(strng);
+			printLongString_LCD(strng, l, LCD_VALUE_HOLD_MS);
+			break;
 
-			case PRINT_HELLO:
+		case NEGOTIATE_FRAME_FORMAT:
 
-				; //Empty statement needed here
-				char strng[] = "Hello from the Samsung GalaxyS5!";
-				size_t l = strlen(strng);
-				printLongString_LCD(strng, l);
-				sleep(1);
-				clear_LCD();
-				break;
+			/* There are no history exports over Bluetooth, so no compression either */
+			length = negotiateFrameSession(session, command->payload[0] & FRAME_VERSION_MASK, sendBuffer, sizeof(sendBuffer));
+			printf("Frame format version %d\n", session->version);
+			break;
 
-			case READ_SENSOR_DATA:
+		case READ_SENSOR_DATA:
+		case READ_BATCH:
 
-				/* Serialize the data and send it through the socket */
+			/* Serialize the data in the negotiated format */
+			if(command->opcode == READ_BATCH) {
+				lockSensorData(sensorData);
+				length = encodeSensorResponse(session, sendBuffer, sizeof(sendBuffer), sensorData, command->payload[0], 1);
+				unlockSensorData(sensorData);
+			}
+			else {
 				pthread_mutex_lock(&sensorData->mutex1);
 				pthread_mutex_lock(&sensorData->mutex5);
-				serializationLengthPtr = serializeStruct(sendBuffer, sensorData);
+				length = encodeSensorResponse(session, sendBuffer, sizeof(sendBuffer), sensorData, BATCH_CURRENT_VALUES, 0);
 				pthread_mutex_unlock(&sensorData->mutex1);
 				pthread_mutex_unlock(&sensorData->mutex5);
-				sendBuffer[8] = FRAME_END_CHAR;
-				sleep(1);
-				bytes_sent = write(client, sendBuffer, serializationLengthPtr - sendBuffer + 1);
-				sleep(1);
-				if(bytes_sent <= 0) {
-					perror("Write failed!\n");
-					socketCloseFlag = true;
-					break;
-				}
-				else {
-					printf("Bytes sent: %d\n", bytes_sent);
-					int k;
-
-					for(k = 0 ; k < 9 ; k++) {
-						printf("buf[%d]: %X \t",k, sendBuffer[k]);
-					}
-					printf("\n");
-				}
-
-				break;
-
-			/*
-			 * Read random text from the Android end and print it to the LCD display
-			*/
-			case RANDOM_TEXT:
-
-				bytes_read = read(client, recvBuffer, sizeof(recvBuffer));
-				if(bytes_read <= 0) {
-					perror("read() failed: \n");
-					socketCloseFlag = true;
-					exit(1);
-				}
-				else {
-					printf("Bytes received: %d \n", bytes_read);
-
-					/* Print it to a LCD screen */
-					printLongString_LCD((char*)recvBuffer, bytes_read);
-
-					if(bytes_read < 32) {
-						sleep(1);
-					}
-					else
-						sleep(2);
-
-					clear_LCD();
-				}
-				break;
-
-			case CLEAR_SCREEN:
-				clear_LCD();
-				break;
-
-			default:
-				//Do nothing
-				break;
-		}//Switch
-	}//While
+			}
+			break;
+
+		/*
+		 * Print the random text from the Android end to the LCD display
+		 */
+		case RANDOM_TEXT:
+
+			printf("Text received: %d bytes\n", (int)command->payloadLength);
+			printLongString_LCD((const char*)command->payload, command->payloadLength,
+					command->payloadLength < 32 ? LCD_VALUE_HOLD_MS : LCD_MESSAGE_HOLD_MS);
+			break;
+
+		case CLEAR_SCREEN:
+			blank_LCD();
+			break;
+
+		default:
+			//Do nothing
+			break;
+	}
 
-	printDisconnect();
-	sdp_close(session);
-	close(client);
+	/* Send the response through the socket */
+	if(length > 0) {
+		bytes_sent = write(socket, sendBuffer, length);
+		if(bytes_sent <= 0) {
+			perror("Write failed!\n");
+			return -1;
+		}
+
+		printf("Bytes sent: %d\n", bytes_sent);
+		for(k = 0 ; k < bytes_sent ; k++) {
+			printf("buf[%d]: %X \t", k, sendBuffer[k]);
+		}
+		printf("\n");
+	}
 	return 0;
 }
 
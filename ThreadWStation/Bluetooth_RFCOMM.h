@@ -18,7 +18,8 @@
 #define LENGTH_OF_BLTADDR			18
 #define LENGTH_OF_BLTNAME			40
 
-#define FRAME_END_CHAR				0xEE
+/* Idle time after which an unterminated text command is printed */
+#define TEXT_IDLE_TIMEOUT_MS		100
 
 typedef enum { false, true } bool;
 
@@ -30,6 +31,8 @@ typedef enum
 	READ_SENSOR_DATA			   = 0x03,
 	RANDOM_TEXT					   = 0x04,
 	CLEAR_SCREEN				   = 0x05,
+	READ_BATCH					   = 0x06,
+	NEGOTIATE_FRAME_FORMAT		   = 0x07,
 } BluetoothMessageCommand;
 
 /* Function prototypes */
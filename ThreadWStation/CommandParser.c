@@ -0,0 +1,130 @@
+/*
+ * CommandParser.c
+ *
+ * Streaming parser for the command bytes received through the Bluetooth and TCP sockets. A single read()
+ * may contain any number of pipelined commands and the last one may be split between two reads, so the
+ * unparsed tail of the buffer is carried over to the next read.
+ */
+#include <string.h>
+#include "CommandParser.h"
+
+/* Static function declarations */
+static int lookupPayloadLength(const command_parser_t *parser, const unsigned char opcode);
+
+void initCommandParser(command_parser_t *parser, const command_rule_t *rules, size_t numberOfRules)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->rules = rules;
+	parser->numberOfRules = numberOfRules;
+}
+
+/*
+ * Returns the free space at the end of the buffer so the caller can read() straight into it.
+ * The unparsed bytes of the previous read are moved to the beginning of the buffer first.
+ */
+unsigned char *commandParserReadBuffer(command_parser_t *parser, size_t *space)
+{
+	if(parser->offset > 0) {
+		memmove(parser->buffer, parser->buffer + parser->offset, parser->length - parser->offset);
+		parser->length -= parser->offset;
+		parser->offset = 0;
+	}
+
+	*space = sizeof(parser->buffer) - parser->length;
+	return parser->buffer + parser->length;
+}
+
+/* Tell the parser how many bytes the caller read into the buffer */
+void commandParserCommit(command_parser_t *parser, size_t bytes)
+{
+	parser->length += bytes;
+	if(parser->length > sizeof(parser->buffer))
+		parser->length = sizeof(parser->buffer);
+}
+
+/*
+ * Takes the next complete command from the buffer. Returns 1 when a command was found and 0 when
+ * more bytes are needed to complete it.
+ */
+int nextCommand(command_parser_t *parser, command_t *command)
+{
+	const unsigned char *start = parser->buffer + parser->offset;
+	size_t available = parser->length - parser->offset;
+	size_t i;
+	int payloadLength;
+
+	if(available == 0)
+		return 0;
+
+	payloadLength = lookupPayloadLength(parser, start[0]);
+
+	if(payloadLength == COMMAND_PAYLOAD_TEXT) {
+
+		/* Text runs until the terminator */
+		for(i = 1 ; i < available && i <= COMMAND_MAX_TEXT_LENGTH + 1 ; i++) {
+			if(start[i] == '\0' || start[i] == '\n') {
+				command->opcode = start[0];
+				command->payload = start + 1;
+				command->payloadLength = i - 1;
+				parser->offset += i + 1;
+				return 1;
+			}
+		}
+
+		/* Too long text without the terminator is cut to the maximum length */
+		if(available > COMMAND_MAX_TEXT_LENGTH + 1) {
+			command->opcode = start[0];
+			command->payload = start + 1;
+			command->payloadLength = COMMAND_MAX_TEXT_LENGTH;
+			parser->offset += COMMAND_MAX_TEXT_LENGTH + 1;
+			return 1;
+		}
+		return 0;
+	}
+
+	if(available < (size_t)payloadLength + 1)
+		return 0;
+
+	command->opcode = start[0];
+	command->payload = start + 1;
+	command->payloadLength = payloadLength;
+	parser->offset += payloadLength + 1;
+	return 1;
+}
+
+/*
+ * Older clients send the text without the terminator. When the socket goes idle the pending text
+ * command is completed with what has been received so far.
+ */
+int flushTextCommand(command_parser_t *parser, command_t *command)
+{
+	const unsigned char *start = parser->buffer + parser->offset;
+	size_t available = parser->length - parser->offset;
+
+	if(available < 2 || lookupPayloadLength(parser, start[0]) != COMMAND_PAYLOAD_TEXT)
+		return 0;
+
+	command->opcode = start[0];
+	command->payload = start + 1;
+	command->payloadLength = available - 1;
+	parser->offset += available;
+	return 1;
+}
+
+/* Returns 1 if there is an incomplete command in the buffer */
+int commandParserPending(const command_parser_t *parser)
+{
+	return parser->length > parser->offset;
+}
+
+/* Unknown opcodes have no payload so they are consumed one byte at a time */
+static int lookupPayloadLength(const command_parser_t *parser, const unsigned char opcode)
+{
+	size_t i;
+
+	for(i = 0 ; i < parser->numberOfRules ; i++) {
+		if(parser->rules[i].opcode == opcode)
+			return parser->rules[i].payloadLength;
+	}
+	return 0;
+}
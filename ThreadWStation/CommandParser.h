@@ -0,0 +1,48 @@
+/*
+ * CommandParser.h
+ */
+
+#ifndef COMMANDPARSER_H_
+#define COMMANDPARSER_H_
+
+#include <stddef.h>
+
+#define COMMAND_BUFFER_SIZE			256
+#define COMMAND_MAX_TEXT_LENGTH		128
+
+/* Payload length of a command which carries text terminated by '\0' or '\n' */
+#define COMMAND_PAYLOAD_TEXT		-1
+
+/* Tells the parser how many payload bytes follow an opcode */
+typedef struct command_rule
+{
+	unsigned char opcode;
+	int payloadLength;
+} command_rule_t;
+
+/* One complete command. The payload points into the parser buffer and is valid until the next read */
+typedef struct command
+{
+	unsigned char opcode;
+	const unsigned char *payload;
+	size_t payloadLength;
+} command_t;
+
+typedef struct command_parser
+{
+	const command_rule_t *rules;
+	size_t numberOfRules;
+	unsigned char buffer[COMMAND_BUFFER_SIZE];
+	size_t length;
+	size_t offset;
+} command_parser_t;
+
+/* Function prototypes */
+void initCommandParser(command_parser_t *parser, const command_rule_t *rules, size_t numberOfRules);
+unsigned char *commandParserReadBuffer(command_parser_t *parser, size_t *space);
+void commandParserCommit(command_parser_t *parser, size_t bytes);
+int nextCommand(command_parser_t *parser, command_t *command);
+int flushTextCommand(command_parser_t *parser, command_t *command);
+int commandParserPending(const command_parser_t *parser);
+
+#endif /* COMMANDPARSER_H_ */
@@ -0,0 +1,40 @@
+/*
+ * Deadband.c
+ *
+ * Significant-change filter for the sensor values. Readings which differ from the last passed value by
+ * less than the sensor noise are dropped before they are published.
+ */
+#include <math.h>
+#include <string.h>
+#include "Deadband.h"
+
+void initDeadbandFilter(deadband_filter_t *filter, const deadband_config_t *config)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->config = *config;
+}
+
+/* Returns 1 if the value should be published and 0 if it's inside the deadband */
+int deadbandFilterPass(deadband_filter_t *filter, const uint64_t timestamp, const float value)
+{
+	float threshold;
+
+	filter->samplesSeen++;
+
+	if(filter->primed) {
+		threshold = filter->config.relativeThreshold * fabsf(filter->lastValue);
+		if(threshold < filter->config.absoluteThreshold)
+			threshold = filter->config.absoluteThreshold;
+
+		/* NaN never compares, so a change to or from NaN always passes */
+		if(fabsf(value - filter->lastValue) < threshold &&
+				timestamp - filter->lastTimestamp < filter->config.maxSilenceMs)
+			return 0;
+	}
+
+	filter->primed = 1;
+	filter->lastValue = value;
+	filter->lastTimestamp = timestamp;
+	filter->samplesPassed++;
+	return 1;
+}
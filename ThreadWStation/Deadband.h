@@ -0,0 +1,36 @@
+/*
+ * Deadband.h
+ */
+
+#ifndef DEADBAND_H_
+#define DEADBAND_H_
+
+#include <stdint.h>
+
+/*
+ * A value is significant when it moved more than the larger of the absolute and the relative
+ * threshold from the last passed value, or when nothing has passed for maxSilenceMs.
+ * The receiver's copy is therefore never more than the threshold off.
+ */
+typedef struct deadband_config
+{
+	float absoluteThreshold;
+	float relativeThreshold;
+	uint32_t maxSilenceMs;
+} deadband_config_t;
+
+typedef struct deadband_filter
+{
+	deadband_config_t config;
+	int primed;
+	float lastValue;
+	uint64_t lastTimestamp;
+	uint32_t samplesSeen;
+	uint32_t samplesPassed;
+} deadband_filter_t;
+
+/* Function prototypes */
+void initDeadbandFilter(deadband_filter_t *filter, const deadband_config_t *config);
+int deadbandFilterPass(deadband_filter_t *filter, const uint64_t timestamp, const float value);
+
+#endif /* DEADBAND_H_ */
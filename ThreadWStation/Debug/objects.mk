@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -lbcm2835 -lbluetooth
+LIBS := -lbcm2835 -lbluetooth -lm
 
@@ -6,33 +6,99 @@
 C_SRCS += \
 ../BitBangMPL.c \
 ../Bluetooth_RFCOMM.c \
+../CommandParser.c \
+../Deadband.c \
+../Downsample.c \
+../HistoryExport.c \
+../HistoryWriter.c \
 ../LCD.c \
+../LCDDashboard.c \
+../LCDEmulator.c \
+../LCDFrame.c \
+../LCDGlyph.c \
+../LCDRenderer.c \
+../LCDTrend.c \
 ../MCP3002SPI.c \
 ../MPL3115A2.c \
+../NumberFormat.c \
+../Rollup.c \
+../SampleCompression.c \
+../SamplePublisher.c \
 ../SerializeDeserialize.c \
+../SeriesScan.c \
+../StateCheckpoint.c \
+../StreamingStats.c \
 ../TCP_Socket.c \
+../TextLayout.c \
+../TimeSeriesStore.c \
+../WeatherFrame.c \
+../WindowedExtremes.c \
 ../main.c \
 ../thread.c 
 
 OBJS += \
 ./BitBangMPL.o \
 ./Bluetooth_RFCOMM.o \
+./CommandParser.o \
+./Deadband.o \
+./Downsample.o \
+./HistoryExport.o \
+./HistoryWriter.o \
 ./LCD.o \
+./LCDDashboard.o \
+./LCDEmulator.o \
+./LCDFrame.o \
+./LCDGlyph.o \
+./LCDRenderer.o \
+./LCDTrend.o \
 ./MCP3002SPI.o \
 ./MPL3115A2.o \
+./NumberFormat.o \
+./Rollup.o \
+./SampleCompression.o \
+./SamplePublisher.o \
 ./SerializeDeserialize.o \
+./SeriesScan.o \
+./StateCheckpoint.o \
+./StreamingStats.o \
 ./TCP_Socket.o \
+./TextLayout.o \
+./TimeSeriesStore.o \
+./WeatherFrame.o \
+./WindowedExtremes.o \
 ./main.o \
 ./thread.o 
 
 C_DEPS += \
 ./BitBangMPL.d \
 ./Bluetooth_RFCOMM.d \
+./CommandParser.d \
+./Deadband.d \
+./Downsample.d \
+./HistoryExport.d \
+./HistoryWriter.d \
 ./LCD.d \
+./LCDDashboard.d \
+./LCDEmulator.d \
+./LCDFrame.d \
+./LCDGlyph.d \
+./LCDRenderer.d \
+./LCDTrend.d \
 ./MCP3002SPI.d \
 ./MPL3115A2.d \
+./NumberFormat.d \
+./Rollup.d \
+./SampleCompression.d \
+./SamplePublisher.d \
 ./SerializeDeserialize.d \
+./SeriesScan.d \
+./StateCheckpoint.d \
+./StreamingStats.d \
 ./TCP_Socket.d \
+./TextLayout.d \
+./TimeSeriesStore.d \
+./WeatherFrame.d \
+./WindowedExtremes.d \
 ./main.d \
 ./thread.d 
 
@@ -41,7 +107,7 @@ C_DEPS += \
 %.o: ../%.c
 	@echo 'Building file: $<'
 	@echo 'Invoking: Cross GCC Compiler'
-	arm-linux-gnueabihf-gcc -O2 -g3 -Wall -c -fmessage-length=0 -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
+	arm-linux-gnueabihf-gcc -O2 -g3 -Wall -c -fmessage-length=0 -mcpu=cortex-a53 -mfpu=neon-fp-armv8 -mfloat-abi=hard -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
 	@echo 'Finished building: $<'
 	@echo ' '
 
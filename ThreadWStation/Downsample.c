@@ -0,0 +1,142 @@
+/*
+ * Downsample.c
+ *
+ * Chart series computed next to the history: the client gives a range and the width of its chart
+ * and gets at most a point per pixel, so the reply and the drawing stay the same size for a day or
+ * for a year. Min/max/mean buckets keep the envelope of the signal, largest-triangle-three-buckets
+ * keeps its visual shape with a single line. Both start from the rollup tiers, so a long range
+ * reads the hourly or minute records and only a short one the raw samples.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "Downsample.h"
+
+/* Static function declarations */
+static int queryBuckets(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		const size_t maxBuckets, downsample_point_t *points);
+static size_t largestTriangleThreeBuckets(const downsample_point_t *data, const size_t count, const size_t threshold,
+		downsample_point_t *sampled);
+
+/* Returns the number of points, at most the width, or -1 on failure */
+int downsampleSeries(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		unsigned int width, const downsample_mode_t mode, downsample_point_t *points)
+{
+	downsample_point_t *buckets;
+	int count;
+
+	if(rollups == NULL || from >= to || width == 0)
+		return -1;
+	if(width > DOWNSAMPLE_MAX_POINTS)
+		width = DOWNSAMPLE_MAX_POINTS;
+
+	if(mode == DOWNSAMPLE_MIN_MAX_MEAN)
+		return queryBuckets(rollups, channel, from, to, width, points);
+
+	if(mode != DOWNSAMPLE_LTTB)
+		return -1;
+
+	buckets = malloc(width * LTTB_OVERSAMPLE * sizeof(downsample_point_t));
+	if(buckets == NULL) {
+		perror("Could not allocate the downsample buckets");
+		return -1;
+	}
+
+	count = queryBuckets(rollups, channel, from, to, width * LTTB_OVERSAMPLE, buckets);
+	if(count > 0)
+		count = (int)largestTriangleThreeBuckets(buckets, count, width, points);
+
+	free(buckets);
+	return count;
+}
+
+/*
+ * Summarizes the range in at most maxBuckets buckets. The buckets start at multiples of the resolution,
+ * so the range may cover one more than it has room for and the resolution is rounded up to fit.
+ * A point is placed at the middle of its bucket's samples.
+ */
+static int queryBuckets(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		const size_t maxBuckets, downsample_point_t *points)
+{
+	uint64_t resolution = maxBuckets > 1 ? (to - from + maxBuckets - 2) / (maxBuckets - 1) : to - from;
+	rollup_record_t *records;
+	int count, i;
+
+	records = malloc(maxBuckets * sizeof(rollup_record_t));
+	if(records == NULL) {
+		perror("Could not allocate the downsample buckets");
+		return -1;
+	}
+
+	count = queryRollups(rollups, channel, from, to, resolution, records, maxBuckets);
+	for(i = 0 ; i < count ; i++) {
+		const series_summary_t *summary = &records[i].summary;
+
+		points[i].timestamp = summary->firstTimestamp + (summary->lastTimestamp - summary->firstTimestamp) / 2;
+		points[i].min = summary->min;
+		points[i].max = summary->max;
+		points[i].mean = summary->count > 0 ? (float)(summary->sum / summary->count) : 0.0f;
+	}
+
+	free(records);
+	return count;
+}
+
+/*
+ * Steinarsson's largest-triangle-three-buckets on the bucket means. The first and the last point are
+ * kept, from every bucket in between the point making the largest triangle with the previously picked
+ * point and the average of the next bucket.
+ */
+static size_t largestTriangleThreeBuckets(const downsample_point_t *data, const size_t count, const size_t threshold,
+		downsample_point_t *sampled)
+{
+	double every;
+	size_t picked = 0, a = 0, i, j;
+
+	if(threshold >= count || threshold < 3) {
+		for(i = 0 ; i < count && i < threshold ; i++)
+			sampled[i] = data[i];
+		if(threshold < count && threshold > 1)
+			sampled[threshold - 1] = data[count - 1];
+		return i;
+	}
+
+	every = (double)(count - 2) / (threshold - 2);
+	sampled[picked++] = data[0];
+
+	for(i = 0 ; i < threshold - 2 ; i++) {
+		size_t rangeStart = (size_t)(i * every) + 1;
+		size_t rangeEnd = (size_t)((i + 1) * every) + 1;
+		size_t nextStart = rangeEnd;
+		size_t nextEnd = (size_t)((i + 2) * every) + 1;
+		double averageX = 0.0, averageY = 0.0, largestArea = -1.0;
+		double ax = (double)(data[a].timestamp - data[0].timestamp), ay = data[a].mean;
+		size_t next = a;
+
+		if(nextEnd > count)
+			nextEnd = count;
+		for(j = nextStart ; j < nextEnd ; j++) {
+			averageX += (double)(data[j].timestamp - data[0].timestamp);
+			averageY += data[j].mean;
+		}
+		averageX /= nextEnd - nextStart;
+		averageY /= nextEnd - nextStart;
+
+		for(j = rangeStart ; j < rangeEnd ; j++) {
+			double x = (double)(data[j].timestamp - data[0].timestamp);
+			double area = (ax - averageX) * (data[j].mean - ay) - (ax - x) * (averageY - ay);
+
+			if(area < 0.0)
+				area = -area;
+			if(area > largestArea) {
+				largestArea = area;
+				next = j;
+			}
+		}
+
+		sampled[picked++] = data[next];
+		a = next;
+	}
+
+	sampled[picked++] = data[count - 1];
+	return picked;
+}
@@ -0,0 +1,42 @@
+/*
+ * Downsample.h
+ */
+
+#ifndef DOWNSAMPLE_H_
+#define DOWNSAMPLE_H_
+
+#include <stdint.h>
+#include "thread.h"
+#include "Rollup.h"
+
+/*
+ * A downsample request is the channel, the range [from, to) as two 8 byte millisecond timestamps,
+ * the 2 byte width of the chart in pixels and the mode. The reply has at most one point per pixel
+ * whatever the length of the range.
+ */
+#define DOWNSAMPLE_REQUEST_SIZE		20
+#define DOWNSAMPLE_MAX_POINTS		1024
+
+/* Largest-triangle-three-buckets picks its points from this many buckets per pixel */
+#define LTTB_OVERSAMPLE				4
+
+typedef enum
+{
+	DOWNSAMPLE_MIN_MAX_MEAN			= 0,
+	DOWNSAMPLE_LTTB					= 1,
+} downsample_mode_t;
+
+/* A bucket placed at the middle of its samples, an LTTB point only uses the mean */
+typedef struct downsample_point
+{
+	uint64_t timestamp;
+	float min;
+	float max;
+	float mean;
+} downsample_point_t;
+
+/* Function prototypes */
+int downsampleSeries(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		unsigned int width, const downsample_mode_t mode, downsample_point_t *points);
+
+#endif /* DOWNSAMPLE_H_ */
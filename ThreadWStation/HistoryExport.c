@@ -0,0 +1,325 @@
+/*
+ * HistoryExport.c
+ *
+ * Streams a time range of a channel's history to a client. In the native format the segment columns
+ * go from the page cache to the socket with sendfile() and never pass through the station's memory,
+ * the CSV format is formatted batch by batch into the export's own buffer and the compressed format is
+ * encoded frame by frame into it. The socket is non-blocking and every call sends what fits, so one
+ * long export doesn't hold up the other clients.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include "HistoryExport.h"
+#include "NumberFormat.h"
+
+/* Static function declarations */
+static int prepareChunk(history_export_t *exporter);
+static void prepareHeader(history_export_t *exporter);
+static int prepareText(history_export_t *exporter);
+static int prepareFrame(history_export_t *exporter);
+static int sendColumn(history_export_t *exporter, const int socket, const off_t offset, const off_t length);
+static int sendBytes(history_export_t *exporter, const int socket, const void *data, const size_t length);
+static uint64_t readBigEndian64(const unsigned char *buffer);
+static double cpuElapsedMs(const struct timespec *start);
+
+/*
+ * Starts the export of the request. An invalid request or an unreadable history still gets an empty
+ * export, so the client sees the end of it, and -1 is returned.
+ */
+int beginHistoryExport(history_export_t *exporter, time_series_store_t *store, frame_session_t *session,
+		const unsigned char *request)
+{
+	uint64_t from = readBigEndian64(request + 1);
+
+	exporter->session = session;
+	exporter->channel = request[0];
+	exporter->to = readBigEndian64(request + 9);
+	if(request[17] == EXPORT_FORMAT_COMPRESSED && session->compressed)
+		exporter->format = EXPORT_FORMAT_COMPRESSED;
+	else
+		exporter->format = request[17] == EXPORT_FORMAT_CSV ? EXPORT_FORMAT_CSV : EXPORT_FORMAT_NATIVE;
+	exporter->finished = 0;
+	exporter->batchOffset = 0;
+	exporter->batchCount = 0;
+	exporter->samples = 0;
+	exporter->bytes = 0;
+	exporter->cursor.map = NULL;
+	exporter->cursor.fd = -1;
+	exporter->sent = 0;
+	exporter->wallStartUs = monotonicUs();
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &exporter->cpuStart);
+
+	/* A compressed export asked on a session which didn't negotiate it gets an empty native one */
+	if(store == NULL || exporter->channel >= NUMBER_OF_CHANNELS || request[17] > EXPORT_FORMAT_COMPRESSED ||
+			request[17] != exporter->format || seekTimeSeries(store, exporter->channel, from, &exporter->cursor) < 0) {
+		exporter->extent.count = 0;
+		prepareHeader(exporter);
+		if(exporter->format == EXPORT_FORMAT_CSV) {
+			exporter->text[0] = '\n';
+			exporter->textLength = 1;
+			exporter->finished = 1;
+			exporter->phase = EXPORT_PHASE_TEXT;
+		}
+		else if(exporter->format == EXPORT_FORMAT_COMPRESSED) {
+			exporter->finished = 1;
+			prepareFrame(exporter);
+		}
+		return -1;
+	}
+
+	if(exporter->format == EXPORT_FORMAT_COMPRESSED)
+		return prepareFrame(exporter);
+
+	if(exporter->format == EXPORT_FORMAT_CSV) {
+		exporter->textLength = snprintf(exporter->text, sizeof(exporter->text), "timestamp,%s\n", channelName(exporter->channel));
+		exporter->phase = EXPORT_PHASE_TEXT;
+		return 0;
+	}
+	return prepareChunk(exporter);
+}
+
+/*
+ * Sends as much of the export as the socket takes. Returns 1 when the socket is full and the export
+ * should continue once it is writable, 0 when the export is complete and -1 on failure.
+ */
+int continueHistoryExport(history_export_t *exporter, const int socket)
+{
+	int status;
+
+	for(;;) {
+		switch(exporter->phase) {
+
+			case EXPORT_PHASE_HEADER:
+
+				status = sendBytes(exporter, socket, exporter->header, sizeof(exporter->header));
+				if(status != 0)
+					return status;
+				if(exporter->extent.count == 0)
+					return 0;
+				exporter->phase = EXPORT_PHASE_TIMESTAMPS;
+				exporter->sent = 0;
+				break;
+
+			case EXPORT_PHASE_TIMESTAMPS:
+
+				status = sendColumn(exporter, socket, exporter->extent.timestampOffset,
+						(off_t)exporter->extent.count * sizeof(uint64_t));
+				if(status != 0)
+					return status;
+				exporter->phase = EXPORT_PHASE_VALUES;
+				exporter->sent = 0;
+				break;
+
+			case EXPORT_PHASE_VALUES:
+
+				status = sendColumn(exporter, socket, exporter->extent.valueOffset,
+						(off_t)exporter->extent.count * sizeof(float));
+				if(status != 0)
+					return status;
+				exporter->samples += exporter->extent.count;
+				if(prepareChunk(exporter) < 0)
+					return -1;
+				break;
+
+			case EXPORT_PHASE_TEXT:
+
+				status = sendBytes(exporter, socket, exporter->text, exporter->textLength);
+				if(status != 0)
+					return status;
+				if(exporter->finished)
+					return 0;
+				if(prepareText(exporter) < 0)
+					return -1;
+				break;
+
+			case EXPORT_PHASE_FRAME:
+
+				status = sendBytes(exporter, socket, exporter->frame, exporter->frameLength);
+				if(status != 0)
+					return status;
+				if(exporter->finished)
+					return 0;
+				if(prepareFrame(exporter) < 0)
+					return -1;
+				break;
+		}
+	}
+}
+
+/* Releases the export and prints its throughput and the CPU time the server thread spent on it */
+void endHistoryExport(history_export_t *exporter)
+{
+	double wallMs = (monotonicUs() - exporter->wallStartUs) / 1000.0;
+	double cpuMs = cpuElapsedMs(&exporter->cpuStart);
+	static const char *formatNames[] = { "native", "CSV", "compressed" };
+
+	closeTimeSeriesCursor(&exporter->cursor);
+
+	printf("History export of %llu %s samples, %llu bytes in %.0f ms", (unsigned long long)exporter->samples,
+			formatNames[exporter->format], (unsigned long long)exporter->bytes, wallMs);
+	if(wallMs > 0.0)
+		printf(", %.2f MB/s, CPU %.0f ms (%.0f %%)", exporter->bytes / wallMs / 1000.0, cpuMs, 100.0 * cpuMs / wallMs);
+	printf("\n");
+}
+
+/* The next native chunk, the one of zero samples at the end of the range */
+static int prepareChunk(history_export_t *exporter)
+{
+	int count = nextTimeSeriesExtent(&exporter->cursor, exporter->to, EXPORT_CHUNK_SAMPLES, &exporter->extent);
+
+	if(count < 0)
+		return -1;
+
+	exporter->extent.count = count;
+	prepareHeader(exporter);
+	return 0;
+}
+
+static void prepareHeader(history_export_t *exporter)
+{
+	uint32_t count = exporter->extent.count;
+
+	exporter->header[0] = 'W';
+	exporter->header[1] = 'X';
+	exporter->header[2] = exporter->channel;
+	exporter->header[3] = EXPORT_CHUNK_VERSION;
+	exporter->header[4] = (count >> 24) & 0xFF;
+	exporter->header[5] = (count >> 16) & 0xFF;
+	exporter->header[6] = (count >> 8) & 0xFF;
+	exporter->header[7] = count & 0xFF;
+	exporter->phase = EXPORT_PHASE_HEADER;
+	exporter->sent = 0;
+}
+
+/* Formats the next batch of CSV lines into the text buffer, the empty line ends the range */
+static int prepareText(history_export_t *exporter)
+{
+	int count = readTimeSeries(&exporter->cursor, exporter->timestamps, exporter->values, EXPORT_CSV_SAMPLES);
+	size_t length = 0;
+	int i;
+
+	if(count < 0)
+		return -1;
+
+	/* The same text as "%llu,%.7g\n", a line takes at most EXPORT_CSV_LINE_LENGTH */
+	for(i = 0 ; i < count && exporter->timestamps[i] < exporter->to ; i++) {
+		length += formatUnsigned(exporter->text + length, sizeof(exporter->text) - length, exporter->timestamps[i]);
+		exporter->text[length++] = ',';
+		length += formatSignificant(exporter->text + length, sizeof(exporter->text) - length, exporter->values[i], 7);
+		exporter->text[length++] = '\n';
+	}
+	exporter->samples += i;
+
+	if(i < count || count == 0) {
+		exporter->text[length++] = '\n';
+		exporter->finished = 1;
+	}
+
+	exporter->textLength = length;
+	exporter->phase = EXPORT_PHASE_TEXT;
+	exporter->sent = 0;
+	return 0;
+}
+
+/*
+ * Compresses the next samples of the range into a frame. A batch is read from the store when the last
+ * one is used up, the frame of zero samples after the last sample of the range ends the export.
+ */
+static int prepareFrame(history_export_t *exporter)
+{
+	size_t encoded;
+	int count, i;
+
+	if(exporter->batchOffset == exporter->batchCount && !exporter->finished) {
+		count = readTimeSeries(&exporter->cursor, exporter->timestamps, exporter->values, EXPORT_COMPRESSED_SAMPLES);
+		if(count < 0)
+			return -1;
+
+		for(i = 0 ; i < count && exporter->timestamps[i] < exporter->to ; i++)
+			;
+		exporter->batchOffset = 0;
+		exporter->batchCount = i;
+		if(i == 0)
+			exporter->finished = 1;
+	}
+
+	/* A frame holds a whole batch unless a timestamp gap is too long for the block */
+	exporter->frameLength = encodeCompressedFrame(exporter->session, exporter->frame, sizeof(exporter->frame),
+			exporter->channel, SAMPLE_FIELD_CURRENT, exporter->timestamps + exporter->batchOffset,
+			exporter->values + exporter->batchOffset, exporter->batchCount - exporter->batchOffset, &encoded);
+	if(exporter->frameLength == 0)
+		return -1;
+
+	exporter->batchOffset += encoded;
+	exporter->samples += encoded;
+	exporter->phase = EXPORT_PHASE_FRAME;
+	exporter->sent = 0;
+	return 0;
+}
+
+/* Returns 0 when the whole range of the segment file is sent and 1 when the socket is full */
+static int sendColumn(history_export_t *exporter, const int socket, const off_t offset, const off_t length)
+{
+	while(exporter->sent < length) {
+		off_t position = offset + exporter->sent;
+		ssize_t bytes = sendfile(socket, exporter->extent.fd, &position, length - exporter->sent);
+
+		if(bytes < 0) {
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			perror("sendfile() failed: \n");
+			return -1;
+		}
+		if(bytes == 0) {
+			fprintf(stderr, "History segment ended in the middle of an export\n");
+			return -1;
+		}
+		exporter->sent += bytes;
+		exporter->bytes += bytes;
+	}
+	return 0;
+}
+
+/* Returns 0 when the buffer is sent and 1 when the socket is full */
+static int sendBytes(history_export_t *exporter, const int socket, const void *data, const size_t length)
+{
+	while((size_t)exporter->sent < length) {
+		ssize_t bytes = write(socket, (const unsigned char *)data + exporter->sent, length - exporter->sent);
+
+		if(bytes < 0) {
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			perror("Write failed!\n");
+			return -1;
+		}
+		exporter->sent += bytes;
+		exporter->bytes += bytes;
+	}
+	return 0;
+}
+
+static uint64_t readBigEndian64(const unsigned char *buffer)
+{
+	uint64_t value = 0;
+	int i;
+
+	for(i = 0 ; i < 8 ; i++)
+		value = (value << 8) | buffer[i];
+	return value;
+}
+
+/* The CPU time of the server thread since start */
+static double cpuElapsedMs(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
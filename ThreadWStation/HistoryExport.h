@@ -0,0 +1,94 @@
+/*
+ * HistoryExport.h
+ */
+
+#ifndef HISTORYEXPORT_H_
+#define HISTORYEXPORT_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "thread.h"
+#include "TimeSeriesStore.h"
+#include "WeatherFrame.h"
+#include "SampleCompression.h"
+
+/*
+ * An export request is the channel, the range [from, to) as two 8 byte big-endian millisecond
+ * timestamps and the format.
+ *
+ * The native format streams the segment columns as they are on the card: chunks of an 8 byte header
+ * 'W' 'X' channel version and the big-endian sample count, then count timestamps (uint64) and count
+ * values (float) in the station's byte order, little-endian on the Raspberry Pi. A chunk of zero
+ * samples ends the export.
+ *
+ * The CSV format is a "timestamp,<channel name>" header line, one "timestamp,value" line per sample
+ * and an empty line at the end.
+ *
+ * The compressed format needs a session which negotiated FRAME_FLAG_COMPRESSED. It sends
+ * FRAME_TYPE_COMPRESSED_SAMPLES frames of up to EXPORT_COMPRESSED_SAMPLES samples, see
+ * encodeCompressedFrame(), and a frame of zero samples ends the export.
+ */
+#define EXPORT_REQUEST_SIZE			18
+#define EXPORT_CHUNK_HEADER_SIZE	8
+#define EXPORT_CHUNK_VERSION		1
+
+/* Samples per native chunk, per formatted CSV batch and per compressed frame */
+#define EXPORT_CHUNK_SAMPLES		8192
+#define EXPORT_CSV_SAMPLES			256
+#define EXPORT_COMPRESSED_SAMPLES	1024
+#define EXPORT_FRAME_SIZE			(FRAME_OVERHEAD + 2 + COMPRESSED_BLOCK_MAX_SIZE(EXPORT_COMPRESSED_SAMPLES))
+#define EXPORT_CSV_LINE_LENGTH		40
+
+typedef enum
+{
+	EXPORT_FORMAT_NATIVE			= 0,
+	EXPORT_FORMAT_CSV				= 1,
+	EXPORT_FORMAT_COMPRESSED		= 2,
+} export_format_t;
+
+/* Where the current chunk is: its header, the timestamps and the values are sent in turn */
+typedef enum
+{
+	EXPORT_PHASE_HEADER				= 0,
+	EXPORT_PHASE_TIMESTAMPS			= 1,
+	EXPORT_PHASE_VALUES				= 2,
+	EXPORT_PHASE_TEXT				= 3,
+	EXPORT_PHASE_FRAME				= 4,
+} export_phase_t;
+
+/* One export in progress, the buffers are reused for the whole export */
+typedef struct history_export
+{
+	series_cursor_t cursor;
+	frame_session_t *session;
+	unsigned char channel;
+	export_format_t format;
+	uint64_t to;
+	int finished;
+	export_phase_t phase;
+	series_extent_t extent;
+	off_t sent;
+	unsigned char header[EXPORT_CHUNK_HEADER_SIZE];
+	char text[EXPORT_CSV_SAMPLES * EXPORT_CSV_LINE_LENGTH];
+	size_t textLength;
+	unsigned char frame[EXPORT_FRAME_SIZE];
+	size_t frameLength;
+
+	/* Samples read from the store, a compressed frame takes them from batchOffset on */
+	uint64_t timestamps[EXPORT_COMPRESSED_SAMPLES];
+	float values[EXPORT_COMPRESSED_SAMPLES];
+	size_t batchOffset;
+	size_t batchCount;
+	uint64_t samples;
+	uint64_t bytes;
+	uint64_t wallStartUs;
+	struct timespec cpuStart;
+} history_export_t;
+
+/* Function prototypes */
+int beginHistoryExport(history_export_t *exporter, time_series_store_t *store, frame_session_t *session,
+		const unsigned char *request);
+int continueHistoryExport(history_export_t *exporter, const int socket);
+void endHistoryExport(history_export_t *exporter);
+
+#endif /* HISTORYEXPORT_H_ */
@@ -0,0 +1,184 @@
+/*
+ * HistoryWriter.c
+ *
+ * Group commit of the sample history. The acquisition threads only drop their samples into a ring,
+ * the writer thread moves them into the time-series store and flushes the store in one go when enough
+ * samples are waiting or the oldest of them reaches the crash window. An SD card flush takes tens of
+ * milliseconds, which now stalls nobody but the writer.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "HistoryWriter.h"
+
+/* Static function declarations */
+static void *historyWriterThread(void *arg);
+static void drainRings(history_writer_t *writer);
+static void flushHistory(history_writer_t *writer);
+
+void defaultHistoryWriterConfig(history_writer_config_t *config)
+{
+	config->crashWindowMs = HISTORY_CRASH_WINDOW_MS;
+	config->flushSamples = HISTORY_FLUSH_SAMPLES;
+}
+
+int startHistoryWriter(history_writer_t *writer, time_series_store_t *store, const history_writer_config_t *config)
+{
+	int iret;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->store = store;
+	writer->config = *config;
+	writer->running = 1;
+
+	iret = pthread_create(&writer->thread, NULL, historyWriterThread, (void*)writer);
+	if(iret) {
+		fprintf(stderr, "Error - pthread_create() return code: %d\n", iret);
+		writer->running = 0;
+		return -1;
+	}
+
+	printf("History flushed every %u ms or %u samples\n", config->crashWindowMs, config->flushSamples);
+	return 0;
+}
+
+/* Stops the writer after it has stored and flushed everything that was queued */
+int stopHistoryWriter(history_writer_t *writer)
+{
+	if(!writer->running)
+		return 0;
+
+	writer->running = 0;
+	pthread_join(writer->thread, NULL);
+	return 0;
+}
+
+/*
+ * Called by the acquisition thread of the channel. Never blocks, returns -1 and counts the sample
+ * as dropped when the writer has fallen a whole ring behind.
+ */
+int historyWriterEnqueue(history_writer_t *writer, const sensor_channel_t channel, const uint64_t timestamp, const float value)
+{
+	history_ring_t *ring;
+	uint32_t head, tail;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	ring = &writer->rings[channel];
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= HISTORY_RING_SIZE) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	ring->records[head & (HISTORY_RING_SIZE - 1)].timestamp = timestamp;
+	ring->records[head & (HISTORY_RING_SIZE - 1)].value = value;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Called from the server threads while the writer runs */
+void readHistoryWriterStatus(history_writer_t *writer, history_writer_status_t *status)
+{
+	int i;
+
+	status->crashWindowMs = writer->config.crashWindowMs;
+	status->flushSamples = writer->config.flushSamples;
+	status->flushes = __atomic_load_n(&writer->flushes, __ATOMIC_RELAXED);
+	status->maxFlushLatencyUs = __atomic_load_n(&writer->maxFlushLatencyUs, __ATOMIC_RELAXED);
+	status->dropped = 0;
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++)
+		status->dropped += __atomic_load_n(&writer->rings[i].dropped, __ATOMIC_RELAXED);
+}
+
+void printHistoryWriterStatistics(history_writer_t *writer)
+{
+	uint64_t bytes, samples;
+	uint32_t dropped = 0;
+	int i;
+
+	timeSeriesSyncStatistics(writer->store, &bytes, &samples);
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++)
+		dropped += __atomic_load_n(&writer->rings[i].dropped, __ATOMIC_RELAXED);
+
+	printf("History crash window %u ms, %u flushes, max %llu us\n", writer->config.crashWindowMs,
+			writer->flushes, (unsigned long long)writer->maxFlushLatencyUs);
+	printf("History %llu samples in %llu bytes written", (unsigned long long)samples, (unsigned long long)bytes);
+	if(samples > 0)
+		printf(", %.1f bytes per sample", (double)bytes / samples);
+	printf(", %u dropped\n", dropped);
+
+	for(i = 0 ; i < HISTORY_LATENCY_BUCKETS ; i++) {
+		if(writer->latencyHistogram[i] > 0)
+			printf("  flush < %10llu us: %u\n", 1ULL << (i + 1), writer->latencyHistogram[i]);
+	}
+}
+
+static void *historyWriterThread(void *arg)
+{
+	history_writer_t *writer = (history_writer_t*)arg;
+	const struct timespec pollInterval = { 0, HISTORY_WRITER_POLL_MS * 1000000L };
+
+	while(writer->running)
+	{
+		drainRings(writer);
+
+		if(writer->mostPending >= writer->config.flushSamples ||
+				(writer->mostPending > 0 && timestampMs() >= writer->oldestPending + writer->config.crashWindowMs))
+			flushHistory(writer);
+
+		nanosleep(&pollInterval, NULL);
+	}
+
+	/* Whatever was queued before the stop is stored too */
+	drainRings(writer);
+	if(writer->mostPending > 0)
+		flushHistory(writer);
+	return NULL;
+}
+
+static void drainRings(history_writer_t *writer)
+{
+	int channel;
+
+	for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+		history_ring_t *ring = &writer->rings[channel];
+		uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		while(tail != head) {
+			history_record_t *record = &ring->records[tail & (HISTORY_RING_SIZE - 1)];
+
+			if(timeSeriesAppend(writer->store, channel, record->timestamp, record->value) == 0) {
+				if(writer->mostPending == 0)
+					writer->oldestPending = record->timestamp;
+				if(++writer->pendingSamples[channel] > writer->mostPending)
+					writer->mostPending = writer->pendingSamples[channel];
+			}
+			tail++;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+static void flushHistory(history_writer_t *writer)
+{
+	uint64_t start, latency;
+	int bucket = 0;
+
+	start = monotonicUs();
+	syncTimeSeriesStore(writer->store);
+	latency = monotonicUs() - start;
+
+	while(bucket < HISTORY_LATENCY_BUCKETS - 1 && (latency >> (bucket + 1)) > 0)
+		bucket++;
+	writer->latencyHistogram[bucket]++;
+	if(latency > writer->maxFlushLatencyUs)
+		__atomic_store_n(&writer->maxFlushLatencyUs, latency, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&writer->flushes, writer->flushes + 1, __ATOMIC_RELAXED);
+	writer->mostPending = 0;
+	memset(writer->pendingSamples, 0, sizeof(writer->pendingSamples));
+}
@@ -0,0 +1,81 @@
+/*
+ * HistoryWriter.h
+ */
+
+#ifndef HISTORYWRITER_H_
+#define HISTORYWRITER_H_
+
+#include <stdint.h>
+#include "thread.h"
+#include "TimeSeriesStore.h"
+
+/* Ring of samples waiting for the writer, power of two */
+#define HISTORY_RING_SIZE			1024
+#define HISTORY_WRITER_POLL_MS		50
+
+/* Defaults: flush when a channel has a page of timestamps waiting or the oldest sample is 5 s old */
+#define HISTORY_CRASH_WINDOW_MS		5000
+#define HISTORY_FLUSH_SAMPLES		512
+
+/* Flush latency histogram, bucket n counts the flushes of 2^n to 2^(n+1) microseconds */
+#define HISTORY_LATENCY_BUCKETS		24
+
+typedef struct history_record
+{
+	uint64_t timestamp;
+	float value;
+} history_record_t;
+
+/* Single producer, single consumer: the channel's acquisition thread and the writer */
+typedef struct history_ring
+{
+	history_record_t records[HISTORY_RING_SIZE];
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dropped;
+} history_ring_t;
+
+/*
+ * crashWindowMs is the longest time a stored sample may wait for its fdatasync, so at most this much
+ * history is lost on a power cut. flushSamples flushes earlier when the batch of a channel fills a page.
+ */
+typedef struct history_writer_config
+{
+	uint32_t crashWindowMs;
+	uint32_t flushSamples;
+} history_writer_config_t;
+
+typedef struct history_writer
+{
+	time_series_store_t *store;
+	history_writer_config_t config;
+	history_ring_t rings[NUMBER_OF_CHANNELS];
+	pthread_t thread;
+	volatile int running;
+	uint32_t pendingSamples[NUMBER_OF_CHANNELS];
+	uint32_t mostPending;
+	uint64_t oldestPending;
+	uint32_t flushes;
+	uint64_t maxFlushLatencyUs;
+	uint32_t latencyHistogram[HISTORY_LATENCY_BUCKETS];
+} history_writer_t;
+
+/* What a client can read of the writer: the crash window in force next to the flush statistics */
+typedef struct history_writer_status
+{
+	uint32_t crashWindowMs;
+	uint32_t flushSamples;
+	uint32_t flushes;
+	uint32_t dropped;
+	uint64_t maxFlushLatencyUs;
+} history_writer_status_t;
+
+/* Function prototypes */
+void defaultHistoryWriterConfig(history_writer_config_t *config);
+int startHistoryWriter(history_writer_t *writer, time_series_store_t *store, const history_writer_config_t *config);
+int stopHistoryWriter(history_writer_t *writer);
+int historyWriterEnqueue(history_writer_t *writer, const sensor_channel_t channel, const uint64_t timestamp, const float value);
+void readHistoryWriterStatus(history_writer_t *writer, history_writer_status_t *status);
+void printHistoryWriterStatistics(history_writer_t *writer);
+
+#endif /* HISTORYWRITER_H_ */
@@ -4,35 +4,42 @@
  * This library is for writing to 16x4 LCD display with Serial interface. The 16x4 LCD display is
  * attached to I2C/Serial LCD Backpack and it's controlled with Raspberry Pi.
  */
+#include <errno.h>
+#include <poll.h>
 #include "LCD.h"
+#include "LCDRenderer.h"
+#include "NumberFormat.h"
 
 /* Static function declarations */
-static int createCharacter(const unsigned char memoryLocation, const unsigned char *characterMap);
-static int createAwithDots(void);
-static int createOwithDots(void);
-static int createCapitalAwithDots(void);
-static int createCapitalOwithDots(void);
-static int printTemperature(const char *pstring, const size_t len);
-static int printPressure(const char *pstring, const size_t len);
-static int printAltitude(const char *pstring, const size_t len);
-static int printHumidity(const char *pstring, const size_t len);
+static int appendCommand(lcd_encoder_t *encoder, const unsigned char *data, const size_t len);
+static void printValue(const char *caption, const unsigned char captionCol, const unsigned char valueCol,
+		const float value, const char *unit);
+static int printMessage(const char *message, const unsigned char col);
 
 /* Static local variable of serial file descriptor */
 static int g_Fd = 0;
 
-/* Static local variable of returned bytes of write function */
-static int g_bytesWritten = 0;
+/* Static local size of the display */
+static unsigned char g_lines = LCD_LINES;
+static unsigned char g_columns = LCD_COLUMNS;
 
-/* Static local variable of length of string */
-static size_t stringLength = 0;
+/* Static local counters of the write() calls and the bytes sent */
+static uint32_t g_writeCalls = 0;
+static uint64_t g_bytesSent = 0;
 
 /* Open serial port and set the settings */
 int setup_Serial()
+{
+	return openSerial_LCD(LCD_SERIAL_DEVICE);
+}
+
+/* Open the display on another device, like the pty of the LCD emulator */
+int openSerial_LCD(const char *device)
 {
 	int error;
 
 	/* Open in write mode */
-	g_Fd = open("/dev/ttyAMA0", O_WRONLY | O_NOCTTY | O_NDELAY);
+	g_Fd = open(device, O_WRONLY | O_NOCTTY | O_NDELAY);
 	if (g_Fd == -1)
 	{
 		perror("Error - Unable to open UART!\n");
@@ -72,12 +79,7 @@ int setup_Serial()
 		return -1;
 	}
 
-	/* Create custom made characters */
-	createAwithDots();
-	createOwithDots();
-	createCapitalAwithDots();
-	createCapitalOwithDots();
-
+	/* The custom made characters are uploaded by the glyph cache when a frame needs them */
 	return 0;
 }
 
@@ -96,672 +98,299 @@ int serialLCD_Close(void)
 }
 
 /* Creates custom made character */
-static int createCharacter(const unsigned char memoryLocation, const unsigned char *characterMap)
+int createCharacter_LCD(lcd_encoder_t *encoder, const unsigned char memoryLocation, const unsigned char *characterMap)
 {
 	/* Memory location for custom made character can be between 0-7 */
-	if(memoryLocation <= 7 && memoryLocation >= 0)
+	if(memoryLocation <= 7)
 	{
-		unsigned char characterMapData[8];
-		int i;
-
-		/* Populate the character map data array */
-		for( i = 0 ; i < 8 ; i++){
-			characterMapData[i] = characterMap[i];
-		}
+		unsigned char data[LCD_CHARACTER_BYTES];
 
-		unsigned char data[2], dataEnd[1] = { 0xFF };
 		data[0] = 0x40;
 		data[1] = memoryLocation;
+		memcpy(data + 2, characterMap, 8);
+		data[10] = 0xFF;
 
-		g_bytesWritten = write(g_Fd, &data, sizeof(data));
+		return appendCommand(encoder, data, sizeof(data));
+	}
+	else
+		return -1;
+}
 
-		if (g_bytesWritten < 0)
-		{
-			perror("Write failed - ");
-			return -1;
-		}
+/* Starts an empty batch of commands */
+void beginCommands_LCD(lcd_encoder_t *encoder)
+{
+	encoder->length = 0;
+	encoder->overflow = 0;
+}
 
-		g_bytesWritten = write(g_Fd, &characterMapData, sizeof(characterMapData));
+int encodeClear_LCD(lcd_encoder_t *encoder)
+{
+	const unsigned char data[LCD_CLEAR_BYTES] = { 0x04, 0xFF };
 
-		if (g_bytesWritten < 0)
-		{
-			perror("Write failed - ");
-			return -1;
-		}
+	return appendCommand(encoder, data, sizeof(data));
+}
 
-		g_bytesWritten = write(g_Fd, &dataEnd, sizeof(dataEnd));
+int encodeCursor_LCD(lcd_encoder_t *encoder, const unsigned char line, const unsigned char col)
+{
+	const unsigned char data[LCD_CURSOR_BYTES] = { 0x02, line, col, 0xFF };
 
-		if (g_bytesWritten < 0)
-		{
-			perror("Write failed - ");
-			return -1;
-		}
-		return 0;
-	}
-	else
-		return -1;
+	return appendCommand(encoder, data, sizeof(data));
 }
 
-static int createAwithDots(void)
+int encodeChar_LCD(lcd_encoder_t *encoder, const unsigned char c)
 {
-	unsigned char aWithDots[8] = {
-		0b01010,
-		0b00000,
-		0b01110,
-		0b00011,
-		0b01111,
-		0b11011,
-		0b01111,
-		0b0000
-	};
-
-	if(createCharacter(0x00, aWithDots) < 0){
-		return -1;
-	}
-	else
-		return 0;
+	const unsigned char data[LCD_CHAR_BYTES] = { 0x0A, c, 0xFF };
+
+	return appendCommand(encoder, data, sizeof(data));
 }
 
-static int createOwithDots(void)
+/* The string command ends at the '\0', so the string can't hold one */
+int encodeString_LCD(lcd_encoder_t *encoder, const char *pstring, const size_t len)
 {
-	unsigned char oWithDots[8] = {
-		0b01010,
-		0b00000,
-		0b01110,
-		0b10001,
-		0b10001,
-		0b10001,
-		0b01110,
-		0b00000
-	};
-
-	if(createCharacter(0x01, oWithDots) < 0){
+	unsigned char *data = encoder->buffer + encoder->length;
+
+	if(encoder->overflow || encoder->length + len + LCD_STRING_OVERHEAD > sizeof(encoder->buffer)) {
+		encoder->overflow = 1;
 		return -1;
 	}
-	else
-		return 0;
+
+	data[0] = 0x01;
+	memcpy(data + 1, pstring, len);
+	data[len + 1] = '\0';
+	data[len + 2] = 0xFF;
+	encoder->length += len + LCD_STRING_OVERHEAD;
+	return 0;
 }
 
-static int createCapitalAwithDots(void)
+/*
+ * Sends the batch with as few write() calls as the UART takes, normally one. The port is non-blocking,
+ * so a full transmit buffer is waited on with poll().
+ */
+int flushCommands_LCD(lcd_encoder_t *encoder)
 {
-	unsigned char capitalAwithDots[8] = {
-		0b01010,
-		0b00000,
-		0b01110,
-		0b10001,
-		0b10001,
-		0b11111,
-		0b10001,
-		0b10001
-	};
-
-	if(createCharacter(0x02, capitalAwithDots) < 0){
+	size_t sent = 0;
+	ssize_t bytesWritten;
+
+	if(encoder->overflow) {
+		fprintf(stderr, "LCD command buffer overflow\n");
+		beginCommands_LCD(encoder);
 		return -1;
 	}
-	else
-		return 0;
+
+	while(sent < encoder->length)
+	{
+		bytesWritten = write(g_Fd, encoder->buffer + sent, encoder->length - sent);
+		__atomic_add_fetch(&g_writeCalls, 1, __ATOMIC_RELAXED);
+
+		if(bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			struct pollfd pollFd = { g_Fd, POLLOUT, 0 };
+
+			if(poll(&pollFd, 1, LCD_WRITE_TIMEOUT_MS) > 0)
+				continue;
+			fprintf(stderr, "LCD write timed out\n");
+			break;
+		}
+		if(bytesWritten < 0) {
+			perror("Write failed - ");
+			break;
+		}
+		sent += bytesWritten;
+	}
+
+	__atomic_add_fetch(&g_bytesSent, sent, __ATOMIC_RELAXED);
+	bytesWritten = sent == encoder->length ? 0 : -1;
+	beginCommands_LCD(encoder);
+	return (int)bytesWritten;
 }
 
-static int createCapitalOwithDots(void)
+/* Number of write() calls and bytes sent to the display so far */
+void serialStatistics_LCD(uint32_t *writeCalls, uint64_t *bytes)
 {
-	unsigned char capitalOwithDots[8] = {
-		0b01010,
-		0b00000,
-		0b01110,
-		0b10001,
-		0b10001,
-		0b10001,
-		0b10001,
-		0b01110
-	};
-
-	if(createCharacter(0x03, capitalOwithDots) < 0){
-		return -1;
-	}
-	else
-		return 0;
+	*writeCalls = __atomic_load_n(&g_writeCalls, __ATOMIC_RELAXED);
+	*bytes = __atomic_load_n(&g_bytesSent, __ATOMIC_RELAXED);
 }
 
 /* Clear the LCD screen */
 int clear_LCD()
 {
-	unsigned char data[2];
-	data[0] = 4;
-	data[1] = 0xFF;
-
-	g_bytesWritten = write(g_Fd, &data, sizeof(data));
+	lcd_encoder_t encoder;
 
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed - ");
-		return -1;
-	}
-	return 0;
+	beginCommands_LCD(&encoder);
+	encodeClear_LCD(&encoder);
+	return flushCommands_LCD(&encoder);
 }
 
 /* Define number of rows/columns on the display */
 int setType_LCD(const unsigned char line, const unsigned char col)
 {
-	unsigned char data[4];
-	data[0] = 0x05;
-	data[1] = line;
-	data[2] = col;
-	data[3] = 0xFF;
+	const unsigned char data[4] = { 0x05, line, col, 0xFF };
+	lcd_encoder_t encoder;
 
-	g_bytesWritten = write(g_Fd, &data, sizeof(data));
+	if(line < 1 || line > LCD_MAX_LINES || col < 1 || col > LCD_MAX_COLUMNS)
+		return -1;
 
-    if (g_bytesWritten < 0)
-    {
-            perror("Write failed - ");
-            return -1;
-    }
-    return 0;
+	__atomic_store_n(&g_lines, line, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_columns, col, __ATOMIC_RELAXED);
+
+	beginCommands_LCD(&encoder);
+	appendCommand(&encoder, data, sizeof(data));
+	return flushCommands_LCD(&encoder);
+}
+
+/* The size set with setType_LCD(), the frames and the text layout use it */
+void displaySize_LCD(unsigned char *lines, unsigned char *columns)
+{
+	*lines = __atomic_load_n(&g_lines, __ATOMIC_RELAXED);
+	*columns = __atomic_load_n(&g_columns, __ATOMIC_RELAXED);
 }
 
 /* Backlight brightness */
 int setBacklight_LCD(const unsigned char brightness)
 {
-	unsigned char data[3];
-	data[0] = 0x07;
-	data[1] = brightness;
-	data[2] = 0xFF;
+	const unsigned char data[3] = { 0x07, brightness, 0xFF };
+	lcd_encoder_t encoder;
 
-	g_bytesWritten =  write(g_Fd, &data, sizeof(data));
-
-    if (g_bytesWritten < 0)
-    {
-    	perror("Write failed - ");
-    	return -1;
-    }
-    return 0;
+	beginCommands_LCD(&encoder);
+	appendCommand(&encoder, data, sizeof(data));
+	return flushCommands_LCD(&encoder);
 }
 
 /* Position the cursor */
 int setCursor_LCD(const unsigned char line, const unsigned char col)
 {
-	unsigned char data[4];
-	data[0] = 0x02;
-	data[1] = line;
-	data[2] = col;
-	data[3] = 0xFF;
+	lcd_encoder_t encoder;
 
-	g_bytesWritten = write(g_Fd, &data, sizeof(data));
-
-    if (g_bytesWritten < 0)
-    {
-            perror("Write failed - ");
-            return -1;
-    }
-    return 0;
+	beginCommands_LCD(&encoder);
+	encodeCursor_LCD(&encoder, line, col);
+	return flushCommands_LCD(&encoder);
 }
 
 /* Write a single character */
 int writeChar_LCD(const unsigned char c)
 {
-	unsigned char data[3];
-	data[0] = 0x0A;
-	data[1] = c;
-	data[2] = 0xFF;
+	lcd_encoder_t encoder;
 
-	g_bytesWritten = write(g_Fd, &data, sizeof(data));
-
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed -");
-		return -1;
-	}
-	return 0;
+	beginCommands_LCD(&encoder);
+	encodeChar_LCD(&encoder, c);
+	return flushCommands_LCD(&encoder);
 }
 
-/* Print long string to a lcd */
-int printLongString_LCD(const char *pstring, const size_t len)
+/*
+ * Prints a UTF-8 text of any length, wrapped for the size of the display. A text longer than the
+ * screen is paged, each page is shown for holdMs.
+ */
+int printLongString_LCD(const char *pstring, const size_t len, const unsigned int holdMs)
 {
-	size_t i;
-
-		/*
-		 * If String is 16 or under characters long
-		 */
-		if(len <= 16){
-
-			setCursor_LCD(1,1);
-			unsigned char data[len+3];
-			data[0] = 0x01;
-			for(i = 1 ; i < (len+1) ; i++)
-			{
-				data[i] = *pstring++;
-			}
-
-			data[len+1] = '\0';
-			data[len+2] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data, sizeof(data));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-		}
-		/*
-		 * If string is between 16 and 32 characters long
-		 */
-		else if (len > 16 && len <= 32){
-
-			unsigned char data[19];
-			unsigned char data2[len-13];
-
-			setCursor_LCD(1,1);
-
-			data[0] = 0x01;
-			for(i = 1 ; i < 17 ; i++)
-			{
-				data[i] = *pstring++;
-			}
-
-			data[17] = '\0';
-			data[18] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data, sizeof(data));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-			//Jump to next line
-			setCursor_LCD(2,1);
-
-			data2[0] = 0x01;
-			for(i = 1 ; i < (len-15) ; i++)
-			{
-				data2[i] = *pstring++;
-			}
-
-			data2[(len-15)] = '\0';
-			data2[(len-15)+1] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data2, sizeof(data2));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
+	text_layout_t layout;
+	unsigned char lines, columns;
 
-		}
-		/*
-		 * If string is between 32-48 characters long
-		 */
-		else if (len > 32 && len <= 48){
-
-			unsigned char data[19];
-			unsigned char data2[19];
-			unsigned char data3[len-29];
-
-			setCursor_LCD(1,1);
-
-			data[0] = 0x01;
-			for(i = 1 ; i < 17 ; i++)
-			{
-				data[i] = *pstring++;
-			}
-
-			data[17] = '\0';
-			data[18] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data, sizeof(data));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-			//Jump to next line
-			setCursor_LCD(2,1);
-
-			data2[0] = 0x01;
-			for(i = 1 ; i < 17 ; i++)
-			{
-				data2[i] = *pstring++;
-			}
-
-			data2[17] = '\0';
-			data2[18] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data2, sizeof(data2));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-			//Jump to next line
-			setCursor_LCD(3,1);
-
-			data3[0] = 0x01;
-			for(i = 1 ; i < (len-31) ; i++)
-			{
-				data3[i] = *pstring++;
-			}
-			data3[len-31] = '\0';
-			data3[len-31+1] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data3, sizeof(data3));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-		}
-		/*
-		 * If string is more than 48 and max 64 characters long
-		 */
-		else if(len > 48 && len <= 64){
-
-			unsigned char data[19];
-			unsigned char data2[19];
-			unsigned char data3[19];
-			unsigned char data4[len-45];
-
-			setCursor_LCD(1,1);
-
-			data[0] = 0x01;
-			for(i = 1 ; i < 17 ; i++)
-			{
-				data[i] = *pstring++;
-			}
-
-			data[17] = '\0';
-			data[18] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data, sizeof(data));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-			//Jump to next line
-			setCursor_LCD(2,1);
-
-			data2[0] = 0x01;
-			for(i = 1 ; i < 17 ; i++)
-			{
-				data2[i] = *pstring++;
-			}
-
-			data2[17] = '\0';
-			data2[18] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data2, sizeof(data2));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-			//Jump to next line
-			setCursor_LCD(3,1);
-
-			data3[0] = 0x01;
-			for(i = 1 ; i < 17 ; i++)
-			{
-				data3[i] = *pstring++;
-			}
-			data3[17] = '\0';
-			data3[18] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data3, sizeof(data3));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-
-			//Jump to next line
-			setCursor_LCD(4,1);
-
-			data4[0] = 0x01;
-			for(i = 1 ; i < (len-47) ; i++)
-			{
-				data4[i] = *pstring++;
-			}
-			data4[(len-47)] = '\0';
-			data4[(len-47)+1] = 0xFF;
-
-			g_bytesWritten = write(g_Fd, &data4, sizeof(data4));
-			if (g_bytesWritten < 0)
-			{
-				perror("Write failed -");
-				return -1;
-			}
-		} else {
-			setCursor_LCD(2,1);
-			char tooLongString[] = "Too long string!";
-			stringLength = strlen(tooLongString);
-			printString_LCD(tooLongString, stringLength);
-			printf("Too long string\n");
-			sleep(2);
-		}
+	displaySize_LCD(&lines, &columns);
+	if(layoutText(&layout, pstring, len, lines, columns) < 0)
+		return -1;
 
-	return 0;
+	return showLayout_LCD(&layout, TEXT_PAGING, holdMs);
 }
 
 /* Print short string */
 int printString_LCD(const char *pstring, const size_t len)
 {
-	unsigned char sData[len+3];
-	sData[0] = 0x01;
-	size_t i;
-
-	for(i = 1 ; i < (len+1) ; i++)
-	{
-		sData[i] = *pstring++;
-	}
-
-	sData[len+1] = '\0';
-	sData[len+2] = 0xFF;
-
-	g_bytesWritten = write(g_Fd, &sData, sizeof(sData));
-
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed -");
-		return -1;
-	}
-	return 0;
-}
-
-//Print temperature to the LCD
-static int printTemperature(const char *pstring, const size_t len)
-{
-	unsigned char sTdata[len+4];
-	sTdata[0] = 0x01;
-	size_t i;
+	lcd_encoder_t encoder;
 
-	for(i = 1 ; i < (len+1) ; i++)
-	{
-		sTdata[i] = *pstring++;
-	}
-
-	sTdata[len+1] = 'C';
-	sTdata[len+2] = '\0';
-	sTdata[len+3] = 0xFF;
-
-	g_bytesWritten = write(g_Fd, &sTdata, sizeof(sTdata));
-
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed -");
-		return -1;
-	}
-	return 0;
+	beginCommands_LCD(&encoder);
+	encodeString_LCD(&encoder, pstring, len);
+	return flushCommands_LCD(&encoder);
 }
 
-static int printPressure(const char *pstring, const size_t len)
+/* Adds the command to the batch, a command which doesn't fit marks the batch overflown */
+static int appendCommand(lcd_encoder_t *encoder, const unsigned char *data, const size_t len)
 {
-	unsigned char sTdata[len+6];
-	sTdata[0] = 0x01;
-	size_t i;
-
-	for(i = 1 ; i < (len+1) ; i++)
-	{
-		sTdata[i] = *pstring++;
-	}
-
-	sTdata[len+1] = 'h';
-	sTdata[len+2] = 'P';
-	sTdata[len+3] = 'a';
-	sTdata[len+4] = '\0';
-	sTdata[len+5] = 0xFF;
-
-	g_bytesWritten = write(g_Fd, &sTdata, sizeof(sTdata));
-
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed -");
+	if(encoder->overflow || encoder->length + len > sizeof(encoder->buffer)) {
+		encoder->overflow = 1;
 		return -1;
 	}
-	return 0;
-}
-
-static int printAltitude(const char *pstring, const size_t len)
-{
-	unsigned char sTdata[len+4];
-	sTdata[0] = 0x01;
-	size_t i;
-
-	for(i = 1 ; i < (len+1) ; i++)
-	{
-		sTdata[i] = *pstring++;
-	}
-
-	sTdata[len+1] = 'm';
-	sTdata[len+2] = '\0';
-	sTdata[len+3] = 0xFF;
 
-	g_bytesWritten = write(g_Fd, &sTdata, sizeof(sTdata));
-
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed -");
-		return -1;
-	}
+	memcpy(encoder->buffer + encoder->length, data, len);
+	encoder->length += len;
 	return 0;
 }
 
-static int printHumidity(const char *pstring, const size_t len)
+static void printValue(const char *caption, const unsigned char captionCol, const unsigned char valueCol,
+		const float value, const char *unit)
 {
-	unsigned char sTdata[len+4];
-	sTdata[0] = 0x01;
-	size_t i;
-
-	for(i = 1 ; i < (len+1) ; i++)
-	{
-		sTdata[i] = *pstring++;
-	}
-
-	sTdata[len+1] = '%';
-	sTdata[len+2] = '\0';
-	sTdata[len+3] = 0xFF;
-
-	g_bytesWritten = write(g_Fd, &sTdata, sizeof(sTdata));
+	lcd_frame_t frame;
+	char buf[LCD_MAX_COLUMNS + 1];
 
-	if (g_bytesWritten < 0)
-	{
-		perror("Write failed -");
-		return -1;
-	}
-	return 0;
+	clearFrame(&frame);
+	putFrameString(&frame, 2, captionCol, caption, strlen(caption));
+	putFrameString(&frame, 3, valueCol, buf, formatFloat(buf, sizeof(buf), value, 2, unit, 0));
+	showFrame_LCD(&frame, LCD_VALUE_HOLD_MS);
 }
 
 void printMPL3115A2Temperature_LCD(const float temperature)
 {
-	setCursor_LCD(2,3);
-	const char *strng = "MPL tmp is:";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-
-	setCursor_LCD(3,5);
-	char buf[6];
-	snprintf(buf, sizeof(buf), "%.2f", temperature);
-	stringLength = strlen(buf);
-	printTemperature(buf, stringLength);
+	printValue("MPL tmp is:", 3, 5, temperature, "C");
 }
 
 void printTMP36Temperature_LCD(const float temperature)
 {
-	setCursor_LCD(2,3);
-	const char *strng = "TMP36 tmp is:";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-
-	setCursor_LCD(3,6);
-	char buf[6];
-	snprintf(buf, sizeof(buf), "%.2f", temperature);
-	stringLength = strlen(buf);
-	printTemperature(buf, stringLength);
+	printValue("TMP36 tmp is:", 3, 6, temperature, "C");
 }
 
 void printPressure_LCD(const float pressure)
 {
-	setCursor_LCD(2,3);
-	const char *strng = "MPL pres is:";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-
-	setCursor_LCD(3,4);
-	char buf[10];
-	snprintf(buf, sizeof(buf), "%.2f", pressure);
-	stringLength = strlen(buf);
-	printPressure(buf, stringLength);
+	printValue("MPL pres is:", 3, 4, pressure, "hPa");
 }
 
 void printAltitude_LCD(const float altitude)
 {
-	setCursor_LCD(2,3);
-	const char *strng = "MPL alt is:";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-
-	setCursor_LCD(3,4);
-	char buf[10];
-	snprintf(buf, sizeof(buf), "%.2f", altitude);
-	stringLength = strlen(buf);
-	printAltitude(buf, stringLength);
+	printValue("MPL alt is:", 3, 4, altitude, "m");
 }
 
 void printHumidity_LCD(const float humidity)
 {
-	setCursor_LCD(2,3);
-	const char *strng = "Humidity is:";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-
-	setCursor_LCD(3,6);
-	char buf[6];
-	snprintf(buf, sizeof(buf), "%.2f", humidity);
-	stringLength = strlen(buf);
-	printHumidity(buf, stringLength);
+	printValue("Humidity is:", 3, 6, humidity, "%");
+}
+
+/* Title on the first line, mean and deviation, median and the p5-p95 range below it, shown for a second */
+void printStatistics_LCD(const char *title, const float mean, const float stddev, const float p5, const float p50, const float p95)
+{
+	lcd_frame_t frame;
+	char buf[LCD_MAX_COLUMNS + 1];
+	size_t len;
+
+	clearFrame(&frame);
+	putFrameString(&frame, 1, 1, title, strlen(title));
+
+	len = formatFloat(buf, sizeof(buf), mean, 1, " sd ", 0);
+	len += formatFloat(buf + len, sizeof(buf) - len, stddev, 2, NULL, 0);
+	putFrameString(&frame, 2, 1, buf, len);
+
+	putFrameString(&frame, 3, 1, "p50 ", 4);
+	putFrameString(&frame, 3, 5, buf, formatFloat(buf, sizeof(buf), p50, 1, NULL, 0));
+
+	len = formatFloat(buf, sizeof(buf), p5, 1, "..", 0);
+	len += formatFloat(buf + len, sizeof(buf) - len, p95, 1, NULL, 0);
+	putFrameString(&frame, 4, 1, buf, len);
+
+	showFrame_LCD(&frame, LCD_VALUE_HOLD_MS);
+}
+
+/* Shows the message for two seconds */
+static int printMessage(const char *message, const unsigned char col)
+{
+	lcd_frame_t frame;
+
+	clearFrame(&frame);
+	putFrameString(&frame, 2, col, message, strlen(message));
+	return showFrame_LCD(&frame, LCD_MESSAGE_HOLD_MS);
 }
 
 int printConnect(void)
 {
-	setCursor_LCD(2,3);
-	const char *strng = "CONNECTED!!";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-	sleep(2);
-	clear_LCD();
-	return 0;
+	return printMessage("CONNECTED!!", 3);
 }
 
 int printDisconnect(void)
 {
-	setCursor_LCD(2,2);
-	const char *strng = "DISCONNECTED!!";
-	stringLength = strlen(strng);
-	printString_LCD(strng, stringLength);
-	sleep(2);
-	clear_LCD();
-	return 0;
+	return printMessage("DISCONNECTED!!", 2);
 }
@@ -11,16 +11,59 @@
 #include <termios.h> //Used for UART
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+
+#ifndef LCD_SERIAL_DEVICE
+#define LCD_SERIAL_DEVICE			"/dev/ttyAMA0"
+#endif
+
+/* Size of the display, setType_LCD() takes any size up to the maximum */
+#define LCD_LINES					4
+#define LCD_COLUMNS					16
+#define LCD_MAX_LINES				4
+#define LCD_MAX_COLUMNS				20
+
+/* The UART runs at 9600 baud, 8N1 takes 10 bits a byte */
+#define LCD_BAUD_RATE				9600
+#define LCD_BITS_PER_BYTE			10
+
+/* Bytes on the wire of the backpack commands, a string command is its characters and this overhead */
+#define LCD_CLEAR_BYTES				2
+#define LCD_CURSOR_BYTES			4
+#define LCD_CHAR_BYTES				3
+#define LCD_STRING_OVERHEAD			3
+#define LCD_CHARACTER_BYTES			11
+
+/* A frame's commands are batched and sent with one write(), a 4x20 frame takes at most 258 bytes and its glyphs 88 */
+#define LCD_COMMAND_BUFFER_SIZE		384
+#define LCD_WRITE_TIMEOUT_MS		2000
+
+typedef struct lcd_encoder
+{
+	unsigned char buffer[LCD_COMMAND_BUFFER_SIZE];
+	size_t length;
+	int overflow;
+} lcd_encoder_t;
 
 /* Function prototypes */
 int setup_Serial(void);
+int openSerial_LCD(const char *device);
 int serialLCD_Close(void);
+void beginCommands_LCD(lcd_encoder_t *encoder);
+int encodeClear_LCD(lcd_encoder_t *encoder);
+int encodeCursor_LCD(lcd_encoder_t *encoder, const unsigned char line, const unsigned char col);
+int encodeChar_LCD(lcd_encoder_t *encoder, const unsigned char c);
+int encodeString_LCD(lcd_encoder_t *encoder, const char *pstring, const size_t len);
+int createCharacter_LCD(lcd_encoder_t *encoder, const unsigned char memoryLocation, const unsigned char *characterMap);
+int flushCommands_LCD(lcd_encoder_t *encoder);
+void serialStatistics_LCD(uint32_t *writeCalls, uint64_t *bytes);
 int clear_LCD(void);
 int setType_LCD(const unsigned char line, const unsigned char col);
+void displaySize_LCD(unsigned char *lines, unsigned char *columns);
 int setBacklight_LCD(const unsigned char brightness);
 int setCursor_LCD(const unsigned char line, const unsigned char col);
 int writeChar_LCD(const unsigned char c);
-int printLongString_LCD(const char *pstring, const size_t len);
+int printLongString_LCD(const char *pstring, const size_t len, const unsigned int holdMs);
 int printString_LCD(const char *pstring, const size_t len);
 void printData_LCD(float temperature, float pressure, float altitude);
 void printMPL3115A2Temperature_LCD(const float temperature);
@@ -28,6 +71,7 @@ void printTMP36Temperature_LCD(const float temperature);
 void printPressure_LCD(const float pressure);
 void printAltitude_LCD(const float altitude);
 void printHumidity_LCD(const float humidity);
+void printStatistics_LCD(const char *title, const float mean, const float stddev, const float p5, const float p50, const float p95);
 int printConnect(void);
 int printDisconnect(void);
 
@@ -0,0 +1,453 @@
+/*
+ * LCDDashboard.c
+ *
+ * Dashboard of the idle display. The LCD thread runs it between the key presses: the pages rotate on
+ * their schedule, and a page is redrawn only when one of its values moved by its display resolution,
+ * so the noise of a sensor doesn't flicker the last digit. The bytes on the line are held to a budget,
+ * a refresh waits until the line has the time for it. A keyed view pauses the dashboard for its hold
+ * time, a message of another thread for LCD_MESSAGE_HOLD_MS.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "LCDDashboard.h"
+#include "LCDRenderer.h"
+#include "SamplePublisher.h"
+#include "TCP_Socket.h"
+#include "NumberFormat.h"
+
+/* How a channel is shown: the value with its decimals, the extremes and the trend scale */
+typedef struct dashboard_channel
+{
+	const char *label;
+	const char *title;
+	const char *unit;
+	unsigned int decimals;
+	unsigned int extremesDecimals;
+	float trendSpan;
+} dashboard_channel_t;
+
+/* Static function declarations */
+static void enterPage(lcd_dashboard_t *dashboard, const dashboard_page_t *page, const uint64_t now);
+static void updateBudget(lcd_dashboard_t *dashboard, const uint64_t now);
+static void composePage(lcd_dashboard_t *dashboard, lcd_frame_t *frame);
+static void composeCurrentValues(lcd_dashboard_t *dashboard, lcd_frame_t *frame);
+static void composeExtremes(lcd_frame_t *frame);
+static void composeTrendPage(lcd_dashboard_t *dashboard, lcd_frame_t *frame, const sensor_channel_t channel);
+static void composeNetwork(lcd_frame_t *frame);
+static int shownValue(lcd_dashboard_t *dashboard, const sensor_channel_t channel, float *value);
+static void followTrend(lcd_trend_t *trend, const sensor_channel_t channel);
+
+static const dashboard_channel_t g_channels[NUMBER_OF_CHANNELS] =
+{
+	[CHANNEL_MPL3115A2_TEMPERATURE]	= { "Temp",		"Temp",		"C",	1,	1,	1.0f },
+	[CHANNEL_PRESSURE]				= { "Pres",		"Pressure",	"hPa",	1,	0,	1.0f },
+	[CHANNEL_ALTITUDE]				= { "Alt",		"Altitude",	"m",	0,	0,	10.0f },
+	[CHANNEL_TMP36_TEMPERATURE]		= { "TMP36",	"TMP36",	"C",	1,	1,	1.0f },
+	[CHANNEL_HUMIDITY]				= { "Hum",		"Humidity",	"%",	0,	0,	2.0f },
+};
+
+/* The channels of the current values and the extremes pages, a line each */
+static const sensor_channel_t g_currentChannels[] =
+{
+	CHANNEL_MPL3115A2_TEMPERATURE, CHANNEL_PRESSURE, CHANNEL_HUMIDITY, CHANNEL_TMP36_TEMPERATURE
+};
+static const sensor_channel_t g_extremesChannels[] =
+{
+	CHANNEL_MPL3115A2_TEMPERATURE, CHANNEL_PRESSURE, CHANNEL_HUMIDITY
+};
+
+/* Static local dashboard, used by the LCD thread only */
+static lcd_dashboard_t g_dashboard;
+
+void defaultDashboardConfig(dashboard_config_t *config)
+{
+	static const dashboard_page_t pages[] =
+	{
+		{ DASHBOARD_CURRENT_VALUES,	CHANNEL_MPL3115A2_TEMPERATURE,	LCD_DASHBOARD_PAGE_MS },
+		{ DASHBOARD_EXTREMES,		CHANNEL_MPL3115A2_TEMPERATURE,	LCD_DASHBOARD_PAGE_MS / 2 },
+		{ DASHBOARD_TREND,			CHANNEL_PRESSURE,				LCD_DASHBOARD_PAGE_MS },
+		{ DASHBOARD_TREND,			CHANNEL_HUMIDITY,				LCD_DASHBOARD_PAGE_MS },
+		{ DASHBOARD_NETWORK,		CHANNEL_MPL3115A2_TEMPERATURE,	LCD_DASHBOARD_PAGE_MS / 2 },
+	};
+
+	memset(config, 0, sizeof(*config));
+	memcpy(config->pages, pages, sizeof(pages));
+	config->pageCount = sizeof(pages) / sizeof(pages[0]);
+	config->refreshMs = LCD_DASHBOARD_REFRESH_MS;
+	config->bytesPerSecond = LCD_DASHBOARD_BYTES_PER_SECOND;
+	config->burstBytes = LCD_DASHBOARD_BURST_BYTES;
+}
+
+/* Starts the rotation from the first page. Returns -1 and leaves the dashboard off for an invalid configuration. */
+int initDashboard_LCD(const dashboard_config_t *config)
+{
+	lcd_dashboard_t *dashboard = &g_dashboard;
+	deadband_config_t resolution = { 0.0f, 0.0f, UINT32_MAX };
+	uint32_t writeCalls;
+	size_t i, decimal;
+
+	memset(dashboard, 0, sizeof(*dashboard));
+	if(config->pageCount == 0 || config->pageCount > LCD_DASHBOARD_MAX_PAGES || config->bytesPerSecond == 0) {
+		printf("Invalid LCD dashboard configuration\n");
+		return -1;
+	}
+	for(i = 0 ; i < config->pageCount ; i++) {
+		if(config->pages[i].type > DASHBOARD_NETWORK || config->pages[i].channel >= NUMBER_OF_CHANNELS) {
+			printf("Invalid LCD dashboard page %u\n", (unsigned int)i);
+			return -1;
+		}
+	}
+	dashboard->config = *config;
+
+	/* A value is redrawn when it moved by a unit of its last decimal */
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		resolution.absoluteThreshold = 1.0f;
+		for(decimal = 0 ; decimal < g_channels[i].decimals ; decimal++)
+			resolution.absoluteThreshold /= 10.0f;
+		initDeadbandFilter(&dashboard->values[i], &resolution);
+	}
+
+	dashboard->startMs = monotonicMs();
+	serialStatistics_LCD(&writeCalls, &dashboard->startBytes);
+	dashboard->budget = (int64_t)config->burstBytes * 1000;
+	dashboard->budgetMs = dashboard->startMs;
+	dashboard->bytesSeen = dashboard->startBytes;
+	dashboard->viewsSeen = queuedViews_LCD();
+
+	enterPage(dashboard, &config->pages[0], dashboard->startMs);
+	dashboard->enabled = 1;
+	return 0;
+}
+
+/* Turns the page and redraws it when it's time, called from the loop of the LCD thread */
+void runDashboard_LCD(void)
+{
+	lcd_dashboard_t *dashboard = &g_dashboard;
+	uint64_t now = monotonicMs();
+	uint32_t views;
+	lcd_frame_t frame;
+	uint32_t interval;
+
+	if(!dashboard->enabled || now < dashboard->nextPollMs)
+		return;
+	dashboard->nextPollMs = now + LCD_DASHBOARD_POLL_MS;
+	updateBudget(dashboard, now);
+
+	/* Another thread showed something, it stays its time */
+	views = queuedViews_LCD();
+	if(views != dashboard->viewsSeen) {
+		dashboard->viewsSeen = views;
+		dashboard->interruptions++;
+		if(!dashboard->paused || (dashboard->resumeMs != 0 && dashboard->resumeMs < now + LCD_MESSAGE_HOLD_MS))
+			pauseDashboard_LCD(LCD_MESSAGE_HOLD_MS);
+	}
+
+	if(dashboard->paused) {
+		if(dashboard->resumeMs == 0 || now < dashboard->resumeMs)
+			return;
+		dashboard->paused = 0;
+		dashboard->pageEndMs = now + dashboard->page.showMs;
+		dashboard->nextRefreshMs = now;
+	}
+
+	if(!dashboard->held && dashboard->config.pageCount > 1 && now >= dashboard->pageEndMs) {
+		dashboard->pageIndex = (dashboard->pageIndex + 1) % dashboard->config.pageCount;
+		enterPage(dashboard, &dashboard->config.pages[dashboard->pageIndex], now);
+		dashboard->turns++;
+	}
+
+	if(now < dashboard->nextRefreshMs)
+		return;
+
+	composePage(dashboard, &frame);
+	if(dashboard->shownValid && memcmp(&frame, &dashboard->shown, sizeof(frame)) == 0) {
+		dashboard->unchanged++;
+	}
+	else if(dashboard->budget < 0) {
+		/* Tried again at the next poll */
+		dashboard->deferred++;
+		return;
+	}
+	else {
+		showFrame_LCD(&frame, 0);
+		dashboard->viewsSeen = queuedViews_LCD();
+		dashboard->shown = frame;
+		dashboard->shownValid = 1;
+		dashboard->refreshes++;
+	}
+
+	interval = dashboard->page.type == DASHBOARD_TREND ? LCD_TREND_REFRESH_MS : dashboard->config.refreshMs;
+	dashboard->nextRefreshMs = now + interval;
+}
+
+/* A keyed view takes the screen, holdMs 0 keeps the dashboard paused until it's resumed */
+void pauseDashboard_LCD(const uint32_t holdMs)
+{
+	lcd_dashboard_t *dashboard = &g_dashboard;
+
+	dashboard->paused = 1;
+	dashboard->resumeMs = holdMs > 0 ? monotonicMs() + holdMs : 0;
+	dashboard->shownValid = 0;
+	dashboard->viewsSeen = queuedViews_LCD();
+}
+
+/* Shows the page until the rotation is resumed */
+void holdDashboardPage_LCD(const dashboard_page_type_t type, const sensor_channel_t channel)
+{
+	lcd_dashboard_t *dashboard = &g_dashboard;
+	dashboard_page_t page = { type, channel, 0 };
+
+	if(!dashboard->enabled || type > DASHBOARD_NETWORK || channel >= NUMBER_OF_CHANNELS)
+		return;
+
+	dashboard->paused = 0;
+	dashboard->held = 1;
+	enterPage(dashboard, &page, monotonicMs());
+	dashboard->nextPollMs = 0;
+	runDashboard_LCD();
+}
+
+/* Goes on with the rotation from the page it was on */
+void resumeDashboard_LCD(void)
+{
+	lcd_dashboard_t *dashboard = &g_dashboard;
+	uint64_t now = monotonicMs();
+
+	if(!dashboard->enabled)
+		return;
+
+	dashboard->paused = 0;
+	if(dashboard->held) {
+		dashboard->held = 0;
+		enterPage(dashboard, &dashboard->config.pages[dashboard->pageIndex], now);
+	}
+	dashboard->shownValid = 0;
+	dashboard->pageEndMs = now + dashboard->page.showMs;
+	dashboard->nextRefreshMs = now;
+	dashboard->nextPollMs = 0;
+}
+
+void printDashboardStatistics_LCD(void)
+{
+	lcd_dashboard_t *dashboard = &g_dashboard;
+	uint64_t elapsedMs = monotonicMs() - dashboard->startMs;
+	uint32_t writeCalls;
+	uint64_t bytes;
+
+	if(!dashboard->enabled)
+		return;
+
+	serialStatistics_LCD(&writeCalls, &bytes);
+	printf("LCD dashboard %u refreshes, %u unchanged, %u deferred by the byte budget, %u pages turned, %u interruptions\n",
+			dashboard->refreshes, dashboard->unchanged, dashboard->deferred, dashboard->turns, dashboard->interruptions);
+	printf("LCD line %.1f bytes/s on average, the budget is %u bytes/s\n",
+			elapsedMs > 0 ? (bytes - dashboard->startBytes) * 1000.0 / elapsedMs : 0.0, dashboard->config.bytesPerSecond);
+}
+
+/* A new page is drawn at the next poll, the trend starts from the rollups of its whole width */
+static void enterPage(lcd_dashboard_t *dashboard, const dashboard_page_t *page, const uint64_t now)
+{
+	dashboard->page = *page;
+	if(dashboard->page.showMs == 0)
+		dashboard->page.showMs = LCD_DASHBOARD_PAGE_MS;
+	dashboard->pageEndMs = now + dashboard->page.showMs;
+	dashboard->nextRefreshMs = now;
+	dashboard->shownValid = 0;
+	dashboard->trendValid = 0;
+}
+
+/* Adds the budget of the time passed and takes the bytes sent since, whoever sent them */
+static void updateBudget(lcd_dashboard_t *dashboard, const uint64_t now)
+{
+	int64_t limit = (int64_t)dashboard->config.burstBytes * 1000;
+	uint32_t writeCalls;
+	uint64_t bytes;
+
+	serialStatistics_LCD(&writeCalls, &bytes);
+
+	dashboard->budget += (int64_t)(now - dashboard->budgetMs) * dashboard->config.bytesPerSecond;
+	if(dashboard->budget > limit)
+		dashboard->budget = limit;
+	dashboard->budget -= (int64_t)(bytes - dashboard->bytesSeen) * 1000;
+
+	dashboard->budgetMs = now;
+	dashboard->bytesSeen = bytes;
+}
+
+static void composePage(lcd_dashboard_t *dashboard, lcd_frame_t *frame)
+{
+	switch(dashboard->page.type)
+	{
+		case DASHBOARD_CURRENT_VALUES:
+			composeCurrentValues(dashboard, frame);
+			break;
+		case DASHBOARD_EXTREMES:
+			composeExtremes(frame);
+			break;
+		case DASHBOARD_TREND:
+			composeTrendPage(dashboard, frame, dashboard->page.channel);
+			break;
+		case DASHBOARD_NETWORK:
+			composeNetwork(frame);
+			break;
+	}
+}
+
+/* A channel a line, the value right-aligned after its label */
+static void composeCurrentValues(lcd_dashboard_t *dashboard, lcd_frame_t *frame)
+{
+	char buf[LCD_MAX_COLUMNS + 1];
+	unsigned char lines, columns;
+	size_t i, labelLength, len;
+	float value;
+
+	displaySize_LCD(&lines, &columns);
+	clearFrame(frame);
+
+	for(i = 0 ; i < sizeof(g_currentChannels) / sizeof(g_currentChannels[0]) && i < lines ; i++) {
+		const dashboard_channel_t *channel = &g_channels[g_currentChannels[i]];
+
+		labelLength = strlen(channel->label);
+		putFrameString(frame, i + 1, 1, channel->label, labelLength);
+
+		if(shownValue(dashboard, g_currentChannels[i], &value) < 0) {
+			memcpy(buf, "--", 2);
+			len = 2;
+		}
+		else
+			len = formatFloat(buf, sizeof(buf), value, channel->decimals, channel->unit, 0);
+
+		if(labelLength + 1 + len <= columns)
+			putFrameString(frame, i + 1, columns - len + 1, buf, len);
+	}
+}
+
+/* The title and the min..max of the report window, a channel a line */
+static void composeExtremes(lcd_frame_t *frame)
+{
+	char buf[LCD_MAX_COLUMNS + 1];
+	unsigned char lines, columns;
+	size_t i, len;
+	float min, max;
+
+	displaySize_LCD(&lines, &columns);
+	clearFrame(frame);
+	putFrameString(frame, 1, 1, "Min..max 24h", 12);
+
+	for(i = 0 ; i < sizeof(g_extremesChannels) / sizeof(g_extremesChannels[0]) && i + 1 < lines ; i++) {
+		const dashboard_channel_t *channel = &g_channels[g_extremesChannels[i]];
+
+		len = strlen(channel->label);
+		memcpy(buf, channel->label, len);
+		buf[len++] = ' ';
+		if(readWindowedExtremes(g_extremesChannels[i], EXTREMES_REPORT_WINDOW, &min, &max) < 0) {
+			memcpy(buf + len, "--", 2);
+			len += 2;
+		}
+		else {
+			len += formatFloat(buf + len, sizeof(buf) - len, min, channel->extremesDecimals, "..", 0);
+			len += formatFloat(buf + len, sizeof(buf) - len, max, channel->extremesDecimals, NULL, 0);
+		}
+		putFrameString(frame, i + 2, 1, buf, len < columns ? len : columns);
+	}
+}
+
+/* The trend view of the channel, titled with the hours its columns span */
+static void composeTrendPage(lcd_dashboard_t *dashboard, lcd_frame_t *frame, const sensor_channel_t channel)
+{
+	char title[LCD_MAX_COLUMNS + 1];
+	unsigned char lines, columns;
+	size_t len;
+	float value = 0.0f;
+
+	if(!dashboard->trendValid) {
+		displaySize_LCD(&lines, &columns);
+		initTrend(&dashboard->trend, columns, LCD_TREND_RESOLUTION_MS, g_channels[channel].trendSpan);
+		dashboard->trendValid = 1;
+	}
+	followTrend(&dashboard->trend, channel);
+	shownValue(dashboard, channel, &value);
+
+	len = strlen(g_channels[channel].title);
+	memcpy(title, g_channels[channel].title, len);
+	title[len++] = ' ';
+	len += formatUnsigned(title + len, sizeof(title) - len,
+			dashboard->trend.columns * dashboard->trend.resolutionMs / 3600000ULL);
+	if(len + 1 < sizeof(title))
+		title[len++] = 'h';
+	title[len] = '\0';
+
+	composeTrendView(frame, title, value, g_channels[channel].decimals, g_channels[channel].unit, &dashboard->trend);
+}
+
+static void composeNetwork(lcd_frame_t *frame)
+{
+	tcp_server_status_t status;
+	char buf[LCD_MAX_COLUMNS + 1];
+	size_t len;
+
+	readTCPServerStatus(&status);
+	clearFrame(frame);
+	putFrameString(frame, 1, 1, "Network", 7);
+
+	if(status.listening) {
+		memcpy(buf, "Port ", 5);
+		len = 5 + formatUnsigned(buf + 5, sizeof(buf) - 5, TCP_SERVER_PORT);
+		putFrameString(frame, 2, 1, buf, len);
+	}
+	else
+		putFrameString(frame, 2, 1, "Server down", 11);
+
+	memcpy(buf, "Clients ", 8);
+	len = 8 + formatUnsigned(buf + 8, sizeof(buf) - 8, status.clients);
+	buf[len++] = '/';
+	len += formatUnsigned(buf + len, sizeof(buf) - len, MAX_TCP_CLIENTS);
+	putFrameString(frame, 3, 1, buf, len);
+
+	memcpy(buf, "Push ", 5);
+	len = 5 + formatUnsigned(buf + 5, sizeof(buf) - 5, status.subscribers);
+	memcpy(buf + len, " refused ", 9);
+	len += 9;
+	len += formatUnsigned(buf + len, sizeof(buf) - len, status.refused);
+	putFrameString(frame, 4, 1, buf, len);
+}
+
+/*
+ * The value to show of the channel: the latest published sample once it moved by the resolution from
+ * the value shown before. Returns -1 when the channel hasn't published anything.
+ */
+static int shownValue(lcd_dashboard_t *dashboard, const sensor_channel_t channel, float *value)
+{
+	deadband_filter_t *filter = &dashboard->values[channel];
+	published_sample_t sample;
+
+	if(latestPublishedSample(channel, &sample) == 0)
+		deadbandFilterPass(filter, sample.timestamp, sample.value);
+	if(!filter->primed)
+		return -1;
+
+	*value = filter->lastValue;
+	return 0;
+}
+
+/* Adds the rollup buckets since the newest column, a trend without rollups stays empty */
+static void followTrend(lcd_trend_t *trend, const sensor_channel_t channel)
+{
+	rollup_record_t buckets[LCD_MAX_COLUMNS];
+	rollup_store_t *rollups = publishedRollups();
+	uint64_t now = timestampMs();
+	uint64_t from;
+	int count, i;
+
+	if(rollups == NULL || trend->columns == 0)
+		return;
+
+	from = trend->newestStart > 0 ? trend->newestStart :
+			(now / trend->resolutionMs - (trend->columns - 1)) * trend->resolutionMs;
+	count = queryRollups(rollups, channel, from, now + 1, trend->resolutionMs, buckets, LCD_MAX_COLUMNS);
+
+	for(i = 0 ; i < count ; i++) {
+		if(buckets[i].summary.count > 0)
+			pushTrendValue(trend, buckets[i].start, (float)(buckets[i].summary.sum / buckets[i].summary.count));
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ * LCDDashboard.h
+ */
+
+#ifndef LCDDASHBOARD_H_
+#define LCDDASHBOARD_H_
+
+#include <stdint.h>
+#include "thread.h"
+#include "LCDFrame.h"
+#include "LCDTrend.h"
+#include "Deadband.h"
+
+#define LCD_DASHBOARD_MAX_PAGES		8
+#define LCD_DASHBOARD_POLL_MS		100
+
+/*
+ * Defaults: a page stays 8 s and its data is looked at every second, the trends every
+ * LCD_TREND_REFRESH_MS. The display may take a quarter of the 960 bytes/s of the line on average,
+ * a page turn of a 4x16 display with a full set of glyphs is about 180 bytes.
+ */
+#define LCD_DASHBOARD_PAGE_MS			8000
+#define LCD_DASHBOARD_REFRESH_MS		1000
+#define LCD_DASHBOARD_BYTES_PER_SECOND	240
+#define LCD_DASHBOARD_BURST_BYTES		LCD_COMMAND_BUFFER_SIZE
+
+typedef enum
+{
+	DASHBOARD_CURRENT_VALUES	= 0,
+	DASHBOARD_EXTREMES			= 1,
+	DASHBOARD_TREND				= 2,
+	DASHBOARD_NETWORK			= 3,
+} dashboard_page_type_t;
+
+/* A page of the rotation, the channel is the one of a trend page */
+typedef struct dashboard_page
+{
+	dashboard_page_type_t type;
+	sensor_channel_t channel;
+	uint32_t showMs;
+} dashboard_page_t;
+
+/*
+ * The pages are shown in turn. A page is redrawn at most every refreshMs, and only when what it shows
+ * changed. All the bytes sent to the display, the keyed views' too, are taken from a budget of
+ * bytesPerSecond which saves up to burstBytes. A refresh or a page turn waits while it is spent.
+ */
+typedef struct dashboard_config
+{
+	dashboard_page_t pages[LCD_DASHBOARD_MAX_PAGES];
+	size_t pageCount;
+	uint32_t refreshMs;
+	uint32_t bytesPerSecond;
+	uint32_t burstBytes;
+} dashboard_config_t;
+
+typedef struct lcd_dashboard
+{
+	dashboard_config_t config;
+	int enabled;
+
+	/* The page on the screen, a held page isn't turned */
+	dashboard_page_t page;
+	size_t pageIndex;
+	int held;
+	uint64_t pageEndMs;
+	uint64_t nextRefreshMs;
+	uint64_t nextPollMs;
+
+	/* A keyed view or a message on the screen pauses the dashboard, resumeMs 0 until resumed */
+	int paused;
+	uint64_t resumeMs;
+	uint32_t viewsSeen;
+
+	/* The frame last shown, and the value shown of each channel which moves by its resolution */
+	lcd_frame_t shown;
+	int shownValid;
+	deadband_filter_t values[NUMBER_OF_CHANNELS];
+	lcd_trend_t trend;
+	int trendValid;
+
+	/* Byte budget in thousandths of a byte */
+	int64_t budget;
+	uint64_t budgetMs;
+	uint64_t bytesSeen;
+
+	/* Statistics */
+	uint64_t startMs;
+	uint64_t startBytes;
+	uint32_t refreshes;
+	uint32_t unchanged;
+	uint32_t deferred;
+	uint32_t turns;
+	uint32_t interruptions;
+} lcd_dashboard_t;
+
+/* Function prototypes */
+void defaultDashboardConfig(dashboard_config_t *config);
+int initDashboard_LCD(const dashboard_config_t *config);
+void runDashboard_LCD(void);
+void pauseDashboard_LCD(const uint32_t holdMs);
+void holdDashboardPage_LCD(const dashboard_page_type_t type, const sensor_channel_t channel);
+void resumeDashboard_LCD(void);
+void printDashboardStatistics_LCD(void);
+
+#endif /* LCDDASHBOARD_H_ */
@@ -0,0 +1,334 @@
+/*
+ * LCDEmulator.c
+ *
+ * Virtual serial LCD for measuring and checking the display path without the display. The emulator
+ * decodes the backpack's commands like the HD44780 behind it: the characters go to the display
+ * memory at the address counter, the lines are its rows at 0x00, 0x40 and the columns after them,
+ * and a CGRAM upload leaves the counter in the CGRAM until the cursor is set or the screen cleared.
+ * So a write which would land on the wrong line or in a glyph on the real display does so here too.
+ */
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include "LCDEmulator.h"
+#include "thread.h"
+
+/* Static function declarations */
+static void *emulatorThread(void *arg);
+static void receiveByte(lcd_emulator_t *emulator, const unsigned char c);
+static int commandComplete(const lcd_emulator_t *emulator);
+static void executeCommand(lcd_emulator_t *emulator);
+static void writeData(lcd_emulator_t *emulator, const unsigned char c);
+static unsigned char lineAddress(const lcd_emulator_t *emulator, const unsigned char line);
+static void endFrame(lcd_emulator_t *emulator);
+static void sleepUntilUs(const uint64_t deadline);
+
+int startLCDEmulator(lcd_emulator_t *emulator)
+{
+	const char *name;
+	int iret;
+
+	memset(emulator, 0, sizeof(*emulator));
+	memset(emulator->ddram, ' ', sizeof(emulator->ddram));
+	emulator->lines = LCD_LINES;
+	emulator->columns = LCD_COLUMNS;
+	emulator->cgramAddress = -1;
+
+	emulator->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(emulator->master < 0) {
+		perror("Could not open the emulator pty");
+		return -1;
+	}
+
+	name = grantpt(emulator->master) == 0 && unlockpt(emulator->master) == 0 ? ptsname(emulator->master) : NULL;
+	if(name == NULL || strlen(name) >= sizeof(emulator->path)) {
+		perror("Could not unlock the emulator pty");
+		close(emulator->master);
+		return -1;
+	}
+	strcpy(emulator->path, name);
+	pthread_mutex_init(&emulator->mutex, NULL);
+
+	emulator->running = 1;
+	iret = pthread_create(&emulator->thread, NULL, emulatorThread, (void*)emulator);
+	if(iret) {
+		fprintf(stderr, "Error - pthread_create() return code: %d\n", iret);
+		emulator->running = 0;
+		pthread_mutex_destroy(&emulator->mutex);
+		close(emulator->master);
+		return -1;
+	}
+	return 0;
+}
+
+/* Lets the sent bytes through the line, then closes the pty */
+int stopLCDEmulator(lcd_emulator_t *emulator)
+{
+	if(!emulator->running)
+		return -1;
+
+	waitLCDEmulatorStable(emulator, 5000);
+	emulator->running = 0;
+	pthread_join(emulator->thread, NULL);
+	pthread_mutex_destroy(&emulator->mutex);
+	close(emulator->master);
+	return 0;
+}
+
+/* Waits until the last frame is stable. Returns -1 when the bytes are still coming after timeoutMs. */
+int waitLCDEmulatorStable(lcd_emulator_t *emulator, const uint32_t timeoutMs)
+{
+	const struct timespec step = { 0, 1000000L };
+	uint64_t deadline = monotonicUs() + timeoutMs * 1000ULL;
+	int inFrame;
+
+	/* The bytes written just before may not be read yet */
+	nanosleep(&step, NULL);
+	do {
+		pthread_mutex_lock(&emulator->mutex);
+		inFrame = emulator->inFrame;
+		pthread_mutex_unlock(&emulator->mutex);
+		if(!inFrame)
+			return 0;
+		nanosleep(&step, NULL);
+	} while(monotonicUs() < deadline);
+	return -1;
+}
+
+/* Copies what the glass shows, the custom made characters are their codes 0-7 */
+void readLCDEmulatorScreen(lcd_emulator_t *emulator, unsigned char screen[LCD_MAX_LINES][LCD_MAX_COLUMNS])
+{
+	unsigned char line, col;
+
+	memset(screen, ' ', LCD_MAX_LINES * LCD_MAX_COLUMNS);
+
+	pthread_mutex_lock(&emulator->mutex);
+	for(line = 0 ; line < emulator->lines && line < LCD_MAX_LINES ; line++) {
+		unsigned char address = lineAddress(emulator, line);
+
+		for(col = 0 ; col < emulator->columns && col < LCD_MAX_COLUMNS ; col++) {
+			unsigned char c = emulator->ddram[(address + col) % LCD_DDRAM_SIZE];
+
+			screen[line][col] = c < 2 * LCD_CGRAM_SLOTS ? c % LCD_CGRAM_SLOTS : c;
+		}
+	}
+	pthread_mutex_unlock(&emulator->mutex);
+}
+
+void printLCDEmulatorReport(lcd_emulator_t *emulator)
+{
+	unsigned char screen[LCD_MAX_LINES][LCD_MAX_COLUMNS];
+	unsigned char line, col;
+
+	readLCDEmulatorScreen(emulator, screen);
+
+	pthread_mutex_lock(&emulator->mutex);
+	printf("LCD emulator %llu bytes, %u commands, %u malformed, %u data writes to the CGRAM\n",
+			(unsigned long long)emulator->bytes, emulator->commands, emulator->malformed, emulator->cgramWrites);
+	printf("LCD emulator %u frames stable after %.1f ms on average, %.1f ms at most\n", emulator->frames,
+			emulator->frames > 0 ? emulator->stableUsTotal / 1000.0 / emulator->frames : 0.0,
+			emulator->stableUsMax / 1000.0);
+	printf("LCD emulator %ux%u screen, backlight %u:\n", emulator->lines, emulator->columns, emulator->backlight);
+	for(line = 0 ; line < emulator->lines && line < LCD_MAX_LINES ; line++) {
+		printf("  |");
+		for(col = 0 ; col < emulator->columns && col < LCD_MAX_COLUMNS ; col++)
+			putchar(screen[line][col] < LCD_CGRAM_SLOTS ? '0' + screen[line][col] :
+					(screen[line][col] < 0x20 || screen[line][col] > 0x7E ? '?' : screen[line][col]));
+		printf("|\n");
+	}
+	pthread_mutex_unlock(&emulator->mutex);
+}
+
+/* Takes the bytes at the pace of the line, a chunk is read when the previous one has left the wire */
+static void *emulatorThread(void *arg)
+{
+	lcd_emulator_t *emulator = (lcd_emulator_t*)arg;
+	struct pollfd descriptor = { emulator->master, POLLIN, 0 };
+	unsigned char chunk[LCD_EMULATOR_CHUNK];
+
+	while(emulator->running)
+	{
+		uint64_t now;
+		ssize_t length;
+		ssize_t i;
+
+		if(poll(&descriptor, 1, LCD_EMULATOR_IDLE_MS) <= 0 || (length = read(emulator->master, chunk, sizeof(chunk))) <= 0) {
+			/* Nothing came since the line went quiet, the frame is on the glass */
+			now = monotonicUs();
+			pthread_mutex_lock(&emulator->mutex);
+			if(emulator->inFrame && now >= emulator->lineFreeUs + LCD_EMULATOR_IDLE_MS * 1000ULL)
+				endFrame(emulator);
+			pthread_mutex_unlock(&emulator->mutex);
+			continue;
+		}
+
+		now = monotonicUs();
+		pthread_mutex_lock(&emulator->mutex);
+		if(!emulator->inFrame) {
+			emulator->inFrame = 1;
+			emulator->frameStartUs = now;
+		}
+		if(emulator->lineFreeUs < now)
+			emulator->lineFreeUs = now;
+		emulator->lineFreeUs += length * LCD_BITS_PER_BYTE * 1000000ULL / LCD_BAUD_RATE;
+
+		for(i = 0 ; i < length ; i++)
+			receiveByte(emulator, chunk[i]);
+		emulator->bytes += length;
+		pthread_mutex_unlock(&emulator->mutex);
+
+		sleepUntilUs(emulator->lineFreeUs);
+	}
+	return NULL;
+}
+
+static void receiveByte(lcd_emulator_t *emulator, const unsigned char c)
+{
+	if(emulator->commandLength >= sizeof(emulator->command)) {
+		emulator->malformed++;
+		emulator->commandLength = 0;
+	}
+
+	emulator->command[emulator->commandLength++] = c;
+	if(c == 0xFF && commandComplete(emulator)) {
+		executeCommand(emulator);
+		emulator->commandLength = 0;
+	}
+}
+
+/* The terminator may also be an argument, a command is complete at its length */
+static int commandComplete(const lcd_emulator_t *emulator)
+{
+	const unsigned char *command = emulator->command;
+	size_t length = emulator->commandLength;
+
+	switch(command[0])
+	{
+		case 0x01: return length >= 3 && command[length - 2] == '\0';
+		case 0x02: return length >= LCD_CURSOR_BYTES;
+		case 0x05: return length >= 4;
+		case 0x07: return length >= 3;
+		case 0x0A: return length >= LCD_CHAR_BYTES;
+		case 0x40: return length >= LCD_CHARACTER_BYTES;
+		default: return 1;
+	}
+}
+
+static void executeCommand(lcd_emulator_t *emulator)
+{
+	const unsigned char *command = emulator->command;
+	size_t length = emulator->commandLength;
+	size_t i;
+
+	emulator->commands++;
+	switch(command[0])
+	{
+		case 0x01:
+			for(i = 1 ; i < length - 2 ; i++)
+				writeData(emulator, command[i]);
+			break;
+
+		case 0x02:
+			if(command[1] < 1 || command[1] > emulator->lines || command[2] < 1 || command[2] > LCD_DDRAM_LINE_LENGTH) {
+				emulator->malformed++;
+				break;
+			}
+			emulator->address = lineAddress(emulator, command[1] - 1) + command[2] - 1;
+			emulator->cgramAddress = -1;
+			break;
+
+		case 0x04:
+			if(length != LCD_CLEAR_BYTES) {
+				emulator->malformed++;
+				break;
+			}
+			memset(emulator->ddram, ' ', sizeof(emulator->ddram));
+			emulator->address = 0;
+			emulator->cgramAddress = -1;
+			break;
+
+		case 0x05:
+			if(command[1] < 1 || command[1] > LCD_MAX_LINES || command[2] < 1 || command[2] > LCD_MAX_COLUMNS) {
+				emulator->malformed++;
+				break;
+			}
+			emulator->lines = command[1];
+			emulator->columns = command[2];
+			break;
+
+		case 0x07:
+			emulator->backlight = command[1];
+			break;
+
+		case 0x0A:
+			writeData(emulator, command[1]);
+			break;
+
+		case 0x40:
+			if(command[1] >= LCD_CGRAM_SLOTS) {
+				emulator->malformed++;
+				break;
+			}
+			memcpy(emulator->cgram[command[1]], command + 2, LCD_GLYPH_ROWS);
+			emulator->cgramAddress = (command[1] + 1) * LCD_GLYPH_ROWS;
+			break;
+
+		default:
+			emulator->commands--;
+			emulator->malformed++;
+			break;
+	}
+}
+
+/* Writes at the address counter like the controller, after an upload into the CGRAM */
+static void writeData(lcd_emulator_t *emulator, const unsigned char c)
+{
+	if(emulator->cgramAddress >= 0) {
+		emulator->cgram[(emulator->cgramAddress / LCD_GLYPH_ROWS) % LCD_CGRAM_SLOTS][emulator->cgramAddress % LCD_GLYPH_ROWS] = c;
+		emulator->cgramAddress = (emulator->cgramAddress + 1) % (LCD_CGRAM_SLOTS * LCD_GLYPH_ROWS);
+		emulator->cgramWrites++;
+		return;
+	}
+
+	emulator->ddram[emulator->address] = c;
+	emulator->address++;
+	if(emulator->address == LCD_DDRAM_LINE_LENGTH)
+		emulator->address = LCD_DDRAM_SECOND_LINE;
+	else if(emulator->address == LCD_DDRAM_SECOND_LINE + LCD_DDRAM_LINE_LENGTH)
+		emulator->address = 0;
+}
+
+/* The third and the fourth line continue the first and the second */
+static unsigned char lineAddress(const lcd_emulator_t *emulator, const unsigned char line)
+{
+	return (line % 2 ? LCD_DDRAM_SECOND_LINE : 0) + (line >= 2 ? emulator->columns : 0);
+}
+
+static void endFrame(lcd_emulator_t *emulator)
+{
+	uint64_t stableUs = emulator->lineFreeUs - emulator->frameStartUs;
+
+	emulator->inFrame = 0;
+	emulator->frames++;
+	emulator->stableUsTotal += stableUs;
+	if(stableUs > emulator->stableUsMax)
+		emulator->stableUsMax = stableUs;
+}
+
+static void sleepUntilUs(const uint64_t deadline)
+{
+	uint64_t now = monotonicUs();
+	struct timespec pause;
+
+	if(deadline <= now)
+		return;
+
+	pause.tv_sec = (deadline - now) / 1000000ULL;
+	pause.tv_nsec = (long)((deadline - now) % 1000000ULL) * 1000L;
+	nanosleep(&pause, NULL);
+}
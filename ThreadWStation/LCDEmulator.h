@@ -0,0 +1,72 @@
+/*
+ * LCDEmulator.h
+ */
+
+#ifndef LCDEMULATOR_H_
+#define LCDEMULATOR_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "LCD.h"
+#include "LCDGlyph.h"
+
+/* The display memory of the HD44780, two lines of 40 characters shown as up to four lines */
+#define LCD_DDRAM_SIZE				0x80
+#define LCD_DDRAM_LINE_LENGTH		0x28
+#define LCD_DDRAM_SECOND_LINE		0x40
+
+/* Bytes read at a time and the quiet time which ends a frame */
+#define LCD_EMULATOR_CHUNK			16
+#define LCD_EMULATOR_IDLE_MS		5
+#define LCD_EMULATOR_COMMAND_SIZE	64
+
+/*
+ * A virtual display behind a pty. The station opens the pty's device like the UART, the emulator
+ * decodes the backpack protocol into the display memory and takes the bytes no faster than the
+ * 9600 baud line would, so a full pty pushes back on the writer like the real UART. A frame is the
+ * bytes sent without a pause, it is stable when its last byte would have left the wire.
+ */
+typedef struct lcd_emulator
+{
+	int master;
+	char path[64];
+	pthread_t thread;
+	volatile int running;
+	pthread_mutex_t mutex;
+
+	/* The display */
+	unsigned char ddram[LCD_DDRAM_SIZE];
+	unsigned char cgram[LCD_CGRAM_SLOTS][LCD_GLYPH_ROWS];
+	unsigned char address;
+	int cgramAddress;
+	unsigned char lines;
+	unsigned char columns;
+	unsigned char backlight;
+
+	/* The command being received */
+	unsigned char command[LCD_EMULATOR_COMMAND_SIZE];
+	size_t commandLength;
+
+	/* The simulated line and the current frame */
+	uint64_t lineFreeUs;
+	uint64_t frameStartUs;
+	int inFrame;
+
+	/* Statistics */
+	uint64_t bytes;
+	uint32_t commands;
+	uint32_t malformed;
+	uint32_t cgramWrites;
+	uint32_t frames;
+	uint64_t stableUsTotal;
+	uint64_t stableUsMax;
+} lcd_emulator_t;
+
+/* Function prototypes */
+int startLCDEmulator(lcd_emulator_t *emulator);
+int stopLCDEmulator(lcd_emulator_t *emulator);
+int waitLCDEmulatorStable(lcd_emulator_t *emulator, const uint32_t timeoutMs);
+void readLCDEmulatorScreen(lcd_emulator_t *emulator, unsigned char screen[LCD_MAX_LINES][LCD_MAX_COLUMNS]);
+void printLCDEmulatorReport(lcd_emulator_t *emulator);
+
+#endif /* LCDEMULATOR_H_ */
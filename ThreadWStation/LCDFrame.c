@@ -0,0 +1,263 @@
+/*
+ * LCDFrame.c
+ *
+ * Shadow framebuffer of the LCD. The print paths compose a whole frame and present it, and only the
+ * cells which differ from what is on the glass go over the 9600 baud UART. The changed cells of a line
+ * are grouped into writes by their cost in bytes: a gap of unchanged cells is written again when that
+ * is cheaper than a cursor move and another command, and the cursor is only moved when the previous
+ * write didn't leave it in place. When the diff costs more than clearing and drawing the frame, the
+ * screen is cleared instead. The glyphs of a frame are mapped to the CGRAM first and the uploads go
+ * out in the same batch.
+ */
+#include <pthread.h>
+#include "LCDFrame.h"
+#include "LCDGlyph.h"
+
+/* Static function declarations */
+static size_t writeCost(const unsigned char *cells, const size_t count);
+static size_t drawLine(const unsigned char *target, const unsigned char *current, const size_t columns,
+		const unsigned char line, unsigned char *cursorLine, unsigned char *cursorCol, lcd_encoder_t *encoder);
+static void encodeCells(lcd_encoder_t *encoder, const unsigned char *cells, const size_t count);
+static int charCommandOnly(const unsigned char c);
+static double wireMs(const double bytes);
+
+/* Static local copy of what is on the glass, of which size, and where the cursor is, 0 when unknown */
+static unsigned char g_shadow[LCD_MAX_LINES][LCD_MAX_COLUMNS];
+static unsigned char g_shadowLines = 0;
+static unsigned char g_shadowColumns = 0;
+static int g_shadowValid = 0;
+static unsigned char g_cursorLine = 0;
+static unsigned char g_cursorCol = 0;
+static pthread_mutex_t g_frameMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Static local command batch of a frame, guarded by the frame mutex */
+static lcd_encoder_t g_encoder;
+
+/* Static local update statistics, what was sent and what redrawing every frame would have sent */
+static uint32_t g_updates = 0;
+static uint64_t g_bytesSent = 0;
+static uint64_t g_bytesFullRedraw = 0;
+static size_t g_maxUpdateBytes = 0;
+
+void clearFrame(lcd_frame_t *frame)
+{
+	int line, col;
+
+	for(line = 0 ; line < LCD_MAX_LINES ; line++) {
+		for(col = 0 ; col < LCD_MAX_COLUMNS ; col++)
+			frame->cells[line][col] = ' ';
+	}
+}
+
+/* Puts the string on a line starting from the column, the part beyond the line is cut off */
+void putFrameString(lcd_frame_t *frame, const unsigned char line, const unsigned char col, const char *pstring, const size_t len)
+{
+	size_t i;
+
+	if(line < 1 || line > LCD_MAX_LINES || col < 1 || col > LCD_MAX_COLUMNS)
+		return;
+
+	for(i = 0 ; i < len && col - 1 + i < LCD_MAX_COLUMNS ; i++)
+		frame->cells[line - 1][col - 1 + i] = (unsigned char)pstring[i];
+}
+
+/* Puts a character code or a glyph in a cell, a cell outside the display is ignored */
+void putFrameCell(lcd_frame_t *frame, const unsigned char line, const unsigned char col, const lcd_cell_t cell)
+{
+	if(line < 1 || line > LCD_MAX_LINES || col < 1 || col > LCD_MAX_COLUMNS)
+		return;
+
+	frame->cells[line - 1][col - 1] = cell;
+}
+
+/* Brings the glass to the frame with the fewest bytes. Returns the number of bytes sent or -1 on a failed write. */
+int presentFrame_LCD(const lcd_frame_t *frame)
+{
+	unsigned char target[LCD_MAX_LINES][LCD_MAX_COLUMNS];
+	unsigned char blank[LCD_MAX_COLUMNS];
+	unsigned char cursorLine, cursorCol, lines, columns;
+	size_t diffBytes = 0, redrawBytes = LCD_CLEAR_BYTES, glyphBytes;
+	int line, cleared, ok;
+
+	memset(blank, ' ', sizeof(blank));
+
+	displaySize_LCD(&lines, &columns);
+
+	pthread_mutex_lock(&g_frameMutex);
+
+	/* After setType_LCD() the glass has another size */
+	if(lines != g_shadowLines || columns != g_shadowColumns) {
+		g_shadowValid = 0;
+		g_shadowLines = lines;
+		g_shadowColumns = columns;
+	}
+
+	/* The whole update goes out in one batch, the glyph uploads first */
+	beginCommands_LCD(&g_encoder);
+	glyphBytes = mapGlyphs_LCD(frame, lines, columns, target, &g_encoder) * LCD_CHARACTER_BYTES;
+	if(glyphBytes > 0)
+		g_cursorLine = 0;
+
+	/* Plan both ways, the clear command leaves the cursor home */
+	cursorLine = 1;
+	cursorCol = 1;
+	for(line = 0 ; line < lines ; line++)
+		redrawBytes += drawLine(target[line], blank, columns, line + 1, &cursorLine, &cursorCol, NULL);
+
+	if(g_shadowValid) {
+		cursorLine = g_cursorLine;
+		cursorCol = g_cursorCol;
+		for(line = 0 ; line < lines ; line++)
+			diffBytes += drawLine(target[line], g_shadow[line], columns, line + 1, &cursorLine, &cursorCol, NULL);
+	}
+
+	cleared = !g_shadowValid || diffBytes > redrawBytes;
+	if(cleared) {
+		encodeClear_LCD(&g_encoder);
+		memset(g_shadow, ' ', sizeof(g_shadow));
+		g_cursorLine = 1;
+		g_cursorCol = 1;
+	}
+
+	for(line = 0 ; line < lines ; line++)
+		drawLine(target[line], g_shadow[line], columns, line + 1, &g_cursorLine, &g_cursorCol, &g_encoder);
+	ok = flushCommands_LCD(&g_encoder) == 0;
+
+	/* After a failed write the glass and the CGRAM are unknown, the next frame clears and uploads again */
+	g_shadowValid = ok;
+	if(ok)
+		memcpy(g_shadow, target, sizeof(g_shadow));
+	else
+		invalidateGlyphs_LCD();
+
+	diffBytes += glyphBytes;
+	redrawBytes += glyphBytes;
+	g_updates++;
+	g_bytesSent += cleared ? redrawBytes : diffBytes;
+	g_bytesFullRedraw += redrawBytes;
+	if((cleared ? redrawBytes : diffBytes) > g_maxUpdateBytes)
+		g_maxUpdateBytes = cleared ? redrawBytes : diffBytes;
+
+	pthread_mutex_unlock(&g_frameMutex);
+
+	return ok ? (int)(cleared ? redrawBytes : diffBytes) : -1;
+}
+
+void printFrameStatistics_LCD(void)
+{
+	double sent, full;
+	uint32_t writeCalls;
+	uint64_t bytes;
+
+	serialStatistics_LCD(&writeCalls, &bytes);
+
+	pthread_mutex_lock(&g_frameMutex);
+	sent = g_updates > 0 ? (double)g_bytesSent / g_updates : 0.0;
+	full = g_updates > 0 ? (double)g_bytesFullRedraw / g_updates : 0.0;
+	printf("LCD %u updates, %.1f bytes and %.1f ms per update, max %u bytes\n", g_updates, sent, wireMs(sent),
+			(unsigned int)g_maxUpdateBytes);
+	printf("LCD %u write() calls for %llu bytes in all\n", writeCalls, (unsigned long long)bytes);
+	printf("LCD full redraws would have been %.1f bytes and %.1f ms per update\n", full, wireMs(full));
+	printGlyphStatistics_LCD();
+	pthread_mutex_unlock(&g_frameMutex);
+}
+
+/*
+ * Plans the writes which turn the current cells of a line into the target cells and returns their
+ * cost in bytes. With an encoder the writes are also added to it. The cursor is never assumed to wrap
+ * to the next line.
+ */
+static size_t drawLine(const unsigned char *target, const unsigned char *current, const size_t columns,
+		const unsigned char line, unsigned char *cursorLine, unsigned char *cursorCol, lcd_encoder_t *encoder)
+{
+	size_t cost = 0;
+	size_t col = 0;
+
+	while(col < columns) {
+		size_t start, end, next, runEnd;
+		int move;
+
+		if(target[col] == current[col]) {
+			col++;
+			continue;
+		}
+
+		/* The changed run, then the following runs while bridging the gap is cheaper than a new write */
+		start = col;
+		for(end = start ; end < columns && target[end] != current[end] ; end++)
+			;
+		for(;;) {
+			for(next = end ; next < columns && target[next] == current[next] ; next++)
+				;
+			if(next == columns)
+				break;
+			for(runEnd = next ; runEnd < columns && target[runEnd] != current[runEnd] ; runEnd++)
+				;
+			if(writeCost(target + start, runEnd - start) >
+					writeCost(target + start, end - start) + LCD_CURSOR_BYTES + writeCost(target + next, runEnd - next))
+				break;
+			end = runEnd;
+		}
+
+		move = *cursorLine != line || *cursorCol != start + 1;
+		cost += (move ? LCD_CURSOR_BYTES : 0) + writeCost(target + start, end - start);
+
+		if(encoder != NULL) {
+			if(move)
+				encodeCursor_LCD(encoder, line, start + 1);
+			encodeCells(encoder, target + start, end - start);
+		}
+		*cursorLine = line;
+		*cursorCol = end + 1;
+		col = end;
+	}
+	return cost;
+}
+
+/* Bytes of encodeCells(): strings of the printable cells, single characters with the character command */
+static size_t writeCost(const unsigned char *cells, const size_t count)
+{
+	size_t cost = 0, i = 0;
+
+	while(i < count) {
+		size_t n = 0;
+
+		while(i + n < count && !charCommandOnly(cells[i + n]))
+			n++;
+		if(n == 0)
+			n = 1;
+		cost += n == 1 ? LCD_CHAR_BYTES : n + LCD_STRING_OVERHEAD;
+		i += n;
+	}
+	return cost;
+}
+
+static void encodeCells(lcd_encoder_t *encoder, const unsigned char *cells, const size_t count)
+{
+	size_t i = 0;
+
+	while(i < count) {
+		size_t n = 0;
+
+		while(i + n < count && !charCommandOnly(cells[i + n]))
+			n++;
+		if(n == 0)
+			n = 1;
+		if(n == 1)
+			encodeChar_LCD(encoder, cells[i]);
+		else
+			encodeString_LCD(encoder, (const char*)cells + i, n);
+		i += n;
+	}
+}
+
+/* The string command ends at '\0' and the commands at 0xFF, so the custom character 0 and 0xFF can't be in a string */
+static int charCommandOnly(const unsigned char c)
+{
+	return c == '\0' || c == 0xFF;
+}
+
+static double wireMs(const double bytes)
+{
+	return bytes * LCD_BITS_PER_BYTE * 1000.0 / LCD_BAUD_RATE;
+}
@@ -0,0 +1,32 @@
+/*
+ * LCDFrame.h
+ */
+
+#ifndef LCDFRAME_H_
+#define LCDFRAME_H_
+
+#include <stdint.h>
+#include "LCD.h"
+
+/* A cell is a character code of the display, or a glyph of the CGRAM cache from LCD_GLYPH_BASE on */
+#define LCD_GLYPH_BASE				0x100
+
+typedef uint16_t lcd_cell_t;
+
+/*
+ * A whole screen, one cell per character. Lines and columns are 1-based like setCursor_LCD().
+ * The frame has room for the largest display, only the size set with setType_LCD() is shown.
+ */
+typedef struct lcd_frame
+{
+	lcd_cell_t cells[LCD_MAX_LINES][LCD_MAX_COLUMNS];
+} lcd_frame_t;
+
+/* Function prototypes */
+void clearFrame(lcd_frame_t *frame);
+void putFrameString(lcd_frame_t *frame, const unsigned char line, const unsigned char col, const char *pstring, const size_t len);
+void putFrameCell(lcd_frame_t *frame, const unsigned char line, const unsigned char col, const lcd_cell_t cell);
+int presentFrame_LCD(const lcd_frame_t *frame);
+void printFrameStatistics_LCD(void);
+
+#endif /* LCDFRAME_H_ */
@@ -0,0 +1,174 @@
+/*
+ * LCDGlyph.c
+ *
+ * Cache of the custom made characters in the display's CGRAM. A frame refers to a glyph by its cell
+ * code and the glyphs are uploaded to the eight CGRAM slots when a frame first needs them, so a glyph
+ * costs UART bytes once and not on every frame. When the slots are full the least recently used glyph
+ * which the frame doesn't need is replaced. A slot is rewritten while its old glyph may still be on the
+ * glass, but then that glyph isn't in the frame and the cells showing it are redrawn by the diff.
+ * The glyphs are shown with the mirrored codes 0x08-0x0F, so slot 0 fits in a string command too.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "LCDGlyph.h"
+
+/* Static function declarations */
+static int allocateSlot(void);
+
+/* Static local glyphs, the frames refer to them as LCD_GLYPH_BASE + index */
+static const lcd_glyph_t g_glyphs[] = {
+	{ 0x00E4, { 0b01010, 0b00000, 0b01110, 0b00011, 0b01111, 0b11011, 0b01111, 0b00000 }, 'a' },	/* ä */
+	{ 0x00F6, { 0b01010, 0b00000, 0b01110, 0b10001, 0b10001, 0b10001, 0b01110, 0b00000 }, 'o' },	/* ö */
+	{ 0x00E5, { 0b00100, 0b01010, 0b01110, 0b00001, 0b01111, 0b10001, 0b01111, 0b00000 }, 'a' },	/* å */
+	{ 0x00C4, { 0b01010, 0b00000, 0b01110, 0b10001, 0b10001, 0b11111, 0b10001, 0b10001 }, 'A' },	/* Ä */
+	{ 0x00D6, { 0b01010, 0b00000, 0b01110, 0b10001, 0b10001, 0b10001, 0b10001, 0b01110 }, 'O' },	/* Ö */
+	{ 0x00C5, { 0b00100, 0b01010, 0b01110, 0b10001, 0b11111, 0b10001, 0b10001, 0b00000 }, 'A' },	/* Å */
+	{ 0x2191, { 0b00100, 0b01110, 0b10101, 0b00100, 0b00100, 0b00100, 0b00100, 0b00000 }, '^' },	/* up arrow */
+	{ 0x2193, { 0b00100, 0b00100, 0b00100, 0b00100, 0b10101, 0b01110, 0b00100, 0b00000 }, 'v' },	/* down arrow */
+	{ 0x2581, { 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b11111 }, '_' },	/* bar segments */
+	{ 0x2582, { 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b11111, 0b11111 }, '_' },
+	{ 0x2583, { 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b11111, 0b11111, 0b11111 }, '_' },
+	{ 0x2584, { 0b00000, 0b00000, 0b00000, 0b00000, 0b11111, 0b11111, 0b11111, 0b11111 }, '_' },
+	{ 0x2585, { 0b00000, 0b00000, 0b00000, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111 }, 0xFF },
+	{ 0x2586, { 0b00000, 0b00000, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111 }, 0xFF },
+	{ 0x2587, { 0b00000, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111 }, 0xFF },
+	{ 0x2588, { 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111, 0b11111 }, 0xFF },
+};
+
+#define LCD_GLYPH_COUNT				(sizeof(g_glyphs) / sizeof(g_glyphs[0]))
+
+/* Static local CGRAM contents, the slot of each glyph or -1, and the frame counter */
+static lcd_glyph_slot_t g_slots[LCD_CGRAM_SLOTS] = {
+	{ -1, 0 }, { -1, 0 }, { -1, 0 }, { -1, 0 }, { -1, 0 }, { -1, 0 }, { -1, 0 }, { -1, 0 }
+};
+static int g_glyphSlot[LCD_GLYPH_COUNT];
+static int g_glyphSlotsValid = 0;
+static uint32_t g_frameClock = 0;
+
+/* Static local statistics */
+static uint32_t g_uploads = 0;
+static uint32_t g_hits = 0;
+static uint32_t g_evictions = 0;
+static uint32_t g_fallbacks = 0;
+
+/* The cell code of the code point's glyph, -1 when there is no glyph for it */
+int glyphCell_LCD(const uint32_t codePoint)
+{
+	size_t i;
+
+	for(i = 0 ; i < LCD_GLYPH_COUNT ; i++) {
+		if(g_glyphs[i].codePoint == codePoint)
+			return LCD_GLYPH_BASE + (int)i;
+	}
+	return -1;
+}
+
+/*
+ * Turns the frame's cells into character codes. The glyphs which aren't in the CGRAM are uploaded with
+ * the encoder, first the glyphs already there are kept for the frame so an upload never replaces a
+ * glyph the same frame shows. Returns the number of uploads, they leave the cursor unknown.
+ */
+int mapGlyphs_LCD(const lcd_frame_t *frame, const unsigned char lines, const unsigned char columns,
+		unsigned char target[LCD_MAX_LINES][LCD_MAX_COLUMNS], lcd_encoder_t *encoder)
+{
+	unsigned char needed[LCD_GLYPH_COUNT];
+	size_t glyph;
+	int line, col, uploads = 0;
+
+	if(!g_glyphSlotsValid)
+		invalidateGlyphs_LCD();
+
+	g_frameClock++;
+	memset(needed, 0, sizeof(needed));
+
+	for(line = 0 ; line < lines ; line++) {
+		for(col = 0 ; col < columns ; col++) {
+			lcd_cell_t cell = frame->cells[line][col];
+
+			if(cell < LCD_GLYPH_BASE || (size_t)(cell - LCD_GLYPH_BASE) >= LCD_GLYPH_COUNT)
+				continue;
+
+			glyph = cell - LCD_GLYPH_BASE;
+			if(g_glyphSlot[glyph] >= 0 && g_slots[g_glyphSlot[glyph]].lastUsed != g_frameClock) {
+				g_slots[g_glyphSlot[glyph]].lastUsed = g_frameClock;
+				g_hits++;
+			}
+			else if(g_glyphSlot[glyph] < 0)
+				needed[glyph] = 1;
+		}
+	}
+
+	for(glyph = 0 ; glyph < LCD_GLYPH_COUNT ; glyph++) {
+		int slot;
+
+		if(!needed[glyph])
+			continue;
+
+		slot = allocateSlot();
+		if(slot < 0) {
+			g_fallbacks++;
+			continue;
+		}
+		if(g_slots[slot].glyph >= 0) {
+			g_glyphSlot[g_slots[slot].glyph] = -1;
+			g_evictions++;
+		}
+		g_slots[slot].glyph = (int)glyph;
+		g_slots[slot].lastUsed = g_frameClock;
+		g_glyphSlot[glyph] = slot;
+		createCharacter_LCD(encoder, (unsigned char)slot, g_glyphs[glyph].rows);
+		g_uploads++;
+		uploads++;
+	}
+
+	for(line = 0 ; line < lines ; line++) {
+		for(col = 0 ; col < columns ; col++) {
+			lcd_cell_t cell = frame->cells[line][col];
+
+			if(cell < LCD_GLYPH_BASE)
+				target[line][col] = (unsigned char)cell;
+			else if((size_t)(cell - LCD_GLYPH_BASE) >= LCD_GLYPH_COUNT)
+				target[line][col] = '?';
+			else if(g_glyphSlot[cell - LCD_GLYPH_BASE] >= 0)
+				target[line][col] = (unsigned char)(g_glyphSlot[cell - LCD_GLYPH_BASE] + LCD_CGRAM_MIRROR);
+			else
+				target[line][col] = g_glyphs[cell - LCD_GLYPH_BASE].fallback;
+		}
+	}
+	return uploads;
+}
+
+/* After a failed write the CGRAM contents are unknown, the glyphs are uploaded again */
+void invalidateGlyphs_LCD(void)
+{
+	size_t i;
+
+	for(i = 0 ; i < LCD_CGRAM_SLOTS ; i++) {
+		g_slots[i].glyph = -1;
+		g_slots[i].lastUsed = 0;
+	}
+	for(i = 0 ; i < LCD_GLYPH_COUNT ; i++)
+		g_glyphSlot[i] = -1;
+	g_glyphSlotsValid = 1;
+}
+
+void printGlyphStatistics_LCD(void)
+{
+	printf("LCD glyphs %u uploaded (%u bytes), %u reused, %u evicted, %u shown as fallback\n", g_uploads,
+			g_uploads * LCD_CHARACTER_BYTES, g_hits, g_evictions, g_fallbacks);
+}
+
+/* A free slot, or the least recently used one which the current frame doesn't need. -1 when there is none. */
+static int allocateSlot(void)
+{
+	int slot, oldest = -1;
+
+	for(slot = 0 ; slot < LCD_CGRAM_SLOTS ; slot++) {
+		if(g_slots[slot].glyph < 0)
+			return slot;
+		if(g_slots[slot].lastUsed != g_frameClock &&
+				(oldest < 0 || g_slots[slot].lastUsed < g_slots[oldest].lastUsed))
+			oldest = slot;
+	}
+	return oldest;
+}
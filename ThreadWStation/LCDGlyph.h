@@ -0,0 +1,40 @@
+/*
+ * LCDGlyph.h
+ */
+
+#ifndef LCDGLYPH_H_
+#define LCDGLYPH_H_
+
+#include <stdint.h>
+#include "LCDFrame.h"
+
+/* The display has eight CGRAM slots for custom made characters */
+#define LCD_CGRAM_SLOTS				8
+#define LCD_GLYPH_ROWS				8
+
+/* The character codes 0x08-0x0F show the same CGRAM slots as 0x00-0x07 */
+#define LCD_CGRAM_MIRROR			0x08
+
+/* A custom made character, shown as the fallback character when all the slots are taken by the frame */
+typedef struct lcd_glyph
+{
+	uint32_t codePoint;
+	unsigned char rows[LCD_GLYPH_ROWS];
+	unsigned char fallback;
+} lcd_glyph_t;
+
+/* A CGRAM slot, which glyph it holds and the frame it was last used by */
+typedef struct lcd_glyph_slot
+{
+	int glyph;
+	uint32_t lastUsed;
+} lcd_glyph_slot_t;
+
+/* Function prototypes, the frame mutex guards all but glyphCell_LCD() */
+int glyphCell_LCD(const uint32_t codePoint);
+int mapGlyphs_LCD(const lcd_frame_t *frame, const unsigned char lines, const unsigned char columns,
+		unsigned char target[LCD_MAX_LINES][LCD_MAX_COLUMNS], lcd_encoder_t *encoder);
+void invalidateGlyphs_LCD(void);
+void printGlyphStatistics_LCD(void);
+
+#endif /* LCDGLYPH_H_ */
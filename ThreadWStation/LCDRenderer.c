@@ -0,0 +1,264 @@
+/*
+ * LCDRenderer.c
+ *
+ * The LCD renderer thread. The keyboard and the network threads only compose frames and queue them,
+ * the renderer owns the UART: it shows the newest queued view, drops the ones it superseded and blanks
+ * a timed view when its time is up. Texts are wrapped by the producer and the renderer pages or
+ * scrolls through them, so no producer waits for the 9600 baud display or sleeps to keep a message
+ * on the screen.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "LCDRenderer.h"
+#include "thread.h"
+
+/* Static function declarations */
+static void *renderThread(void *arg);
+static int enqueueView(lcd_renderer_t *renderer, const lcd_view_t *view);
+static int dequeueView(lcd_renderer_t *renderer, lcd_view_t *view);
+static void showPage(lcd_view_t *view, const size_t page);
+static void releaseView(lcd_view_t *view);
+static uint64_t pageExpiry(const lcd_view_t *view, const size_t page);
+
+/* Static local renderer, there is one display */
+static lcd_renderer_t g_renderer;
+
+int startLCDRenderer(void)
+{
+	lcd_renderer_t *renderer = &g_renderer;
+	uint32_t i;
+	int iret;
+
+	memset(renderer, 0, sizeof(*renderer));
+	for(i = 0 ; i < LCD_VIEW_QUEUE_SIZE ; i++)
+		renderer->cells[i].sequence = i;
+
+	renderer->running = 1;
+	iret = pthread_create(&renderer->thread, NULL, renderThread, (void*)renderer);
+	if(iret) {
+		fprintf(stderr, "Error - pthread_create() return code: %d\n", iret);
+		renderer->running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+int stopLCDRenderer(void)
+{
+	if(!g_renderer.running)
+		return -1;
+
+	g_renderer.running = 0;
+	pthread_join(g_renderer.thread, NULL);
+
+	/* The texts still queued own their layouts */
+	while(dequeueView(&g_renderer, NULL) == 0)
+		;
+	return 0;
+}
+
+/*
+ * Queues the frame for the renderer and returns at once. A full queue only holds views this one
+ * supersedes, so the oldest is taken out to make room. Without a running renderer the frame is shown
+ * by the calling thread.
+ */
+int showFrame_LCD(const lcd_frame_t *frame, const uint32_t holdMs)
+{
+	lcd_view_t view;
+
+	if(!g_renderer.running)
+		return presentFrame_LCD(frame) < 0 ? -1 : 0;
+
+	memset(&view, 0, sizeof(view));
+	view.frame = *frame;
+	view.holdMs = holdMs;
+	return enqueueView(&g_renderer, &view);
+}
+
+/*
+ * Queues a wrapped text, the renderer takes over its lines and frees them. Without a running renderer
+ * only the first page is shown.
+ */
+int showLayout_LCD(text_layout_t *layout, const text_motion_t motion, const uint32_t holdMs)
+{
+	lcd_view_t view;
+	int retValue = 0;
+
+	memset(&view, 0, sizeof(view));
+	view.layout = *layout;
+	view.motion = motion;
+	view.pages = textPageCount(layout, motion);
+	view.holdMs = holdMs;
+	memset(layout, 0, sizeof(*layout));
+
+	if(g_renderer.running)
+		return enqueueView(&g_renderer, &view);
+
+	composeTextPage(&view.layout, view.motion, 0, &view.frame);
+	if(presentFrame_LCD(&view.frame) < 0)
+		retValue = -1;
+	releaseView(&view);
+	return retValue;
+}
+
+/* Queues an empty screen */
+int blank_LCD(void)
+{
+	lcd_frame_t frame;
+
+	clearFrame(&frame);
+	return showFrame_LCD(&frame, 0);
+}
+
+/* Views queued so far, a change tells another thread has put something on the screen */
+uint32_t queuedViews_LCD(void)
+{
+	return __atomic_load_n(&g_renderer.queued, __ATOMIC_RELAXED);
+}
+
+void printRendererStatistics_LCD(void)
+{
+	printf("LCD views %u queued, %u shown, %u superseded, %u expired, %u text pages turned\n",
+			__atomic_load_n(&g_renderer.queued, __ATOMIC_RELAXED), g_renderer.shown,
+			__atomic_load_n(&g_renderer.coalesced, __ATOMIC_RELAXED), g_renderer.expired, g_renderer.pagesShown);
+}
+
+static void *renderThread(void *arg)
+{
+	lcd_renderer_t *renderer = (lcd_renderer_t*)arg;
+	const struct timespec pollInterval = { 0, LCD_RENDER_POLL_MS * 1000000L };
+	uint64_t expiry = 0;
+	lcd_view_t view, current;
+	size_t page = 0;
+
+	memset(&current, 0, sizeof(current));
+
+	while(renderer->running)
+	{
+		int pending = 0;
+
+		/* Only the newest view is shown, the older ones are superseded */
+		while(dequeueView(renderer, &view) == 0) {
+			if(pending)
+				__atomic_add_fetch(&renderer->coalesced, 1, __ATOMIC_RELAXED);
+			releaseView(&current);
+			current = view;
+			pending = 1;
+		}
+
+		if(pending) {
+			page = 0;
+			showPage(&current, page);
+			renderer->shown++;
+			expiry = pageExpiry(&current, page);
+		}
+		else if(expiry != 0 && monotonicMs() >= expiry) {
+			if(page + 1 < current.pages) {
+				/* The next page of the text, only its changed cells are sent */
+				showPage(&current, ++page);
+				renderer->pagesShown++;
+				expiry = pageExpiry(&current, page);
+			}
+			else {
+				releaseView(&current);
+				clearFrame(&current.frame);
+				presentFrame_LCD(&current.frame);
+				renderer->expired++;
+				expiry = 0;
+			}
+		}
+		nanosleep(&pollInterval, NULL);
+	}
+
+	releaseView(&current);
+	return NULL;
+}
+
+/* Claims a cell for the view, dropping the oldest view when the queue is full */
+static int enqueueView(lcd_renderer_t *renderer, const lcd_view_t *view)
+{
+	lcd_view_cell_t *cell;
+	uint32_t position, sequence;
+
+	position = __atomic_load_n(&renderer->head, __ATOMIC_RELAXED);
+	for(;;) {
+		cell = &renderer->cells[position & (LCD_VIEW_QUEUE_SIZE - 1)];
+		sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+
+		if(sequence == position) {
+			/* A failed exchange loads the current head into position */
+			if(__atomic_compare_exchange_n(&renderer->head, &position, position + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else {
+			if((int32_t)(sequence - position) < 0 && dequeueView(renderer, NULL) == 0)
+				__atomic_add_fetch(&renderer->coalesced, 1, __ATOMIC_RELAXED);
+			position = __atomic_load_n(&renderer->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->view = *view;
+	__atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&renderer->queued, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * Takes the oldest view, or just drops it and its text when view is NULL. The renderer and a producer making room
+ * may race for it, the tail is moved with a compare-and-swap. Returns -1 when nothing is published.
+ */
+static int dequeueView(lcd_renderer_t *renderer, lcd_view_t *view)
+{
+	lcd_view_t taken;
+	lcd_view_cell_t *cell;
+	uint32_t position, sequence;
+
+	position = __atomic_load_n(&renderer->tail, __ATOMIC_RELAXED);
+	for(;;) {
+		cell = &renderer->cells[position & (LCD_VIEW_QUEUE_SIZE - 1)];
+		sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+
+		if(sequence == position + 1) {
+			if(__atomic_compare_exchange_n(&renderer->tail, &position, position + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if((int32_t)(sequence - (position + 1)) < 0)
+			return -1;
+		else
+			position = __atomic_load_n(&renderer->tail, __ATOMIC_RELAXED);
+	}
+
+	taken = cell->view;
+	__atomic_store_n(&cell->sequence, position + LCD_VIEW_QUEUE_SIZE, __ATOMIC_RELEASE);
+
+	if(view != NULL)
+		*view = taken;
+	else
+		releaseView(&taken);
+	return 0;
+}
+
+/* A text page is composed when it is shown */
+static void showPage(lcd_view_t *view, const size_t page)
+{
+	if(view->pages > 0)
+		composeTextPage(&view->layout, view->motion, page, &view->frame);
+	presentFrame_LCD(&view->frame);
+}
+
+static void releaseView(lcd_view_t *view)
+{
+	if(view->pages > 0)
+		freeTextLayout(&view->layout);
+	view->pages = 0;
+}
+
+/* When the page is turned or the screen blanked, 0 keeps the page */
+static uint64_t pageExpiry(const lcd_view_t *view, const size_t page)
+{
+	if(page + 1 < view->pages)
+		return monotonicMs() + (view->holdMs > 0 ? view->holdMs : LCD_MESSAGE_HOLD_MS);
+	return view->holdMs > 0 ? monotonicMs() + view->holdMs : 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * LCDRenderer.h
+ */
+
+#ifndef LCDRENDERER_H_
+#define LCDRENDERER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "LCDFrame.h"
+#include "TextLayout.h"
+
+/* Queue of views waiting for the renderer, power of two */
+#define LCD_VIEW_QUEUE_SIZE			16
+#define LCD_RENDER_POLL_MS			20
+
+/* How long the timed views stay before the screen is blanked */
+#define LCD_VALUE_HOLD_MS			1000
+#define LCD_MESSAGE_HOLD_MS			2000
+
+/*
+ * A frame or a wrapped text to show, holdMs 0 keeps it until the next view. The pages of a text change
+ * every holdMs, or every LCD_MESSAGE_HOLD_MS when the last page is kept. A text view owns its layout.
+ */
+typedef struct lcd_view
+{
+	lcd_frame_t frame;
+	text_layout_t layout;
+	text_motion_t motion;
+	size_t pages;
+	uint32_t holdMs;
+} lcd_view_t;
+
+/* A cell of the bounded multi-producer queue, the sequence tells whose turn the cell is */
+typedef struct lcd_view_cell
+{
+	lcd_view_t view;
+	uint32_t sequence;
+} lcd_view_cell_t;
+
+/*
+ * Any thread may queue views and none of them blocks: a producer claims a cell by moving the head with
+ * a compare-and-swap and publishes it with the cell's sequence, and makes room by dropping the oldest
+ * view when the queue is full. The renderer thread takes all the queued views at once and only shows
+ * the newest, the older ones are superseded.
+ */
+typedef struct lcd_renderer
+{
+	lcd_view_cell_t cells[LCD_VIEW_QUEUE_SIZE];
+	uint32_t head;
+	uint32_t tail;
+	pthread_t thread;
+	volatile int running;
+	uint32_t queued;
+	uint32_t shown;
+	uint32_t coalesced;
+	uint32_t expired;
+	uint32_t pagesShown;
+} lcd_renderer_t;
+
+/* Function prototypes */
+int startLCDRenderer(void);
+int stopLCDRenderer(void);
+int showFrame_LCD(const lcd_frame_t *frame, const uint32_t holdMs);
+int showLayout_LCD(text_layout_t *layout, const text_motion_t motion, const uint32_t holdMs);
+int blank_LCD(void);
+uint32_t queuedViews_LCD(void);
+void printRendererStatistics_LCD(void);
+
+#endif /* LCDRENDERER_H_ */
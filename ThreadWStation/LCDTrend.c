@@ -0,0 +1,162 @@
+/*
+ * LCDTrend.c
+ *
+ * Trend view of a channel: the value with an arrow of its direction on the top lines and the bucket
+ * means of the last hours as bars on the two lowest lines. The bars are scaled to the values shown,
+ * sixteen levels over the two lines. A new bucket shifts the bars left, the glyphs stay the same and
+ * only the cells which changed level are sent.
+ */
+#include <string.h>
+#include "LCDTrend.h"
+#include "LCDRenderer.h"
+#include "NumberFormat.h"
+
+/* The bar segments are the glyphs of U+2581..U+2588, a full cell is the block of the ROM */
+#define TREND_BAR_CODE_POINT		0x2580
+#define TREND_FULL_BLOCK			0xFF
+
+/* Static function declarations */
+static lcd_cell_t barCell(const int level);
+
+void initTrend(lcd_trend_t *trend, const unsigned char columns, const uint64_t resolutionMs, const float minSpan)
+{
+	memset(trend, 0, sizeof(*trend));
+	trend->columns = columns < LCD_MAX_COLUMNS ? columns : LCD_MAX_COLUMNS;
+	trend->resolutionMs = resolutionMs > 0 ? resolutionMs : 1;
+	trend->minSpan = minSpan;
+}
+
+/*
+ * Sets the mean of the bucket starting at start. A bucket newer than the last column shifts the
+ * columns left, the buckets in between have no value. A bucket older than the view is ignored.
+ */
+void pushTrendValue(lcd_trend_t *trend, const uint64_t start, const float value)
+{
+	uint64_t bucket = start / trend->resolutionMs * trend->resolutionMs;
+	uint64_t age;
+	size_t shift, column;
+
+	if(trend->columns == 0)
+		return;
+
+	if(bucket > trend->newestStart) {
+		shift = trend->newestStart == 0 ? trend->columns : (bucket - trend->newestStart) / trend->resolutionMs;
+		if(shift > trend->columns)
+			shift = trend->columns;
+
+		memmove(trend->values, trend->values + shift, (trend->columns - shift) * sizeof(float));
+		memmove(trend->present, trend->present + shift, trend->columns - shift);
+		memset(trend->present + trend->columns - shift, 0, shift);
+		trend->newestStart = bucket;
+	}
+
+	age = (trend->newestStart - bucket) / trend->resolutionMs;
+	if(age >= trend->columns)
+		return;
+
+	column = trend->columns - 1 - age;
+	trend->values[column] = value;
+	trend->present[column] = 1;
+}
+
+/* Draws the bars on the two lines from firstLine, a column without a value stays empty */
+void composeTrend(const lcd_trend_t *trend, lcd_frame_t *frame, const unsigned char firstLine)
+{
+	float min = 0.0f, max = 0.0f, span;
+	int found = 0;
+	size_t i;
+
+	for(i = 0 ; i < trend->columns ; i++) {
+		if(!trend->present[i])
+			continue;
+		if(!found || trend->values[i] < min)
+			min = trend->values[i];
+		if(!found || trend->values[i] > max)
+			max = trend->values[i];
+		found = 1;
+	}
+
+	/* A flat series is drawn around the middle, not stretched from its noise */
+	span = max - min;
+	if(span < trend->minSpan) {
+		min -= (trend->minSpan - span) / 2;
+		span = trend->minSpan;
+	}
+
+	for(i = 0 ; i < trend->columns ; i++) {
+		int level = 0;
+
+		if(trend->present[i])
+			level = span > 0.0f ? 1 + (int)((trend->values[i] - min) / span * (LCD_TREND_LEVELS - 1) + 0.5f) :
+					LCD_TREND_LEVELS / 2;
+
+		putFrameCell(frame, firstLine, i + 1, barCell(level - LCD_GLYPH_ROWS));
+		putFrameCell(frame, firstLine + 1, i + 1, barCell(level));
+	}
+}
+
+/*
+ * Composes the title, the value with an arrow telling whether it rose or fell over the view, and the
+ * bars below them on the two lowest lines of the display set with setType_LCD().
+ */
+void composeTrendView(lcd_frame_t *frame, const char *title, const float value, const unsigned int decimals,
+		const char *unit, const lcd_trend_t *trend)
+{
+	char buf[LCD_MAX_COLUMNS + 1];
+	unsigned char lines, columns;
+	size_t first, len;
+	int arrow = -1;
+
+	displaySize_LCD(&lines, &columns);
+	clearFrame(frame);
+	putFrameString(frame, 1, 1, title, strlen(title));
+
+	len = formatFloat(buf, sizeof(buf), value, decimals, unit, 0);
+	if(len + 2 > columns)
+		len = columns > 2 ? columns - 2 : 0;
+	putFrameString(frame, 2, 1, buf, len);
+
+	/* The direction from the oldest bucket to the newest, a change under a tenth of the span is level */
+	for(first = 0 ; first < trend->columns && !trend->present[first] ; first++)
+		;
+	if(first + 1 < trend->columns && trend->present[trend->columns - 1]) {
+		float change = trend->values[trend->columns - 1] - trend->values[first];
+
+		if(change > trend->minSpan / 10)
+			arrow = glyphCell_LCD(0x2191);
+		else if(change < -trend->minSpan / 10)
+			arrow = glyphCell_LCD(0x2193);
+	}
+	if(arrow >= 0)
+		putFrameCell(frame, 2, len + 2, (lcd_cell_t)arrow);
+
+	composeTrend(trend, frame, lines > LCD_TREND_LINES ? lines - LCD_TREND_LINES + 1 : 1);
+}
+
+/* The most bytes a refresh of the trend view sends to the display set with setType_LCD() */
+int maxTrendRefreshBytes(void)
+{
+	unsigned char lines, columns;
+
+	displaySize_LCD(&lines, &columns);
+	return LCD_TREND_MAX_REFRESH_BYTES(lines, columns);
+}
+
+void printTrend_LCD(const char *title, const float value, const char *unit, const lcd_trend_t *trend,
+		const uint32_t holdMs)
+{
+	lcd_frame_t frame;
+
+	composeTrendView(&frame, title, value, 2, unit, trend);
+	showFrame_LCD(&frame, holdMs);
+}
+
+/* The cell of a line showing level rows of a bar, nothing below 1 and the full block from 8 on */
+static lcd_cell_t barCell(const int level)
+{
+	if(level <= 0)
+		return ' ';
+	if(level >= LCD_GLYPH_ROWS)
+		return TREND_FULL_BLOCK;
+	return (lcd_cell_t)glyphCell_LCD(TREND_BAR_CODE_POINT + level);
+}
@@ -0,0 +1,55 @@
+/*
+ * LCDTrend.h
+ */
+
+#ifndef LCDTREND_H_
+#define LCDTREND_H_
+
+#include <stdint.h>
+#include "LCDFrame.h"
+#include "LCDGlyph.h"
+
+/* The bars take the two lowest lines, eight levels a line */
+#define LCD_TREND_LINES				2
+#define LCD_TREND_LEVELS			(LCD_TREND_LINES * LCD_GLYPH_ROWS)
+
+/* A column is a quarter of an hour, so 16 columns show four hours */
+#define LCD_TREND_RESOLUTION_MS		(15 * 60000ULL)
+#define LCD_TREND_REFRESH_MS		5000
+
+/*
+ * Bytes per refresh: the bars use seven bar segment glyphs and the full block of the ROM, the value
+ * line one arrow glyph, so the glyphs are uploaded with the first frame only. A refresh within a
+ * bucket sends the value and the last column, a shift or a new scale the bar lines. No refresh costs
+ * more than clearing and drawing the screen with every bar cell a single character: 152 bytes, 158 ms
+ * at 9600 baud on 4x16 and 184 bytes, 192 ms on 4x20. maxTrendRefreshBytes() gives the bound of the
+ * display set with setType_LCD(). test/TrendBench refreshes a synthetic pressure every 5 s for 7.5
+ * hours: on 4x16 a refresh within a bucket takes 3.3 bytes on average and 43 at most, a shift 26
+ * bytes on average and 41 at most, on 4x20 3.3 and 41 within a bucket and 30 and 54 for a shift.
+ */
+#define LCD_TREND_MAX_REFRESH_BYTES(lines, columns)	(LCD_CLEAR_BYTES + \
+		((lines) - LCD_TREND_LINES) * (LCD_CURSOR_BYTES + (columns) + LCD_STRING_OVERHEAD) + \
+		LCD_TREND_LINES * (LCD_CURSOR_BYTES + (columns) * LCD_CHAR_BYTES))
+
+/* The bucket means of the last columns, the newest on the right */
+typedef struct lcd_trend
+{
+	float values[LCD_MAX_COLUMNS];
+	unsigned char present[LCD_MAX_COLUMNS];
+	unsigned char columns;
+	uint64_t resolutionMs;
+	uint64_t newestStart;
+	float minSpan;
+} lcd_trend_t;
+
+/* Function prototypes */
+void initTrend(lcd_trend_t *trend, const unsigned char columns, const uint64_t resolutionMs, const float minSpan);
+void pushTrendValue(lcd_trend_t *trend, const uint64_t start, const float value);
+void composeTrend(const lcd_trend_t *trend, lcd_frame_t *frame, const unsigned char firstLine);
+void composeTrendView(lcd_frame_t *frame, const char *title, const float value, const unsigned int decimals,
+		const char *unit, const lcd_trend_t *trend);
+int maxTrendRefreshBytes(void);
+void printTrend_LCD(const char *title, const float value, const char *unit, const lcd_trend_t *trend,
+		const uint32_t holdMs);
+
+#endif /* LCDTREND_H_ */
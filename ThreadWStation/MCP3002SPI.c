@@ -187,14 +187,4 @@ void readHIH4030Humidity(thread_data_t *mcp3002SPI_Data)
 
 	HIH4030CalcHum(ADCvalue, &mcp3002SPI_Data->humidity, &mcp3002SPI_Data->MPL3115A2temperature);
 
-	/* Get the minimum and maximum values */
-	if(mcp3002SPI_Data->humidity < mcp3002SPI_Data->minHumidity) {
-		mcp3002SPI_Data->minHumidity = mcp3002SPI_Data->humidity;
-		//printf("Min humidity: %0.2f\n", mcp3002SPI_Data->minHumidity);
-
-	}
-	if(mcp3002SPI_Data->humidity > mcp3002SPI_Data->maxHumidity) {
-		mcp3002SPI_Data->maxHumidity = mcp3002SPI_Data->humidity;
-		//printf("Max humidity: %0.2f\n", mcp3002SPI_Data->maxHumidity);
-	}
 }
@@ -0,0 +1,244 @@
+/*
+ * NumberFormat.c
+ *
+ * Number formatting for the LCD, the CSV export and the logs without snprintf(): no locale, no heap
+ * and no double arithmetic. A float is taken apart into its integer mantissa and binary exponent and
+ * scaled to the decimals with integer arithmetic, so the rounding is exact and ties go to the even
+ * digit like glibc's printf. The value, the unit and the padding are written straight into the
+ * caller's buffer.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "NumberFormat.h"
+
+/* Static function declarations */
+static int scaleFloat(const float value, const unsigned int decimals, int *negative, uint64_t *scaled);
+static uint64_t divideRounded(const uint64_t value, const uint64_t divisor);
+static size_t emitDecimal(char *buf, const size_t size, const int negative, uint64_t magnitude,
+		const unsigned int decimals, const int trim, const char *unit, const unsigned int width);
+static size_t emitText(char *buf, const size_t size, const char *text, const size_t length, const char *unit,
+		const unsigned int width);
+
+static const uint64_t g_powersOfTen[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/*
+ * Formats the fixed-point value, value / 10^scale, with the decimals and the unit right-aligned in a
+ * field of width characters. Returns the length, or 0 with an empty buffer when it doesn't fit.
+ */
+size_t formatFixed(char *buf, const size_t size, const int64_t value, const unsigned int scale,
+		const unsigned int decimals, const char *unit, const unsigned int width)
+{
+	uint64_t magnitude = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+
+	if(scale > FORMAT_MAX_DECIMALS || decimals > FORMAT_MAX_DECIMALS)
+		return emitText(buf, size, NULL, 0, NULL, 0);
+
+	if(decimals >= scale) {
+		if(magnitude > UINT64_MAX / g_powersOfTen[decimals - scale])
+			return emitText(buf, size, NULL, 0, NULL, 0);
+		magnitude *= g_powersOfTen[decimals - scale];
+	}
+	else
+		magnitude = divideRounded(magnitude, g_powersOfTen[scale - decimals]);
+
+	return emitDecimal(buf, size, value < 0, magnitude, decimals, 0, unit, width);
+}
+
+/* Formats the float like "%*.*f" followed by the unit */
+size_t formatFloat(char *buf, const size_t size, const float value, const unsigned int decimals,
+		const char *unit, const unsigned int width)
+{
+	uint64_t scaled;
+	int negative, retValue;
+
+	if(decimals > FORMAT_MAX_DECIMALS)
+		return emitText(buf, size, NULL, 0, NULL, 0);
+
+	retValue = scaleFloat(value, decimals, &negative, &scaled);
+	if(retValue == 1)
+		return emitText(buf, size, value != value ? (negative ? "-nan" : "nan") : (negative ? "-inf" : "inf"),
+				negative ? 4 : 3, unit, width);
+
+	/* Beyond 64 bits of scaled digits, which no sensor reaches */
+	if(retValue < 0) {
+		char text[64];
+		int length = snprintf(text, sizeof(text), "%.*f", (int)decimals, value);
+
+		return emitText(buf, size, text, length > 0 && (size_t)length < sizeof(text) ? (size_t)length : 0, unit, width);
+	}
+
+	return emitDecimal(buf, size, negative, scaled, decimals, 0, unit, width);
+}
+
+/*
+ * Formats the float like "%.*g" with digits significant digits. The values from 1e-4 to below 1e9
+ * which need no exponent are formatted here, the rest by snprintf().
+ */
+size_t formatSignificant(char *buf, const size_t size, const float value, const unsigned int digits)
+{
+	static const double powers[] = { 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+	unsigned int precision = digits > 0 ? digits : 1;
+	double magnitude = value < 0 ? -(double)value : (double)value;
+	uint64_t scaled;
+	int exponent, decimals, negative;
+
+	if(value == 0.0f) {
+		scaleFloat(value, 0, &negative, &scaled);
+		return emitText(buf, size, negative ? "-0" : "0", negative ? 2 : 1, NULL, 0);
+	}
+
+	if(magnitude >= powers[0] && magnitude < powers[13] && precision <= 19) {
+		for(exponent = -4 ; magnitude >= powers[exponent + 5] ; exponent++)
+			;
+		decimals = (int)precision - 1 - exponent;
+
+		/* Rounding up to the next power of ten takes one decimal less */
+		if(decimals >= 0 && decimals <= FORMAT_MAX_DECIMALS && scaleFloat(value, decimals, &negative, &scaled) == 0) {
+			if(scaled >= g_powersOfTen[precision]) {
+				exponent++;
+				decimals--;
+			}
+			if(decimals >= 0 && exponent < (int)precision) {
+				scaleFloat(value, decimals, &negative, &scaled);
+				return emitDecimal(buf, size, negative, scaled, decimals, 1, NULL, 0);
+			}
+		}
+	}
+
+	{
+		char text[64];
+		int length = snprintf(text, sizeof(text), "%.*g", (int)precision, value);
+
+		return emitText(buf, size, text, length > 0 && (size_t)length < sizeof(text) ? (size_t)length : 0, NULL, 0);
+	}
+}
+
+size_t formatUnsigned(char *buf, const size_t size, const uint64_t value)
+{
+	return emitDecimal(buf, size, 0, value, 0, 0, NULL, 0);
+}
+
+/*
+ * Rounds value * 10^decimals to an integer. The float is mantissa * 2^exponent, so the product is
+ * the mantissa times a power of ten shifted by the exponent. Returns 1 for NaN and infinity and -1
+ * when the scaled value doesn't fit 64 bits.
+ */
+static int scaleFloat(const float value, const unsigned int decimals, int *negative, uint64_t *scaled)
+{
+	uint32_t bits, biased;
+	uint64_t mantissa, product, remainder, half;
+	int exponent;
+
+	memcpy(&bits, &value, sizeof(bits));
+	*negative = bits >> 31;
+	biased = (bits >> 23) & 0xFF;
+	mantissa = bits & 0x7FFFFF;
+
+	if(biased == 0xFF)
+		return 1;
+	if(biased == 0)
+		exponent = -149;
+	else {
+		mantissa |= 0x800000;
+		exponent = (int)biased - 150;
+	}
+
+	if(exponent >= 0) {
+		if(exponent > 39 || (mantissa << exponent) > UINT64_MAX / g_powersOfTen[decimals])
+			return -1;
+		*scaled = (mantissa << exponent) * g_powersOfTen[decimals];
+		return 0;
+	}
+
+	/* Below 2^58, so shifted out by 64 bits it is under a half */
+	product = mantissa * g_powersOfTen[decimals];
+	if(-exponent >= 64) {
+		*scaled = 0;
+		return 0;
+	}
+
+	*scaled = product >> -exponent;
+	remainder = product & ((1ULL << -exponent) - 1);
+	half = 1ULL << (-exponent - 1);
+	if(remainder > half || (remainder == half && (*scaled & 1)))
+		(*scaled)++;
+	return 0;
+}
+
+/* Divides with the ties to the even quotient */
+static uint64_t divideRounded(const uint64_t value, const uint64_t divisor)
+{
+	uint64_t quotient = value / divisor;
+	uint64_t remainder = value % divisor;
+
+	if(remainder > divisor - remainder || (remainder == divisor - remainder && (quotient & 1)))
+		quotient++;
+	return quotient;
+}
+
+/* Writes the digits of magnitude with the point before the last decimals, trim drops the trailing zeros */
+static size_t emitDecimal(char *buf, const size_t size, const int negative, uint64_t magnitude,
+		const unsigned int decimals, const int trim, const char *unit, const unsigned int width)
+{
+	char digits[FORMAT_MAX_DIGITS];
+	char text[FORMAT_MAX_DIGITS + 2];
+	size_t count = 0, length = 0, fraction;
+
+	do {
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while(magnitude > 0);
+
+	while(count <= decimals)
+		digits[count++] = '0';
+
+	/* Trailing zeros of the fraction are the lowest digits */
+	fraction = decimals;
+	if(trim) {
+		size_t lowest = 0;
+
+		while(fraction > 0 && digits[lowest] == '0') {
+			lowest++;
+			fraction--;
+		}
+	}
+
+	if(negative)
+		text[length++] = '-';
+	while(count > decimals)
+		text[length++] = digits[--count];
+	if(fraction > 0) {
+		text[length++] = '.';
+		while(fraction-- > 0)
+			text[length++] = digits[--count];
+	}
+
+	return emitText(buf, size, text, length, unit, width);
+}
+
+/* Writes the text and the unit right-aligned in the field, an empty text leaves the buffer empty */
+static size_t emitText(char *buf, const size_t size, const char *text, const size_t length, const char *unit,
+		const unsigned int width)
+{
+	size_t unitLength = unit != NULL ? strlen(unit) : 0;
+	size_t total = length + unitLength;
+	size_t padding = width > total ? width - total : 0;
+
+	if(length == 0 || padding + total + 1 > size) {
+		if(size > 0)
+			buf[0] = '\0';
+		return 0;
+	}
+
+	memset(buf, ' ', padding);
+	memcpy(buf + padding, text, length);
+	if(unitLength > 0)
+		memcpy(buf + padding + length, unit, unitLength);
+	buf[padding + total] = '\0';
+	return padding + total;
+}
@@ -0,0 +1,23 @@
+/*
+ * NumberFormat.h
+ */
+
+#ifndef NUMBERFORMAT_H_
+#define NUMBERFORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The most decimals of a formatted value, and the longest field with its sign and unit */
+#define FORMAT_MAX_DECIMALS			10
+#define FORMAT_MAX_DIGITS			24
+
+/* Function prototypes */
+size_t formatFixed(char *buf, const size_t size, const int64_t value, const unsigned int scale,
+		const unsigned int decimals, const char *unit, const unsigned int width);
+size_t formatFloat(char *buf, const size_t size, const float value, const unsigned int decimals,
+		const char *unit, const unsigned int width);
+size_t formatSignificant(char *buf, const size_t size, const float value, const unsigned int digits);
+size_t formatUnsigned(char *buf, const size_t size, const uint64_t value);
+
+#endif /* NUMBERFORMAT_H_ */
@@ -0,0 +1,561 @@
+/*
+ * Rollup.c
+ *
+ * Multi-resolution history. A low priority compaction thread rolls the raw samples up into 1 minute
+ * and hourly tiers and deletes the raw segments and the minute files when their retention ends.
+ * The tiers are flat files of fixed size records, one minute file per channel and UTC day and one
+ * hourly file per channel. The thread only reads the store, so ingest is never held up by it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "Rollup.h"
+
+/* I/O priority class idle, for ioprio_set() of the calling thread */
+#define IOPRIO_WHO_PROCESS			1
+#define IOPRIO_IDLE					(3 << 13)
+
+#define ROLLUP_READ_CHUNK			256
+
+/* Static function declarations */
+static void *rollupThread(void *arg);
+static void lowerPriority(void);
+static int loadWatermarks(rollup_store_t *rollups, const int channel);
+static int lastRecord(const int fd, rollup_record_t *record);
+static void compactChannel(rollup_store_t *rollups, const int channel, const uint64_t now);
+static int rollupMinutes(rollup_store_t *rollups, const int channel, const uint64_t end);
+static int rollupHours(rollup_store_t *rollups, const int channel, const uint64_t end);
+static int writeMinuteRecord(rollup_store_t *rollups, const int channel, const rollup_record_t *record);
+static void expireMinuteFiles(rollup_store_t *rollups, const uint64_t now);
+static void minutePath(const rollup_store_t *rollups, const int channel, const uint64_t day, char *path, size_t size);
+static void hourPath(const rollup_store_t *rollups, const int channel, char *path, size_t size);
+static int queryRaw(rollup_store_t *rollups, const int channel, const uint64_t from, const uint64_t to,
+		const uint64_t resolutionMs, rollup_record_t *buckets, size_t maxBuckets, size_t *count);
+static int queryTierFile(const char *path, const uint64_t tierMs, const uint64_t from, const uint64_t to,
+		const uint64_t resolutionMs, rollup_record_t *buckets, size_t maxBuckets, size_t *count);
+static int addBucket(rollup_record_t *buckets, size_t maxBuckets, size_t *count, const uint64_t start,
+		const series_summary_t *summary);
+
+/* The raw part of the queries is scanned on the scan pool, or by the querying thread if it is NULL */
+int startRollupCompaction(rollup_store_t *rollups, time_series_store_t *store, scan_pool_t *scans)
+{
+	int i, iret;
+
+	memset(rollups, 0, sizeof(*rollups));
+	rollups->store = store;
+	rollups->scans = scans;
+
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		rollups->channels[i].minuteFd = -1;
+		rollups->channels[i].hourFd = -1;
+		if(loadWatermarks(rollups, i) < 0) {
+			stopRollupCompaction(rollups);
+			return -1;
+		}
+	}
+
+	rollups->running = 1;
+	iret = pthread_create(&rollups->thread, NULL, rollupThread, (void*)rollups);
+	if(iret) {
+		fprintf(stderr, "Error - pthread_create() return code: %d\n", iret);
+		rollups->running = 0;
+		stopRollupCompaction(rollups);
+		return -1;
+	}
+	return 0;
+}
+
+int stopRollupCompaction(rollup_store_t *rollups)
+{
+	int i;
+
+	if(rollups->running) {
+		rollups->running = 0;
+		pthread_join(rollups->thread, NULL);
+	}
+
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		if(rollups->channels[i].minuteFd >= 0)
+			close(rollups->channels[i].minuteFd);
+		if(rollups->channels[i].hourFd >= 0)
+			close(rollups->channels[i].hourFd);
+		rollups->channels[i].minuteFd = -1;
+		rollups->channels[i].hourFd = -1;
+	}
+	return 0;
+}
+
+/* The coarsest tier fine enough for the resolution which still covers the start of the query */
+rollup_tier_t chooseRollupTier(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from,
+		const uint64_t resolutionMs)
+{
+	uint64_t rawFirst = timeSeriesFirstTimestamp(rollups->store, channel);
+	uint64_t minuteFirst = (timestampMs() / SUMMARY_DAY_MS - ROLLUP_MINUTE_RETENTION_DAYS) * SUMMARY_DAY_MS;
+	rollup_tier_t tier;
+
+	if(resolutionMs >= ROLLUP_HOUR_MS)
+		tier = ROLLUP_TIER_HOUR;
+	else if(resolutionMs >= ROLLUP_MINUTE_MS)
+		tier = ROLLUP_TIER_MINUTE;
+	else
+		tier = ROLLUP_TIER_RAW;
+
+	if(tier == ROLLUP_TIER_RAW && (rawFirst == 0 || from < rawFirst))
+		tier = ROLLUP_TIER_MINUTE;
+	if(tier == ROLLUP_TIER_MINUTE && from < minuteFirst)
+		tier = ROLLUP_TIER_HOUR;
+	return tier;
+}
+
+/*
+ * Summarizes [from, to) in buckets of the resolution, starting at multiples of it. Empty buckets are
+ * left out and the records of a rollup tier are taken whole. The part newer than the tier's watermark
+ * comes from the raw samples. Returns the number of buckets, at most maxBuckets, or -1 on failure.
+ */
+int queryRollups(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		const uint64_t resolutionMs, rollup_record_t *buckets, size_t maxBuckets)
+{
+	uint64_t resolution = resolutionMs > 0 ? resolutionMs : 1;
+	uint64_t watermark, end, day;
+	char path[TSDB_PATH_LENGTH + 32];
+	rollup_tier_t tier;
+	size_t count = 0;
+
+	if(channel >= NUMBER_OF_CHANNELS || from >= to)
+		return -1;
+
+	tier = chooseRollupTier(rollups, channel, from, resolution);
+	if(tier == ROLLUP_TIER_RAW)
+		return queryRaw(rollups, channel, from, to, resolution, buckets, maxBuckets, &count) < 0 ? -1 : (int)count;
+
+	if(tier == ROLLUP_TIER_MINUTE) {
+		watermark = __atomic_load_n(&rollups->channels[channel].minuteWatermark, __ATOMIC_ACQUIRE);
+		end = to < watermark ? to : watermark;
+
+		for(day = from / SUMMARY_DAY_MS ; from < end && day <= (end - 1) / SUMMARY_DAY_MS ; day++) {
+			minutePath(rollups, channel, day, path, sizeof(path));
+			if(queryTierFile(path, ROLLUP_MINUTE_MS, from, end, resolution, buckets, maxBuckets, &count) < 0)
+				return -1;
+		}
+	}
+	else {
+		watermark = __atomic_load_n(&rollups->channels[channel].hourWatermark, __ATOMIC_ACQUIRE);
+		end = to < watermark ? to : watermark;
+
+		hourPath(rollups, channel, path, sizeof(path));
+		if(from < end && queryTierFile(path, ROLLUP_HOUR_MS, from, end, resolution, buckets, maxBuckets, &count) < 0)
+			return -1;
+	}
+
+	/* Not rolled up yet */
+	if(to > watermark && queryRaw(rollups, channel, from > watermark ? from : watermark, to, resolution,
+			buckets, maxBuckets, &count) < 0)
+		return -1;
+
+	return (int)count;
+}
+
+static void *rollupThread(void *arg)
+{
+	rollup_store_t *rollups = (rollup_store_t*)arg;
+	const struct timespec step = { 0, 200000000L };
+	uint64_t lastPass = 0;
+	int i;
+
+	lowerPriority();
+
+	while(rollups->running)
+	{
+		uint64_t now = timestampMs();
+
+		if(now - lastPass >= ROLLUP_INTERVAL_MS) {
+			for(i = 0 ; i < NUMBER_OF_CHANNELS && rollups->running ; i++)
+				compactChannel(rollups, i, now);
+			expireMinuteFiles(rollups, now);
+			lastPass = now;
+		}
+		nanosleep(&step, NULL);
+	}
+	return NULL;
+}
+
+/* Compaction only gets the CPU and the card when nothing else wants them */
+static void lowerPriority(void)
+{
+	pid_t tid = (pid_t)syscall(SYS_gettid);
+
+	if(setpriority(PRIO_PROCESS, tid, 19) < 0)
+		perror("Could not lower the rollup thread priority");
+#ifdef SYS_ioprio_set
+	if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_IDLE) < 0)
+		perror("Could not lower the rollup thread I/O priority");
+#endif
+}
+
+/* Opens the hourly file and continues both tiers after their last records */
+static int loadWatermarks(rollup_store_t *rollups, const int channel)
+{
+	rollup_channel_t *state = &rollups->channels[channel];
+	char path[TSDB_PATH_LENGTH + 32];
+	rollup_record_t record;
+	uint64_t today = timestampMs() / SUMMARY_DAY_MS, day;
+	int fd;
+
+	hourPath(rollups, channel, path, sizeof(path));
+	state->hourFd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(state->hourFd < 0) {
+		perror("Could not open the hourly rollups");
+		return -1;
+	}
+	if(lastRecord(state->hourFd, &record) == 1)
+		state->hourWatermark = record.start + ROLLUP_HOUR_MS;
+
+	for(day = today + 1 ; day-- > today - ROLLUP_MINUTE_RETENTION_DAYS ; ) {
+		minutePath(rollups, channel, day, path, sizeof(path));
+		fd = open(path, O_RDWR);
+		if(fd < 0)
+			continue;
+
+		if(lastRecord(fd, &record) == 1) {
+			state->minuteWatermark = record.start + ROLLUP_MINUTE_MS;
+			close(fd);
+			break;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+/* Reads the last whole record of a tier file, a torn record from a crash is cut off. Returns 1 if there is one. */
+static int lastRecord(const int fd, rollup_record_t *record)
+{
+	struct stat status;
+	off_t records;
+
+	if(fstat(fd, &status) < 0)
+		return -1;
+
+	records = status.st_size / sizeof(rollup_record_t);
+	if(status.st_size % sizeof(rollup_record_t) != 0 && ftruncate(fd, records * sizeof(rollup_record_t)) < 0)
+		return -1;
+	if(records == 0)
+		return 0;
+
+	if(pread(fd, record, sizeof(*record), (records - 1) * sizeof(rollup_record_t)) != sizeof(*record))
+		return -1;
+	return 1;
+}
+
+static void compactChannel(rollup_store_t *rollups, const int channel, const uint64_t now)
+{
+	rollup_channel_t *state = &rollups->channels[channel];
+	uint64_t end = (now - ROLLUP_SETTLE_MS) / ROLLUP_MINUTE_MS * ROLLUP_MINUTE_MS;
+	uint64_t before = now - ROLLUP_RAW_RETENTION_MS;
+
+	if(rollupMinutes(rollups, channel, end) < 0 || rollupHours(rollups, channel, end) < 0)
+		return;
+
+	/* Raw samples go once they are old enough and in both tiers */
+	if(before > state->minuteWatermark)
+		before = state->minuteWatermark;
+	if(before > state->hourWatermark)
+		before = state->hourWatermark;
+	if(timeSeriesDropBefore(rollups->store, channel, before) > 0)
+		printf("Expired raw history of %s\n", channelName(channel));
+}
+
+static int rollupMinutes(rollup_store_t *rollups, const int channel, const uint64_t end)
+{
+	rollup_channel_t *state = &rollups->channels[channel];
+	uint64_t timestamps[ROLLUP_READ_CHUNK];
+	float values[ROLLUP_READ_CHUNK];
+	rollup_record_t record;
+	series_cursor_t cursor;
+	uint64_t start = state->minuteWatermark;
+	int samples, i, done = 0, written = 0;
+
+	if(start == 0)
+		start = timeSeriesFirstTimestamp(rollups->store, channel) / ROLLUP_MINUTE_MS * ROLLUP_MINUTE_MS;
+	if(start == 0 || start >= end)
+		return 0;
+
+	if(seekTimeSeries(rollups->store, channel, start, &cursor) < 0)
+		return -1;
+
+	memset(&record, 0, sizeof(record));
+	while(!done && (samples = readTimeSeries(&cursor, timestamps, values, ROLLUP_READ_CHUNK)) > 0) {
+		for(i = 0 ; i < samples ; i++) {
+			uint64_t minute = timestamps[i] / ROLLUP_MINUTE_MS * ROLLUP_MINUTE_MS;
+
+			if(timestamps[i] >= end) {
+				done = 1;
+				break;
+			}
+
+			if(record.summary.count > 0 && record.start != minute) {
+				if(writeMinuteRecord(rollups, channel, &record) < 0) {
+					closeTimeSeriesCursor(&cursor);
+					return -1;
+				}
+				written++;
+				memset(&record, 0, sizeof(record));
+			}
+			record.start = minute;
+			addSeriesSample(&record.summary, timestamps[i], values[i]);
+		}
+	}
+	closeTimeSeriesCursor(&cursor);
+
+	if(samples < 0)
+		return -1;
+	if(record.summary.count > 0) {
+		if(writeMinuteRecord(rollups, channel, &record) < 0)
+			return -1;
+		written++;
+	}
+
+	if(written > 0 && fdatasync(state->minuteFd) < 0) {
+		perror("fdatasync() of the minute rollups failed");
+		return -1;
+	}
+
+	__atomic_store_n(&state->minuteWatermark, end, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* The hours come from the summary index of the raw store, only the edge blocks of an hour are scanned */
+static int rollupHours(rollup_store_t *rollups, const int channel, const uint64_t end)
+{
+	rollup_channel_t *state = &rollups->channels[channel];
+	uint64_t hourEnd = end / ROLLUP_HOUR_MS * ROLLUP_HOUR_MS;
+	uint64_t first = timeSeriesFirstTimestamp(rollups->store, channel) / ROLLUP_HOUR_MS * ROLLUP_HOUR_MS;
+	uint64_t hour = state->hourWatermark;
+	rollup_record_t record;
+	int written = 0;
+
+	if(first == 0)
+		return 0;
+	if(hour < first)
+		hour = first;
+
+	for( ; hour < hourEnd ; hour += ROLLUP_HOUR_MS) {
+		record.start = hour;
+		if(timeSeriesAggregate(rollups->store, channel, hour, hour + ROLLUP_HOUR_MS, &record.summary) < 0)
+			return -1;
+		if(record.summary.count == 0)
+			continue;
+
+		if(write(state->hourFd, &record, sizeof(record)) != sizeof(record)) {
+			perror("Could not write the hourly rollups");
+			return -1;
+		}
+		written++;
+	}
+
+	if(written > 0 && fdatasync(state->hourFd) < 0) {
+		perror("fdatasync() of the hourly rollups failed");
+		return -1;
+	}
+
+	if(hourEnd > state->hourWatermark)
+		__atomic_store_n(&state->hourWatermark, hourEnd, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Appends a record to the minute file of its day, the file of the previous day is flushed and closed */
+static int writeMinuteRecord(rollup_store_t *rollups, const int channel, const rollup_record_t *record)
+{
+	rollup_channel_t *state = &rollups->channels[channel];
+	uint64_t day = record->start / SUMMARY_DAY_MS;
+	char path[TSDB_PATH_LENGTH + 32];
+
+	if(state->minuteFd < 0 || state->minuteFdDay != day) {
+		if(state->minuteFd >= 0) {
+			fdatasync(state->minuteFd);
+			close(state->minuteFd);
+		}
+
+		minutePath(rollups, channel, day, path, sizeof(path));
+		state->minuteFd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+		if(state->minuteFd < 0) {
+			perror("Could not open the minute rollups");
+			return -1;
+		}
+		state->minuteFdDay = day;
+	}
+
+	if(write(state->minuteFd, record, sizeof(*record)) != sizeof(*record)) {
+		perror("Could not write the minute rollups");
+		return -1;
+	}
+	return 0;
+}
+
+static void expireMinuteFiles(rollup_store_t *rollups, const uint64_t now)
+{
+	uint64_t oldest = now / SUMMARY_DAY_MS - ROLLUP_MINUTE_RETENTION_DAYS;
+	char path[TSDB_PATH_LENGTH + 32];
+	struct dirent *entry;
+	DIR *dir;
+
+	dir = opendir(rollups->store->directory);
+	if(dir == NULL)
+		return;
+
+	while((entry = readdir(dir)) != NULL) {
+		int channel;
+		unsigned int day;
+		char suffix[8];
+
+		if(sscanf(entry->d_name, "ch%d-1m-%5u.%7s", &channel, &day, suffix) != 3 ||
+				strcmp(suffix, "rollup") != 0 || day >= oldest)
+			continue;
+
+		minutePath(rollups, channel, day, path, sizeof(path));
+		if(unlink(path) < 0)
+			perror("Could not delete expired minute rollups");
+	}
+	closedir(dir);
+}
+
+static void minutePath(const rollup_store_t *rollups, const int channel, const uint64_t day, char *path, size_t size)
+{
+	snprintf(path, size, "%s/ch%d-1m-%05u.rollup", rollups->store->directory, channel, (unsigned int)day);
+}
+
+static void hourPath(const rollup_store_t *rollups, const int channel, char *path, size_t size)
+{
+	snprintf(path, size, "%s/ch%d-1h.rollup", rollups->store->directory, channel);
+}
+
+static int queryRaw(rollup_store_t *rollups, const int channel, const uint64_t from, const uint64_t to,
+		const uint64_t resolutionMs, rollup_record_t *buckets, size_t maxBuckets, size_t *count)
+{
+	uint64_t timestamps[ROLLUP_READ_CHUNK];
+	float values[ROLLUP_READ_CHUNK];
+	series_cursor_t cursor;
+	series_summary_t sample;
+	series_bucket_t *scanned;
+	int samples, i;
+
+	if(*count >= maxBuckets)
+		return 0;
+
+	/* One bucket more than there is room for, the first may merge into the last of the tier */
+	if(rollups->scans != NULL) {
+		scanned = malloc((maxBuckets - *count + 1) * sizeof(series_bucket_t));
+		if(scanned == NULL)
+			return -1;
+
+		samples = scanTimeSeriesBuckets(rollups->scans, rollups->store, channel, from, to, resolutionMs,
+				scanned, maxBuckets - *count + 1);
+		for(i = 0 ; i < samples ; i++) {
+			if(addBucket(buckets, maxBuckets, count, scanned[i].start, &scanned[i].summary) < 0)
+				break;
+		}
+		free(scanned);
+		return samples < 0 ? -1 : 0;
+	}
+
+	if(seekTimeSeries(rollups->store, channel, from, &cursor) < 0)
+		return -1;
+
+	while((samples = readTimeSeries(&cursor, timestamps, values, ROLLUP_READ_CHUNK)) > 0) {
+		for(i = 0 ; i < samples ; i++) {
+			if(timestamps[i] >= to) {
+				closeTimeSeriesCursor(&cursor);
+				return 0;
+			}
+
+			sample.count = 0;
+			addSeriesSample(&sample, timestamps[i], values[i]);
+			if(addBucket(buckets, maxBuckets, count, timestamps[i] / resolutionMs * resolutionMs, &sample) < 0) {
+				closeTimeSeriesCursor(&cursor);
+				return 0;
+			}
+		}
+	}
+	closeTimeSeriesCursor(&cursor);
+	return samples < 0 ? -1 : 0;
+}
+
+/* Merges the records of a tier file in [from, to) into the buckets, a missing file is an empty one */
+static int queryTierFile(const char *path, const uint64_t tierMs, const uint64_t from, const uint64_t to,
+		const uint64_t resolutionMs, rollup_record_t *buckets, size_t maxBuckets, size_t *count)
+{
+	rollup_record_t records[ROLLUP_READ_CHUNK / 4];
+	uint64_t first = from / tierMs * tierMs;
+	struct stat status;
+	off_t low, high;
+	ssize_t bytes;
+	int fd, i, n;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return errno == ENOENT ? 0 : -1;
+	if(fstat(fd, &status) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* Binary search of the first record of the range */
+	low = 0;
+	high = status.st_size / sizeof(rollup_record_t);
+	while(low < high) {
+		off_t middle = low + (high - low) / 2;
+		uint64_t start;
+
+		if(pread(fd, &start, sizeof(start), middle * sizeof(rollup_record_t)) != sizeof(start)) {
+			close(fd);
+			return -1;
+		}
+		if(start < first)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	while((bytes = pread(fd, records, sizeof(records), low * sizeof(rollup_record_t))) > 0) {
+		n = bytes / sizeof(rollup_record_t);
+		if(n == 0)
+			break;
+
+		for(i = 0 ; i < n ; i++) {
+			if(records[i].start >= to ||
+					addBucket(buckets, maxBuckets, count, records[i].start / resolutionMs * resolutionMs, &records[i].summary) < 0) {
+				close(fd);
+				return 0;
+			}
+		}
+		low += n;
+	}
+	close(fd);
+	return bytes < 0 ? -1 : 0;
+}
+
+/* Merges a summary into the last bucket or starts a new one. Returns -1 when the buckets are full. */
+static int addBucket(rollup_record_t *buckets, size_t maxBuckets, size_t *count, const uint64_t start,
+		const series_summary_t *summary)
+{
+	if(*count > 0 && buckets[*count - 1].start == start) {
+		mergeSeriesSummary(&buckets[*count - 1].summary, summary);
+		return 0;
+	}
+
+	if(*count >= maxBuckets)
+		return -1;
+
+	buckets[*count].start = start;
+	memset(&buckets[*count].summary, 0, sizeof(series_summary_t));
+	mergeSeriesSummary(&buckets[*count].summary, summary);
+	(*count)++;
+	return 0;
+}
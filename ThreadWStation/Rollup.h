@@ -0,0 +1,65 @@
+/*
+ * Rollup.h
+ */
+
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+#include <stdint.h>
+#include "thread.h"
+#include "TimeSeriesStore.h"
+#include "SeriesScan.h"
+
+/* Retention: raw samples for 48 hours, 1 minute rollups for 90 days and hourly rollups forever */
+#define ROLLUP_MINUTE_MS			60000ULL
+#define ROLLUP_HOUR_MS				SUMMARY_HOUR_MS
+#define ROLLUP_RAW_RETENTION_MS		(48 * SUMMARY_HOUR_MS)
+#define ROLLUP_MINUTE_RETENTION_DAYS	90
+
+/* Compaction runs once a minute and leaves the newest samples time to reach the store */
+#define ROLLUP_INTERVAL_MS			60000
+#define ROLLUP_SETTLE_MS			10000
+
+/* Resolutions of the stored tiers, a query is answered from the coarsest tier fine enough */
+typedef enum
+{
+	ROLLUP_TIER_RAW					= 0,
+	ROLLUP_TIER_MINUTE				= 1,
+	ROLLUP_TIER_HOUR				= 2,
+} rollup_tier_t;
+
+/* One bucket of a tier file, or of a query result */
+typedef struct rollup_record
+{
+	uint64_t start;
+	series_summary_t summary;
+} rollup_record_t;
+
+/* Compaction progress of a channel: everything before the watermarks is rolled up */
+typedef struct rollup_channel
+{
+	uint64_t minuteWatermark;
+	uint64_t hourWatermark;
+	int minuteFd;
+	uint64_t minuteFdDay;
+	int hourFd;
+} rollup_channel_t;
+
+typedef struct rollup_store
+{
+	time_series_store_t *store;
+	scan_pool_t *scans;
+	rollup_channel_t channels[NUMBER_OF_CHANNELS];
+	pthread_t thread;
+	volatile int running;
+} rollup_store_t;
+
+/* Function prototypes */
+int startRollupCompaction(rollup_store_t *rollups, time_series_store_t *store, scan_pool_t *scans);
+int stopRollupCompaction(rollup_store_t *rollups);
+rollup_tier_t chooseRollupTier(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from,
+		const uint64_t resolutionMs);
+int queryRollups(rollup_store_t *rollups, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		const uint64_t resolutionMs, rollup_record_t *buckets, size_t maxBuckets);
+
+#endif /* ROLLUP_H_ */
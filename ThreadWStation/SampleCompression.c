@@ -0,0 +1,283 @@
+/*
+ * SampleCompression.c
+ *
+ * Compact encoding of a channel's samples for history transfers and streaming over slow links.
+ * Timestamps are stored as delta-of-delta and the float values as XOR against the previous value
+ * (the Gorilla scheme). A sensor sampled at a steady rate costs one bit per timestamp and an unchanged
+ * value costs one bit, a small change typically 10-20 bits.
+ */
+#include <string.h>
+#include "SampleCompression.h"
+
+/* Static function declarations */
+static int writeBits(bit_writer_t *writer, uint64_t value, unsigned int bits);
+static int readBits(bit_reader_t *reader, unsigned int bits, uint64_t *value);
+static int64_t signExtend(uint64_t value, unsigned int bits);
+static int writeTimestamp(compressed_block_encoder_t *encoder, const int64_t deltaOfDelta);
+static int writeValue(compressed_block_encoder_t *encoder, const uint32_t value);
+
+int beginCompressedBlock(compressed_block_encoder_t *encoder, unsigned char *buffer, size_t capacity)
+{
+	if(capacity < COMPRESSED_BLOCK_HEADER_SIZE)
+		return -1;
+
+	memset(encoder, 0, sizeof(*encoder));
+	encoder->writer.buffer = buffer;
+	encoder->writer.capacity = capacity;
+	encoder->writer.bitLength = COMPRESSED_BLOCK_HEADER_SIZE * 8;
+
+	/* No previous leading/trailing zero window yet */
+	encoder->previousLeading = 0xFF;
+	return 0;
+}
+
+/*
+ * Appends one sample to the block. Returns -1 if the block is full, the buffer is too small or the
+ * timestamp jumped too far; the block is left as it was so it can be finished and a new one begun.
+ */
+int appendCompressedSample(compressed_block_encoder_t *encoder, const uint64_t timestamp, const float value)
+{
+	compressed_block_encoder_t saved = *encoder;
+	uint32_t rawValue;
+	int64_t delta;
+
+	if(encoder->count >= COMPRESSED_BLOCK_MAX_SAMPLES)
+		return -1;
+
+	memcpy(&rawValue, &value, sizeof(rawValue));
+
+	if(encoder->count == 0) {
+		if(writeBits(&encoder->writer, timestamp, 64) < 0 || writeBits(&encoder->writer, rawValue, 32) < 0) {
+			*encoder = saved;
+			return -1;
+		}
+	}
+	else {
+		delta = (int64_t)(timestamp - encoder->previousTimestamp);
+		if(writeTimestamp(encoder, delta - encoder->previousDelta) < 0 || writeValue(encoder, rawValue) < 0) {
+			*encoder = saved;
+			return -1;
+		}
+		encoder->previousDelta = delta;
+	}
+
+	encoder->previousTimestamp = timestamp;
+	encoder->previousValue = rawValue;
+	encoder->count++;
+	return 0;
+}
+
+/* Writes the sample count and returns the length of the block in bytes */
+size_t finishCompressedBlock(compressed_block_encoder_t *encoder)
+{
+	encoder->writer.buffer[0] = encoder->count >> 8;
+	encoder->writer.buffer[1] = encoder->count;
+
+	return (encoder->writer.bitLength + 7) / 8;
+}
+
+/*
+ * Decodes a block into the timestamp and value arrays.
+ * Returns the number of samples or -1 if the block is malformed or doesn't fit the arrays.
+ */
+int decodeCompressedBlock(const unsigned char *buffer, size_t length, uint64_t *timestamps, float *values, size_t maxSamples)
+{
+	bit_reader_t reader;
+	uint64_t bits, timestamp;
+	int64_t delta = 0;
+	uint32_t rawValue, xorValue;
+	unsigned int count, i, leading = 0, meaningful = 0;
+
+	if(length < COMPRESSED_BLOCK_HEADER_SIZE)
+		return -1;
+
+	count = (unsigned int)buffer[0] << 8 | buffer[1];
+	if(count > maxSamples)
+		return -1;
+	if(count == 0)
+		return 0;
+
+	reader.buffer = buffer;
+	reader.bitLength = length * 8;
+	reader.bitOffset = COMPRESSED_BLOCK_HEADER_SIZE * 8;
+
+	if(readBits(&reader, 64, &timestamp) < 0 || readBits(&reader, 32, &bits) < 0)
+		return -1;
+
+	rawValue = (uint32_t)bits;
+	timestamps[0] = timestamp;
+	memcpy(&values[0], &rawValue, sizeof(float));
+
+	for(i = 1 ; i < count ; i++) {
+
+		/* Delta-of-delta timestamp: 0, 10 + 7 bits, 110 + 9 bits, 1110 + 12 bits or 1111 + 32 bits */
+		unsigned int prefix = 0;
+		int64_t deltaOfDelta = 0;
+		static const unsigned int timestampBits[] = { 0, 7, 9, 12, 32 };
+
+		while(prefix < 4) {
+			if(readBits(&reader, 1, &bits) < 0)
+				return -1;
+			if(bits == 0)
+				break;
+			prefix++;
+		}
+		if(prefix > 0) {
+			if(readBits(&reader, timestampBits[prefix], &bits) < 0)
+				return -1;
+			deltaOfDelta = signExtend(bits, timestampBits[prefix]);
+		}
+		delta += deltaOfDelta;
+		timestamp += delta;
+		timestamps[i] = timestamp;
+
+		/* XOR value: 0 unchanged, 10 within the previous window, 11 + 5 bits leading + 6 bits length */
+		if(readBits(&reader, 1, &bits) < 0)
+			return -1;
+
+		if(bits == 1) {
+			if(readBits(&reader, 1, &bits) < 0)
+				return -1;
+
+			if(bits == 1) {
+				uint64_t leadingBits, lengthBits;
+
+				if(readBits(&reader, 5, &leadingBits) < 0 || readBits(&reader, 6, &lengthBits) < 0)
+					return -1;
+				leading = (unsigned int)leadingBits;
+				meaningful = (unsigned int)lengthBits;
+				if(meaningful == 0 || leading + meaningful > 32)
+					return -1;
+			}
+			else if(meaningful == 0)
+				return -1;
+
+			if(readBits(&reader, meaningful, &bits) < 0)
+				return -1;
+			xorValue = (uint32_t)(bits << (32 - leading - meaningful));
+			rawValue ^= xorValue;
+		}
+		memcpy(&values[i], &rawValue, sizeof(float));
+	}
+	return (int)count;
+}
+
+static int writeTimestamp(compressed_block_encoder_t *encoder, const int64_t deltaOfDelta)
+{
+	uint64_t prefix;
+	unsigned int prefixBits, bits;
+
+	if(deltaOfDelta == 0)
+		return writeBits(&encoder->writer, 0x00, 1);
+
+	if(deltaOfDelta >= -64 && deltaOfDelta <= 63) {
+		prefix = 0x02; prefixBits = 2; bits = 7;
+	}
+	else if(deltaOfDelta >= -256 && deltaOfDelta <= 255) {
+		prefix = 0x06; prefixBits = 3; bits = 9;
+	}
+	else if(deltaOfDelta >= -2048 && deltaOfDelta <= 2047) {
+		prefix = 0x0E; prefixBits = 4; bits = 12;
+	}
+	else if(deltaOfDelta >= INT32_MIN && deltaOfDelta <= INT32_MAX) {
+		prefix = 0x0F; prefixBits = 4; bits = 32;
+	}
+	else {
+		/* The gap is too large for this block */
+		return -1;
+	}
+
+	if(writeBits(&encoder->writer, prefix, prefixBits) < 0 || writeBits(&encoder->writer, (uint64_t)deltaOfDelta, bits) < 0)
+		return -1;
+	return 0;
+}
+
+static int writeValue(compressed_block_encoder_t *encoder, const uint32_t value)
+{
+	uint32_t xorValue = value ^ encoder->previousValue;
+	unsigned int leading, trailing, meaningful;
+
+	if(xorValue == 0)
+		return writeBits(&encoder->writer, 0x00, 1);
+
+	leading = __builtin_clz(xorValue);
+	trailing = __builtin_ctz(xorValue);
+	if(leading > 31)
+		leading = 31;
+
+	/* The changed bits fit in the window of the previous value */
+	if(encoder->previousLeading != 0xFF && leading >= encoder->previousLeading && trailing >= encoder->previousTrailing) {
+		meaningful = 32 - encoder->previousLeading - encoder->previousTrailing;
+		if(writeBits(&encoder->writer, 0x02, 2) < 0 ||
+				writeBits(&encoder->writer, xorValue >> encoder->previousTrailing, meaningful) < 0)
+			return -1;
+		return 0;
+	}
+
+	meaningful = 32 - leading - trailing;
+	encoder->previousLeading = leading;
+	encoder->previousTrailing = trailing;
+
+	if(writeBits(&encoder->writer, 0x03, 2) < 0 || writeBits(&encoder->writer, leading, 5) < 0 ||
+			writeBits(&encoder->writer, meaningful, 6) < 0 || writeBits(&encoder->writer, xorValue >> trailing, meaningful) < 0)
+		return -1;
+	return 0;
+}
+
+/* Writes the lowest bits of the value, most significant bit first */
+static int writeBits(bit_writer_t *writer, uint64_t value, unsigned int bits)
+{
+	if(writer->bitLength + bits > writer->capacity * 8)
+		return -1;
+
+	while(bits > 0) {
+		size_t byteIndex = writer->bitLength / 8;
+		unsigned int bitIndex = writer->bitLength % 8;
+		unsigned int chunk = 8 - bitIndex;
+		unsigned char byte;
+
+		if(chunk > bits)
+			chunk = bits;
+
+		byte = (unsigned char)((value >> (bits - chunk)) & ((1U << chunk) - 1));
+		if(bitIndex == 0)
+			writer->buffer[byteIndex] = 0;
+		writer->buffer[byteIndex] |= byte << (8 - bitIndex - chunk);
+
+		writer->bitLength += chunk;
+		bits -= chunk;
+	}
+	return 0;
+}
+
+static int readBits(bit_reader_t *reader, unsigned int bits, uint64_t *value)
+{
+	uint64_t result = 0;
+
+	if(reader->bitOffset + bits > reader->bitLength)
+		return -1;
+
+	while(bits > 0) {
+		size_t byteIndex = reader->bitOffset / 8;
+		unsigned int bitIndex = reader->bitOffset % 8;
+		unsigned int chunk = 8 - bitIndex;
+
+		if(chunk > bits)
+			chunk = bits;
+
+		result = (result << chunk) | ((reader->buffer[byteIndex] >> (8 - bitIndex - chunk)) & ((1U << chunk) - 1));
+		reader->bitOffset += chunk;
+		bits -= chunk;
+	}
+
+	*value = result;
+	return 0;
+}
+
+static int64_t signExtend(uint64_t value, unsigned int bits)
+{
+	uint64_t signBit = 1ULL << (bits - 1);
+
+	value &= (signBit << 1) - 1;
+	return (int64_t)((value ^ signBit) - signBit);
+}
@@ -0,0 +1,53 @@
+/*
+ * SampleCompression.h
+ */
+
+#ifndef SAMPLECOMPRESSION_H_
+#define SAMPLECOMPRESSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A block starts with a 2 byte sample count followed by the bit stream */
+#define COMPRESSED_BLOCK_HEADER_SIZE	2
+#define COMPRESSED_BLOCK_MAX_SAMPLES	65535
+
+/* Worst case size of a compressed block: 64+32 bits for the first sample and 36+45 bits for the rest */
+#define COMPRESSED_BLOCK_MAX_SIZE(samples) (COMPRESSED_BLOCK_HEADER_SIZE + 12 + ((samples) * 81 + 7) / 8)
+
+typedef struct bit_writer
+{
+	unsigned char *buffer;
+	size_t capacity;
+	size_t bitLength;
+} bit_writer_t;
+
+typedef struct bit_reader
+{
+	const unsigned char *buffer;
+	size_t bitLength;
+	size_t bitOffset;
+} bit_reader_t;
+
+/*
+ * Encodes one channel into a block: delta-of-delta timestamps and XOR'd float values.
+ * Slowly changing weather values compress to a few bits per sample.
+ */
+typedef struct compressed_block_encoder
+{
+	bit_writer_t writer;
+	unsigned int count;
+	uint64_t previousTimestamp;
+	int64_t previousDelta;
+	uint32_t previousValue;
+	unsigned int previousLeading;
+	unsigned int previousTrailing;
+} compressed_block_encoder_t;
+
+/* Function prototypes */
+int beginCompressedBlock(compressed_block_encoder_t *encoder, unsigned char *buffer, size_t capacity);
+int appendCompressedSample(compressed_block_encoder_t *encoder, const uint64_t timestamp, const float value);
+size_t finishCompressedBlock(compressed_block_encoder_t *encoder);
+int decodeCompressedBlock(const unsigned char *buffer, size_t length, uint64_t *timestamps, float *values, size_t maxSamples);
+
+#endif /* SAMPLECOMPRESSION_H_ */
@@ -0,0 +1,206 @@
+/*
+ * SamplePublisher.c
+ *
+ * The acquisition threads publish every reading here. Readings inside the channel's deadband are
+ * dropped, the rest become the channel's latest published sample which the subscribers pick up.
+ * Every reading, filtered or not, also goes into the channel's windowed extremes and statistics.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "SamplePublisher.h"
+
+/* Deadbands of the channels, about the noise of each sensor */
+static const deadband_config_t deadbandConfigs[NUMBER_OF_CHANNELS] =
+{
+	[CHANNEL_MPL3115A2_TEMPERATURE]	= { 0.125f,	0.0f,	PUBLISH_MAX_SILENCE_MS },	/* 2 LSB of 1/16 C */
+	[CHANNEL_PRESSURE]				= { 0.05f,	0.0f,	PUBLISH_MAX_SILENCE_MS },	/* hPa */
+	[CHANNEL_ALTITUDE]				= { 0.5f,	0.0f,	PUBLISH_MAX_SILENCE_MS },	/* m */
+	[CHANNEL_TMP36_TEMPERATURE]		= { 0.5f,	0.0f,	PUBLISH_MAX_SILENCE_MS },	/* 1.5 LSB of the ADC */
+	[CHANNEL_HUMIDITY]				= { 0.5f,	0.01f,	PUBLISH_MAX_SILENCE_MS },	/* %RH */
+};
+
+/* Static local filters, latest published samples and aggregates, guarded by the publish mutex */
+static publisher_state_t g_state;
+static pthread_mutex_t g_publishMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Static local history writer of the published samples, NULL when the history is disabled */
+static history_writer_t *g_history = NULL;
+
+/* Static local rollup tiers of the history, NULL when the compaction isn't running */
+static rollup_store_t *g_rollups = NULL;
+
+int initSamplePublisher(history_writer_t *history)
+{
+	int i, window;
+
+	pthread_mutex_lock(&g_publishMutex);
+	g_history = history;
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		initDeadbandFilter(&g_state.filters[i], &deadbandConfigs[i]);
+		g_state.published[i].timestamp = 0;
+		g_state.published[i].value = 0.0f;
+		g_state.published[i].sequence = 0;
+		for(window = 0 ; window < NUMBER_OF_EXTREMES_WINDOWS ; window++)
+			initWindowedExtremes(&g_state.extremes[i][window], extremesWindowLength(window));
+		for(window = 0 ; window < NUMBER_OF_STATS_WINDOWS ; window++)
+			initWindowStats(&g_state.stats[i][window], statsWindowLength(window));
+		initEwmaStats(&g_state.ewma[i]);
+	}
+	pthread_mutex_unlock(&g_publishMutex);
+	return 0;
+}
+
+/* Returns 1 if the reading was a significant change and got published, 0 if it was filtered out */
+int publishSample(const sensor_channel_t channel, const uint64_t timestamp, const float value)
+{
+	int published = 0;
+	int window;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	pthread_mutex_lock(&g_publishMutex);
+	for(window = 0 ; window < NUMBER_OF_EXTREMES_WINDOWS ; window++)
+		updateWindowedExtremes(&g_state.extremes[channel][window], timestamp, value);
+	for(window = 0 ; window < NUMBER_OF_STATS_WINDOWS ; window++)
+		updateWindowStats(&g_state.stats[channel][window], timestamp, value);
+	updateEwmaStats(&g_state.ewma[channel], timestamp, value);
+
+	if(deadbandFilterPass(&g_state.filters[channel], timestamp, value)) {
+		g_state.published[channel].timestamp = timestamp;
+		g_state.published[channel].value = value;
+		g_state.published[channel].sequence++;
+		published = 1;
+	}
+	pthread_mutex_unlock(&g_publishMutex);
+
+	if(published && g_history != NULL)
+		historyWriterEnqueue(g_history, channel, timestamp, value);
+
+	return published;
+}
+
+/* Returns 0 when the channel has published something and -1 otherwise */
+int latestPublishedSample(const sensor_channel_t channel, published_sample_t *sample)
+{
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	pthread_mutex_lock(&g_publishMutex);
+	*sample = g_state.published[channel];
+	pthread_mutex_unlock(&g_publishMutex);
+
+	return sample->sequence > 0 ? 0 : -1;
+}
+
+/* Min and max of the channel's readings over the window up to now, -1 when there were none */
+int readWindowedExtremes(const sensor_channel_t channel, const extremes_window_t window, float *min, float *max)
+{
+	int ret;
+
+	if(channel >= NUMBER_OF_CHANNELS || window >= NUMBER_OF_EXTREMES_WINDOWS)
+		return -1;
+
+	pthread_mutex_lock(&g_publishMutex);
+	ret = getWindowedExtremes(&g_state.extremes[channel][window], timestampMs(), min, max);
+	pthread_mutex_unlock(&g_publishMutex);
+
+	return ret;
+}
+
+/* All windows of all channels at the same instant */
+void snapshotWindowedExtremes(extremes_value_t extremes[NUMBER_OF_EXTREMES_WINDOWS][NUMBER_OF_CHANNELS])
+{
+	uint64_t now = timestampMs();
+	int window, channel;
+
+	pthread_mutex_lock(&g_publishMutex);
+	for(window = 0 ; window < NUMBER_OF_EXTREMES_WINDOWS ; window++) {
+		for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+			extremes_value_t *value = &extremes[window][channel];
+
+			value->valid = getWindowedExtremes(&g_state.extremes[channel][window], now, &value->min, &value->max) == 0;
+		}
+	}
+	pthread_mutex_unlock(&g_publishMutex);
+}
+
+/* Statistics of the channel's readings over the window up to now, -1 when there were none. The EWMAs are always filled. */
+int readChannelStatistics(const sensor_channel_t channel, const stats_window_t window, stats_snapshot_t *snapshot)
+{
+	int ret = -1;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	pthread_mutex_lock(&g_publishMutex);
+	snapshot->valid = 0;
+	if(window < NUMBER_OF_STATS_WINDOWS)
+		ret = getWindowStats(&g_state.stats[channel][window], timestampMs(), snapshot);
+	getEwmaStats(&g_state.ewma[channel], snapshot);
+	pthread_mutex_unlock(&g_publishMutex);
+
+	return ret;
+}
+
+/* Copies the whole state at one instant, for a checkpoint */
+void savePublisherState(publisher_state_t *state)
+{
+	pthread_mutex_lock(&g_publishMutex);
+	memcpy(state, &g_state, sizeof(*state));
+	pthread_mutex_unlock(&g_publishMutex);
+}
+
+/* Takes over a checkpointed state. The deadbands keep the current configuration and the counters start from zero. */
+void restorePublisherState(const publisher_state_t *state)
+{
+	int i;
+
+	pthread_mutex_lock(&g_publishMutex);
+	memcpy(&g_state, state, sizeof(g_state));
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		g_state.filters[i].config = deadbandConfigs[i];
+		g_state.filters[i].samplesSeen = 0;
+		g_state.filters[i].samplesPassed = 0;
+	}
+	pthread_mutex_unlock(&g_publishMutex);
+}
+
+/* The store holding the published samples, NULL when the history is disabled */
+time_series_store_t *publishedHistory(void)
+{
+	return g_history != NULL ? g_history->store : NULL;
+}
+
+/* The crash window and the flush statistics of the history writer, -1 when the history is disabled */
+int readPublishedHistoryStatus(history_writer_status_t *status)
+{
+	if(g_history == NULL)
+		return -1;
+
+	readHistoryWriterStatus(g_history, status);
+	return 0;
+}
+
+void setPublishedRollups(rollup_store_t *rollups)
+{
+	g_rollups = rollups;
+}
+
+/* The rollup tiers over the published history, NULL when there are none */
+rollup_store_t *publishedRollups(void)
+{
+	return g_rollups;
+}
+
+void printPublisherStatistics(void)
+{
+	int i;
+
+	pthread_mutex_lock(&g_publishMutex);
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		printf("%-22s readings: %8u published: %8u\n", channelName(i),
+				g_state.filters[i].samplesSeen, g_state.filters[i].samplesPassed);
+	}
+	pthread_mutex_unlock(&g_publishMutex);
+}
@@ -0,0 +1,52 @@
+/*
+ * SamplePublisher.h
+ */
+
+#ifndef SAMPLEPUBLISHER_H_
+#define SAMPLEPUBLISHER_H_
+
+#include <stdint.h>
+#include "thread.h"
+#include "HistoryWriter.h"
+#include "Deadband.h"
+#include "WindowedExtremes.h"
+#include "StreamingStats.h"
+#include "Rollup.h"
+
+/* Heartbeat: a value is published at least this often even if it didn't change */
+#define PUBLISH_MAX_SILENCE_MS		60000
+
+/* The latest published sample of a channel, the sequence grows on every publish */
+typedef struct published_sample
+{
+	uint64_t timestamp;
+	float value;
+	uint32_t sequence;
+} published_sample_t;
+
+/* Everything the publisher keeps in memory, plain data so a checkpoint can copy it as it is */
+typedef struct publisher_state
+{
+	deadband_filter_t filters[NUMBER_OF_CHANNELS];
+	published_sample_t published[NUMBER_OF_CHANNELS];
+	windowed_extremes_t extremes[NUMBER_OF_CHANNELS][NUMBER_OF_EXTREMES_WINDOWS];
+	window_stats_t stats[NUMBER_OF_CHANNELS][NUMBER_OF_STATS_WINDOWS];
+	ewma_stats_t ewma[NUMBER_OF_CHANNELS];
+} publisher_state_t;
+
+/* Function prototypes */
+int initSamplePublisher(history_writer_t *history);
+int publishSample(const sensor_channel_t channel, const uint64_t timestamp, const float value);
+int latestPublishedSample(const sensor_channel_t channel, published_sample_t *sample);
+int readWindowedExtremes(const sensor_channel_t channel, const extremes_window_t window, float *min, float *max);
+void snapshotWindowedExtremes(extremes_value_t extremes[NUMBER_OF_EXTREMES_WINDOWS][NUMBER_OF_CHANNELS]);
+int readChannelStatistics(const sensor_channel_t channel, const stats_window_t window, stats_snapshot_t *snapshot);
+void savePublisherState(publisher_state_t *state);
+void restorePublisherState(const publisher_state_t *state);
+time_series_store_t *publishedHistory(void);
+int readPublishedHistoryStatus(history_writer_status_t *status);
+void setPublishedRollups(rollup_store_t *rollups);
+rollup_store_t *publishedRollups(void);
+void printPublisherStatistics(void);
+
+#endif /* SAMPLEPUBLISHER_H_ */
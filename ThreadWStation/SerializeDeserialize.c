@@ -5,6 +5,14 @@
  * network interface.
  */
 #include "SerializeDeserialize.h"
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* Static function declarations */
+static void swapFloatBytes(unsigned char *out, const unsigned char *in, size_t count);
+static unsigned int pack754(float f, unsigned int bits, unsigned int expbits);
+static float unpack754(unsigned int f, unsigned int bits, unsigned int expbits);
 
 unsigned char *serializeInt(unsigned char *buffer, int value)
 {
@@ -19,7 +27,7 @@ unsigned char *serializeInt(unsigned char *buffer, int value)
 
 unsigned char *serializeFloat(unsigned char *buffer, float FloatValue)
 {
-	int value;
+	uint32_t value;
 
 	value = Serialize754_32(FloatValue);
 
@@ -31,7 +39,83 @@ unsigned char *serializeFloat(unsigned char *buffer, float FloatValue)
     return buffer + 4;
 }
 
+float deserializeFloat(const unsigned char *buffer)
+{
+	uint32_t value;
+
+	value = (uint32_t)buffer[0] << 24 | (uint32_t)buffer[1] << 16 | (uint32_t)buffer[2] << 8 | buffer[3];
+
+	return Deserialize754_32(value);
+}
+
+/*
+ * Writes the floats as big-endian IEEE 754 values. The floats are already in IEEE 754 format in
+ * memory so only the byte order is swapped, four values at a time with NEON.
+ */
+unsigned char *serializeFloatArray(unsigned char *buffer, const float *values, size_t count)
+{
+	swapFloatBytes(buffer, (const unsigned char *)values, count);
+	return buffer + count * 4;
+}
+
+/* Reads big-endian IEEE 754 values written by serializeFloatArray() */
+const unsigned char *deserializeFloatArray(float *values, const unsigned char *buffer, size_t count)
+{
+	swapFloatBytes((unsigned char *)values, buffer, count);
+	return buffer + count * 4;
+}
+
+/*
+ * The bit pattern of a 32bit float is its IEEE 754 encoding, so it's copied as it is. Denormals,
+ * infinities and NaN keep their encoding. Other sizes go through the slow normalizing loop.
+ */
 unsigned int Serialize754Float(float f, unsigned int bits, unsigned int expbits)
+{
+	if(bits == 32 && expbits == 8) {
+		uint32_t value;
+		memcpy(&value, &f, sizeof(value));
+		return value;
+	}
+	return pack754(f, bits, expbits);
+}
+
+float Deserialize754Float(unsigned int f, unsigned int bits, unsigned int expbits)
+{
+	if(bits == 32 && expbits == 8) {
+		uint32_t value = f;
+		float result;
+		memcpy(&result, &value, sizeof(result));
+		return result;
+	}
+	return unpack754(f, bits, expbits);
+}
+
+/*
+ * Swaps the byte order of every 4 byte value when the CPU is little-endian. The input and output
+ * may be the same buffer.
+ */
+static void swapFloatBytes(unsigned char *out, const unsigned char *in, size_t count)
+{
+	size_t i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	memmove(out, in, count * 4);
+#else
+#ifdef __ARM_NEON
+	for( ; i + 4 <= count ; i += 4) {
+		vst1q_u8(out + i * 4, vrev32q_u8(vld1q_u8(in + i * 4)));
+	}
+#endif
+	for( ; i < count ; i++) {
+		uint32_t value;
+		memcpy(&value, in + i * 4, sizeof(value));
+		value = __builtin_bswap32(value);
+		memcpy(out + i * 4, &value, sizeof(value));
+	}
+#endif
+}
+
+static unsigned int pack754(float f, unsigned int bits, unsigned int expbits)
 {
     float fnorm;
     int shift;
@@ -72,7 +156,7 @@ unsigned int Serialize754Float(float f, unsigned int bits, unsigned int expbits)
     return (sign<<(bits-1)) | (exp<<(bits-expbits-1)) | significand;
 }
 
-float Deserialize754Float(unsigned int f, unsigned int bits, unsigned int expbits)
+static float unpack754(unsigned int f, unsigned int bits, unsigned int expbits)
 {
 	float result;
 	int shift;
@@ -119,3 +203,29 @@ unsigned char *serializeStruct2(unsigned char *buffer, const thread_data_t *Data
 	buffer = serializeFloat(buffer, Data->maxHumidity);
 	return buffer;
 }
+
+unsigned char *serializeStruct3(unsigned char *buffer, const thread_data_t *Data)
+{
+	buffer = serializeFloat(buffer, Data->pressure);
+	buffer = serializeFloat(buffer, Data->altitude);
+	buffer = serializeFloat(buffer, Data->TMP36temperature);
+	return buffer;
+}
+
+/*
+ * Serializes several datasets into one response. The first byte tells which datasets follow
+ * and they are written in the order of their bits.
+ */
+unsigned char *serializeBatch(unsigned char *buffer, const thread_data_t *Data, unsigned char datasets)
+{
+	datasets &= BATCH_ALL_DATASETS;
+	*buffer++ = datasets;
+
+	if(datasets & BATCH_CURRENT_VALUES)
+		buffer = serializeStruct(buffer, Data);
+	if(datasets & BATCH_MAX_MIN_VALUES)
+		buffer = serializeStruct2(buffer, Data);
+	if(datasets & BATCH_ENVIRONMENT_VALUES)
+		buffer = serializeStruct3(buffer, Data);
+	return buffer;
+}
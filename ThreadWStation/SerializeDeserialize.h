@@ -5,8 +5,18 @@
 #ifndef SERIALIZEDESERIALIZE_H_
 #define SERIALIZEDESERIALIZE_H_
 
+#include <stdint.h>
+#include <string.h>
 #include "thread.h"
 
+#define FRAME_END_CHAR				0xEE
+
+/* Datasets which can be requested with one batch command */
+#define BATCH_CURRENT_VALUES		0x01
+#define BATCH_MAX_MIN_VALUES		0x02
+#define BATCH_ENVIRONMENT_VALUES	0x04
+#define BATCH_ALL_DATASETS			(BATCH_CURRENT_VALUES | BATCH_MAX_MIN_VALUES | BATCH_ENVIRONMENT_VALUES)
+
 /* Macros for serializing and deserializing 32bit float */
 #define Serialize754_32(f) (Serialize754Float((f), 32, 8))
 #define Deserialize754_32(f) (Deserialize754Float((f), 32, 8))
@@ -14,10 +24,15 @@
 /* Function prototypes */
 unsigned char *serializeInt(unsigned char *buffer, int value);
 unsigned char *serializeFloat(unsigned char *buffer, float FloatValue);
+float deserializeFloat(const unsigned char *buffer);
+unsigned char *serializeFloatArray(unsigned char *buffer, const float *values, size_t count);
+const unsigned char *deserializeFloatArray(float *values, const unsigned char *buffer, size_t count);
 unsigned int Serialize754Float(float f, unsigned int bits, unsigned int expbits);
 float Deserialize754Float(unsigned int f, unsigned int bits, unsigned int expbits);
 unsigned char *serializeStruct(unsigned char *buffer, const thread_data_t *Data);
 unsigned char *serializeStruct2(unsigned char *buffer, const thread_data_t *Data);
+unsigned char *serializeStruct3(unsigned char *buffer, const thread_data_t *Data);
+unsigned char *serializeBatch(unsigned char *buffer, const thread_data_t *Data, unsigned char datasets);
 
 
 #endif /* SERIALIZEDESERIALIZE_H_ */
@@ -0,0 +1,412 @@
+/*
+ * SeriesScan.c
+ *
+ * Bucketed aggregates of the raw history on all cores. The blocks of the segments in the query range
+ * are split into one contiguous run per worker, every worker maps its segments and summarizes its
+ * blocks into its own buckets, and the runs are joined in time order at the end, merging the bucket
+ * two neighbouring runs share. A block wholly inside one bucket is taken from its summary in the
+ * segment header, the rest are aggregated with the NEON or SSE kernel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "SeriesScan.h"
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Static function declarations */
+static int scanBatch(scan_pool_t *pool, series_bucket_t *buckets, const size_t maxBuckets, const size_t carried);
+static void *scanWorker(void *arg);
+static void runTasks(scan_pool_t *pool);
+static void scanTask(scan_query_t *query, scan_task_t *task);
+static void scanBlock(scan_query_t *query, scan_task_t *task, const segment_view_t *view, const uint32_t block);
+static void addTaskBucket(scan_query_t *query, scan_task_t *task, const series_summary_t *summary);
+static uint32_t lowerBound(const uint64_t *timestamps, uint32_t low, uint32_t high, const uint64_t timestamp);
+
+/* Starts workers - 1 helper threads, 0 workers means one per core */
+int startScanPool(scan_pool_t *pool, int workers)
+{
+	int i, iret;
+
+	if(workers <= 0)
+		workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(workers < 1)
+		workers = 1;
+	if(workers > SCAN_MAX_WORKERS)
+		workers = SCAN_MAX_WORKERS;
+
+	memset(pool, 0, sizeof(*pool));
+	pthread_mutex_init(&pool->queryMutex, NULL);
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->started, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+	pool->running = 1;
+	pool->workers = 1;
+
+	for(i = 0 ; i < workers - 1 ; i++) {
+		iret = pthread_create(&pool->threads[i], NULL, scanWorker, (void*)pool);
+		if(iret) {
+			fprintf(stderr, "Error - pthread_create() return code: %d\n", iret);
+			break;
+		}
+		pool->workers++;
+	}
+
+	printf("History scans on %d threads\n", pool->workers);
+	return 0;
+}
+
+int stopScanPool(scan_pool_t *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->running = 0;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for(i = 0 ; i < pool->workers - 1 ; i++)
+		pthread_join(pool->threads[i], NULL);
+	pool->workers = 1;
+	return 0;
+}
+
+/*
+ * Summarizes the raw samples of [from, to) in buckets starting at multiples of bucketMs. Empty buckets
+ * are left out. Returns the number of buckets, at most maxBuckets, or -1 on failure.
+ */
+int scanTimeSeriesBuckets(scan_pool_t *pool, time_series_store_t *store, const sensor_channel_t channel, const uint64_t from,
+		const uint64_t to, const uint64_t bucketMs, series_bucket_t *buckets, size_t maxBuckets)
+{
+	scan_query_t *query = &pool->query;
+	uint64_t listFrom = from;
+	uint32_t lastSequence = 0;
+	size_t count = 0, listed, skipped, carried;
+	int scanned, status = 0;
+
+	if(channel >= NUMBER_OF_CHANNELS || from >= to || bucketMs == 0 || maxBuckets == 0)
+		return -1;
+
+	pthread_mutex_lock(&pool->queryMutex);
+
+	query->store = store;
+	query->channel = channel;
+	query->from = from;
+	query->to = to;
+	query->bucketMs = bucketMs;
+
+	/*
+	 * A range over more segments than a query holds is scanned SCAN_MAX_SEGMENTS at a time. The next
+	 * batch is listed from the last timestamp scanned, the segments already scanned are skipped by their
+	 * sequence as a timestamp may go on in the next segment.
+	 */
+	for(;;) {
+		listed = timeSeriesSegments(store, channel, listFrom, to, query->segments, SCAN_MAX_SEGMENTS);
+		for(skipped = 0 ; skipped < listed && query->segments[skipped].sequence <= lastSequence ; skipped++)
+			;
+		query->segmentCount = listed - skipped;
+		if(query->segmentCount == 0)
+			break;
+		memmove(query->segments, query->segments + skipped, query->segmentCount * sizeof(segment_info_t));
+		lastSequence = query->segments[query->segmentCount - 1].sequence;
+		listFrom = query->segments[query->segmentCount - 1].lastTimestamp;
+
+		/* The batch goes on in the last bucket of the one before */
+		carried = count > 0 ? 1 : 0;
+		scanned = scanBatch(pool, buckets + count - carried, maxBuckets - count + carried, carried);
+		if(scanned < 0) {
+			status = -1;
+			break;
+		}
+		count += scanned - carried;
+		if(listed < SCAN_MAX_SEGMENTS || count >= maxBuckets)
+			break;
+	}
+
+	pthread_mutex_unlock(&pool->queryMutex);
+	return status < 0 ? -1 : (int)count;
+}
+
+/*
+ * Minimum, maximum and sum of the values. The sum is taken relative to the first value so the
+ * single precision lanes only add up the small deviations of a sensor from it.
+ */
+void aggregateValues(const float *values, size_t count, float *min, float *max, double *sum)
+{
+	const float base = values[0];
+	float lowest = base, highest = base, deviation = 0.0f;
+	size_t i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	if(count >= 4) {
+		float32x4_t vbase = vdupq_n_f32(base);
+		float32x4_t vmin = vbase, vmax = vbase, vsum = vdupq_n_f32(0.0f);
+		float32x2_t pair;
+
+		for( ; i + 4 <= count ; i += 4) {
+			float32x4_t v = vld1q_f32(values + i);
+
+			vmin = vminq_f32(vmin, v);
+			vmax = vmaxq_f32(vmax, v);
+			vsum = vaddq_f32(vsum, vsubq_f32(v, vbase));
+		}
+
+		pair = vpmin_f32(vget_low_f32(vmin), vget_high_f32(vmin));
+		lowest = vget_lane_f32(vpmin_f32(pair, pair), 0);
+		pair = vpmax_f32(vget_low_f32(vmax), vget_high_f32(vmax));
+		highest = vget_lane_f32(vpmax_f32(pair, pair), 0);
+		pair = vadd_f32(vget_low_f32(vsum), vget_high_f32(vsum));
+		deviation = vget_lane_f32(vpadd_f32(pair, pair), 0);
+	}
+#elif defined(__SSE2__)
+	if(count >= 4) {
+		__m128 vbase = _mm_set1_ps(base);
+		__m128 vmin = vbase, vmax = vbase, vsum = _mm_setzero_ps();
+		float lanes[4];
+
+		for( ; i + 4 <= count ; i += 4) {
+			__m128 v = _mm_loadu_ps(values + i);
+
+			vmin = _mm_min_ps(vmin, v);
+			vmax = _mm_max_ps(vmax, v);
+			vsum = _mm_add_ps(vsum, _mm_sub_ps(v, vbase));
+		}
+
+		vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+		vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+		lowest = _mm_cvtss_f32(vmin);
+		vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+		vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+		highest = _mm_cvtss_f32(vmax);
+		_mm_storeu_ps(lanes, vsum);
+		deviation = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+#endif
+
+	for( ; i < count ; i++) {
+		if(values[i] < lowest)
+			lowest = values[i];
+		if(values[i] > highest)
+			highest = values[i];
+		deviation += values[i] - base;
+	}
+
+	*min = lowest;
+	*max = highest;
+	*sum = (double)base * count + deviation;
+}
+
+/*
+ * Scans the query's segments into the buckets, the first carried buckets are already filled and the
+ * first run goes on in them. Returns the number of buckets or -1 on failure.
+ */
+static int scanBatch(scan_pool_t *pool, series_bucket_t *buckets, const size_t maxBuckets, const size_t carried)
+{
+	scan_query_t *query = &pool->query;
+	size_t i, j, totalBlocks, count;
+	int t, status = 0;
+
+	query->maxBuckets = maxBuckets;
+	query->blockOffsets[0] = 0;
+	for(i = 0 ; i < query->segmentCount ; i++) {
+		query->blockOffsets[i + 1] = query->blockOffsets[i] +
+				(query->segments[i].sampleCount + SEGMENT_BLOCK_SAMPLES - 1) / SEGMENT_BLOCK_SAMPLES;
+	}
+	totalBlocks = query->blockOffsets[query->segmentCount];
+
+	/* The first run goes straight into the caller's buckets */
+	query->taskCount = totalBlocks < (size_t)pool->workers ? (int)totalBlocks : pool->workers;
+	for(t = 0 ; t < query->taskCount ; t++) {
+		scan_task_t *task = &query->tasks[t];
+
+		task->firstBlock = totalBlocks * t / query->taskCount;
+		task->endBlock = totalBlocks * (t + 1) / query->taskCount;
+		task->count = t == 0 ? carried : 0;
+		task->status = 0;
+		task->buckets = t == 0 ? buckets : malloc(maxBuckets * sizeof(series_bucket_t));
+		if(task->buckets == NULL) {
+			perror("Could not allocate the scan buckets");
+			query->taskCount = t;
+			status = -1;
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	query->nextTask = 0;
+	query->pendingTasks = query->taskCount;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->mutex);
+
+	runTasks(pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	while(query->pendingTasks > 0)
+		pthread_cond_wait(&pool->finished, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+
+	/* Join the runs, a bucket cut by the border of two runs is merged */
+	count = query->taskCount > 0 ? query->tasks[0].count : carried;
+	for(t = 0 ; t < query->taskCount ; t++) {
+		scan_task_t *task = &query->tasks[t];
+
+		if(task->status < 0)
+			status = -1;
+		for(j = 0 ; t > 0 && j < task->count ; j++) {
+			if(count > 0 && buckets[count - 1].start == task->buckets[j].start)
+				mergeSeriesSummary(&buckets[count - 1].summary, &task->buckets[j].summary);
+			else if(count < maxBuckets)
+				buckets[count++] = task->buckets[j];
+		}
+		if(t > 0)
+			free(task->buckets);
+	}
+
+	return status < 0 ? -1 : (int)count;
+}
+
+static void *scanWorker(void *arg)
+{
+	scan_pool_t *pool = (scan_pool_t*)arg;
+	uint32_t generation;
+
+	pthread_mutex_lock(&pool->mutex);
+	generation = pool->generation;
+	for(;;) {
+		while(pool->running && pool->generation == generation)
+			pthread_cond_wait(&pool->started, &pool->mutex);
+		if(!pool->running)
+			break;
+
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+		runTasks(pool);
+		pthread_mutex_lock(&pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/* Takes the query's runs one by one until none is left, the caller and the helpers alike */
+static void runTasks(scan_pool_t *pool)
+{
+	scan_query_t *query = &pool->query;
+	int task;
+
+	for(;;) {
+		pthread_mutex_lock(&pool->mutex);
+		if(query->nextTask >= query->taskCount) {
+			pthread_mutex_unlock(&pool->mutex);
+			return;
+		}
+		task = query->nextTask++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		scanTask(query, &query->tasks[task]);
+
+		pthread_mutex_lock(&pool->mutex);
+		if(--query->pendingTasks == 0)
+			pthread_cond_signal(&pool->finished);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+}
+
+static void scanTask(scan_query_t *query, scan_task_t *task)
+{
+	segment_view_t view = { -1, NULL, NULL, NULL, NULL, 0 };
+	size_t segment = 0, block = task->firstBlock;
+
+	while(block < task->endBlock && task->status == 0) {
+		while(query->blockOffsets[segment + 1] <= block)
+			segment++;
+
+		/* A segment expired since the query started has nothing left to scan */
+		if(openSegmentView(query->store, query->channel, &query->segments[segment], &view) < 0) {
+			block = query->blockOffsets[segment + 1];
+			continue;
+		}
+
+		for( ; block < task->endBlock && block < query->blockOffsets[segment + 1] && task->status == 0 ; block++)
+			scanBlock(query, task, &view, block - query->blockOffsets[segment]);
+
+		closeSegmentView(&view);
+	}
+}
+
+static void scanBlock(scan_query_t *query, scan_task_t *task, const segment_view_t *view, const uint32_t block)
+{
+	const series_summary_t *summary = &view->header->blocks[block];
+	uint32_t start = block * SEGMENT_BLOCK_SAMPLES;
+	uint32_t end = start + SEGMENT_BLOCK_SAMPLES;
+	series_summary_t run;
+	uint32_t i, last;
+
+	if(end > view->sampleCount)
+		end = view->sampleCount;
+	if(view->timestamps[start] >= query->to || view->timestamps[end - 1] < query->from)
+		return;
+
+	/* Only a full block's summary is final, the writer may still be adding to the last one */
+	if(end - start == SEGMENT_BLOCK_SAMPLES && summary->firstTimestamp >= query->from && summary->lastTimestamp < query->to &&
+			summary->firstTimestamp / query->bucketMs == summary->lastTimestamp / query->bucketMs) {
+		addTaskBucket(query, task, summary);
+		return;
+	}
+
+	i = lowerBound(view->timestamps, start, end, query->from);
+	last = lowerBound(view->timestamps, i, end, query->to);
+
+	/* One run of samples per bucket */
+	while(i < last && task->status == 0) {
+		uint64_t boundary = (view->timestamps[i] / query->bucketMs + 1) * query->bucketMs;
+		uint32_t j = lowerBound(view->timestamps, i, last, boundary);
+
+		aggregateValues(view->values + i, j - i, &run.min, &run.max, &run.sum);
+		run.count = j - i;
+		run.firstTimestamp = view->timestamps[i];
+		run.lastTimestamp = view->timestamps[j - 1];
+		run.first = view->values[i];
+		run.last = view->values[j - 1];
+		addTaskBucket(query, task, &run);
+		i = j;
+	}
+}
+
+/* Merges into the run's last bucket or starts a new one, a full run stops scanning */
+static void addTaskBucket(scan_query_t *query, scan_task_t *task, const series_summary_t *summary)
+{
+	uint64_t start = summary->firstTimestamp / query->bucketMs * query->bucketMs;
+
+	if(task->count > 0 && task->buckets[task->count - 1].start == start) {
+		mergeSeriesSummary(&task->buckets[task->count - 1].summary, summary);
+		return;
+	}
+
+	if(task->count >= query->maxBuckets) {
+		task->status = 1;
+		return;
+	}
+
+	task->buckets[task->count].start = start;
+	task->buckets[task->count].summary = *summary;
+	task->count++;
+}
+
+/* The first index in [low, high) whose timestamp is at or after the timestamp */
+static uint32_t lowerBound(const uint64_t *timestamps, uint32_t low, uint32_t high, const uint64_t timestamp)
+{
+	while(low < high) {
+		uint32_t middle = low + (high - low) / 2;
+
+		if(timestamps[middle] < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
@@ -0,0 +1,74 @@
+/*
+ * SeriesScan.h
+ */
+
+#ifndef SERIESSCAN_H_
+#define SERIESSCAN_H_
+
+#include <stdint.h>
+#include "thread.h"
+#include "TimeSeriesStore.h"
+
+/* The Pi 4 has four cores, the calling thread scans too */
+#define SCAN_MAX_WORKERS			4
+
+/* Segments of a query scanned at a time, a longer range is scanned in batches */
+#define SCAN_MAX_SEGMENTS			64
+
+/* One bucket of a scan result */
+typedef struct series_bucket
+{
+	uint64_t start;
+	series_summary_t summary;
+} series_bucket_t;
+
+/* A contiguous run of blocks of the query's segments and the buckets it produced */
+typedef struct scan_task
+{
+	size_t firstBlock;
+	size_t endBlock;
+	series_bucket_t *buckets;
+	size_t count;
+	int status;
+} scan_task_t;
+
+/* The query being scanned, shared by the workers */
+typedef struct scan_query
+{
+	time_series_store_t *store;
+	sensor_channel_t channel;
+	uint64_t from;
+	uint64_t to;
+	uint64_t bucketMs;
+	size_t maxBuckets;
+	segment_info_t segments[SCAN_MAX_SEGMENTS];
+	size_t blockOffsets[SCAN_MAX_SEGMENTS + 1];
+	size_t segmentCount;
+	scan_task_t tasks[SCAN_MAX_WORKERS];
+	int taskCount;
+	int nextTask;
+	int pendingTasks;
+} scan_query_t;
+
+/* The helper threads of the scans, one query at a time */
+typedef struct scan_pool
+{
+	pthread_t threads[SCAN_MAX_WORKERS - 1];
+	int workers;
+	pthread_mutex_t queryMutex;
+	pthread_mutex_t mutex;
+	pthread_cond_t started;
+	pthread_cond_t finished;
+	uint32_t generation;
+	int running;
+	scan_query_t query;
+} scan_pool_t;
+
+/* Function prototypes */
+int startScanPool(scan_pool_t *pool, int workers);
+int stopScanPool(scan_pool_t *pool);
+int scanTimeSeriesBuckets(scan_pool_t *pool, time_series_store_t *store, const sensor_channel_t channel, const uint64_t from,
+		const uint64_t to, const uint64_t bucketMs, series_bucket_t *buckets, size_t maxBuckets);
+void aggregateValues(const float *values, size_t count, float *min, float *max, double *sum);
+
+#endif /* SERIESSCAN_H_ */
@@ -0,0 +1,333 @@
+/*
+ * StateCheckpoint.c
+ *
+ * Checkpoints of the publisher's in-memory state: the deadbands, the latest samples, the windowed
+ * extremes and the statistics. A checkpoint thread copies the state into a mapped state file once a
+ * minute and the station restores the newest intact checkpoint at startup, so a restart serves the
+ * same min/max and statistics without rescanning the history. Restoring is one checksum and one
+ * copy of the state.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "StateCheckpoint.h"
+#include "WeatherFrame.h"
+
+#define STATE_THREAD_POLL_MS		200
+
+/* A member of the state for the layout fingerprint, the type is told apart for the scalar members */
+#define STATE_FIELD(type, member)	{ #type "." #member, offsetof(type, member), sizeof(((type*)0)->member), \
+		_Generic(((type*)0)->member, float: 'f', double: 'd', int: 'i', unsigned int: 'u', uint64_t: 'q', default: 's') }
+
+typedef struct state_field
+{
+	const char *name;
+	uint32_t offset;
+	uint32_t size;
+	char type;
+} state_field_t;
+
+/* Every member of publisher_state_t and of the structures in it, a new member goes here too */
+static const state_field_t g_stateFields[] =
+{
+	STATE_FIELD(publisher_state_t, filters),
+	STATE_FIELD(publisher_state_t, published),
+	STATE_FIELD(publisher_state_t, extremes),
+	STATE_FIELD(publisher_state_t, stats),
+	STATE_FIELD(publisher_state_t, ewma),
+	STATE_FIELD(deadband_config_t, absoluteThreshold),
+	STATE_FIELD(deadband_config_t, relativeThreshold),
+	STATE_FIELD(deadband_config_t, maxSilenceMs),
+	STATE_FIELD(deadband_filter_t, config),
+	STATE_FIELD(deadband_filter_t, primed),
+	STATE_FIELD(deadband_filter_t, lastValue),
+	STATE_FIELD(deadband_filter_t, lastTimestamp),
+	STATE_FIELD(deadband_filter_t, samplesSeen),
+	STATE_FIELD(deadband_filter_t, samplesPassed),
+	STATE_FIELD(published_sample_t, timestamp),
+	STATE_FIELD(published_sample_t, value),
+	STATE_FIELD(published_sample_t, sequence),
+	STATE_FIELD(extremes_entry_t, bucket),
+	STATE_FIELD(extremes_entry_t, value),
+	STATE_FIELD(extremes_deque_t, entries),
+	STATE_FIELD(extremes_deque_t, head),
+	STATE_FIELD(extremes_deque_t, count),
+	STATE_FIELD(windowed_extremes_t, windowMs),
+	STATE_FIELD(windowed_extremes_t, bucketMs),
+	STATE_FIELD(windowed_extremes_t, hasCurrent),
+	STATE_FIELD(windowed_extremes_t, currentBucket),
+	STATE_FIELD(windowed_extremes_t, currentMin),
+	STATE_FIELD(windowed_extremes_t, currentMax),
+	STATE_FIELD(windowed_extremes_t, minDeque),
+	STATE_FIELD(windowed_extremes_t, maxDeque),
+	STATE_FIELD(welford_moments_t, count),
+	STATE_FIELD(welford_moments_t, mean),
+	STATE_FIELD(welford_moments_t, m2),
+	STATE_FIELD(p2_quantile_t, probability),
+	STATE_FIELD(p2_quantile_t, count),
+	STATE_FIELD(p2_quantile_t, heights),
+	STATE_FIELD(p2_quantile_t, positions),
+	STATE_FIELD(p2_quantile_t, desired),
+	STATE_FIELD(stats_bucket_t, bucket),
+	STATE_FIELD(stats_bucket_t, moments),
+	STATE_FIELD(window_stats_t, windowMs),
+	STATE_FIELD(window_stats_t, bucketMs),
+	STATE_FIELD(window_stats_t, buckets),
+	STATE_FIELD(window_stats_t, sketchEpochs),
+	STATE_FIELD(window_stats_t, sketches),
+	STATE_FIELD(ewma_stats_t, values),
+	STATE_FIELD(ewma_stats_t, lastTimestamp),
+	STATE_FIELD(ewma_stats_t, initialized),
+};
+
+/* Static function declarations */
+static void *checkpointThread(void *arg);
+static int validSlot(const state_checkpoint_t *checkpoint, const unsigned int slot);
+static uint32_t slotChecksum(const state_header_t *header, const unsigned char *state);
+static unsigned char *slotAddress(const state_checkpoint_t *checkpoint, const unsigned int slot);
+static uint32_t stateLayout(void);
+
+int openStateCheckpoint(state_checkpoint_t *checkpoint, const char *directory)
+{
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t fileSize;
+	struct stat status;
+	void *address;
+	int retValue;
+
+	memset(checkpoint, 0, sizeof(*checkpoint));
+	checkpoint->fd = -1;
+	checkpoint->layout = stateLayout();
+	checkpoint->slotSize = (STATE_HEADER_SIZE + sizeof(publisher_state_t) + pageSize - 1) / pageSize * pageSize;
+	fileSize = STATE_SLOTS * checkpoint->slotSize;
+	snprintf(checkpoint->path, sizeof(checkpoint->path), "%s/%s", directory, STATE_FILE_NAME);
+
+	if(mkdir(directory, 0755) < 0 && errno != EEXIST) {
+		perror("Could not create the state directory");
+		return -1;
+	}
+
+	checkpoint->fd = open(checkpoint->path, O_RDWR | O_CREAT, 0644);
+	if(checkpoint->fd < 0) {
+		perror("Could not open the state file");
+		return -1;
+	}
+
+	/* A file of another size is of another state layout, its slots fail the size check anyway */
+	if(fstat(checkpoint->fd, &status) < 0 || (size_t)status.st_size != fileSize) {
+		retValue = ftruncate(checkpoint->fd, 0) < 0 ? -1 : posix_fallocate(checkpoint->fd, 0, fileSize);
+		if(retValue != 0 && ftruncate(checkpoint->fd, fileSize) < 0) {
+			perror("Could not allocate the state file");
+			close(checkpoint->fd);
+			checkpoint->fd = -1;
+			return -1;
+		}
+	}
+
+	address = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, checkpoint->fd, 0);
+	if(address == MAP_FAILED) {
+		perror("Could not map the state file");
+		close(checkpoint->fd);
+		checkpoint->fd = -1;
+		return -1;
+	}
+
+	checkpoint->map = address;
+	return 0;
+}
+
+/*
+ * Hands the newest intact checkpoint to the publisher and returns its age in ms. Returns -1 when there
+ * is none, or when it is newer than the clock: the Pi has no RTC and the clock may not be set yet.
+ */
+int restoreStateCheckpoint(state_checkpoint_t *checkpoint, uint64_t *age)
+{
+	const state_header_t *header = NULL;
+	uint64_t now = timestampMs();
+	unsigned int slot;
+
+	for(slot = 0 ; slot < STATE_SLOTS ; slot++) {
+		const state_header_t *candidate = (const state_header_t*)slotAddress(checkpoint, slot);
+
+		if(!validSlot(checkpoint, slot))
+			continue;
+		if(header == NULL || candidate->sequence > header->sequence) {
+			header = candidate;
+			checkpoint->sequence = candidate->sequence;
+			checkpoint->nextSlot = (slot + 1) % STATE_SLOTS;
+		}
+	}
+
+	if(header == NULL) {
+		printf("No state checkpoint to restore\n");
+		return -1;
+	}
+	if(header->timestamp > now) {
+		printf("State checkpoint is newer than the clock, not restored\n");
+		return -1;
+	}
+
+	restorePublisherState((const publisher_state_t*)((const unsigned char*)header + STATE_HEADER_SIZE));
+	*age = now - header->timestamp;
+	return 0;
+}
+
+/*
+ * Copies the state into the older slot and flushes it. Only the pages which changed since that slot was
+ * written are touched, so msync() writes back just those and the header page.
+ */
+int writeStateCheckpoint(state_checkpoint_t *checkpoint)
+{
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	const unsigned char *source = (const unsigned char*)&checkpoint->state;
+	uint64_t started = monotonicUs();
+	unsigned char *slot, *target;
+	state_header_t *header;
+	uint64_t elapsed;
+	size_t offset, length;
+
+	if(checkpoint->map == NULL)
+		return -1;
+
+	slot = slotAddress(checkpoint, checkpoint->nextSlot);
+	header = (state_header_t*)slot;
+	target = slot + STATE_HEADER_SIZE;
+	savePublisherState(&checkpoint->state);
+
+	for(offset = 0 ; offset < sizeof(publisher_state_t) ; offset += length) {
+		length = pageSize - (STATE_HEADER_SIZE + offset) % pageSize;
+		if(length > sizeof(publisher_state_t) - offset)
+			length = sizeof(publisher_state_t) - offset;
+		if(memcmp(target + offset, source + offset, length) != 0) {
+			memcpy(target + offset, source + offset, length);
+			checkpoint->pagesWritten++;
+		}
+	}
+
+	memcpy(header->magic, STATE_MAGIC, sizeof(header->magic));
+	header->version = STATE_FORMAT_VERSION;
+	header->reserved = 0;
+	header->stateSize = sizeof(publisher_state_t);
+	header->layout = checkpoint->layout;
+	header->sequence = checkpoint->sequence + 1;
+	header->timestamp = timestampMs();
+	header->crc = slotChecksum(header, target);
+
+	if(msync(slot, checkpoint->slotSize, MS_SYNC) < 0) {
+		perror("msync() of the state checkpoint failed");
+		return -1;
+	}
+
+	checkpoint->sequence++;
+	checkpoint->nextSlot = (checkpoint->nextSlot + 1) % STATE_SLOTS;
+	checkpoint->checkpoints++;
+	elapsed = monotonicUs() - started;
+	if(elapsed > checkpoint->maxCheckpointUs)
+		checkpoint->maxCheckpointUs = elapsed;
+	return 0;
+}
+
+int startStateCheckpoints(state_checkpoint_t *checkpoint)
+{
+	int iret;
+
+	checkpoint->running = 1;
+	iret = pthread_create(&checkpoint->thread, NULL, checkpointThread, (void*)checkpoint);
+	if(iret) {
+		fprintf(stderr, "Error - pthread_create() return code: %d\n", iret);
+		checkpoint->running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* Writes a last checkpoint so a clean restart loses nothing, then closes the state file */
+int stopStateCheckpoints(state_checkpoint_t *checkpoint)
+{
+	int retValue;
+
+	if(checkpoint->running) {
+		checkpoint->running = 0;
+		pthread_join(checkpoint->thread, NULL);
+	}
+	if(checkpoint->map == NULL)
+		return -1;
+
+	retValue = writeStateCheckpoint(checkpoint);
+	munmap(checkpoint->map, STATE_SLOTS * checkpoint->slotSize);
+	close(checkpoint->fd);
+	checkpoint->map = NULL;
+	checkpoint->fd = -1;
+	return retValue;
+}
+
+void printStateCheckpointStatistics(state_checkpoint_t *checkpoint)
+{
+	printf("State checkpoints %u of %u bytes, %u pages changed, max %llu us\n", checkpoint->checkpoints,
+			(unsigned int)sizeof(publisher_state_t), checkpoint->pagesWritten,
+			(unsigned long long)checkpoint->maxCheckpointUs);
+}
+
+static void *checkpointThread(void *arg)
+{
+	state_checkpoint_t *checkpoint = (state_checkpoint_t*)arg;
+	const struct timespec step = { 0, STATE_THREAD_POLL_MS * 1000000L };
+	uint64_t lastCheckpoint = monotonicUs();
+
+	while(checkpoint->running)
+	{
+		if(monotonicUs() - lastCheckpoint >= STATE_CHECKPOINT_MS * 1000ULL) {
+			writeStateCheckpoint(checkpoint);
+			lastCheckpoint = monotonicUs();
+		}
+		nanosleep(&step, NULL);
+	}
+	return NULL;
+}
+
+static int validSlot(const state_checkpoint_t *checkpoint, const unsigned int slot)
+{
+	const unsigned char *address = slotAddress(checkpoint, slot);
+	const state_header_t *header = (const state_header_t*)address;
+
+	return memcmp(header->magic, STATE_MAGIC, sizeof(header->magic)) == 0 &&
+			header->version == STATE_FORMAT_VERSION &&
+			header->stateSize == sizeof(publisher_state_t) &&
+			header->layout == checkpoint->layout &&
+			header->crc == slotChecksum(header, address + STATE_HEADER_SIZE);
+}
+
+static uint32_t slotChecksum(const state_header_t *header, const unsigned char *state)
+{
+	uint32_t crc = crc32c(0, (const unsigned char*)header, offsetof(state_header_t, crc));
+
+	return crc32c(crc, state, sizeof(publisher_state_t));
+}
+
+static unsigned char *slotAddress(const state_checkpoint_t *checkpoint, const unsigned int slot)
+{
+	return checkpoint->map + slot * checkpoint->slotSize;
+}
+
+/* The checksum of every member's name, offset, size and type */
+static uint32_t stateLayout(void)
+{
+	uint32_t crc = 0;
+	size_t i;
+
+	for(i = 0 ; i < sizeof(g_stateFields) / sizeof(g_stateFields[0]) ; i++) {
+		const state_field_t *field = &g_stateFields[i];
+
+		crc = crc32c(crc, (const unsigned char*)field->name, strlen(field->name));
+		crc = crc32c(crc, (const unsigned char*)&field->offset, sizeof(field->offset));
+		crc = crc32c(crc, (const unsigned char*)&field->size, sizeof(field->size));
+		crc = crc32c(crc, (const unsigned char*)&field->type, sizeof(field->type));
+	}
+	return crc;
+}
@@ -0,0 +1,71 @@
+/*
+ * StateCheckpoint.h
+ */
+
+#ifndef STATECHECKPOINT_H_
+#define STATECHECKPOINT_H_
+
+#include <stdint.h>
+#include "SamplePublisher.h"
+
+#define STATE_FILE_NAME				"state"
+#define STATE_PATH_LENGTH			(TSDB_PATH_LENGTH + 16)
+
+/*
+ * State file layout, native byte order like the segments:
+ *
+ *  0                            slot 0: header, publisher_state_t
+ *  slotSize                     slot 1: header, publisher_state_t
+ *
+ * The slots are written in turn and a slot is only overwritten when the other one holds the newer
+ * checkpoint. A slot torn by a power cut fails its checksum and the other one is restored. The layout
+ * is a fingerprint of the names, offsets, sizes and types of the state's members, so a build which
+ * moved or retyped a member doesn't restore the old bytes as its own even with the same state size.
+ */
+#define STATE_MAGIC					"WSTA"
+#define STATE_FORMAT_VERSION		2
+#define STATE_SLOTS					2
+#define STATE_HEADER_SIZE			64
+
+/* A checkpoint every minute, at most this much aggregation is lost on a power cut */
+#define STATE_CHECKPOINT_MS			60000
+
+/* The checksum covers the header up to the checksum and the state */
+typedef struct state_header
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t stateSize;
+	uint32_t layout;
+	uint32_t sequence;
+	uint64_t timestamp;
+	uint32_t crc;
+} state_header_t;
+
+typedef struct state_checkpoint
+{
+	char path[STATE_PATH_LENGTH];
+	int fd;
+	unsigned char *map;
+	size_t slotSize;
+	uint32_t layout;
+	uint32_t sequence;
+	unsigned int nextSlot;
+	publisher_state_t state;
+	pthread_t thread;
+	volatile int running;
+	uint32_t checkpoints;
+	uint32_t pagesWritten;
+	uint64_t maxCheckpointUs;
+} state_checkpoint_t;
+
+/* Function prototypes */
+int openStateCheckpoint(state_checkpoint_t *checkpoint, const char *directory);
+int restoreStateCheckpoint(state_checkpoint_t *checkpoint, uint64_t *age);
+int writeStateCheckpoint(state_checkpoint_t *checkpoint);
+int startStateCheckpoints(state_checkpoint_t *checkpoint);
+int stopStateCheckpoints(state_checkpoint_t *checkpoint);
+void printStateCheckpointStatistics(state_checkpoint_t *checkpoint);
+
+#endif /* STATECHECKPOINT_H_ */
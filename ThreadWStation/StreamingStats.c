@@ -0,0 +1,272 @@
+/*
+ * StreamingStats.c
+ *
+ * Incremental statistics of the readings: mean and standard deviation over a sliding window with
+ * Welford's algorithm, p5/p50/p95 with P-square sketches and EWMAs at several time constants. Every
+ * update costs the same and the memory is fixed, no samples are kept.
+ */
+#include <stddef.h>
+#include <math.h>
+#include "StreamingStats.h"
+
+/* Static function declarations */
+static void addMoments(welford_moments_t *moments, const double value);
+static void mergeMoments(welford_moments_t *moments, const welford_moments_t *other);
+static void initQuantile(p2_quantile_t *quantile, const double probability);
+static void addQuantile(p2_quantile_t *quantile, const double value);
+static double getQuantile(const p2_quantile_t *quantile);
+static double parabolicHeight(const p2_quantile_t *quantile, const int i, const int d);
+
+static const double quantileProbabilities[STATS_QUANTILES] = { 0.05, 0.5, 0.95 };
+static const double ewmaTimeConstants[STATS_EWMAS] = STATS_EWMA_TAU_MS;
+
+void initWindowStats(window_stats_t *stats, const uint64_t windowMs)
+{
+	int i, j;
+
+	stats->windowMs = windowMs;
+	stats->bucketMs = windowMs / STATS_BUCKETS;
+	for(i = 0 ; i < STATS_BUCKETS + 1 ; i++) {
+		stats->buckets[i].bucket = 0;
+		stats->buckets[i].moments.count = 0;
+	}
+	for(i = 0 ; i < 2 ; i++) {
+		stats->sketchEpochs[i] = 0;
+		for(j = 0 ; j < STATS_QUANTILES ; j++)
+			initQuantile(&stats->sketches[i][j], quantileProbabilities[j]);
+	}
+}
+
+void updateWindowStats(window_stats_t *stats, const uint64_t timestamp, const float value)
+{
+	uint64_t bucket = timestamp / stats->bucketMs;
+	uint64_t epoch = timestamp / (stats->windowMs / 2);
+	stats_bucket_t *slot = &stats->buckets[bucket % (STATS_BUCKETS + 1)];
+	int i, j;
+
+	if(isnan(value))
+		return;
+
+	/* The slot of a bucket which slid out of the window is reused */
+	if(slot->bucket != bucket) {
+		slot->bucket = bucket;
+		slot->moments.count = 0;
+		slot->moments.mean = 0.0;
+		slot->moments.m2 = 0.0;
+	}
+	addMoments(&slot->moments, value);
+
+	if(stats->sketchEpochs[epoch % 2] < epoch) {
+		stats->sketchEpochs[epoch % 2] = epoch;
+		for(j = 0 ; j < STATS_QUANTILES ; j++)
+			initQuantile(&stats->sketches[epoch % 2][j], quantileProbabilities[j]);
+	}
+	for(i = 0 ; i < 2 ; i++) {
+		for(j = 0 ; j < STATS_QUANTILES ; j++)
+			addQuantile(&stats->sketches[i][j], value);
+	}
+}
+
+/* Fills the count, the mean, the deviation and the quantiles. Returns -1 if there were no samples in the window */
+int getWindowStats(const window_stats_t *stats, const uint64_t now, stats_snapshot_t *snapshot)
+{
+	uint64_t lastBucket = now / stats->bucketMs;
+	uint64_t firstBucket = lastBucket > STATS_BUCKETS ? lastBucket - STATS_BUCKETS : 0;
+	uint64_t epoch = now / (stats->windowMs / 2);
+	welford_moments_t moments = { 0, 0.0, 0.0 };
+	const p2_quantile_t *sketch = NULL;
+	int i;
+
+	for(i = 0 ; i < STATS_BUCKETS + 1 ; i++) {
+		const stats_bucket_t *slot = &stats->buckets[i];
+
+		if(slot->moments.count > 0 && slot->bucket >= firstBucket && slot->bucket <= lastBucket)
+			mergeMoments(&moments, &slot->moments);
+	}
+
+	snapshot->valid = moments.count > 0;
+	if(!snapshot->valid)
+		return -1;
+
+	snapshot->count = moments.count;
+	snapshot->mean = (float)moments.mean;
+	snapshot->stddev = moments.count > 1 ? (float)sqrt(moments.m2 / (moments.count - 1)) : 0.0f;
+
+	/* The older of the sketches which started in the window */
+	for(i = 0 ; i < 2 ; i++) {
+		if(stats->sketches[i][0].count > 0 && stats->sketchEpochs[i] + 1 >= epoch &&
+				(sketch == NULL || stats->sketchEpochs[i] < stats->sketchEpochs[!i]))
+			sketch = stats->sketches[i];
+	}
+	for(i = 0 ; i < STATS_QUANTILES ; i++)
+		snapshot->quantiles[i] = sketch != NULL ? (float)getQuantile(&sketch[i]) : NAN;
+
+	return 0;
+}
+
+void initEwmaStats(ewma_stats_t *ewma)
+{
+	ewma->initialized = 0;
+	ewma->lastTimestamp = 0;
+}
+
+/* The weight of a sample depends on the time since the previous one, so irregular sampling is fine */
+void updateEwmaStats(ewma_stats_t *ewma, const uint64_t timestamp, const float value)
+{
+	double elapsed;
+	int i;
+
+	if(isnan(value))
+		return;
+
+	if(!ewma->initialized) {
+		for(i = 0 ; i < STATS_EWMAS ; i++)
+			ewma->values[i] = value;
+		ewma->lastTimestamp = timestamp;
+		ewma->initialized = 1;
+		return;
+	}
+
+	elapsed = timestamp > ewma->lastTimestamp ? (double)(timestamp - ewma->lastTimestamp) : 0.0;
+	for(i = 0 ; i < STATS_EWMAS ; i++)
+		ewma->values[i] += (1.0 - exp(-elapsed / ewmaTimeConstants[i])) * (value - ewma->values[i]);
+	if(timestamp > ewma->lastTimestamp)
+		ewma->lastTimestamp = timestamp;
+}
+
+/* Returns -1 before the first sample */
+int getEwmaStats(const ewma_stats_t *ewma, stats_snapshot_t *snapshot)
+{
+	int i;
+
+	for(i = 0 ; i < STATS_EWMAS ; i++)
+		snapshot->ewma[i] = ewma->initialized ? (float)ewma->values[i] : NAN;
+
+	return ewma->initialized ? 0 : -1;
+}
+
+uint64_t statsWindowLength(const stats_window_t window)
+{
+	static const uint64_t lengths[NUMBER_OF_STATS_WINDOWS] =
+	{
+		[STATS_WINDOW_15_MINUTES]	= 900000ULL,
+		[STATS_WINDOW_1_HOUR]		= 3600000ULL,
+		[STATS_WINDOW_24_HOURS]		= 24 * 3600000ULL,
+	};
+
+	return lengths[window];
+}
+
+static void addMoments(welford_moments_t *moments, const double value)
+{
+	double delta = value - moments->mean;
+
+	moments->count++;
+	moments->mean += delta / moments->count;
+	moments->m2 += delta * (value - moments->mean);
+}
+
+/* Chan's parallel combination of two runs */
+static void mergeMoments(welford_moments_t *moments, const welford_moments_t *other)
+{
+	uint32_t count = moments->count + other->count;
+	double delta = other->mean - moments->mean;
+
+	if(other->count == 0)
+		return;
+
+	moments->mean += delta * other->count / count;
+	moments->m2 += other->m2 + delta * delta * ((double)moments->count * other->count / count);
+	moments->count = count;
+}
+
+static void initQuantile(p2_quantile_t *quantile, const double probability)
+{
+	quantile->probability = probability;
+	quantile->count = 0;
+}
+
+/* Jain and Chlamtac: the markers move towards their desired positions by parabolic interpolation */
+static void addQuantile(p2_quantile_t *quantile, const double value)
+{
+	const double p = quantile->probability;
+	const double increments[STATS_P2_MARKERS] = { 0.0, p / 2.0, p, (1.0 + p) / 2.0, 1.0 };
+	int i, k;
+
+	/* The first samples are kept sorted in the markers */
+	if(quantile->count < STATS_P2_MARKERS) {
+		i = quantile->count++;
+		while(i > 0 && quantile->heights[i - 1] > value) {
+			quantile->heights[i] = quantile->heights[i - 1];
+			i--;
+		}
+		quantile->heights[i] = value;
+
+		if(quantile->count == STATS_P2_MARKERS) {
+			for(i = 0 ; i < STATS_P2_MARKERS ; i++)
+				quantile->positions[i] = i;
+			quantile->desired[0] = 0.0;
+			quantile->desired[1] = 2.0 * p;
+			quantile->desired[2] = 4.0 * p;
+			quantile->desired[3] = 2.0 + 2.0 * p;
+			quantile->desired[4] = 4.0;
+		}
+		return;
+	}
+
+	quantile->count++;
+	if(value < quantile->heights[0]) {
+		quantile->heights[0] = value;
+		k = 0;
+	}
+	else if(value >= quantile->heights[4]) {
+		quantile->heights[4] = value;
+		k = 3;
+	}
+	else {
+		k = 0;
+		while(value >= quantile->heights[k + 1])
+			k++;
+	}
+
+	for(i = k + 1 ; i < STATS_P2_MARKERS ; i++)
+		quantile->positions[i] += 1.0;
+	for(i = 0 ; i < STATS_P2_MARKERS ; i++)
+		quantile->desired[i] += increments[i];
+
+	for(i = 1 ; i < STATS_P2_MARKERS - 1 ; i++) {
+		double offset = quantile->desired[i] - quantile->positions[i];
+
+		if((offset >= 1.0 && quantile->positions[i + 1] - quantile->positions[i] > 1.0) ||
+				(offset <= -1.0 && quantile->positions[i - 1] - quantile->positions[i] < -1.0)) {
+			int d = offset > 0.0 ? 1 : -1;
+			double height = parabolicHeight(quantile, i, d);
+
+			if(quantile->heights[i - 1] < height && height < quantile->heights[i + 1])
+				quantile->heights[i] = height;
+			else
+				quantile->heights[i] += d * (quantile->heights[i + d] - quantile->heights[i]) /
+						(quantile->positions[i + d] - quantile->positions[i]);
+			quantile->positions[i] += d;
+		}
+	}
+}
+
+/* Before the markers are filled the exact quantile of the few samples */
+static double getQuantile(const p2_quantile_t *quantile)
+{
+	if(quantile->count >= STATS_P2_MARKERS)
+		return quantile->heights[2];
+
+	return quantile->heights[(int)(quantile->probability * (quantile->count - 1) + 0.5)];
+}
+
+static double parabolicHeight(const p2_quantile_t *quantile, const int i, const int d)
+{
+	const double *q = quantile->heights;
+	const double *n = quantile->positions;
+
+	return q[i] + d / (n[i + 1] - n[i - 1]) *
+			((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+			(n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
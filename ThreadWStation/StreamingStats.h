@@ -0,0 +1,95 @@
+/*
+ * StreamingStats.h
+ */
+
+#ifndef STREAMINGSTATS_H_
+#define STREAMINGSTATS_H_
+
+#include <stdint.h>
+
+/* Like the extremes, a window is split in buckets and reaches back between its length and one bucket more */
+#define STATS_BUCKETS				60
+
+/* Quantiles estimated of every window: p5, p50 and p95 */
+#define STATS_QUANTILES				3
+#define STATS_P2_MARKERS			5
+
+/* Time constants of the exponentially weighted moving averages: 1 minute, 15 minutes and 1 hour */
+#define STATS_EWMAS					3
+#define STATS_EWMA_TAU_MS			{ 60000.0, 900000.0, 3600000.0 }
+
+/* Windows of the statistics */
+typedef enum
+{
+	STATS_WINDOW_15_MINUTES			= 0,
+	STATS_WINDOW_1_HOUR				= 1,
+	STATS_WINDOW_24_HOURS			= 2,
+	NUMBER_OF_STATS_WINDOWS
+} stats_window_t;
+
+/* Count, mean and the sum of the squared deviations of a run of samples, Welford's algorithm */
+typedef struct welford_moments
+{
+	uint32_t count;
+	double mean;
+	double m2;
+} welford_moments_t;
+
+/* P-square estimator of one quantile, five markers whatever the number of samples */
+typedef struct p2_quantile
+{
+	double probability;
+	uint32_t count;
+	double heights[STATS_P2_MARKERS];
+	double positions[STATS_P2_MARKERS];
+	double desired[STATS_P2_MARKERS];
+} p2_quantile_t;
+
+typedef struct stats_bucket
+{
+	uint64_t bucket;
+	welford_moments_t moments;
+} stats_bucket_t;
+
+/*
+ * The moments are kept per bucket and merged on a query. A P-square sketch can't forget samples, so two
+ * sets of sketches take turns restarting every half window and the older one answers the query: the
+ * quantiles are over the last half to full window.
+ */
+typedef struct window_stats
+{
+	uint64_t windowMs;
+	uint64_t bucketMs;
+	stats_bucket_t buckets[STATS_BUCKETS + 1];
+	uint64_t sketchEpochs[2];
+	p2_quantile_t sketches[2][STATS_QUANTILES];
+} window_stats_t;
+
+typedef struct ewma_stats
+{
+	double values[STATS_EWMAS];
+	uint64_t lastTimestamp;
+	int initialized;
+} ewma_stats_t;
+
+/* Statistics of a channel over a window, valid is 0 when there were no readings in it */
+typedef struct stats_snapshot
+{
+	uint32_t count;
+	float mean;
+	float stddev;
+	float quantiles[STATS_QUANTILES];
+	float ewma[STATS_EWMAS];
+	int valid;
+} stats_snapshot_t;
+
+/* Function prototypes */
+void initWindowStats(window_stats_t *stats, const uint64_t windowMs);
+void updateWindowStats(window_stats_t *stats, const uint64_t timestamp, const float value);
+int getWindowStats(const window_stats_t *stats, const uint64_t now, stats_snapshot_t *snapshot);
+void initEwmaStats(ewma_stats_t *ewma);
+void updateEwmaStats(ewma_stats_t *ewma, const uint64_t timestamp, const float value);
+int getEwmaStats(const ewma_stats_t *ewma, stats_snapshot_t *snapshot);
+uint64_t statsWindowLength(const stats_window_t window);
+
+#endif /* STREAMINGSTATS_H_ */
@@ -0,0 +1,517 @@
+/*
+ * TCP_Socket.c
+ *
+ * This library serves the sensor data to the desktop GUI through a polling TCP server. Every call of the
+ * server function polls the listening socket and the connected clients once.
+ */
+#include "TCP_Socket.h"
+#include "LCD.h"
+#include "SerializeDeserialize.h"
+#include "CommandParser.h"
+#include "WeatherFrame.h"
+#include "SamplePublisher.h"
+#include "HistoryExport.h"
+
+/* Static function declarations */
+static int openListeningSocket(void);
+static void acceptClient(void);
+static void closeClient(const int slot);
+static int readClient(const int slot, thread_data_t *sensorData);
+static int handleCommands(const int slot, thread_data_t *sensorData);
+static int serveExport(const int slot, thread_data_t *sensorData);
+static int setBlocking(const int socket, const int blocking);
+static int handleCommand(const int socket, const command_t *command, frame_session_t *session, thread_data_t *sensorData);
+static int pushPublishedSamples(const int slot);
+static void publishServerStatus(void);
+
+/* Payload lengths of the TCP commands, the rest of the commands are a single byte */
+static const command_rule_t tcpCommandRules[] =
+{
+	{ READ_BATCH_VALUES, 1 },
+	{ NEGOTIATE_FRAME_VERSION, 1 },
+	{ SUBSCRIBE_SAMPLES, 1 },
+	{ READ_RANGE_AGGREGATE, AGGREGATE_REQUEST_SIZE },
+	{ READ_WINDOW_EXTREMES, 1 },
+	{ READ_STATISTICS, 1 },
+	{ EXPORT_HISTORY, EXPORT_REQUEST_SIZE },
+	{ READ_DOWNSAMPLED, DOWNSAMPLE_REQUEST_SIZE },
+};
+
+/* Static local variable of the listening socket, index 0 of the poll set */
+static int g_listenFd = -1;
+
+/* Static local poll set, the command parsers and the frame formats of the connected clients */
+static struct pollfd g_pollFds[MAX_TCP_CLIENTS + 1];
+static command_parser_t g_parsers[MAX_TCP_CLIENTS + 1];
+static frame_session_t g_sessions[MAX_TCP_CLIENTS + 1];
+
+/* Static local subscriptions: channel bit mask and the last pushed publish sequence of each channel */
+static unsigned char g_subscriptions[MAX_TCP_CLIENTS + 1];
+static uint32_t g_pushedSequences[MAX_TCP_CLIENTS + 1][NUMBER_OF_CHANNELS];
+
+/* Static local history exports, a client exporting only waits for its socket to be writable */
+static history_export_t g_exports[MAX_TCP_CLIENTS + 1];
+static int g_exporting[MAX_TCP_CLIENTS + 1];
+
+/* Static local status of the server, read by the other threads */
+static tcp_server_status_t g_status;
+
+/* Static local buffers of the downsampled series, too big for the stack of the server thread */
+static downsample_point_t g_seriesPoints[DOWNSAMPLE_MAX_POINTS];
+static unsigned char g_seriesBuffer[FRAME_OVERHEAD + SERIES_HEADER_SIZE + DOWNSAMPLE_MAX_POINTS * SERIES_BUCKET_SIZE];
+
+/*
+ * Polls the listening socket and the clients once. Returns 1 when the server keeps on running
+ * and -1 on failure.
+ */
+int TCP_SocketPollingServer(thread_data_t *sensorData)
+{
+	int retValue, i, timeout = TCP_POLL_TIMEOUT_MS;
+
+	if(g_listenFd < 0 && openListeningSocket() < 0)
+		return -1;
+
+	/* Wake up more often when someone waits for the published samples */
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		if(g_pollFds[i].fd >= 0 && g_subscriptions[i])
+			timeout = TCP_PUSH_INTERVAL_MS;
+	}
+
+	retValue = poll(g_pollFds, MAX_TCP_CLIENTS + 1, timeout);
+	if(retValue < 0) {
+		if(errno == EINTR)
+			return 1;
+		perror("poll() error: \n");
+		return -1;
+	}
+
+	if(g_pollFds[0].revents & POLLIN)
+		acceptClient();
+
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		if(g_pollFds[i].fd < 0 || g_pollFds[i].revents == 0)
+			continue;
+
+		if(g_exporting[i]) {
+			if(serveExport(i, sensorData) <= 0)
+				closeClient(i);
+			continue;
+		}
+
+		if(readClient(i, sensorData) <= 0)
+			closeClient(i);
+	}
+
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		if(g_pollFds[i].fd < 0 || !g_subscriptions[i] || g_exporting[i])
+			continue;
+
+		if(pushPublishedSamples(i) < 0)
+			closeClient(i);
+	}
+	return 1;
+}
+
+/* Close the clients and the listening socket */
+int TCP_SocketClose(void)
+{
+	int i;
+
+	if(g_listenFd < 0)
+		return 0;
+
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		if(g_pollFds[i].fd >= 0)
+			closeClient(i);
+	}
+
+	if(close(g_listenFd) < 0) {
+		perror("Could not close the TCP socket");
+		return -1;
+	}
+	g_listenFd = -1;
+	publishServerStatus();
+	return 0;
+}
+
+void readTCPServerStatus(tcp_server_status_t *status)
+{
+	status->listening = __atomic_load_n(&g_status.listening, __ATOMIC_RELAXED);
+	status->clients = __atomic_load_n(&g_status.clients, __ATOMIC_RELAXED);
+	status->subscribers = __atomic_load_n(&g_status.subscribers, __ATOMIC_RELAXED);
+	status->accepted = __atomic_load_n(&g_status.accepted, __ATOMIC_RELAXED);
+	status->refused = __atomic_load_n(&g_status.refused, __ATOMIC_RELAXED);
+}
+
+static int openListeningSocket(void)
+{
+	struct sockaddr_in serverAddr;
+	int reuse = 1, i;
+
+	g_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+	if(g_listenFd < 0) {
+		perror("Error opening TCP socket: \n");
+		return -1;
+	}
+
+	setsockopt(g_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	memset(&serverAddr, 0, sizeof(serverAddr));
+	serverAddr.sin_family = AF_INET;
+	serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	serverAddr.sin_port = htons(TCP_SERVER_PORT);
+
+	if(bind(g_listenFd, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+		perror("Binding error: \n");
+		close(g_listenFd);
+		g_listenFd = -1;
+		return -1;
+	}
+
+	if(listen(g_listenFd, MAX_TCP_CLIENTS) < 0) {
+		perror("Listening error: \n");
+		close(g_listenFd);
+		g_listenFd = -1;
+		return -1;
+	}
+	printf("TCP server listening on port %d\n", TCP_SERVER_PORT);
+
+	/* The free client slots are marked with a negative fd so poll ignores them */
+	g_pollFds[0].fd = g_listenFd;
+	g_pollFds[0].events = POLLIN;
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		g_pollFds[i].fd = -1;
+		g_pollFds[i].events = POLLIN;
+	}
+	publishServerStatus();
+	return 0;
+}
+
+static void acceptClient(void)
+{
+	struct sockaddr_in clientAddr;
+	socklen_t addrLength = sizeof(clientAddr);
+	int client, noDelay = 1, i;
+
+	client = accept(g_listenFd, (struct sockaddr *)&clientAddr, &addrLength);
+	if(client < 0) {
+		perror("Couldn't accept connection: \n");
+		return;
+	}
+
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		if(g_pollFds[i].fd < 0)
+			break;
+	}
+
+	if(i > MAX_TCP_CLIENTS) {
+		printf("Too many TCP clients, connection refused\n");
+		__atomic_add_fetch(&g_status.refused, 1, __ATOMIC_RELAXED);
+		close(client);
+		return;
+	}
+
+	/* The responses are small so send them right away */
+	setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+	g_pollFds[i].fd = client;
+	initCommandParser(&g_parsers[i], tcpCommandRules, sizeof(tcpCommandRules) / sizeof(tcpCommandRules[0]));
+	initFrameSession(&g_sessions[i]);
+	g_subscriptions[i] = 0;
+	memset(g_pushedSequences[i], 0, sizeof(g_pushedSequences[i]));
+	__atomic_add_fetch(&g_status.accepted, 1, __ATOMIC_RELAXED);
+	publishServerStatus();
+	printf("Accepted TCP connection from %s\n", inet_ntoa(clientAddr.sin_addr));
+}
+
+static void closeClient(const int slot)
+{
+	printf("Closing TCP connection...\n");
+	if(g_exporting[slot]) {
+		endHistoryExport(&g_exports[slot]);
+		g_exporting[slot] = 0;
+	}
+	close(g_pollFds[slot].fd);
+	g_pollFds[slot].fd = -1;
+	g_pollFds[slot].events = POLLIN;
+	g_subscriptions[slot] = 0;
+	publishServerStatus();
+}
+
+/*
+ * Reads the client once and handles every complete command of the read.
+ * Returns 0 when the client should be closed and -1 on failure.
+ */
+static int readClient(const int slot, thread_data_t *sensorData)
+{
+	command_parser_t *parser = &g_parsers[slot];
+	unsigned char *recvBuffer;
+	size_t space;
+	int bytes_read;
+
+	recvBuffer = commandParserReadBuffer(parser, &space);
+	bytes_read = read(g_pollFds[slot].fd, recvBuffer, space);
+	if(bytes_read <= 0) {
+		if(bytes_read < 0)
+			perror("read() failed: \n");
+		return bytes_read;
+	}
+	commandParserCommit(parser, bytes_read);
+
+	return handleCommands(slot, sensorData);
+}
+
+/*
+ * Handles the complete commands waiting in the client's parser. An export takes over the socket, the
+ * commands after it wait until it is complete. Returns 0 when the client should be closed and -1 on failure.
+ */
+static int handleCommands(const int slot, thread_data_t *sensorData)
+{
+	command_parser_t *parser = &g_parsers[slot];
+	command_t command;
+	int status;
+
+	while(nextCommand(parser, &command)) {
+		if(command.opcode == SUBSCRIBE_SAMPLES) {
+
+			/* Pushing needs the framed format, the legacy format has no channel information */
+			g_subscriptions[slot] = g_sessions[slot].version > 0 ? command.payload[0] : 0;
+			publishServerStatus();
+			continue;
+		}
+
+		if(command.opcode == EXPORT_HISTORY) {
+			if(beginHistoryExport(&g_exports[slot], publishedHistory(), &g_sessions[slot], command.payload) < 0)
+				printf("Invalid history export request, sending an empty export\n");
+			if(setBlocking(g_pollFds[slot].fd, 0) < 0)
+				return -1;
+			g_exporting[slot] = 1;
+			g_pollFds[slot].events = POLLOUT;
+			return 1;
+		}
+
+		status = handleCommand(g_pollFds[slot].fd, &command, &g_sessions[slot], sensorData);
+		if(status < 0)
+			return -1;
+		if(status > 0)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Sends more of the client's export once its socket is writable. When the export is complete the
+ * socket blocks again and the commands which arrived meanwhile are handled.
+ * Returns 0 when the client should be closed and -1 on failure.
+ */
+static int serveExport(const int slot, thread_data_t *sensorData)
+{
+	int status;
+
+	if(g_pollFds[slot].revents & (POLLERR | POLLHUP))
+		return 0;
+
+	status = continueHistoryExport(&g_exports[slot], g_pollFds[slot].fd);
+	if(status > 0)
+		return 1;
+
+	endHistoryExport(&g_exports[slot]);
+	g_exporting[slot] = 0;
+	g_pollFds[slot].events = POLLIN;
+	if(status < 0 || setBlocking(g_pollFds[slot].fd, 1) < 0)
+		return -1;
+
+	return handleCommands(slot, sensorData);
+}
+
+static int setBlocking(const int socket, const int blocking)
+{
+	int flags = fcntl(socket, F_GETFL, 0);
+
+	if(flags < 0 || fcntl(socket, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK) < 0) {
+		perror("fcntl() failed: \n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Handles one command. Returns 1 when the socket should be closed, -1 on failure and 0 otherwise.
+ */
+static int handleCommand(const int socket, const command_t *command, frame_session_t *session, thread_data_t *sensorData)
+{
+	unsigned char sendBuffer[512] = { 0 };
+	extremes_value_t extremes[NUMBER_OF_EXTREMES_WINDOWS][NUMBER_OF_CHANNELS];
+	stats_snapshot_t stats[NUMBER_OF_CHANNELS];
+	series_summary_t summary;
+	history_writer_status_t history;
+	uint64_t from, to;
+	unsigned char channel, mode;
+	unsigned int width;
+	size_t length;
+	int i, count;
+
+	switch(command->opcode) {
+
+		case TCP_SOCKET_CLOSE:
+			return 1;
+
+		case NEGOTIATE_FRAME_VERSION:
+
+			length = negotiateFrameSession(session, command->payload[0], sendBuffer, sizeof(sendBuffer));
+			break;
+
+		case READ_CURRENT_VALUES:
+
+			pthread_mutex_lock(&sensorData->mutex1);
+			pthread_mutex_lock(&sensorData->mutex5);
+			length = encodeSensorResponse(session, sendBuffer, sizeof(sendBuffer), sensorData, BATCH_CURRENT_VALUES, 0);
+			pthread_mutex_unlock(&sensorData->mutex1);
+			pthread_mutex_unlock(&sensorData->mutex5);
+			break;
+
+		case READ_MAX_MIN_VALUES:
+
+			pthread_mutex_lock(&sensorData->mutex1);
+			pthread_mutex_lock(&sensorData->mutex5);
+			length = encodeSensorResponse(session, sendBuffer, sizeof(sendBuffer), sensorData, BATCH_MAX_MIN_VALUES, 0);
+			pthread_mutex_unlock(&sensorData->mutex1);
+			pthread_mutex_unlock(&sensorData->mutex5);
+			break;
+
+		case READ_BATCH_VALUES:
+
+			lockSensorData(sensorData);
+			length = encodeSensorResponse(session, sendBuffer, sizeof(sendBuffer), sensorData, command->payload[0], 1);
+			unlockSensorData(sensorData);
+			break;
+
+		case READ_RANGE_AGGREGATE:
+
+			/* Answered from the block, hour and day summaries of the history */
+			if(publishedHistory() == NULL || parseAggregateRequest(command->payload, &channel, &from, &to) < 0 ||
+					timeSeriesAggregate(publishedHistory(), channel, from, to, &summary) < 0)
+				memset(&summary, 0, sizeof(summary));
+
+			length = encodeAggregateResponse(session, sendBuffer, sizeof(sendBuffer), command->payload[0], &summary);
+			break;
+
+		case READ_WINDOW_EXTREMES:
+
+			/* Kept up to date by the publisher, nothing is scanned */
+			snapshotWindowedExtremes(extremes);
+			length = encodeExtremesResponse(session, sendBuffer, sizeof(sendBuffer), command->payload[0], extremes);
+			break;
+
+		case READ_STATISTICS:
+
+			/* The payload is the stats_window_t of the mean, the deviation and the quantiles */
+			for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++)
+				readChannelStatistics(i, command->payload[0], &stats[i]);
+			length = encodeStatisticsResponse(session, sendBuffer, sizeof(sendBuffer), command->payload[0], stats);
+			break;
+
+		case READ_HISTORY_STATUS:
+
+			/* The crash window and the flushes of the history writer, all 0 when the history is disabled */
+			if(readPublishedHistoryStatus(&history) < 0)
+				memset(&history, 0, sizeof(history));
+			length = encodeHistoryStatusResponse(session, sendBuffer, sizeof(sendBuffer), &history);
+			break;
+
+		case READ_DOWNSAMPLED:
+
+			/* An invalid request or a range without samples gets an empty series, the reply echoes what was parsed */
+			mode = DOWNSAMPLE_MIN_MAX_MEAN;
+			if(parseDownsampleRequest(command->payload, &channel, &from, &to, &width, &mode) < 0 ||
+					(count = downsampleSeries(publishedRollups(), channel, from, to, width, mode, g_seriesPoints)) < 0)
+				count = 0;
+
+			length = encodeSeriesResponse(session, g_seriesBuffer, sizeof(g_seriesBuffer), channel, mode, g_seriesPoints, count);
+			if(length > 0 && write(socket, g_seriesBuffer, length) <= 0) {
+				perror("Write failed!\n");
+				return -1;
+			}
+			return 0;
+
+		default:
+			//Do nothing
+			return 0;
+	}
+
+	if(length > 0 && write(socket, sendBuffer, length) <= 0) {
+		perror("Write failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Sends the subscribed channels that have published since the last push as one push frame, its own
+ * type so a client doesn't take it for the response of a pending request. The deadband filter in the
+ * publisher keeps this quiet while the weather stays the same.
+ */
+static int pushPublishedSamples(const int slot)
+{
+	unsigned char sendBuffer[FRAME_OVERHEAD + FRAME_SAMPLE_COUNT_SIZE + NUMBER_OF_CHANNELS * FRAME_SAMPLE_SIZE];
+	published_sample_t samples[NUMBER_OF_CHANNELS];
+	frame_encoder_t encoder;
+	uint64_t newest = 0;
+	size_t length;
+	int channel, changed = 0;
+
+	for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+		samples[channel].sequence = 0;
+		if(!(g_subscriptions[slot] & (1 << channel)))
+			continue;
+		if(latestPublishedSample(channel, &samples[channel]) < 0 ||
+				samples[channel].sequence == g_pushedSequences[slot][channel]) {
+			samples[channel].sequence = 0;
+			continue;
+		}
+		if(samples[channel].timestamp > newest)
+			newest = samples[channel].timestamp;
+		changed++;
+	}
+
+	if(changed == 0)
+		return 0;
+
+	/* The frame is stamped with the newest sample */
+	if(beginFrame(&encoder, sendBuffer, sizeof(sendBuffer), FRAME_TYPE_PUSH, g_sessions[slot].sequence++, newest) < 0)
+		return -1;
+
+	for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+		if(samples[channel].sequence == 0)
+			continue;
+		if(appendFrameSample(&encoder, channel, SAMPLE_FIELD_CURRENT, samples[channel].value) < 0)
+			return -1;
+		g_pushedSequences[slot][channel] = samples[channel].sequence;
+	}
+	length = finishFrame(&encoder);
+
+	if(write(g_pollFds[slot].fd, sendBuffer, length) <= 0) {
+		perror("Write failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* Counts the clients and the subscribers for readTCPServerStatus() */
+static void publishServerStatus(void)
+{
+	uint32_t clients = 0, subscribers = 0;
+	int i;
+
+	for(i = 1 ; i <= MAX_TCP_CLIENTS ; i++) {
+		if(g_pollFds[i].fd < 0)
+			continue;
+		clients++;
+		if(g_subscriptions[i])
+			subscribers++;
+	}
+
+	__atomic_store_n(&g_status.listening, g_listenFd >= 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_status.clients, clients, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_status.subscribers, subscribers, __ATOMIC_RELAXED);
+}
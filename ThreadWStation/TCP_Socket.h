@@ -0,0 +1,54 @@
+/*
+ * TCP_Socket.h
+ */
+
+#ifndef TCP_SOCKET_H_
+#define TCP_SOCKET_H_
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "thread.h"
+
+#define TCP_SERVER_PORT				51000
+#define MAX_TCP_CLIENTS				4
+#define TCP_POLL_TIMEOUT_MS			1000
+#define TCP_PUSH_INTERVAL_MS		200
+
+/* TCP transfer messages */
+typedef enum
+{
+	TCP_SOCKET_CLOSE			   = 'Q',
+	READ_CURRENT_VALUES			   = 'S',
+	READ_MAX_MIN_VALUES			   = 'T',
+	READ_BATCH_VALUES			   = 'B',
+	NEGOTIATE_FRAME_VERSION		   = 'V',
+	SUBSCRIBE_SAMPLES			   = 'P',
+	READ_RANGE_AGGREGATE		   = 'A',
+	READ_WINDOW_EXTREMES		   = 'W',
+	READ_STATISTICS				   = 'M',
+	EXPORT_HISTORY				   = 'X',
+	READ_DOWNSAMPLED			   = 'D',
+	READ_HISTORY_STATUS			   = 'H',
+} TCPMessageCommand;
+
+/* The state of the server for the other threads, the server thread updates it as the clients come and go */
+typedef struct tcp_server_status
+{
+	uint32_t listening;
+	uint32_t clients;
+	uint32_t subscribers;
+	uint32_t accepted;
+	uint32_t refused;
+} tcp_server_status_t;
+
+/* Function prototypes */
+int TCP_SocketPollingServer(thread_data_t *sensorData);
+int TCP_SocketClose(void);
+void readTCPServerStatus(tcp_server_status_t *status);
+
+#endif /* TCP_SOCKET_H_ */
@@ -0,0 +1,210 @@
+/*
+ * TextLayout.c
+ *
+ * Word wrapping of UTF-8 text for the LCD. The text is decoded to cells and wrapped once for
+ * the size of the display, the renderer then pages or scrolls through the wrapped lines. A newline
+ * always breaks the line, a word longer than a line is broken where the line ends and the spaces at
+ * the start of a wrapped line are dropped.
+ */
+#include "TextLayout.h"
+#include "LCDGlyph.h"
+
+/* Static function declarations */
+static size_t decodeText(const char *text, const size_t len, lcd_cell_t *codes);
+static lcd_cell_t displayCode(const uint32_t codePoint);
+static int addLine(text_layout_t *layout, const lcd_cell_t *codes, const size_t count);
+
+/* Wraps the text into lines of the given size. Returns -1 when out of memory. */
+int layoutText(text_layout_t *layout, const char *text, const size_t len, const unsigned char lines,
+		const unsigned char columns)
+{
+	lcd_cell_t *codes;
+	size_t count, position = 0;
+	int wrapped = 0;
+
+	memset(layout, 0, sizeof(*layout));
+	layout->columns = columns < LCD_MAX_COLUMNS ? columns : LCD_MAX_COLUMNS;
+	layout->linesPerPage = lines < LCD_MAX_LINES ? lines : LCD_MAX_LINES;
+	if(layout->columns == 0 || layout->linesPerPage == 0)
+		return -1;
+
+	/* A character never takes more cells than bytes */
+	codes = malloc((len + 1) * sizeof(lcd_cell_t));
+	if(codes == NULL) {
+		perror("Out of memory for the text layout");
+		return -1;
+	}
+	count = decodeText(text, len, codes);
+
+	while(position < count) {
+		size_t end, next, cut;
+
+		if(wrapped) {
+			while(position < count && codes[position] == ' ')
+				position++;
+			if(position == count)
+				break;
+			/* The newline right after a wrap doesn't make an empty line */
+			if(codes[position] == '\n') {
+				position++;
+				wrapped = 0;
+				continue;
+			}
+		}
+
+		for(end = position ; end < count && end - position < layout->columns && codes[end] != '\n' ; end++)
+			;
+		next = end;
+		wrapped = 1;
+
+		if(end < count && codes[end] == '\n') {
+			next = end + 1;
+			wrapped = 0;
+		}
+		else if(end < count && codes[end] != ' ') {
+			/* The word goes over the edge, it moves to the next line unless it is longer than a line */
+			for(cut = end ; cut > position && codes[cut - 1] != ' ' ; cut--)
+				;
+			if(cut > position)
+				end = next = cut;
+		}
+
+		if(addLine(layout, codes + position, end - position) < 0) {
+			free(codes);
+			freeTextLayout(layout);
+			return -1;
+		}
+		position = next;
+	}
+
+	free(codes);
+	return 0;
+}
+
+/* An empty text still has one blank page */
+size_t textPageCount(const text_layout_t *layout, const text_motion_t motion)
+{
+	if(layout->lineCount <= layout->linesPerPage)
+		return 1;
+	if(motion == TEXT_SCROLLING)
+		return layout->lineCount - layout->linesPerPage + 1;
+	return (layout->lineCount + layout->linesPerPage - 1) / layout->linesPerPage;
+}
+
+void composeTextPage(const text_layout_t *layout, const text_motion_t motion, const size_t page, lcd_frame_t *frame)
+{
+	size_t first = motion == TEXT_SCROLLING ? page : page * layout->linesPerPage;
+	size_t line;
+
+	clearFrame(frame);
+	for(line = 0 ; line < layout->linesPerPage && first + line < layout->lineCount ; line++)
+		memcpy(frame->cells[line], layout->lines[first + line].cells, layout->columns * sizeof(lcd_cell_t));
+}
+
+void freeTextLayout(text_layout_t *layout)
+{
+	free(layout->lines);
+	layout->lines = NULL;
+	layout->lineCount = 0;
+	layout->lineCapacity = 0;
+}
+
+/* Decodes the UTF-8 text to cells, other control characters than the newline become spaces */
+static size_t decodeText(const char *text, const size_t len, lcd_cell_t *codes)
+{
+	const unsigned char *bytes = (const unsigned char*)text;
+	size_t i = 0, count = 0;
+
+	while(i < len) {
+		uint32_t codePoint;
+		size_t length, k;
+
+		if(bytes[i] < 0x80) {
+			if(bytes[i] == '\r') {
+				i++;
+				continue;
+			}
+			codes[count++] = bytes[i] == '\n' || (bytes[i] >= 0x20 && bytes[i] < 0x7F) ? bytes[i] : ' ';
+			i++;
+			continue;
+		}
+
+		if((bytes[i] & 0xE0) == 0xC0) {
+			codePoint = bytes[i] & 0x1F;
+			length = 2;
+		}
+		else if((bytes[i] & 0xF0) == 0xE0) {
+			codePoint = bytes[i] & 0x0F;
+			length = 3;
+		}
+		else if((bytes[i] & 0xF8) == 0xF0) {
+			codePoint = bytes[i] & 0x07;
+			length = 4;
+		}
+		else
+			length = 0;
+
+		for(k = 1 ; length > 0 && k < length ; k++) {
+			if(i + k >= len || (bytes[i + k] & 0xC0) != 0x80)
+				length = 0;
+			else
+				codePoint = codePoint << 6 | (bytes[i + k] & 0x3F);
+		}
+
+		/* A broken sequence is one unknown character per byte */
+		if(length == 0) {
+			codes[count++] = LCD_CODE_UNKNOWN;
+			i++;
+			continue;
+		}
+		codes[count++] = displayCode(codePoint);
+		i += length;
+	}
+	return count;
+}
+
+/* A glyph of the CGRAM cache when there is one, else a character of the ROM */
+static lcd_cell_t displayCode(const uint32_t codePoint)
+{
+	int glyph = glyphCell_LCD(codePoint);
+
+	if(glyph >= 0)
+		return (lcd_cell_t)glyph;
+
+	switch(codePoint)
+	{
+		case 0x00FC: return LCD_CODE_U_DOTS;
+		case 0x00DF: return LCD_CODE_SHARP_S;
+		case 0x00B0: return LCD_CODE_DEGREE;
+		case 0x00B5:
+		case 0x03BC: return LCD_CODE_MICRO;
+		case 0x2192: return LCD_CODE_ARROW_RIGHT;
+		case 0x2190: return LCD_CODE_ARROW_LEFT;
+		case 0x00A0: return ' ';
+		default: return LCD_CODE_UNKNOWN;
+	}
+}
+
+/* Adds a line padded with spaces, growing the array like the history index */
+static int addLine(text_layout_t *layout, const lcd_cell_t *codes, const size_t count)
+{
+	text_line_t *line;
+	size_t i;
+
+	if(layout->lineCount == layout->lineCapacity) {
+		size_t newCapacity = layout->lineCapacity ? layout->lineCapacity * 2 : 8;
+		text_line_t *grown = realloc(layout->lines, newCapacity * sizeof(text_line_t));
+
+		if(grown == NULL) {
+			perror("Out of memory for the text layout");
+			return -1;
+		}
+		layout->lines = grown;
+		layout->lineCapacity = newCapacity;
+	}
+
+	line = &layout->lines[layout->lineCount++];
+	for(i = 0 ; i < LCD_MAX_COLUMNS ; i++)
+		line->cells[i] = i < count ? codes[i] : ' ';
+	return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * TextLayout.h
+ */
+
+#ifndef TEXTLAYOUT_H_
+#define TEXTLAYOUT_H_
+
+#include <stddef.h>
+#include "LCDFrame.h"
+
+/* Character codes in the display's ROM for the characters outside ASCII which have no glyph */
+#define LCD_CODE_U_DOTS				0xF5
+#define LCD_CODE_SHARP_S			0xE2
+#define LCD_CODE_DEGREE				0xDF
+#define LCD_CODE_MICRO				0xE4
+#define LCD_CODE_ARROW_RIGHT		0x7E
+#define LCD_CODE_ARROW_LEFT			0x7F
+#define LCD_CODE_UNKNOWN			'?'
+
+/* How the pages of a text follow each other */
+typedef enum text_motion
+{
+	TEXT_PAGING = 0,	/* a whole screen of new lines at a time */
+	TEXT_SCROLLING		/* one line up at a time */
+} text_motion_t;
+
+/* A wrapped line, padded with spaces */
+typedef struct text_line
+{
+	lcd_cell_t cells[LCD_MAX_COLUMNS];
+} text_line_t;
+
+/* A text wrapped once for a display size, the pages are composed from its lines */
+typedef struct text_layout
+{
+	text_line_t *lines;
+	size_t lineCount;
+	size_t lineCapacity;
+	unsigned char columns;
+	unsigned char linesPerPage;
+} text_layout_t;
+
+/* Function prototypes */
+int layoutText(text_layout_t *layout, const char *text, const size_t len, const unsigned char lines,
+		const unsigned char columns);
+size_t textPageCount(const text_layout_t *layout, const text_motion_t motion);
+void composeTextPage(const text_layout_t *layout, const text_motion_t motion, const size_t page, lcd_frame_t *frame);
+void freeTextLayout(text_layout_t *layout);
+
+#endif /* TEXTLAYOUT_H_ */
@@ -0,0 +1,1176 @@
+/*
+ * TimeSeriesStore.c
+ *
+ * Append-only history of the sensor channels. Every channel is a column of fixed size segment
+ * files which are filled through a shared mapping. The history writer decides when they are flushed.
+ * The segment header keeps the time range and a summary of every block of samples, so a seek
+ * is a binary search over the segments, the blocks and finally the timestamps of one block.
+ * The block summaries are further indexed by hour and day in memory: a range aggregate merges the
+ * days, hours and blocks which lie inside the range and only scans the samples of the edge blocks.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "TimeSeriesStore.h"
+
+/* The header with the block summaries has to fit in its reserved pages */
+typedef char segment_header_size_check[(sizeof(segment_header_t) <= SEGMENT_HEADER_SIZE) ? 1 : -1];
+
+/* Static function declarations */
+static void segmentPath(const time_series_store_t *store, const int channel, const uint32_t sequence, char *path, size_t size);
+static int loadSegments(time_series_store_t *store, const int channel);
+static int addSegment(series_channel_t *series, const segment_info_t *info);
+static int growArray(void **array, size_t *capacity, const size_t count, const size_t elementSize);
+static int compareSegments(const void *a, const void *b);
+static int mapSegment(const char *path, const int writable, int *fd, unsigned char **map);
+static int openActiveSegment(time_series_store_t *store, const int channel);
+static int createSegment(time_series_store_t *store, const int channel, const uint32_t sequence);
+static void recoverSegment(series_channel_t *series);
+static void closeActiveSegment(series_channel_t *series);
+static int syncChannel(series_channel_t *series);
+static uint32_t pagesSpanned(const size_t start, const size_t end, const size_t pageSize);
+static int cursorMapSegment(series_cursor_t *cursor);
+static int cursorNextRun(series_cursor_t *cursor, size_t maxSamples);
+static size_t findSegment(const series_channel_t *series, const uint32_t sequence);
+static void rebuildDays(series_channel_t *series);
+static uint32_t findSample(const segment_header_t *header, const uint64_t *timestamps, const uint64_t timestamp);
+static int buildIndex(time_series_store_t *store, const int channel);
+static int indexSummary(series_channel_t *series, const uint32_t segmentIndex, const uint32_t blockIndex,
+		const series_summary_t *summary, const int startsBlock);
+static int readSegmentHeader(time_series_store_t *store, const int channel, const uint32_t segmentIndex, segment_header_t *header);
+static int aggregateHourBlocks(time_series_store_t *store, const int channel, const size_t hour, const uint64_t from,
+		const uint64_t to, segment_header_t *header, uint32_t *headerSegment, series_summary_t *result);
+static int scanBlock(time_series_store_t *store, const int channel, const uint32_t segmentIndex, const uint32_t blockIndex,
+		const uint32_t count, const uint64_t from, const uint64_t to, series_summary_t *result);
+static int summaryInside(const series_summary_t *summary, const uint64_t from, const uint64_t to);
+
+int openTimeSeriesStore(time_series_store_t *store, const char *directory)
+{
+	int i;
+
+	memset(store, 0, sizeof(*store));
+	snprintf(store->directory, sizeof(store->directory), "%s", directory);
+
+	if(mkdir(directory, 0755) < 0 && errno != EEXIST) {
+		perror("Could not create the history directory");
+		return -1;
+	}
+
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		store->channels[i].fd = -1;
+		pthread_mutex_init(&store->channels[i].mutex, NULL);
+
+		if(loadSegments(store, i) < 0 ||
+				(store->channels[i].segmentCount > 0 && openActiveSegment(store, i) < 0) ||
+				buildIndex(store, i) < 0) {
+			closeTimeSeriesStore(store);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int closeTimeSeriesStore(time_series_store_t *store)
+{
+	int i, retValue = 0;
+
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		series_channel_t *series = &store->channels[i];
+
+		pthread_mutex_lock(&series->mutex);
+		if(series->map != NULL && syncChannel(series) < 0)
+			retValue = -1;
+		closeActiveSegment(series);
+		free(series->segments);
+		free(series->hours);
+		free(series->days);
+		series->segments = NULL;
+		series->hours = NULL;
+		series->days = NULL;
+		series->segmentCount = 0;
+		series->hourCount = 0;
+		series->dayCount = 0;
+		pthread_mutex_unlock(&series->mutex);
+		pthread_mutex_destroy(&series->mutex);
+	}
+	return retValue;
+}
+
+/*
+ * Appends one sample to the channel. The timestamps of a channel have to grow, an older sample
+ * returns -1 and is dropped.
+ */
+int timeSeriesAppend(time_series_store_t *store, const sensor_channel_t channel, const uint64_t timestamp, const float value)
+{
+	series_channel_t *series;
+	segment_header_t *header;
+	series_summary_t *block, sample;
+	segment_info_t *info;
+	uint32_t index;
+	int startsBlock;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	series = &store->channels[channel];
+	pthread_mutex_lock(&series->mutex);
+
+	if(series->map == NULL && openActiveSegment(store, channel) < 0) {
+		pthread_mutex_unlock(&series->mutex);
+		return -1;
+	}
+
+	header = series->header;
+	info = &series->segments[series->segmentCount - 1];
+
+	if(timestamp < info->lastTimestamp ||
+			(series->segmentCount > 1 && timestamp < series->segments[series->segmentCount - 2].lastTimestamp)) {
+		pthread_mutex_unlock(&series->mutex);
+		return -1;
+	}
+
+	/* A full segment is flushed and the next one started */
+	if(header->sampleCount >= SEGMENT_CAPACITY) {
+		uint32_t sequence = header->sequence + 1;
+
+		syncChannel(series);
+		closeActiveSegment(series);
+		if(createSegment(store, channel, sequence) < 0) {
+			pthread_mutex_unlock(&series->mutex);
+			return -1;
+		}
+		header = series->header;
+		info = &series->segments[series->segmentCount - 1];
+	}
+
+	/* The sample is written before the count, a torn append is cut off by the recovery */
+	index = header->sampleCount;
+	series->timestamps[index] = timestamp;
+	series->values[index] = value;
+
+	block = &header->blocks[index / SEGMENT_BLOCK_SAMPLES];
+	startsBlock = block->count == 0;
+	addSeriesSample(block, timestamp, value);
+
+	sample.count = 0;
+	addSeriesSample(&sample, timestamp, value);
+	indexSummary(series, series->segmentCount - 1, index / SEGMENT_BLOCK_SAMPLES, &sample, startsBlock);
+
+	if(index == 0)
+		header->firstTimestamp = timestamp;
+	header->lastTimestamp = timestamp;
+	header->sampleCount = index + 1;
+
+	info->sampleCount = header->sampleCount;
+	info->firstTimestamp = header->firstTimestamp;
+	info->lastTimestamp = timestamp;
+
+	pthread_mutex_unlock(&series->mutex);
+	return 0;
+}
+
+/* Flushes the appended samples of every channel to the card, one fdatasync per changed segment */
+int syncTimeSeriesStore(time_series_store_t *store)
+{
+	int i, retValue = 0;
+
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		series_channel_t *series = &store->channels[i];
+
+		pthread_mutex_lock(&series->mutex);
+		if(series->map != NULL && series->header->sampleCount > series->syncedCount && syncChannel(series) < 0)
+			retValue = -1;
+		pthread_mutex_unlock(&series->mutex);
+	}
+	return retValue;
+}
+
+/* Bytes of the segment pages written back by the syncs and the samples they carried */
+void timeSeriesSyncStatistics(time_series_store_t *store, uint64_t *bytes, uint64_t *samples)
+{
+	int i;
+
+	*bytes = 0;
+	*samples = 0;
+	for(i = 0 ; i < NUMBER_OF_CHANNELS ; i++) {
+		pthread_mutex_lock(&store->channels[i].mutex);
+		*bytes += store->channels[i].bytesSynced;
+		*samples += store->channels[i].samplesSynced;
+		pthread_mutex_unlock(&store->channels[i].mutex);
+	}
+}
+
+/*
+ * Positions the cursor on the first sample of the channel at or after the timestamp.
+ * Returns 0 on success and -1 on failure, a cursor past the newest sample reads nothing.
+ */
+int seekTimeSeries(time_series_store_t *store, const sensor_channel_t channel, const uint64_t timestamp, series_cursor_t *cursor)
+{
+	series_channel_t *series;
+	size_t low, high;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->store = store;
+	cursor->channel = channel;
+	cursor->fd = -1;
+
+	series = &store->channels[channel];
+	pthread_mutex_lock(&series->mutex);
+
+	/* The first segment which ends at or after the timestamp */
+	low = 0;
+	high = series->segmentCount;
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if(series->segments[middle].lastTimestamp < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if(low < series->segmentCount)
+		cursor->sequence = series->segments[low].sequence;
+	else
+		cursor->sequence = series->segmentCount > 0 ? series->segments[series->segmentCount - 1].sequence + 1 : 1;
+	pthread_mutex_unlock(&series->mutex);
+
+	if(cursorMapSegment(cursor) < 0)
+		return -1;
+
+	if(cursor->map != NULL) {
+		cursor->offset = findSample((const segment_header_t *)cursor->map,
+				(const uint64_t *)(cursor->map + SEGMENT_TIMESTAMP_OFFSET), timestamp);
+	}
+	return 0;
+}
+
+/*
+ * Copies the next samples of the cursor into the arrays.
+ * Returns the number of samples, 0 at the end of the channel and -1 on failure.
+ */
+int readTimeSeries(series_cursor_t *cursor, uint64_t *timestamps, float *values, size_t maxSamples)
+{
+	size_t samples = 0;
+
+	while(samples < maxSamples) {
+		int available = cursorNextRun(cursor, maxSamples - samples);
+
+		if(available < 0)
+			return -1;
+		if(available == 0)
+			break;
+
+		memcpy(timestamps + samples, cursor->map + SEGMENT_TIMESTAMP_OFFSET + cursor->offset * sizeof(uint64_t),
+				available * sizeof(uint64_t));
+		memcpy(values + samples, cursor->map + SEGMENT_VALUE_OFFSET + cursor->offset * sizeof(float),
+				available * sizeof(float));
+		cursor->offset += available;
+		samples += available;
+	}
+	return (int)samples;
+}
+
+/*
+ * Like readTimeSeries() but nothing is copied: the extent tells where the next run of samples before
+ * the timestamp "to" lies in the cursor's segment file, for sendfile(). The run is within one segment
+ * and the file descriptor stays valid until the next call. Returns the number of samples, 0 at the end
+ * of the range and -1 on failure.
+ */
+int nextTimeSeriesExtent(series_cursor_t *cursor, const uint64_t to, size_t maxSamples, series_extent_t *extent)
+{
+	const uint64_t *timestamps;
+	uint32_t low, high;
+	int available = cursorNextRun(cursor, maxSamples);
+
+	if(available <= 0)
+		return available;
+
+	/* Cut the run at the end of the range */
+	timestamps = (const uint64_t *)(cursor->map + SEGMENT_TIMESTAMP_OFFSET);
+	low = cursor->offset;
+	high = cursor->offset + available;
+	while(low < high) {
+		uint32_t middle = low + (high - low) / 2;
+
+		if(timestamps[middle] < to)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	extent->fd = cursor->fd;
+	extent->timestampOffset = SEGMENT_TIMESTAMP_OFFSET + (off_t)cursor->offset * sizeof(uint64_t);
+	extent->valueOffset = SEGMENT_VALUE_OFFSET + (off_t)cursor->offset * sizeof(float);
+	extent->count = low - cursor->offset;
+	cursor->offset = low;
+	return (int)extent->count;
+}
+
+void closeTimeSeriesCursor(series_cursor_t *cursor)
+{
+	if(cursor->map != NULL)
+		munmap(cursor->map, SEGMENT_FILE_SIZE);
+	if(cursor->fd >= 0)
+		close(cursor->fd);
+	cursor->map = NULL;
+	cursor->fd = -1;
+}
+
+/*
+ * Aggregates the channel's samples in [from, to). Whole days, hours and blocks inside the range come
+ * from their summaries, only the blocks cut by the range edges are scanned. An empty range gives count 0.
+ */
+int timeSeriesAggregate(time_series_store_t *store, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		series_summary_t *result)
+{
+	series_channel_t *series;
+	segment_header_t header;
+	uint32_t headerSegment = UINT32_MAX;
+	size_t low, high, day, hour, lastHour;
+
+	memset(result, 0, sizeof(*result));
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	series = &store->channels[channel];
+	pthread_mutex_lock(&series->mutex);
+
+	/* The first day which ends at or after the start of the range */
+	low = 0;
+	high = series->dayCount;
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if(series->days[middle].summary.lastTimestamp < from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for(day = low ; day < series->dayCount && series->days[day].summary.firstTimestamp < to ; day++) {
+		if(summaryInside(&series->days[day].summary, from, to)) {
+			mergeSeriesSummary(result, &series->days[day].summary);
+			continue;
+		}
+
+		lastHour = day + 1 < series->dayCount ? series->days[day + 1].firstHour : series->hourCount;
+		for(hour = series->days[day].firstHour ; hour < lastHour ; hour++) {
+			const series_summary_t *summary = &series->hours[hour].summary;
+
+			if(summary->lastTimestamp < from || summary->firstTimestamp >= to)
+				continue;
+
+			if(summaryInside(summary, from, to))
+				mergeSeriesSummary(result, summary);
+			else if(aggregateHourBlocks(store, channel, hour, from, to, &header, &headerSegment, result) < 0) {
+				pthread_mutex_unlock(&series->mutex);
+				return -1;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&series->mutex);
+	return 0;
+}
+
+/*
+ * Deletes the channel's segments which end before the timestamp, never the one being appended.
+ * Returns the number of deleted segments or -1 on failure.
+ */
+int timeSeriesDropBefore(time_series_store_t *store, const sensor_channel_t channel, const uint64_t before)
+{
+	series_channel_t *series;
+	segment_header_t header;
+	uint32_t headerSegment = UINT32_MAX;
+	char path[TSDB_PATH_LENGTH + 32];
+	size_t dropped = 0, hours = 0, i;
+	int continued = 0;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return -1;
+
+	series = &store->channels[channel];
+	pthread_mutex_lock(&series->mutex);
+
+	while(dropped + 1 < series->segmentCount && series->segments[dropped].lastTimestamp < before) {
+		segmentPath(store, channel, series->segments[dropped].sequence, path, sizeof(path));
+		if(unlink(path) < 0) {
+			perror("Could not delete a history segment");
+			break;
+		}
+		dropped++;
+	}
+
+	if(dropped > 0) {
+		memmove(series->segments, series->segments + dropped, (series->segmentCount - dropped) * sizeof(segment_info_t));
+		series->segmentCount -= dropped;
+
+		/* The hours starting in a deleted segment go, the rest point to the shifted segments */
+		while(hours < series->hourCount && series->hours[hours].segmentIndex < dropped)
+			hours++;
+
+		/*
+		 * A new hour is only opened by a block of another hour, so when the first kept block doesn't open
+		 * one it belongs to the hour started in the deleted segments. That hour starts over at the first
+		 * kept block.
+		 */
+		if(hours > 0 && series->segments[0].sampleCount > 0 && (hours == series->hourCount ||
+				series->hours[hours].segmentIndex != dropped || series->hours[hours].firstBlock != 0)) {
+			hours--;
+			series->hours[hours].segmentIndex = dropped;
+			series->hours[hours].firstBlock = 0;
+			continued = 1;
+		}
+
+		memmove(series->hours, series->hours + hours, (series->hourCount - hours) * sizeof(summary_hour_t));
+		series->hourCount -= hours;
+		for(i = 0 ; i < series->hourCount ; i++)
+			series->hours[i].segmentIndex -= dropped;
+
+		/* Its summary is summed again from the kept blocks, or the hour goes when they can't be read */
+		if(continued) {
+			memset(&series->hours[0].summary, 0, sizeof(series_summary_t));
+			if(aggregateHourBlocks(store, channel, 0, 0, UINT64_MAX, &header, &headerSegment, &series->hours[0].summary) < 0) {
+				series->hourCount--;
+				memmove(series->hours, series->hours + 1, series->hourCount * sizeof(summary_hour_t));
+			}
+		}
+		rebuildDays(series);
+	}
+
+	pthread_mutex_unlock(&series->mutex);
+	return (int)dropped;
+}
+
+/* Timestamp of the oldest sample kept for the channel, 0 when there are none */
+uint64_t timeSeriesFirstTimestamp(time_series_store_t *store, const sensor_channel_t channel)
+{
+	uint64_t timestamp = 0;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return 0;
+
+	pthread_mutex_lock(&store->channels[channel].mutex);
+	if(store->channels[channel].segmentCount > 0)
+		timestamp = store->channels[channel].segments[0].firstTimestamp;
+	pthread_mutex_unlock(&store->channels[channel].mutex);
+	return timestamp;
+}
+
+/*
+ * Copies the segments of the channel which have samples in [from, to), oldest first. Returns their
+ * number, at most maxSegments. Their sample counts are a snapshot: a scan doesn't look past them.
+ */
+size_t timeSeriesSegments(time_series_store_t *store, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		segment_info_t *segments, size_t maxSegments)
+{
+	series_channel_t *series;
+	size_t i, count = 0;
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return 0;
+
+	series = &store->channels[channel];
+	pthread_mutex_lock(&series->mutex);
+	for(i = 0 ; i < series->segmentCount && count < maxSegments ; i++) {
+		if(series->segments[i].sampleCount > 0 && series->segments[i].lastTimestamp >= from &&
+				series->segments[i].firstTimestamp < to)
+			segments[count++] = series->segments[i];
+	}
+	pthread_mutex_unlock(&series->mutex);
+	return count;
+}
+
+/* Maps a segment of timeSeriesSegments() read-only, -1 if it is gone meanwhile */
+int openSegmentView(time_series_store_t *store, const sensor_channel_t channel, const segment_info_t *segment, segment_view_t *view)
+{
+	char path[TSDB_PATH_LENGTH + 32];
+
+	view->fd = -1;
+	view->map = NULL;
+	segmentPath(store, channel, segment->sequence, path, sizeof(path));
+	if(mapSegment(path, 0, &view->fd, &view->map) < 0 || view->map == NULL)
+		return -1;
+
+	view->header = (const segment_header_t *)view->map;
+	view->timestamps = (const uint64_t *)(view->map + SEGMENT_TIMESTAMP_OFFSET);
+	view->values = (const float *)(view->map + SEGMENT_VALUE_OFFSET);
+	view->sampleCount = segment->sampleCount;
+	return 0;
+}
+
+void closeSegmentView(segment_view_t *view)
+{
+	if(view->map != NULL)
+		munmap(view->map, SEGMENT_FILE_SIZE);
+	if(view->fd >= 0)
+		close(view->fd);
+	view->map = NULL;
+	view->fd = -1;
+}
+
+void addSeriesSample(series_summary_t *summary, const uint64_t timestamp, const float value)
+{
+	if(summary->count == 0) {
+		summary->firstTimestamp = timestamp;
+		summary->sum = 0.0;
+		summary->min = value;
+		summary->max = value;
+		summary->first = value;
+	}
+	else {
+		if(value < summary->min)
+			summary->min = value;
+		if(value > summary->max)
+			summary->max = value;
+	}
+	summary->lastTimestamp = timestamp;
+	summary->sum += value;
+	summary->last = value;
+	summary->count++;
+}
+
+/* Merges the summary of the samples following the summary's own */
+void mergeSeriesSummary(series_summary_t *summary, const series_summary_t *other)
+{
+	if(other->count == 0)
+		return;
+
+	if(summary->count == 0) {
+		*summary = *other;
+		return;
+	}
+
+	if(other->min < summary->min)
+		summary->min = other->min;
+	if(other->max > summary->max)
+		summary->max = other->max;
+	summary->lastTimestamp = other->lastTimestamp;
+	summary->sum += other->sum;
+	summary->last = other->last;
+	summary->count += other->count;
+}
+
+static void segmentPath(const time_series_store_t *store, const int channel, const uint32_t sequence, char *path, size_t size)
+{
+	snprintf(path, size, "%s/ch%d-%08u.seg", store->directory, channel, sequence);
+}
+
+/* Reads the headers of the channel's segment files into the segment list */
+static int loadSegments(time_series_store_t *store, const int channel)
+{
+	series_channel_t *series = &store->channels[channel];
+	segment_header_t header;
+	segment_info_t info;
+	struct dirent *entry;
+	char path[TSDB_PATH_LENGTH + 32];
+	DIR *dir;
+
+	dir = opendir(store->directory);
+	if(dir == NULL) {
+		perror("Could not open the history directory");
+		return -1;
+	}
+
+	while((entry = readdir(dir)) != NULL) {
+		int fileChannel, fd;
+		unsigned int sequence;
+		char suffix[8];
+
+		if(sscanf(entry->d_name, "ch%d-%8u.%4s", &fileChannel, &sequence, suffix) != 3 ||
+				fileChannel != channel || strcmp(suffix, "seg") != 0)
+			continue;
+
+		segmentPath(store, channel, sequence, path, sizeof(path));
+		fd = open(path, O_RDONLY);
+		if(fd < 0)
+			continue;
+
+		if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, SEGMENT_MAGIC, 4) != 0 ||
+				header.version != SEGMENT_FORMAT_VERSION || header.channel != channel || header.sequence != sequence ||
+				header.sampleCount > SEGMENT_CAPACITY) {
+			printf("Skipping an old or damaged history segment %s\n", path);
+			close(fd);
+			continue;
+		}
+		close(fd);
+
+		info.sequence = header.sequence;
+		info.sampleCount = header.sampleCount;
+		info.firstTimestamp = header.firstTimestamp;
+		info.lastTimestamp = header.lastTimestamp;
+		if(addSegment(series, &info) < 0) {
+			closedir(dir);
+			return -1;
+		}
+	}
+	closedir(dir);
+
+	qsort(series->segments, series->segmentCount, sizeof(segment_info_t), compareSegments);
+	return 0;
+}
+
+static int addSegment(series_channel_t *series, const segment_info_t *info)
+{
+	if(growArray((void **)&series->segments, &series->segmentCapacity, series->segmentCount, sizeof(segment_info_t)) < 0)
+		return -1;
+
+	series->segments[series->segmentCount++] = *info;
+	return 0;
+}
+
+/* Makes room for one more element, doubling the array when it is full */
+static int growArray(void **array, size_t *capacity, const size_t count, const size_t elementSize)
+{
+	void *grown;
+	size_t newCapacity;
+
+	if(count < *capacity)
+		return 0;
+
+	newCapacity = *capacity ? *capacity * 2 : 16;
+	grown = realloc(*array, newCapacity * elementSize);
+	if(grown == NULL) {
+		perror("Out of memory for the history index");
+		return -1;
+	}
+	*array = grown;
+	*capacity = newCapacity;
+	return 0;
+}
+
+static int compareSegments(const void *a, const void *b)
+{
+	const segment_info_t *first = a, *second = b;
+
+	if(first->sequence < second->sequence)
+		return -1;
+	return first->sequence > second->sequence;
+}
+
+static int mapSegment(const char *path, const int writable, int *fd, unsigned char **map)
+{
+	void *address;
+
+	*fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if(*fd < 0) {
+		perror("Could not open a history segment");
+		return -1;
+	}
+
+	address = mmap(NULL, SEGMENT_FILE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, *fd, 0);
+	if(address == MAP_FAILED) {
+		perror("Could not map a history segment");
+		close(*fd);
+		*fd = -1;
+		return -1;
+	}
+
+	*map = address;
+	return 0;
+}
+
+/* Maps the newest segment of the channel for appending or creates the first one */
+static int openActiveSegment(time_series_store_t *store, const int channel)
+{
+	series_channel_t *series = &store->channels[channel];
+	segment_info_t *info;
+	char path[TSDB_PATH_LENGTH + 32];
+
+	if(series->segmentCount == 0)
+		return createSegment(store, channel, 1);
+
+	info = &series->segments[series->segmentCount - 1];
+	segmentPath(store, channel, info->sequence, path, sizeof(path));
+	if(mapSegment(path, 1, &series->fd, &series->map) < 0)
+		return -1;
+
+	series->header = (segment_header_t *)series->map;
+	series->timestamps = (uint64_t *)(series->map + SEGMENT_TIMESTAMP_OFFSET);
+	series->values = (float *)(series->map + SEGMENT_VALUE_OFFSET);
+
+	recoverSegment(series);
+	info->sampleCount = series->header->sampleCount;
+	info->firstTimestamp = series->header->firstTimestamp;
+	info->lastTimestamp = series->header->lastTimestamp;
+	series->syncedCount = series->header->sampleCount;
+	return 0;
+}
+
+static int createSegment(time_series_store_t *store, const int channel, const uint32_t sequence)
+{
+	series_channel_t *series = &store->channels[channel];
+	segment_info_t info = { sequence, 0, 0, 0 };
+	char path[TSDB_PATH_LENGTH + 32];
+	int fd, retValue;
+
+	segmentPath(store, channel, sequence, path, sizeof(path));
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		perror("Could not create a history segment");
+		return -1;
+	}
+
+	/* Allocating the whole file up front keeps it in one piece on the card */
+	retValue = posix_fallocate(fd, 0, SEGMENT_FILE_SIZE);
+	if(retValue != 0 && ftruncate(fd, SEGMENT_FILE_SIZE) < 0) {
+		perror("Could not allocate a history segment");
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+	close(fd);
+
+	if(mapSegment(path, 1, &series->fd, &series->map) < 0)
+		return -1;
+
+	series->header = (segment_header_t *)series->map;
+	series->timestamps = (uint64_t *)(series->map + SEGMENT_TIMESTAMP_OFFSET);
+	series->values = (float *)(series->map + SEGMENT_VALUE_OFFSET);
+
+	memset(series->header, 0, sizeof(segment_header_t));
+	memcpy(series->header->magic, SEGMENT_MAGIC, 4);
+	series->header->version = SEGMENT_FORMAT_VERSION;
+	series->header->channel = channel;
+	series->header->sequence = sequence;
+	series->syncedCount = 0;
+
+	if(addSegment(series, &info) < 0) {
+		closeActiveSegment(series);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The header may have reached the card before the samples it counts, or a page of a column may have
+ * been lost, whose samples read back as zeros. Cuts the segment back to the samples whose timestamps
+ * are still in order and whose blocks still add up to the summaries written with them, then rebuilds
+ * the block summaries of the tail.
+ */
+static void recoverSegment(series_channel_t *series)
+{
+	segment_header_t *header = series->header;
+	series_summary_t summary;
+	uint32_t count = 0, valid, end, block, i;
+
+	while(count < header->sampleCount && series->timestamps[count] != 0 &&
+			(count == 0 || series->timestamps[count] >= series->timestamps[count - 1]))
+		count++;
+
+	/*
+	 * A block summary is built in the same order as at the append, so a block whose samples all made it
+	 * gives the same bits. A summary behind its samples verifies the samples it counts, a summary ahead
+	 * of them or a mismatch drops the whole block.
+	 */
+	for(valid = 0 ; valid < count ; valid = end) {
+		block = valid / SEGMENT_BLOCK_SAMPLES;
+		end = count - valid < SEGMENT_BLOCK_SAMPLES ? count : valid + SEGMENT_BLOCK_SAMPLES;
+		if(header->blocks[block].count < end - valid)
+			end = valid + header->blocks[block].count;
+		if(end == valid || header->blocks[block].count > end - valid)
+			break;
+
+		memset(&summary, 0, sizeof(summary));
+		for(i = valid ; i < end ; i++)
+			addSeriesSample(&summary, series->timestamps[i], series->values[i]);
+		if(memcmp(&summary, &header->blocks[block], sizeof(summary)) != 0)
+			break;
+		if(end % SEGMENT_BLOCK_SAMPLES != 0) {
+			valid = end;
+			break;
+		}
+	}
+	count = valid;
+
+	if(count == header->sampleCount)
+		return;
+
+	printf("History segment %u of channel %u cut back from %u to %u samples\n",
+			header->sequence, header->channel, header->sampleCount, count);
+
+	for(block = count / SEGMENT_BLOCK_SAMPLES ; block < SEGMENT_BLOCKS ; block++)
+		memset(&header->blocks[block], 0, sizeof(series_summary_t));
+
+	for(i = count - count % SEGMENT_BLOCK_SAMPLES ; i < count ; i++)
+		addSeriesSample(&header->blocks[i / SEGMENT_BLOCK_SAMPLES], series->timestamps[i], series->values[i]);
+
+	header->sampleCount = count;
+	header->firstTimestamp = count > 0 ? series->timestamps[0] : 0;
+	header->lastTimestamp = count > 0 ? series->timestamps[count - 1] : 0;
+}
+
+static void closeActiveSegment(series_channel_t *series)
+{
+	if(series->map != NULL)
+		munmap(series->map, SEGMENT_FILE_SIZE);
+	if(series->fd >= 0)
+		close(series->fd);
+
+	series->map = NULL;
+	series->header = NULL;
+	series->timestamps = NULL;
+	series->values = NULL;
+	series->fd = -1;
+}
+
+/*
+ * Writes back the pages dirtied since the last sync. fdatasync() flushes the shared mapping of the
+ * file in one go; the header may land before the samples it counts, which recoverSegment() handles.
+ */
+static int syncChannel(series_channel_t *series)
+{
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	uint32_t count = series->header->sampleCount;
+	uint32_t firstBlock, lastBlock, pages;
+	size_t blocksStart, blocksEnd;
+
+	if(fdatasync(series->fd) < 0) {
+		perror("fdatasync() of the history failed");
+		return -1;
+	}
+
+	/* Account the pages the kernel had to write: the column tails, the block summaries and the first header page */
+	if(count > series->syncedCount) {
+		firstBlock = series->syncedCount / SEGMENT_BLOCK_SAMPLES;
+		lastBlock = (count - 1) / SEGMENT_BLOCK_SAMPLES;
+		blocksStart = offsetof(segment_header_t, blocks) + firstBlock * sizeof(series_summary_t);
+		blocksEnd = offsetof(segment_header_t, blocks) + (lastBlock + 1) * sizeof(series_summary_t);
+
+		pages = pagesSpanned(SEGMENT_TIMESTAMP_OFFSET + series->syncedCount * sizeof(uint64_t),
+				SEGMENT_TIMESTAMP_OFFSET + count * sizeof(uint64_t), pageSize);
+		pages += pagesSpanned(SEGMENT_VALUE_OFFSET + series->syncedCount * sizeof(float),
+				SEGMENT_VALUE_OFFSET + count * sizeof(float), pageSize);
+		pages += pagesSpanned(blocksStart, blocksEnd, pageSize);
+		if(blocksStart >= pageSize)
+			pages++;
+
+		series->bytesSynced += (uint64_t)pages * pageSize;
+		series->samplesSynced += count - series->syncedCount;
+	}
+
+	series->syncedCount = count;
+	return 0;
+}
+
+static uint32_t pagesSpanned(const size_t start, const size_t end, const size_t pageSize)
+{
+	if(end <= start)
+		return 0;
+	return (end - 1) / pageSize - start / pageSize + 1;
+}
+
+/* Maps the segment under the cursor read-only, past the last segment the cursor maps nothing */
+static int cursorMapSegment(series_cursor_t *cursor)
+{
+	series_channel_t *series = &cursor->store->channels[cursor->channel];
+	char path[TSDB_PATH_LENGTH + 32];
+	size_t index;
+
+	closeTimeSeriesCursor(cursor);
+
+	/* The segment of the cursor's sequence or the next one still kept */
+	pthread_mutex_lock(&series->mutex);
+	index = findSegment(series, cursor->sequence);
+	if(index >= series->segmentCount) {
+		pthread_mutex_unlock(&series->mutex);
+		return 0;
+	}
+	cursor->sequence = series->segments[index].sequence;
+	cursor->sampleCount = series->segments[index].sampleCount;
+	pthread_mutex_unlock(&series->mutex);
+
+	segmentPath(cursor->store, cursor->channel, cursor->sequence, path, sizeof(path));
+	return mapSegment(path, 0, &cursor->fd, &cursor->map);
+}
+
+/*
+ * Moves the cursor on to the next segment when its segment is read to the end. Returns how many
+ * samples from the cursor's offset are readable in one go, 0 at the end of the channel and -1 on failure.
+ */
+static int cursorNextRun(series_cursor_t *cursor, size_t maxSamples)
+{
+	series_channel_t *series = &cursor->store->channels[cursor->channel];
+	size_t available;
+
+	while(cursor->map != NULL) {
+		if(cursor->offset >= cursor->sampleCount) {
+			size_t index;
+			int newest = 0;
+
+			/* The newest segment may have grown since it was mapped, a dropped one is complete */
+			pthread_mutex_lock(&series->mutex);
+			index = findSegment(series, cursor->sequence);
+			if(index < series->segmentCount && series->segments[index].sequence == cursor->sequence) {
+				cursor->sampleCount = series->segments[index].sampleCount;
+				newest = index + 1 >= series->segmentCount;
+			}
+			pthread_mutex_unlock(&series->mutex);
+
+			if(cursor->offset >= cursor->sampleCount) {
+				if(newest)
+					return 0;
+
+				cursor->sequence++;
+				cursor->offset = 0;
+				if(cursorMapSegment(cursor) < 0)
+					return -1;
+				continue;
+			}
+		}
+
+		available = cursor->sampleCount - cursor->offset;
+		return (int)(available < maxSamples ? available : maxSamples);
+	}
+	return 0;
+}
+
+/* Binary search of the blocks and then of the block's timestamps, returns the first index at or after the timestamp */
+static uint32_t findSample(const segment_header_t *header, const uint64_t *timestamps, const uint64_t timestamp)
+{
+	uint32_t blocks = (header->sampleCount + SEGMENT_BLOCK_SAMPLES - 1) / SEGMENT_BLOCK_SAMPLES;
+	uint32_t low = 0, high = blocks, end;
+
+	while(low < high) {
+		uint32_t middle = low + (high - low) / 2;
+
+		if(header->blocks[middle].lastTimestamp < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if(low >= blocks)
+		return header->sampleCount;
+
+	end = low * SEGMENT_BLOCK_SAMPLES + header->blocks[low].count;
+	low = low * SEGMENT_BLOCK_SAMPLES;
+	high = end;
+	while(low < high) {
+		uint32_t middle = low + (high - low) / 2;
+
+		if(timestamps[middle] < timestamp)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/* Indexes the block summaries of every segment of the channel by hour and day */
+static int buildIndex(time_series_store_t *store, const int channel)
+{
+	series_channel_t *series = &store->channels[channel];
+	segment_header_t header;
+	uint32_t segment, block, blocks;
+
+	for(segment = 0 ; segment < series->segmentCount ; segment++) {
+		if(readSegmentHeader(store, channel, segment, &header) < 0)
+			return -1;
+
+		blocks = (header.sampleCount + SEGMENT_BLOCK_SAMPLES - 1) / SEGMENT_BLOCK_SAMPLES;
+		for(block = 0 ; block < blocks ; block++) {
+			if(indexSummary(series, segment, block, &header.blocks[block], 1) < 0)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Adds a summary to the newest hour and day. A block starting in a new hour opens the hour,
+ * and the day too when the hour is in a new day.
+ */
+static int indexSummary(series_channel_t *series, const uint32_t segmentIndex, const uint32_t blockIndex,
+		const series_summary_t *summary, const int startsBlock)
+{
+	uint64_t hour = summary->firstTimestamp / SUMMARY_HOUR_MS;
+	uint64_t day = summary->firstTimestamp / SUMMARY_DAY_MS;
+
+	if(startsBlock && (series->hourCount == 0 || series->hours[series->hourCount - 1].hour != hour)) {
+		summary_hour_t *newHour;
+
+		if(growArray((void **)&series->hours, &series->hourCapacity, series->hourCount, sizeof(summary_hour_t)) < 0)
+			return -1;
+
+		newHour = &series->hours[series->hourCount++];
+		memset(newHour, 0, sizeof(*newHour));
+		newHour->hour = hour;
+		newHour->segmentIndex = segmentIndex;
+		newHour->firstBlock = blockIndex;
+
+		if(series->dayCount == 0 || series->days[series->dayCount - 1].day != day) {
+			summary_day_t *newDay;
+
+			if(growArray((void **)&series->days, &series->dayCapacity, series->dayCount, sizeof(summary_day_t)) < 0)
+				return -1;
+
+			newDay = &series->days[series->dayCount++];
+			memset(newDay, 0, sizeof(*newDay));
+			newDay->day = day;
+			newDay->firstHour = series->hourCount - 1;
+		}
+	}
+
+	if(series->hourCount == 0)
+		return -1;
+
+	mergeSeriesSummary(&series->hours[series->hourCount - 1].summary, summary);
+	mergeSeriesSummary(&series->days[series->dayCount - 1].summary, summary);
+	return 0;
+}
+
+/* The mapped header of the segment being appended or the header read from the file */
+static int readSegmentHeader(time_series_store_t *store, const int channel, const uint32_t segmentIndex, segment_header_t *header)
+{
+	series_channel_t *series = &store->channels[channel];
+	char path[TSDB_PATH_LENGTH + 32];
+	int fd;
+
+	if(series->map != NULL && segmentIndex == series->segmentCount - 1) {
+		memcpy(header, series->header, sizeof(*header));
+		return 0;
+	}
+
+	segmentPath(store, channel, series->segments[segmentIndex].sequence, path, sizeof(path));
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		perror("Could not open a history segment");
+		return -1;
+	}
+	if(pread(fd, header, sizeof(*header), 0) != sizeof(*header)) {
+		perror("Could not read a history segment header");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/* Aggregates the blocks of an hour cut by the range, scanning the blocks which are cut too */
+static int aggregateHourBlocks(time_series_store_t *store, const int channel, const size_t hour, const uint64_t from,
+		const uint64_t to, segment_header_t *header, uint32_t *headerSegment, series_summary_t *result)
+{
+	series_channel_t *series = &store->channels[channel];
+	uint32_t segment = series->hours[hour].segmentIndex;
+	uint32_t block = series->hours[hour].firstBlock;
+
+	while(segment < series->segmentCount) {
+		const series_summary_t *summary;
+
+		if(*headerSegment != segment) {
+			if(readSegmentHeader(store, channel, segment, header) < 0)
+				return -1;
+			*headerSegment = segment;
+		}
+
+		if(block >= (header->sampleCount + SEGMENT_BLOCK_SAMPLES - 1) / SEGMENT_BLOCK_SAMPLES) {
+			segment++;
+			block = 0;
+			continue;
+		}
+
+		summary = &header->blocks[block];
+		if(summary->firstTimestamp / SUMMARY_HOUR_MS != series->hours[hour].hour || summary->firstTimestamp >= to)
+			break;
+
+		if(summaryInside(summary, from, to))
+			mergeSeriesSummary(result, summary);
+		else if(summary->lastTimestamp >= from &&
+				scanBlock(store, channel, segment, block, summary->count, from, to, result) < 0)
+			return -1;
+		block++;
+	}
+	return 0;
+}
+
+/* Adds the samples of one block inside [from, to) */
+static int scanBlock(time_series_store_t *store, const int channel, const uint32_t segmentIndex, const uint32_t blockIndex,
+		const uint32_t count, const uint64_t from, const uint64_t to, series_summary_t *result)
+{
+	series_channel_t *series = &store->channels[channel];
+	uint64_t timestamps[SEGMENT_BLOCK_SAMPLES];
+	float values[SEGMENT_BLOCK_SAMPLES];
+	size_t first = (size_t)blockIndex * SEGMENT_BLOCK_SAMPLES;
+	char path[TSDB_PATH_LENGTH + 32];
+	uint32_t i;
+	int fd;
+
+	if(series->map != NULL && segmentIndex == series->segmentCount - 1) {
+		memcpy(timestamps, series->timestamps + first, count * sizeof(uint64_t));
+		memcpy(values, series->values + first, count * sizeof(float));
+	}
+	else {
+		segmentPath(store, channel, series->segments[segmentIndex].sequence, path, sizeof(path));
+		fd = open(path, O_RDONLY);
+		if(fd < 0) {
+			perror("Could not open a history segment");
+			return -1;
+		}
+		if(pread(fd, timestamps, count * sizeof(uint64_t), SEGMENT_TIMESTAMP_OFFSET + first * sizeof(uint64_t)) !=
+					(ssize_t)(count * sizeof(uint64_t)) ||
+				pread(fd, values, count * sizeof(float), SEGMENT_VALUE_OFFSET + first * sizeof(float)) !=
+					(ssize_t)(count * sizeof(float))) {
+			perror("Could not read a history block");
+			close(fd);
+			return -1;
+		}
+		close(fd);
+	}
+
+	for(i = 0 ; i < count ; i++) {
+		if(timestamps[i] >= from && timestamps[i] < to)
+			addSeriesSample(result, timestamps[i], values[i]);
+	}
+	return 0;
+}
+
+static int summaryInside(const series_summary_t *summary, const uint64_t from, const uint64_t to)
+{
+	return summary->count > 0 && summary->firstTimestamp >= from && summary->lastTimestamp < to;
+}
+
+/* Index of the first segment with at least the sequence */
+static size_t findSegment(const series_channel_t *series, const uint32_t sequence)
+{
+	size_t low = 0, high = series->segmentCount;
+
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if(series->segments[middle].sequence < sequence)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/* Regroups the remaining hours into days after the oldest hours were dropped */
+static void rebuildDays(series_channel_t *series)
+{
+	size_t i;
+
+	series->dayCount = 0;
+	for(i = 0 ; i < series->hourCount ; i++) {
+		uint64_t day = series->hours[i].hour * SUMMARY_HOUR_MS / SUMMARY_DAY_MS;
+
+		if(series->dayCount == 0 || series->days[series->dayCount - 1].day != day) {
+			summary_day_t *newDay = &series->days[series->dayCount++];
+
+			memset(newDay, 0, sizeof(*newDay));
+			newDay->day = day;
+			newDay->firstHour = i;
+		}
+		mergeSeriesSummary(&series->days[series->dayCount - 1].summary, &series->hours[i].summary);
+	}
+}
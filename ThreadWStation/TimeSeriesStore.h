@@ -0,0 +1,177 @@
+/*
+ * TimeSeriesStore.h
+ */
+
+#ifndef TIMESERIESSTORE_H_
+#define TIMESERIESSTORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "thread.h"
+
+#define TSDB_DIRECTORY				"/var/lib/weatherstation"
+#define TSDB_PATH_LENGTH			256
+
+/*
+ * Segment file layout, one channel per file and native byte order:
+ *
+ *  0                            header with the time range and the block summaries
+ *  SEGMENT_HEADER_SIZE          timestamp column, SEGMENT_CAPACITY x 8 bytes
+ *  + SEGMENT_CAPACITY * 8       value column, SEGMENT_CAPACITY x 4 bytes
+ *
+ * The files are allocated at their full size when created and filled through mmap, so the data
+ * is never rewritten and only the header pages and the tail pages of the columns get dirty.
+ * Flushing is left to the caller, see syncTimeSeriesStore().
+ */
+#define SEGMENT_MAGIC				"WSEG"
+#define SEGMENT_FORMAT_VERSION		2
+#define SEGMENT_CAPACITY			65536
+#define SEGMENT_BLOCK_SAMPLES		512
+#define SEGMENT_BLOCKS				(SEGMENT_CAPACITY / SEGMENT_BLOCK_SAMPLES)
+#define SEGMENT_HEADER_SIZE			8192
+#define SEGMENT_TIMESTAMP_OFFSET	SEGMENT_HEADER_SIZE
+#define SEGMENT_VALUE_OFFSET		(SEGMENT_TIMESTAMP_OFFSET + SEGMENT_CAPACITY * sizeof(uint64_t))
+#define SEGMENT_FILE_SIZE			(SEGMENT_VALUE_OFFSET + SEGMENT_CAPACITY * sizeof(float))
+
+/* Index levels above the blocks, UTC */
+#define SUMMARY_HOUR_MS				3600000ULL
+#define SUMMARY_DAY_MS				86400000ULL
+
+/* Aggregate of a run of samples: a block of a segment, an hour or a day of the index or a query range */
+typedef struct series_summary
+{
+	uint64_t firstTimestamp;
+	uint64_t lastTimestamp;
+	double sum;
+	uint32_t count;
+	float min;
+	float max;
+	float first;
+	float last;
+} series_summary_t;
+
+typedef struct segment_header
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t channel;
+	uint32_t sequence;
+	uint32_t sampleCount;
+	uint64_t firstTimestamp;
+	uint64_t lastTimestamp;
+	unsigned char reserved[32];
+	series_summary_t blocks[SEGMENT_BLOCKS];
+} segment_header_t;
+
+/* What the store remembers of every segment of a channel without mapping it */
+typedef struct segment_info
+{
+	uint32_t sequence;
+	uint32_t sampleCount;
+	uint64_t firstTimestamp;
+	uint64_t lastTimestamp;
+} segment_info_t;
+
+/*
+ * In-memory index over the block summaries. An hour holds the blocks which start in it and a day holds
+ * its hours, so an hour's summary may reach a little into the next hour.
+ */
+typedef struct summary_hour
+{
+	series_summary_t summary;
+	uint64_t hour;
+	uint32_t segmentIndex;
+	uint32_t firstBlock;
+} summary_hour_t;
+
+typedef struct summary_day
+{
+	series_summary_t summary;
+	uint64_t day;
+	uint32_t firstHour;
+} summary_day_t;
+
+/* The segments and the summary index of one channel, the last segment is mapped for appending */
+typedef struct series_channel
+{
+	pthread_mutex_t mutex;
+	segment_info_t *segments;
+	size_t segmentCount;
+	size_t segmentCapacity;
+	int fd;
+	unsigned char *map;
+	segment_header_t *header;
+	uint64_t *timestamps;
+	float *values;
+	summary_hour_t *hours;
+	size_t hourCount;
+	size_t hourCapacity;
+	summary_day_t *days;
+	size_t dayCount;
+	size_t dayCapacity;
+	uint32_t syncedCount;
+	uint64_t bytesSynced;
+	uint64_t samplesSynced;
+} series_channel_t;
+
+typedef struct time_series_store
+{
+	char directory[TSDB_PATH_LENGTH];
+	series_channel_t channels[NUMBER_OF_CHANNELS];
+} time_series_store_t;
+
+/* Reads one channel forward from a timestamp, one segment mapped at a time. Segments are tracked by sequence so dropping old ones doesn't disturb the cursor. */
+typedef struct series_cursor
+{
+	time_series_store_t *store;
+	sensor_channel_t channel;
+	uint32_t sequence;
+	uint32_t offset;
+	uint32_t sampleCount;
+	int fd;
+	unsigned char *map;
+} series_cursor_t;
+
+/* Where a run of samples lies in a segment file, the timestamps and the values are two separate ranges */
+typedef struct series_extent
+{
+	int fd;
+	off_t timestampOffset;
+	off_t valueOffset;
+	uint32_t count;
+} series_extent_t;
+
+/* A segment mapped read-only for a scan, only the samples up to sampleCount are looked at */
+typedef struct segment_view
+{
+	int fd;
+	unsigned char *map;
+	const segment_header_t *header;
+	const uint64_t *timestamps;
+	const float *values;
+	uint32_t sampleCount;
+} segment_view_t;
+
+/* Function prototypes */
+int openTimeSeriesStore(time_series_store_t *store, const char *directory);
+int closeTimeSeriesStore(time_series_store_t *store);
+int timeSeriesAppend(time_series_store_t *store, const sensor_channel_t channel, const uint64_t timestamp, const float value);
+int syncTimeSeriesStore(time_series_store_t *store);
+void timeSeriesSyncStatistics(time_series_store_t *store, uint64_t *bytes, uint64_t *samples);
+int seekTimeSeries(time_series_store_t *store, const sensor_channel_t channel, const uint64_t timestamp, series_cursor_t *cursor);
+int readTimeSeries(series_cursor_t *cursor, uint64_t *timestamps, float *values, size_t maxSamples);
+int nextTimeSeriesExtent(series_cursor_t *cursor, const uint64_t to, size_t maxSamples, series_extent_t *extent);
+void closeTimeSeriesCursor(series_cursor_t *cursor);
+int timeSeriesAggregate(time_series_store_t *store, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		series_summary_t *result);
+int timeSeriesDropBefore(time_series_store_t *store, const sensor_channel_t channel, const uint64_t before);
+uint64_t timeSeriesFirstTimestamp(time_series_store_t *store, const sensor_channel_t channel);
+size_t timeSeriesSegments(time_series_store_t *store, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		segment_info_t *segments, size_t maxSegments);
+int openSegmentView(time_series_store_t *store, const sensor_channel_t channel, const segment_info_t *segment, segment_view_t *view);
+void closeSegmentView(segment_view_t *view);
+void addSeriesSample(series_summary_t *summary, const uint64_t timestamp, const float value);
+void mergeSeriesSummary(series_summary_t *summary, const series_summary_t *other);
+
+#endif /* TIMESERIESSTORE_H_ */
@@ -0,0 +1,671 @@
+/*
+ * WeatherFrame.c
+ *
+ * Length-prefixed, versioned and CRC32C checked frames for the sensor data sent through the network
+ * interfaces. Unlike the legacy format, which terminates the raw floats with FRAME_END_CHAR, a reader
+ * always knows where a frame ends and can resynchronize on the magic bytes after a corrupted frame.
+ */
+#include <string.h>
+#include <math.h>
+#include "WeatherFrame.h"
+#include "SerializeDeserialize.h"
+#include "SampleCompression.h"
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+
+/* Static function declarations */
+static void writeUint16(unsigned char *buffer, const uint16_t value);
+static void writeUint32(unsigned char *buffer, const uint32_t value);
+static uint16_t readUint16(const unsigned char *buffer);
+static uint32_t readUint32(const unsigned char *buffer);
+static void writeUint64(unsigned char *buffer, const uint64_t value);
+static uint64_t readUint64(const unsigned char *buffer);
+
+#ifndef __ARM_FEATURE_CRC32
+/* CRC32C (Castagnoli) lookup table of the reflected polynomial 0x82F63B78 */
+static const uint32_t crc32cTable[256] =
+{
+	0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C,
+	0x26A1E7E8, 0xD4CA64EB, 0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+	0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24, 0x105EC76F, 0xE235446C,
+	0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+	0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC,
+	0xBC267848, 0x4E4DFB4B, 0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+	0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35, 0xAA64D611, 0x580F5512,
+	0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+	0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD,
+	0x1642AE59, 0xE4292D5A, 0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+	0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595, 0x417B1DBC, 0xB3109EBF,
+	0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+	0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F,
+	0xED03A29B, 0x1F682198, 0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+	0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38, 0xDBFC821C, 0x2997011F,
+	0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+	0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E,
+	0x4767748A, 0xB50CF789, 0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+	0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46, 0x7198540D, 0x83F3D70E,
+	0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+	0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE,
+	0xDDE0EB2A, 0x2F8B6829, 0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+	0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93, 0x082F63B7, 0xFA44E0B4,
+	0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+	0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B,
+	0xB4091BFF, 0x466298FC, 0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+	0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033, 0xA24BB5A6, 0x502036A5,
+	0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+	0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975,
+	0x0E330A81, 0xFC588982, 0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+	0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622, 0x38CC2A06, 0xCAA7A905,
+	0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+	0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8,
+	0xE52CC12C, 0x1747422F, 0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+	0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0, 0xD3D3E1AB, 0x21B862A8,
+	0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+	0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78,
+	0x7FAB5E8C, 0x8DC0DD8F, 0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+	0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1, 0x69E9F0D5, 0x9B8273D6,
+	0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+	0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69,
+	0xD5CF889D, 0x27A40B9E, 0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+	0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351
+};
+#endif
+
+/* Calculates CRC32C of the data. Pass 0 as the crc to start a new checksum. */
+uint32_t crc32c(uint32_t crc, const unsigned char *data, size_t length)
+{
+	crc = ~crc;
+
+#ifdef __ARM_FEATURE_CRC32
+	/* ARMv8 has the CRC32C instructions */
+	while(length >= 4) {
+		uint32_t word;
+		memcpy(&word, data, sizeof(word));
+		crc = __crc32cw(crc, word);
+		data += 4;
+		length -= 4;
+	}
+	while(length--)
+		crc = __crc32cb(crc, *data++);
+#else
+	while(length--)
+		crc = crc32cTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+#endif
+
+	return ~crc;
+}
+
+/*
+ * Starts a frame in the buffer. The payload is appended after the header in place and finishFrame()
+ * fills in the length and the checksum. Returns -1 if the buffer can't hold an empty frame.
+ */
+int beginFrame(frame_encoder_t *encoder, unsigned char *buffer, size_t capacity, const unsigned char type,
+		const uint32_t sequence, const uint64_t timestamp)
+{
+	if(capacity < FRAME_OVERHEAD)
+		return -1;
+
+	encoder->buffer = buffer;
+	encoder->capacity = capacity;
+	encoder->length = FRAME_HEADER_SIZE;
+	encoder->sampleCount = 0;
+
+	buffer[0] = FRAME_MAGIC_0;
+	buffer[1] = FRAME_MAGIC_1;
+	buffer[2] = FRAME_VERSION;
+	buffer[3] = type;
+	writeUint16(buffer + 4, 0);
+	writeUint32(buffer + 6, sequence);
+	writeUint64(buffer + 10, timestamp);
+
+	/* Reserve the sample count of a samples or a push payload */
+	if(type == FRAME_TYPE_SAMPLES || type == FRAME_TYPE_PUSH) {
+		const unsigned char count[FRAME_SAMPLE_COUNT_SIZE] = { 0 };
+		return appendFramePayload(encoder, count, sizeof(count));
+	}
+	return 0;
+}
+
+int appendFramePayload(frame_encoder_t *encoder, const void *data, size_t length)
+{
+	if(encoder->length + length + FRAME_CRC_SIZE > encoder->capacity ||
+			encoder->length + length - FRAME_HEADER_SIZE > FRAME_MAX_PAYLOAD)
+		return -1;
+
+	memcpy(encoder->buffer + encoder->length, data, length);
+	encoder->length += length;
+	return 0;
+}
+
+/* Appends one sample record: channel, field and the big-endian IEEE 754 value */
+int appendFrameSample(frame_encoder_t *encoder, const unsigned char channel, const unsigned char field, const float value)
+{
+	unsigned char sample[FRAME_SAMPLE_SIZE];
+
+	sample[0] = channel;
+	sample[1] = field;
+	serializeFloat(sample + 2, value);
+
+	if(appendFramePayload(encoder, sample, sizeof(sample)) < 0)
+		return -1;
+
+	encoder->sampleCount++;
+	return 0;
+}
+
+/* Fills in the payload length, the sample count and the checksum. Returns the length of the whole frame. */
+size_t finishFrame(frame_encoder_t *encoder)
+{
+	unsigned char *buffer = encoder->buffer;
+	uint32_t crc;
+
+	writeUint16(buffer + 4, (uint16_t)(encoder->length - FRAME_HEADER_SIZE));
+
+	if(buffer[3] == FRAME_TYPE_SAMPLES || buffer[3] == FRAME_TYPE_PUSH)
+		writeUint16(buffer + FRAME_HEADER_SIZE, (uint16_t)encoder->sampleCount);
+
+	crc = crc32c(0, buffer, encoder->length);
+	writeUint32(buffer + encoder->length, crc);
+	encoder->length += FRAME_CRC_SIZE;
+
+	return encoder->length;
+}
+
+/*
+ * Decodes the frame at the beginning of the buffer without copying the payload.
+ * Returns the length of the frame, 0 if more bytes are needed and -1 if the bytes are not a valid frame.
+ */
+int decodeFrame(const unsigned char *buffer, size_t length, frame_view_t *frame)
+{
+	size_t frameLength;
+	uint16_t payloadLength;
+
+	if(length >= 1 && buffer[0] != FRAME_MAGIC_0)
+		return -1;
+	if(length >= 2 && buffer[1] != FRAME_MAGIC_1)
+		return -1;
+	if(length < FRAME_HEADER_SIZE)
+		return 0;
+	if(buffer[2] == 0 || buffer[2] > FRAME_VERSION)
+		return -1;
+
+	payloadLength = readUint16(buffer + 4);
+	frameLength = FRAME_OVERHEAD + payloadLength;
+	if(length < frameLength)
+		return 0;
+
+	if(crc32c(0, buffer, frameLength - FRAME_CRC_SIZE) != readUint32(buffer + frameLength - FRAME_CRC_SIZE))
+		return -1;
+
+	frame->version = buffer[2];
+	frame->type = buffer[3];
+	frame->payloadLength = payloadLength;
+	frame->sequence = readUint32(buffer + 6);
+	frame->timestamp = readUint64(buffer + 10);
+	frame->payload = buffer + FRAME_HEADER_SIZE;
+
+	return (int)frameLength;
+}
+
+/* Returns the offset of the next possible frame start after an invalid frame, used to resynchronize */
+size_t findFrameStart(const unsigned char *buffer, size_t length)
+{
+	size_t i;
+
+	for(i = 1 ; i < length ; i++) {
+		if(buffer[i] == FRAME_MAGIC_0 && (i + 1 == length || buffer[i + 1] == FRAME_MAGIC_1))
+			return i;
+	}
+	return length;
+}
+
+/* Returns the number of sample records in a samples or a push frame or -1 if the payload is malformed */
+int frameSampleCount(const frame_view_t *frame)
+{
+	uint16_t count;
+
+	if((frame->type != FRAME_TYPE_SAMPLES && frame->type != FRAME_TYPE_PUSH) || frame->payloadLength < FRAME_SAMPLE_COUNT_SIZE)
+		return -1;
+
+	count = readUint16(frame->payload);
+	if(FRAME_SAMPLE_COUNT_SIZE + (size_t)count * FRAME_SAMPLE_SIZE > frame->payloadLength)
+		return -1;
+
+	return count;
+}
+
+int readFrameSample(const frame_view_t *frame, const int index, unsigned char *channel, unsigned char *field, float *value)
+{
+	const unsigned char *sample;
+
+	if(index < 0 || index >= frameSampleCount(frame))
+		return -1;
+
+	sample = frame->payload + FRAME_SAMPLE_COUNT_SIZE + index * FRAME_SAMPLE_SIZE;
+	*channel = sample[0];
+	*field = sample[1];
+	*value = deserializeFloat(sample + 2);
+	return 0;
+}
+
+/* New connections talk the legacy format until the client negotiates a frame version */
+void initFrameSession(frame_session_t *session)
+{
+	session->version = 0;
+	session->compressed = 0;
+	session->sequence = 0;
+}
+
+/*
+ * Switches the session to the highest frame version both ends support. Version 0 switches back to the
+ * legacy format and FRAME_FLAG_COMPRESSED asks for compressed history exports, a transport without
+ * exports masks it off. The HELLO reply carries the chosen version with the accepted flags and the
+ * highest supported version.
+ * Returns the length of the reply, 0 if nothing is sent back.
+ */
+size_t negotiateFrameSession(frame_session_t *session, const unsigned char requestedVersion, unsigned char *buffer, size_t capacity)
+{
+	frame_encoder_t encoder;
+	unsigned char hello[2];
+
+	session->version = (requestedVersion & FRAME_VERSION_MASK) < FRAME_VERSION ? (requestedVersion & FRAME_VERSION_MASK) : FRAME_VERSION;
+	session->compressed = session->version > 0 && (requestedVersion & FRAME_FLAG_COMPRESSED);
+	if(session->version == 0)
+		return 0;
+
+	hello[0] = session->version | (session->compressed ? FRAME_FLAG_COMPRESSED : 0);
+	hello[1] = FRAME_VERSION;
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_HELLO, session->sequence++, timestampMs()) < 0 ||
+			appendFramePayload(&encoder, hello, sizeof(hello)) < 0)
+		return 0;
+
+	return finishFrame(&encoder);
+}
+
+/*
+ * Builds a frame of one channel's samples compressed in place into the frame payload: channel, field
+ * and the compressed block. As many samples as fit in the buffer are encoded and their number is
+ * returned in encoded, a count of 0 gives the empty frame which ends a compressed export.
+ * Returns the length of the frame, 0 if not even one sample fits.
+ */
+size_t encodeCompressedFrame(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char channel,
+		const unsigned char field, const uint64_t *timestamps, const float *values, size_t count, size_t *encoded)
+{
+	frame_encoder_t encoder;
+	compressed_block_encoder_t block;
+	unsigned char header[2];
+	size_t i, blockCapacity;
+
+	*encoded = 0;
+	header[0] = channel;
+	header[1] = field;
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_COMPRESSED_SAMPLES, session->sequence, timestampMs()) < 0 ||
+			appendFramePayload(&encoder, header, sizeof(header)) < 0)
+		return 0;
+
+	blockCapacity = capacity - encoder.length - FRAME_CRC_SIZE;
+	if(blockCapacity > FRAME_MAX_PAYLOAD - sizeof(header))
+		blockCapacity = FRAME_MAX_PAYLOAD - sizeof(header);
+
+	if(beginCompressedBlock(&block, buffer + encoder.length, blockCapacity) < 0)
+		return 0;
+
+	for(i = 0 ; i < count ; i++) {
+		if(appendCompressedSample(&block, timestamps[i], values[i]) < 0)
+			break;
+	}
+	if(i == 0 && count > 0)
+		return 0;
+
+	encoder.length += finishCompressedBlock(&block);
+	*encoded = i;
+	session->sequence++;
+	return finishFrame(&encoder);
+}
+
+/* Decodes a compressed samples frame. Returns the number of samples or -1 if the frame is malformed. */
+int decodeCompressedFrame(const frame_view_t *frame, unsigned char *channel, unsigned char *field,
+		uint64_t *timestamps, float *values, size_t maxSamples)
+{
+	if(frame->type != FRAME_TYPE_COMPRESSED_SAMPLES || frame->payloadLength < 2)
+		return -1;
+
+	*channel = frame->payload[0];
+	*field = frame->payload[1];
+	return decodeCompressedBlock(frame->payload + 2, frame->payloadLength - 2, timestamps, values, maxSamples);
+}
+
+/* Reads the channel and the range of an aggregate request. Returns -1 for an unknown channel or an empty range. */
+int parseAggregateRequest(const unsigned char *payload, unsigned char *channel, uint64_t *from, uint64_t *to)
+{
+	*channel = payload[0];
+	*from = readUint64(payload + 1);
+	*to = readUint64(payload + 9);
+
+	if(*channel >= NUMBER_OF_CHANNELS || *from >= *to)
+		return -1;
+	return 0;
+}
+
+/*
+ * Builds the reply of a range aggregate. The legacy reply is the count followed by min, max, mean,
+ * first and last and the end character. Returns the length of the reply, 0 if the buffer is too small.
+ */
+size_t encodeAggregateResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char channel,
+		const series_summary_t *summary)
+{
+	frame_encoder_t encoder;
+	unsigned char payload[AGGREGATE_RESPONSE_SIZE], *end;
+	float values[5];
+
+	values[0] = summary->min;
+	values[1] = summary->max;
+	values[2] = summary->count > 0 ? (float)(summary->sum / summary->count) : 0.0f;
+	values[3] = summary->first;
+	values[4] = summary->last;
+
+	if(session->version == 0) {
+		if(capacity < 4 + sizeof(values) + 1)
+			return 0;
+
+		end = serializeInt(buffer, (int)summary->count);
+		end = serializeFloatArray(end, values, 5);
+		*end++ = FRAME_END_CHAR;
+		return end - buffer;
+	}
+
+	payload[0] = channel;
+	writeUint32(payload + 1, summary->count);
+	writeUint64(payload + 5, summary->firstTimestamp);
+	writeUint64(payload + 13, summary->lastTimestamp);
+	serializeFloatArray(payload + 21, values, 5);
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_AGGREGATE, session->sequence++, timestampMs()) < 0 ||
+			appendFramePayload(&encoder, payload, sizeof(payload)) < 0)
+		return 0;
+
+	return finishFrame(&encoder);
+}
+
+size_t encodeHistoryStatusResponse(frame_session_t *session, unsigned char *buffer, size_t capacity,
+		const history_writer_status_t *status)
+{
+	frame_encoder_t encoder;
+	unsigned char payload[HISTORY_STATUS_RESPONSE_SIZE], *end;
+
+	if(session->version == 0) {
+		if(capacity < 5 * 4 + 1)
+			return 0;
+
+		end = serializeInt(buffer, (int)status->crashWindowMs);
+		end = serializeInt(end, (int)status->flushSamples);
+		end = serializeInt(end, (int)status->flushes);
+		end = serializeInt(end, (int)status->dropped);
+		end = serializeInt(end, status->maxFlushLatencyUs > INT32_MAX ? INT32_MAX : (int)status->maxFlushLatencyUs);
+		*end++ = FRAME_END_CHAR;
+		return end - buffer;
+	}
+
+	writeUint32(payload, status->crashWindowMs);
+	writeUint32(payload + 4, status->flushSamples);
+	writeUint32(payload + 8, status->flushes);
+	writeUint32(payload + 12, status->dropped);
+	writeUint64(payload + 16, status->maxFlushLatencyUs);
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_HISTORY_STATUS, session->sequence++, timestampMs()) < 0 ||
+			appendFramePayload(&encoder, payload, sizeof(payload)) < 0)
+		return 0;
+
+	return finishFrame(&encoder);
+}
+
+int parseDownsampleRequest(const unsigned char *payload, unsigned char *channel, uint64_t *from, uint64_t *to,
+		unsigned int *width, unsigned char *mode)
+{
+	*channel = payload[0];
+	*from = readUint64(payload + 1);
+	*to = readUint64(payload + 9);
+	*width = readUint16(payload + 17);
+	*mode = payload[19];
+
+	if(*channel >= NUMBER_OF_CHANNELS || *from >= *to || *width == 0 || *mode > DOWNSAMPLE_LTTB)
+		return -1;
+	return 0;
+}
+
+/*
+ * Builds the reply of a downsample request. The legacy reply is the series payload followed by the
+ * end character, the count tells where it ends. Returns the length of the reply, 0 if the buffer is too small.
+ */
+size_t encodeSeriesResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char channel,
+		const unsigned char mode, const downsample_point_t *points, const size_t count)
+{
+	size_t pointSize = mode == DOWNSAMPLE_LTTB ? SERIES_POINT_SIZE : SERIES_BUCKET_SIZE;
+	size_t overhead = session->version == 0 ? 1 : FRAME_OVERHEAD;
+	frame_encoder_t encoder;
+	unsigned char *payload, *end;
+	size_t i;
+
+	if(capacity < overhead + SERIES_HEADER_SIZE + count * pointSize || count > 0xFFFF)
+		return 0;
+
+	/* The payload is written in place, after the frame header when framed */
+	payload = session->version == 0 ? buffer : buffer + FRAME_HEADER_SIZE;
+	payload[0] = channel;
+	payload[1] = mode;
+	writeUint16(payload + 2, (uint16_t)count);
+	end = payload + SERIES_HEADER_SIZE;
+	for(i = 0 ; i < count ; i++) {
+		writeUint64(end, points[i].timestamp);
+		end += 8;
+		if(mode != DOWNSAMPLE_LTTB) {
+			end = serializeFloat(end, points[i].min);
+			end = serializeFloat(end, points[i].max);
+		}
+		end = serializeFloat(end, points[i].mean);
+	}
+
+	if(session->version == 0) {
+		*end++ = FRAME_END_CHAR;
+		return end - buffer;
+	}
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_SERIES, session->sequence++, timestampMs()) < 0)
+		return 0;
+	encoder.length += end - payload;
+	return finishFrame(&encoder);
+}
+
+/*
+ * Builds the reply of a windowed extremes request, bit n of the window mask selects extremes_window_t n.
+ * The legacy reply is the mask followed by the minimums and the maximums of every channel for each
+ * selected window, NaN for a channel without readings in the window, and the end character. The framed
+ * reply only carries the channels with readings. Returns the length of the reply, 0 if the buffer is too small.
+ */
+size_t encodeExtremesResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char windows,
+		const extremes_value_t extremes[NUMBER_OF_EXTREMES_WINDOWS][NUMBER_OF_CHANNELS])
+{
+	frame_encoder_t encoder;
+	unsigned char *end;
+	int window, channel, error = 0;
+
+	if(session->version == 0) {
+		if(capacity < 2 + NUMBER_OF_EXTREMES_WINDOWS * NUMBER_OF_CHANNELS * 2 * sizeof(float))
+			return 0;
+
+		end = buffer;
+		*end++ = windows;
+		for(window = 0 ; window < NUMBER_OF_EXTREMES_WINDOWS ; window++) {
+			if(!(windows & (1 << window)))
+				continue;
+			for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++)
+				end = serializeFloat(end, extremes[window][channel].valid ? extremes[window][channel].min : NAN);
+			for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++)
+				end = serializeFloat(end, extremes[window][channel].valid ? extremes[window][channel].max : NAN);
+		}
+		*end++ = FRAME_END_CHAR;
+		return end - buffer;
+	}
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_SAMPLES, session->sequence++, timestampMs()) < 0)
+		return 0;
+
+	for(window = 0 ; window < NUMBER_OF_EXTREMES_WINDOWS ; window++) {
+		if(!(windows & (1 << window)))
+			continue;
+		for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+			if(!extremes[window][channel].valid)
+				continue;
+			error |= appendFrameSample(&encoder, channel, SAMPLE_FIELD_WINDOW_MIN(window), extremes[window][channel].min);
+			error |= appendFrameSample(&encoder, channel, SAMPLE_FIELD_WINDOW_MIN(window) + 1, extremes[window][channel].max);
+		}
+	}
+
+	if(error)
+		return 0;
+
+	return finishFrame(&encoder);
+}
+
+/*
+ * Builds the reply of a statistics request. The legacy reply is the window followed by the count, mean,
+ * standard deviation, p5, p50, p95 and the three EWMAs of every channel, NaN for a channel without
+ * readings in the window, and the end character. The framed reply only carries the channels with
+ * readings. Returns the length of the reply, 0 if the buffer is too small.
+ */
+size_t encodeStatisticsResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char window,
+		const stats_snapshot_t stats[NUMBER_OF_CHANNELS])
+{
+	frame_encoder_t encoder;
+	unsigned char *end = buffer;
+	float values[2 + STATS_QUANTILES + STATS_EWMAS];
+	int channel, i, error = 0;
+
+	if(session->version == 0 && capacity < 2 + NUMBER_OF_CHANNELS * (4 + sizeof(values)))
+		return 0;
+
+	if(session->version == 0)
+		*end++ = window;
+	else if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_SAMPLES, session->sequence++, timestampMs()) < 0)
+		return 0;
+
+	for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+		values[0] = stats[channel].valid ? stats[channel].mean : NAN;
+		values[1] = stats[channel].valid ? stats[channel].stddev : NAN;
+		for(i = 0 ; i < STATS_QUANTILES ; i++)
+			values[2 + i] = stats[channel].valid ? stats[channel].quantiles[i] : NAN;
+		for(i = 0 ; i < STATS_EWMAS ; i++)
+			values[2 + STATS_QUANTILES + i] = stats[channel].ewma[i];
+
+		if(session->version == 0) {
+			end = serializeInt(end, stats[channel].valid ? (int)stats[channel].count : 0);
+			end = serializeFloatArray(end, values, 2 + STATS_QUANTILES + STATS_EWMAS);
+		}
+		else if(stats[channel].valid) {
+			for(i = 0 ; i < 2 + STATS_QUANTILES + STATS_EWMAS ; i++)
+				error |= appendFrameSample(&encoder, channel, SAMPLE_FIELD_MEAN + i, values[i]);
+		}
+	}
+
+	if(session->version == 0) {
+		*end++ = FRAME_END_CHAR;
+		return end - buffer;
+	}
+
+	if(error)
+		return 0;
+
+	return finishFrame(&encoder);
+}
+
+/*
+ * Builds the response of a sensor data request in the format negotiated for the session.
+ * The legacy batch response starts with the dataset mask, the legacy single responses are the bare
+ * serialized structs. Returns the length of the response, 0 if the buffer is too small.
+ */
+size_t encodeSensorResponse(frame_session_t *session, unsigned char *buffer, size_t capacity,
+		const thread_data_t *Data, const unsigned char datasets, const int batch)
+{
+	frame_encoder_t encoder;
+	unsigned char *end;
+	int error = 0;
+
+	if(session->version == 0) {
+
+		/* Mask, nine floats and the end character */
+		if(capacity < 38)
+			return 0;
+
+		if(batch)
+			end = serializeBatch(buffer, Data, datasets);
+		else if(datasets == BATCH_MAX_MIN_VALUES)
+			end = serializeStruct2(buffer, Data);
+		else
+			end = serializeStruct(buffer, Data);
+
+		*end++ = FRAME_END_CHAR;
+		return end - buffer;
+	}
+
+	if(beginFrame(&encoder, buffer, capacity, FRAME_TYPE_SAMPLES, session->sequence++, timestampMs()) < 0)
+		return 0;
+
+	if(datasets & BATCH_CURRENT_VALUES) {
+		error |= appendFrameSample(&encoder, CHANNEL_MPL3115A2_TEMPERATURE, SAMPLE_FIELD_CURRENT, Data->MPL3115A2temperature);
+		error |= appendFrameSample(&encoder, CHANNEL_HUMIDITY, SAMPLE_FIELD_CURRENT, Data->humidity);
+	}
+	if(datasets & BATCH_MAX_MIN_VALUES) {
+		error |= appendFrameSample(&encoder, CHANNEL_MPL3115A2_TEMPERATURE, SAMPLE_FIELD_MIN, Data->minMPL3115A2temperature);
+		error |= appendFrameSample(&encoder, CHANNEL_MPL3115A2_TEMPERATURE, SAMPLE_FIELD_MAX, Data->maxMPL3115A2temperature);
+		error |= appendFrameSample(&encoder, CHANNEL_HUMIDITY, SAMPLE_FIELD_MIN, Data->minHumidity);
+		error |= appendFrameSample(&encoder, CHANNEL_HUMIDITY, SAMPLE_FIELD_MAX, Data->maxHumidity);
+	}
+	if(datasets & BATCH_ENVIRONMENT_VALUES) {
+		error |= appendFrameSample(&encoder, CHANNEL_PRESSURE, SAMPLE_FIELD_CURRENT, Data->pressure);
+		error |= appendFrameSample(&encoder, CHANNEL_ALTITUDE, SAMPLE_FIELD_CURRENT, Data->altitude);
+		error |= appendFrameSample(&encoder, CHANNEL_TMP36_TEMPERATURE, SAMPLE_FIELD_CURRENT, Data->TMP36temperature);
+	}
+
+	if(error)
+		return 0;
+
+	return finishFrame(&encoder);
+}
+
+static void writeUint16(unsigned char *buffer, const uint16_t value)
+{
+	buffer[0] = value >> 8;
+	buffer[1] = value;
+}
+
+static void writeUint32(unsigned char *buffer, const uint32_t value)
+{
+	buffer[0] = value >> 24;
+	buffer[1] = value >> 16;
+	buffer[2] = value >> 8;
+	buffer[3] = value;
+}
+
+static uint16_t readUint16(const unsigned char *buffer)
+{
+	return (uint16_t)(buffer[0] << 8 | buffer[1]);
+}
+
+static uint32_t readUint32(const unsigned char *buffer)
+{
+	return (uint32_t)buffer[0] << 24 | (uint32_t)buffer[1] << 16 | (uint32_t)buffer[2] << 8 | buffer[3];
+}
+
+static void writeUint64(unsigned char *buffer, const uint64_t value)
+{
+	writeUint32(buffer, (uint32_t)(value >> 32));
+	writeUint32(buffer + 4, (uint32_t)value);
+}
+
+static uint64_t readUint64(const unsigned char *buffer)
+{
+	return (uint64_t)readUint32(buffer) << 32 | readUint32(buffer + 4);
+}
@@ -0,0 +1,166 @@
+/*
+ * WeatherFrame.h
+ */
+
+#ifndef WEATHERFRAME_H_
+#define WEATHERFRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "thread.h"
+#include "TimeSeriesStore.h"
+#include "WindowedExtremes.h"
+#include "StreamingStats.h"
+#include "Downsample.h"
+#include "HistoryWriter.h"
+
+/*
+ * Frame layout, all fields big-endian:
+ *
+ *  0  magic 'W' 'F'    2 bytes
+ *  2  version          1 byte
+ *  3  type             1 byte
+ *  4  payload length   2 bytes
+ *  6  sequence         4 bytes
+ * 10  timestamp (ms)   8 bytes
+ * 18  payload          0-65535 bytes
+ *  n  CRC32C           4 bytes over the header and the payload
+ */
+#define FRAME_MAGIC_0				'W'
+#define FRAME_MAGIC_1				'F'
+#define FRAME_VERSION				1
+#define FRAME_HEADER_SIZE			18
+#define FRAME_CRC_SIZE				4
+#define FRAME_OVERHEAD				(FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+#define FRAME_MAX_PAYLOAD			65535
+
+/* Negotiation flag allowing EXPORT_FORMAT_COMPRESSED history exports, the low bits are the version */
+#define FRAME_FLAG_COMPRESSED		0x80
+#define FRAME_VERSION_MASK			0x7F
+
+/* A samples payload is a 2 byte count followed by the sample records */
+#define FRAME_SAMPLE_COUNT_SIZE		2
+#define FRAME_SAMPLE_SIZE			6
+
+/*
+ * A range aggregate request is the channel and the range [from, to) as two 8 byte millisecond timestamps.
+ * The reply payload is the channel, the 4 byte count, the timestamps of the first and the last sample
+ * and min, max, mean, first and last as floats.
+ */
+#define AGGREGATE_REQUEST_SIZE		17
+#define AGGREGATE_RESPONSE_SIZE		41
+
+/*
+ * A series reply payload is the channel, the mode, the 2 byte point count and the points: the 8 byte
+ * timestamp followed by min, max and mean for DOWNSAMPLE_MIN_MAX_MEAN or by the value for DOWNSAMPLE_LTTB.
+ */
+#define SERIES_HEADER_SIZE			4
+#define SERIES_BUCKET_SIZE			20
+#define SERIES_POINT_SIZE			12
+
+/*
+ * A history status reply payload is the crash window in ms, the flush threshold in samples, the
+ * flushes and the dropped samples as 4 byte counts, then the longest flush in microseconds in 8 bytes.
+ */
+#define HISTORY_STATUS_RESPONSE_SIZE	24
+
+/* Frame types, FRAME_TYPE_PUSH carries samples sent to a subscriber unasked and answers no request */
+typedef enum
+{
+	FRAME_TYPE_HELLO				= 0x01,
+	FRAME_TYPE_SAMPLES				= 0x02,
+	FRAME_TYPE_COMPRESSED_SAMPLES	= 0x03,
+	FRAME_TYPE_AGGREGATE			= 0x04,
+	FRAME_TYPE_SERIES				= 0x05,
+	FRAME_TYPE_PUSH					= 0x06,
+	FRAME_TYPE_HISTORY_STATUS		= 0x07,
+	FRAME_TYPE_ERROR				= 0x7F,
+} frame_type_t;
+
+/* What a sample value of a channel means */
+typedef enum
+{
+	SAMPLE_FIELD_CURRENT			= 0x00,
+	SAMPLE_FIELD_MIN				= 0x01,
+	SAMPLE_FIELD_MAX				= 0x02,
+	SAMPLE_FIELD_MIN_1H				= 0x03,
+	SAMPLE_FIELD_MAX_1H				= 0x04,
+	SAMPLE_FIELD_MIN_24H			= 0x05,
+	SAMPLE_FIELD_MAX_24H			= 0x06,
+	SAMPLE_FIELD_MIN_7D				= 0x07,
+	SAMPLE_FIELD_MAX_7D				= 0x08,
+	SAMPLE_FIELD_MEAN				= 0x09,
+	SAMPLE_FIELD_STDDEV				= 0x0A,
+	SAMPLE_FIELD_P5					= 0x0B,
+	SAMPLE_FIELD_P50				= 0x0C,
+	SAMPLE_FIELD_P95				= 0x0D,
+	SAMPLE_FIELD_EWMA_1M			= 0x0E,
+	SAMPLE_FIELD_EWMA_15M			= 0x0F,
+	SAMPLE_FIELD_EWMA_1H			= 0x10,
+} sample_field_t;
+
+/* Field of the minimum of an extremes window, the maximum is the next field */
+#define SAMPLE_FIELD_WINDOW_MIN(window)	(SAMPLE_FIELD_MIN_1H + 2 * (window))
+
+/* Wire format negotiated for one connection, version 0 is the legacy 0xEE terminated format */
+typedef struct frame_session
+{
+	unsigned char version;
+	unsigned char compressed;
+	uint32_t sequence;
+} frame_session_t;
+
+/* Writes a frame straight into the caller's buffer */
+typedef struct frame_encoder
+{
+	unsigned char *buffer;
+	size_t capacity;
+	size_t length;
+	unsigned int sampleCount;
+} frame_encoder_t;
+
+/* Points into the received buffer, nothing is copied */
+typedef struct frame_view
+{
+	unsigned char version;
+	unsigned char type;
+	uint16_t payloadLength;
+	uint32_t sequence;
+	uint64_t timestamp;
+	const unsigned char *payload;
+} frame_view_t;
+
+/* Function prototypes */
+uint32_t crc32c(uint32_t crc, const unsigned char *data, size_t length);
+int beginFrame(frame_encoder_t *encoder, unsigned char *buffer, size_t capacity, const unsigned char type,
+		const uint32_t sequence, const uint64_t timestamp);
+int appendFramePayload(frame_encoder_t *encoder, const void *data, size_t length);
+int appendFrameSample(frame_encoder_t *encoder, const unsigned char channel, const unsigned char field, const float value);
+size_t finishFrame(frame_encoder_t *encoder);
+int decodeFrame(const unsigned char *buffer, size_t length, frame_view_t *frame);
+size_t findFrameStart(const unsigned char *buffer, size_t length);
+int frameSampleCount(const frame_view_t *frame);
+int readFrameSample(const frame_view_t *frame, const int index, unsigned char *channel, unsigned char *field, float *value);
+void initFrameSession(frame_session_t *session);
+size_t negotiateFrameSession(frame_session_t *session, const unsigned char requestedVersion, unsigned char *buffer, size_t capacity);
+size_t encodeCompressedFrame(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char channel,
+		const unsigned char field, const uint64_t *timestamps, const float *values, size_t count, size_t *encoded);
+int decodeCompressedFrame(const frame_view_t *frame, unsigned char *channel, unsigned char *field,
+		uint64_t *timestamps, float *values, size_t maxSamples);
+int parseAggregateRequest(const unsigned char *payload, unsigned char *channel, uint64_t *from, uint64_t *to);
+size_t encodeAggregateResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char channel,
+		const series_summary_t *summary);
+int parseDownsampleRequest(const unsigned char *payload, unsigned char *channel, uint64_t *from, uint64_t *to,
+		unsigned int *width, unsigned char *mode);
+size_t encodeSeriesResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char channel,
+		const unsigned char mode, const downsample_point_t *points, const size_t count);
+size_t encodeExtremesResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char windows,
+		const extremes_value_t extremes[NUMBER_OF_EXTREMES_WINDOWS][NUMBER_OF_CHANNELS]);
+size_t encodeStatisticsResponse(frame_session_t *session, unsigned char *buffer, size_t capacity, const unsigned char window,
+		const stats_snapshot_t stats[NUMBER_OF_CHANNELS]);
+size_t encodeHistoryStatusResponse(frame_session_t *session, unsigned char *buffer, size_t capacity,
+		const history_writer_status_t *status);
+size_t encodeSensorResponse(frame_session_t *session, unsigned char *buffer, size_t capacity,
+		const thread_data_t *Data, const unsigned char datasets, const int batch);
+
+#endif /* WEATHERFRAME_H_ */
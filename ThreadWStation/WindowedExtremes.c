@@ -0,0 +1,143 @@
+/*
+ * WindowedExtremes.c
+ *
+ * Min and max over a sliding time window in O(1) amortized time per sample. The samples are collected
+ * into buckets and the finished buckets' extremes are kept in monotonic deques: a bucket whose minimum
+ * is beaten by a newer bucket can never be the minimum again and is dropped from the back, and the
+ * buckets which slid out of the window are dropped from the front.
+ */
+#include <stddef.h>
+#include <math.h>
+#include "WindowedExtremes.h"
+
+/* Static function declarations */
+static void pushDeque(extremes_deque_t *deque, const uint64_t bucket, const float value, const int keepMinimum);
+static void expireDeque(extremes_deque_t *deque, const uint64_t oldestBucket);
+static const extremes_entry_t *oldestEntry(const extremes_deque_t *deque, const uint64_t oldestBucket);
+static uint64_t firstBucketInWindow(const uint64_t bucket);
+
+void initWindowedExtremes(windowed_extremes_t *extremes, const uint64_t windowMs)
+{
+	extremes->windowMs = windowMs;
+	extremes->bucketMs = windowMs / EXTREMES_BUCKETS;
+	extremes->hasCurrent = 0;
+	extremes->minDeque.head = 0;
+	extremes->minDeque.count = 0;
+	extremes->maxDeque.head = 0;
+	extremes->maxDeque.count = 0;
+}
+
+void updateWindowedExtremes(windowed_extremes_t *extremes, const uint64_t timestamp, const float value)
+{
+	uint64_t bucket = timestamp / extremes->bucketMs;
+
+	if(isnan(value))
+		return;
+
+	/* A clock stepping back keeps filling the current bucket */
+	if(extremes->hasCurrent && bucket <= extremes->currentBucket) {
+		if(value < extremes->currentMin)
+			extremes->currentMin = value;
+		if(value > extremes->currentMax)
+			extremes->currentMax = value;
+		return;
+	}
+
+	if(extremes->hasCurrent) {
+		pushDeque(&extremes->minDeque, extremes->currentBucket, extremes->currentMin, 1);
+		pushDeque(&extremes->maxDeque, extremes->currentBucket, extremes->currentMax, 0);
+	}
+
+	extremes->hasCurrent = 1;
+	extremes->currentBucket = bucket;
+	extremes->currentMin = value;
+	extremes->currentMax = value;
+
+	expireDeque(&extremes->minDeque, firstBucketInWindow(bucket));
+	expireDeque(&extremes->maxDeque, firstBucketInWindow(bucket));
+}
+
+/* Returns -1 if there were no samples in the window before now */
+int getWindowedExtremes(const windowed_extremes_t *extremes, const uint64_t now, float *min, float *max)
+{
+	uint64_t oldestBucket = firstBucketInWindow(now / extremes->bucketMs);
+	const extremes_entry_t *minEntry, *maxEntry;
+	int found = 0;
+
+	if(extremes->hasCurrent && extremes->currentBucket >= oldestBucket) {
+		*min = extremes->currentMin;
+		*max = extremes->currentMax;
+		found = 1;
+	}
+
+	minEntry = oldestEntry(&extremes->minDeque, oldestBucket);
+	if(minEntry != NULL && (!found || minEntry->value < *min))
+		*min = minEntry->value;
+
+	maxEntry = oldestEntry(&extremes->maxDeque, oldestBucket);
+	if(maxEntry != NULL && (!found || maxEntry->value > *max))
+		*max = maxEntry->value;
+
+	return found || minEntry != NULL ? 0 : -1;
+}
+
+uint64_t extremesWindowLength(const extremes_window_t window)
+{
+	static const uint64_t lengths[NUMBER_OF_EXTREMES_WINDOWS] =
+	{
+		[EXTREMES_WINDOW_1_HOUR]	= 3600000ULL,
+		[EXTREMES_WINDOW_24_HOURS]	= 24 * 3600000ULL,
+		[EXTREMES_WINDOW_7_DAYS]	= 7 * 24 * 3600000ULL,
+	};
+
+	return lengths[window];
+}
+
+/* Drops the entries the new one dominates and appends it */
+static void pushDeque(extremes_deque_t *deque, const uint64_t bucket, const float value, const int keepMinimum)
+{
+	while(deque->count > 0) {
+		const extremes_entry_t *last = &deque->entries[(deque->head + deque->count - 1) % (EXTREMES_BUCKETS + 1)];
+
+		if(keepMinimum ? last->value < value : last->value > value)
+			break;
+		deque->count--;
+	}
+
+	/* Only after a long gap in the clock can every bucket still be in the window */
+	if(deque->count == EXTREMES_BUCKETS + 1) {
+		deque->head = (deque->head + 1) % (EXTREMES_BUCKETS + 1);
+		deque->count--;
+	}
+
+	deque->entries[(deque->head + deque->count) % (EXTREMES_BUCKETS + 1)].bucket = bucket;
+	deque->entries[(deque->head + deque->count) % (EXTREMES_BUCKETS + 1)].value = value;
+	deque->count++;
+}
+
+static void expireDeque(extremes_deque_t *deque, const uint64_t oldestBucket)
+{
+	while(deque->count > 0 && deque->entries[deque->head].bucket < oldestBucket) {
+		deque->head = (deque->head + 1) % (EXTREMES_BUCKETS + 1);
+		deque->count--;
+	}
+}
+
+/* The front of the deque skipping what slid out of the window since the last update */
+static const extremes_entry_t *oldestEntry(const extremes_deque_t *deque, const uint64_t oldestBucket)
+{
+	unsigned int i;
+
+	for(i = 0 ; i < deque->count ; i++) {
+		const extremes_entry_t *entry = &deque->entries[(deque->head + i) % (EXTREMES_BUCKETS + 1)];
+
+		if(entry->bucket >= oldestBucket)
+			return entry;
+	}
+	return NULL;
+}
+
+static uint64_t firstBucketInWindow(const uint64_t bucket)
+{
+	return bucket > EXTREMES_BUCKETS ? bucket - EXTREMES_BUCKETS : 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * WindowedExtremes.h
+ */
+
+#ifndef WINDOWEDEXTREMES_H_
+#define WINDOWEDEXTREMES_H_
+
+#include <stdint.h>
+
+/*
+ * A window is split in EXTREMES_BUCKETS buckets. The window reaches back between its length and one
+ * bucket more, so the 1 hour window is exact to a minute and the 7 day window to 168 minutes.
+ */
+#define EXTREMES_BUCKETS			60
+
+/* Windows of the extremes, 'T' and the LCD report the 24 hour window */
+typedef enum
+{
+	EXTREMES_WINDOW_1_HOUR			= 0,
+	EXTREMES_WINDOW_24_HOURS		= 1,
+	EXTREMES_WINDOW_7_DAYS			= 2,
+	NUMBER_OF_EXTREMES_WINDOWS
+} extremes_window_t;
+
+#define EXTREMES_REPORT_WINDOW		EXTREMES_WINDOW_24_HOURS
+
+/* A snapshot of a window, valid is 0 when there were no readings in it */
+typedef struct extremes_value
+{
+	float min;
+	float max;
+	int valid;
+} extremes_value_t;
+
+typedef struct extremes_entry
+{
+	uint64_t bucket;
+	float value;
+} extremes_entry_t;
+
+/* Ring of the finished buckets' extremes, monotonic from the oldest to the newest */
+typedef struct extremes_deque
+{
+	extremes_entry_t entries[EXTREMES_BUCKETS + 1];
+	unsigned int head;
+	unsigned int count;
+} extremes_deque_t;
+
+typedef struct windowed_extremes
+{
+	uint64_t windowMs;
+	uint64_t bucketMs;
+	int hasCurrent;
+	uint64_t currentBucket;
+	float currentMin;
+	float currentMax;
+	extremes_deque_t minDeque;
+	extremes_deque_t maxDeque;
+} windowed_extremes_t;
+
+/* Function prototypes */
+void initWindowedExtremes(windowed_extremes_t *extremes, const uint64_t windowMs);
+void updateWindowedExtremes(windowed_extremes_t *extremes, const uint64_t timestamp, const float value);
+int getWindowedExtremes(const windowed_extremes_t *extremes, const uint64_t now, float *min, float *max);
+uint64_t extremesWindowLength(const extremes_window_t window);
+
+#endif /* WINDOWEDEXTREMES_H_ */
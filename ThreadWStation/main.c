@@ -1,22 +1,45 @@
 /*
  * main.c
  */
-#include "LCD.h"
+#include "LCDRenderer.h"
+#include "LCDDashboard.h"
 #include "BitBangMPL.h"
 //#include "MPL3115A2.h"
 #include "MCP3002SPI.h"
 #include "thread.h"
+#include "SamplePublisher.h"
+#include "Rollup.h"
+#include "StateCheckpoint.h"
+#ifdef LCD_EMULATOR
+#include "LCDEmulator.h"
+#endif
 
 int main(void)
 {
+	/* Start of the process, for the time until the restored statistics are served */
+	struct timespec started;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+
 	/* Structure of sensor measurement data */
 	thread_data_t sensorData;
 	memset(&sensorData, 0, sizeof(sensorData));
 
-	sensorData.minMPL3115A2temperature = FLT_MAX;
-	sensorData.maxMPL3115A2temperature = FLT_MIN;
-	sensorData.minHumidity = FLT_MAX;
-	sensorData.maxHumidity = FLT_MIN;
+	/* History of the published samples and its writer */
+	time_series_store_t history;
+	history_writer_config_t historyConfig;
+	static history_writer_t historyWriter;
+	static rollup_store_t rollups;
+	static scan_pool_t scanPool;
+	int historyEnabled = 0;
+
+	/* Pages of the LCD dashboard */
+	dashboard_config_t dashboardConfig;
+
+	/* Checkpoints of the in-memory aggregates */
+	static state_checkpoint_t checkpoint;
+	int checkpointsEnabled = 0;
+	uint64_t checkpointAge;
+	struct timespec serving;
 
 	pthread_t measureMPL3115A2Thread, measureMCP3002Thread, printToLCDThread, bluetoothRFCOMMThread;
 	int iret, iret1, iret2, iret3;
@@ -36,11 +59,24 @@ int main(void)
 	initMPL3115A2_I2C();
 #endif
 
-	/* LCD setup */
+	/* LCD setup, a build with LCD_EMULATOR defined shows the display on a virtual LCD */
+#ifdef LCD_EMULATOR
+	static lcd_emulator_t lcdEmulator;
+	if(startLCDEmulator(&lcdEmulator) == 0)
+		openSerial_LCD(lcdEmulator.path);
+	else
+		setup_Serial();
+#else
 	setup_Serial();
+#endif
 	clear_LCD();
-	setType_LCD(4, 16);
+	setType_LCD(LCD_LINES, LCD_COLUMNS);
 	setBacklight_LCD(250);
+	if(startLCDRenderer() < 0)
+		printf("LCD renderer disabled\n");
+	defaultDashboardConfig(&dashboardConfig);
+	if(initDashboard_LCD(&dashboardConfig) < 0)
+		printf("LCD dashboard disabled\n");
 
 	/* MCP3002SPI setup */
 	spiOpen();
@@ -48,12 +84,47 @@ int main(void)
 	/* Initialize mutex */
 	initMutex(&sensorData);
 
+	/* History setup */
+	defaultHistoryWriterConfig(&historyConfig);
+	if(openTimeSeriesStore(&history, TSDB_DIRECTORY) == 0) {
+		if(startHistoryWriter(&historyWriter, &history, &historyConfig) == 0)
+			historyEnabled = 1;
+		else
+			closeTimeSeriesStore(&history);
+	}
+	if(historyEnabled)
+		startScanPool(&scanPool, 0);
+	if(historyEnabled && startRollupCompaction(&rollups, &history, &scanPool) < 0)
+		printf("History rollups disabled\n");
+	else if(historyEnabled)
+		setPublishedRollups(&rollups);
+	if(!historyEnabled)
+		printf("History disabled\n");
+	initSamplePublisher(historyEnabled ? &historyWriter : NULL);
+
+	/* State restore, the windows and the statistics carry on where the last checkpoint left them */
+	if(openStateCheckpoint(&checkpoint, TSDB_DIRECTORY) == 0) {
+		if(restoreStateCheckpoint(&checkpoint, &checkpointAge) == 0)
+			printf("State restored from a checkpoint %llu s old\n", (unsigned long long)checkpointAge / 1000);
+		checkpointsEnabled = startStateCheckpoints(&checkpoint) == 0;
+	}
+	if(!checkpointsEnabled)
+		printf("State checkpoints disabled\n");
+	clock_gettime(CLOCK_MONOTONIC, &serving);
+	printf("Statistics served %.1f ms after start\n", (serving.tv_sec - started.tv_sec) * 1000.0 +
+			(serving.tv_nsec - started.tv_nsec) / 1000000.0);
+
 	printf("**************************************************\n");
 	printf("Print MPL3115A2 temperature by pressing t         \n");
 	printf("Print MPL3115A2 pressure by pressing    p         \n");
 	printf("Print MPL3115A2 altitude by pressing    a         \n");
 	printf("Print TMP36 temperature by pressing     y         \n");
 	printf("Print HIH4030 humidity by pressing      h         \n");
+	printf("Print temperature statistics by pressing T         \n");
+	printf("Print humidity statistics by pressing   H         \n");
+	printf("Hold the pressure trend by pressing     P         \n");
+	printf("Hold the humidity trend by pressing     U         \n");
+	printf("Rotate the dashboard pages by pressing  d         \n");
 	printf("Quit the program by pressing Ctrl+C               \n");
 	printf("**************************************************\n");
 
@@ -93,10 +164,34 @@ int main(void)
 	pthread_join(measureMCP3002Thread, NULL);
 	pthread_join(printToLCDThread, NULL);
 	pthread_join(bluetoothRFCOMMThread, NULL);
+	printPublisherStatistics();
+	stopLCDRenderer();
+	printRendererStatistics_LCD();
+	printDashboardStatistics_LCD();
+	printFrameStatistics_LCD();
+#ifdef LCD_EMULATOR
+	waitLCDEmulatorStable(&lcdEmulator, 5000);
+	printLCDEmulatorReport(&lcdEmulator);
+#endif
+	if(checkpoint.map != NULL) {
+		stopStateCheckpoints(&checkpoint);
+		printStateCheckpointStatistics(&checkpoint);
+	}
+	if(historyEnabled) {
+		setPublishedRollups(NULL);
+		stopRollupCompaction(&rollups);
+		stopScanPool(&scanPool);
+		stopHistoryWriter(&historyWriter);
+		printHistoryWriterStatistics(&historyWriter);
+		closeTimeSeriesStore(&history);
+	}
 
 	clear_LCD();
 	setBacklight_LCD(0);
 	serialLCD_Close();
+#ifdef LCD_EMULATOR
+	stopLCDEmulator(&lcdEmulator);
+#endif
 	spiClose();
 #ifdef MPL3115A2_H_
 	closeI2C();
@@ -0,0 +1,105 @@
+/*
+ * AggregateBench.c
+ *
+ * Latency of a range aggregate as the history grows from a day to a year of one channel at 1 Hz.
+ * At every size the whole history, its last 30 days and random ranges are aggregated from the
+ * summary index, and the whole history is also scanned sample by sample for comparison.
+ *
+ *   AggregateBench [days]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../TimeSeriesStore.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define SAMPLE_PERIOD_MS	1000
+#define RANDOM_RANGES		1000
+#define LAST_DAYS			30
+
+static const sensor_channel_t g_channel = CHANNEL_HUMIDITY;
+
+/* Returns the mean latency of the aggregates in microseconds */
+static double aggregateUs(time_series_store_t *store, const uint64_t from, const uint64_t to, const int repeats, uint32_t *count)
+{
+	series_summary_t summary;
+	uint64_t start = benchNowNs();
+	int i;
+
+	for(i = 0 ; i < repeats ; i++)
+		timeSeriesAggregate(store, g_channel, from, to, &summary);
+	*count = summary.count;
+	return (benchNowNs() - start) / 1e3 / repeats;
+}
+
+static double scanMs(time_series_store_t *store, const uint64_t to, uint64_t *count)
+{
+	static uint64_t timestamps[8192];
+	static float values[8192];
+	series_cursor_t cursor;
+	uint64_t start = benchNowNs();
+	double sum = 0.0;
+	int read, i;
+
+	*count = 0;
+	if(seekTimeSeries(store, g_channel, 0, &cursor) < 0)
+		return 0.0;
+	while((read = readTimeSeries(&cursor, timestamps, values, 8192)) > 0) {
+		for(i = 0 ; i < read && timestamps[i] < to ; i++)
+			sum += values[i];
+		*count += i;
+	}
+	closeTimeSeriesCursor(&cursor);
+	return (benchNowNs() - start) / 1e6 + (sum < 0.0 ? 1e-12 : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned int sizes[] = { 1, 7, 30, 90, 365 };
+	time_series_store_t store;
+	char directory[256];
+	unsigned int maxDays = argc > 1 ? (unsigned int)atoi(argv[1]) : 365;
+	uint64_t appended = 0, end, scanned, randomFrom, randomTo;
+	uint32_t seed = 0xC0FFEE, count, lastCount;
+	double wholeUs, lastUs, randomUs, bruteMs;
+	size_t s;
+	int i;
+
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+
+	printf("AggregateBench: %s at 1 Hz, aggregate latency in us\n", channelName(g_channel));
+	printf("  %5s %10s %10s %10s %10s %12s\n", "days", "samples", "whole", "last 30 d", "random", "scan (ms)");
+
+	for(s = 0 ; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= maxDays ; s++) {
+		end = (uint64_t)sizes[s] * 86400;
+		for( ; appended < end ; appended++) {
+			if(timeSeriesAppend(&store, g_channel, SYNTHETIC_EPOCH_MS + appended * SAMPLE_PERIOD_MS,
+					syntheticSample(g_channel, appended * SAMPLE_PERIOD_MS)) < 0)
+				return 1;
+		}
+		syncTimeSeriesStore(&store);
+
+		/* The ranges start and end off the block and the hour boundaries */
+		end = SYNTHETIC_EPOCH_MS + appended * SAMPLE_PERIOD_MS;
+		wholeUs = aggregateUs(&store, 0, UINT64_MAX, 100, &count);
+		lastUs = aggregateUs(&store, end > LAST_DAYS * SUMMARY_DAY_MS + 1234567 ? end - LAST_DAYS * SUMMARY_DAY_MS - 1234567 : 0,
+				end, 100, &lastCount);
+
+		randomUs = 0.0;
+		for(i = 0 ; i < RANDOM_RANGES ; i++) {
+			randomFrom = SYNTHETIC_EPOCH_MS + benchRandom(&seed) % appended * SAMPLE_PERIOD_MS + 137;
+			randomTo = randomFrom + benchRandom(&seed) % (appended * SAMPLE_PERIOD_MS);
+			randomUs += aggregateUs(&store, randomFrom, randomTo, 1, &lastCount);
+		}
+		randomUs /= RANDOM_RANGES;
+
+		bruteMs = scanMs(&store, UINT64_MAX, &scanned);
+		printf("  %5u %10llu %10.1f %10.1f %10.1f %12.1f%s\n", sizes[s], (unsigned long long)appended, wholeUs, lastUs,
+				randomUs, bruteMs, count == appended && scanned == appended ? "" : "  COUNT MISMATCH");
+	}
+
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+	return 0;
+}
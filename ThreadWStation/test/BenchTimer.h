@@ -0,0 +1,33 @@
+/*
+ * BenchTimer.h
+ *
+ * Clock of the benchmarks, a monotonic time in nanoseconds.
+ */
+
+#ifndef BENCHTIMER_H_
+#define BENCHTIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t benchNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* A small xorshift generator, the runs are repeatable on every machine */
+static inline uint32_t benchRandom(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+#endif /* BENCHTIMER_H_ */
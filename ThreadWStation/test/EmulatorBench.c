@@ -0,0 +1,199 @@
+/*
+ * EmulatorBench.c
+ *
+ * The display path against the pty LCD emulator: random 4x20 frames of text and glyphs are presented
+ * one after another, each changing a random part of the one before, and what the emulated glass shows
+ * once the frame is stable is compared with the frame. A glyph cell must show a CGRAM slot holding the
+ * glyph's bitmap. The time until a frame is stable is compared with the time its bytes take at 9600
+ * baud, and the emulator's counts of malformed commands and stray CGRAM writes must stay at 0.
+ *
+ *   EmulatorBench [frames]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../LCD.h"
+#include "../LCDFrame.h"
+#include "../LCDGlyph.h"
+#include "../LCDEmulator.h"
+#include "BenchTimer.h"
+
+#define FRAME_LINES			4
+#define FRAME_COLUMNS		20
+#define BAR_CODE_POINT		0x2580
+#define STABLE_TIMEOUT_MS	2000
+
+/* The glyphs of the frames, at most LCD_CGRAM_SLOTS of them in one frame */
+static const uint32_t g_codePoints[] = {
+	0x00E4, 0x00F6, 0x00E5, 0x00C4, 0x00D6, 0x00C5, 0x2191, 0x2193,
+	0x2581, 0x2582, 0x2583, 0x2584, 0x2585, 0x2586, 0x2587, 0x2588,
+};
+
+#define GLYPH_COUNT			(sizeof(g_codePoints) / sizeof(g_codePoints[0]))
+
+/* The bitmap each glyph was first seen with, the bar segments are known up front */
+static unsigned char g_rows[GLYPH_COUNT][LCD_GLYPH_ROWS];
+static int g_rowsKnown[GLYPH_COUNT];
+
+static void barRows(const int level, unsigned char *rows)
+{
+	int row;
+
+	for(row = 0 ; row < LCD_GLYPH_ROWS ; row++)
+		rows[row] = row >= LCD_GLYPH_ROWS - level ? 0x1F : 0x00;
+}
+
+/* Changes up to every cell of the frame, using at most LCD_CGRAM_SLOTS glyphs */
+static void mutateFrame(lcd_frame_t *frame, lcd_cell_t *glyphCells, uint32_t *seed)
+{
+	size_t glyphs[LCD_CGRAM_SLOTS];
+	uint32_t changes = 1 + benchRandom(seed) % (FRAME_LINES * FRAME_COLUMNS);
+	uint32_t i, pick;
+	int line, col;
+
+	for(i = 0 ; i < LCD_CGRAM_SLOTS ; i++)
+		glyphs[i] = benchRandom(seed) % GLYPH_COUNT;
+
+	/* The glyphs left from the frame before are replaced too, so no frame needs more than the slots */
+	for(line = 0 ; line < FRAME_LINES ; line++) {
+		for(col = 0 ; col < FRAME_COLUMNS ; col++) {
+			if(frame->cells[line][col] >= LCD_GLYPH_BASE)
+				frame->cells[line][col] = glyphCells[glyphs[0]];
+		}
+	}
+
+	for(i = 0 ; i < changes ; i++) {
+		line = benchRandom(seed) % FRAME_LINES;
+		col = benchRandom(seed) % FRAME_COLUMNS;
+		pick = benchRandom(seed) % 8;
+		if(pick < 5)
+			frame->cells[line][col] = ' ' + benchRandom(seed) % ('~' - ' ' + 1);
+		else if(pick < 7)
+			frame->cells[line][col] = glyphCells[glyphs[benchRandom(seed) % LCD_CGRAM_SLOTS]];
+		else
+			frame->cells[line][col] = 0xFF;
+	}
+}
+
+/* Waits until the emulator took every byte written so far, then until the frame is stable */
+static int waitFrame(lcd_emulator_t *emulator)
+{
+	const struct timespec step = { 0, 1000000L };
+	uint64_t deadline = benchNowNs() + STABLE_TIMEOUT_MS * 1000000ULL, received;
+	uint32_t writeCalls;
+	uint64_t written;
+
+	serialStatistics_LCD(&writeCalls, &written);
+	for(;;) {
+		pthread_mutex_lock(&emulator->mutex);
+		received = emulator->bytes;
+		pthread_mutex_unlock(&emulator->mutex);
+		if(received >= written)
+			break;
+		if(benchNowNs() > deadline)
+			return -1;
+		nanosleep(&step, NULL);
+	}
+	return waitLCDEmulatorStable(emulator, STABLE_TIMEOUT_MS);
+}
+
+/* Returns the number of cells which differ from the frame */
+static int compareScreen(lcd_emulator_t *emulator, const lcd_frame_t *frame, const lcd_cell_t *glyphCells)
+{
+	unsigned char screen[LCD_MAX_LINES][LCD_MAX_COLUMNS];
+	int slotGlyph[LCD_CGRAM_SLOTS];
+	int line, col, errors = 0;
+	size_t g;
+
+	readLCDEmulatorScreen(emulator, screen);
+	memset(slotGlyph, -1, sizeof(slotGlyph));
+
+	pthread_mutex_lock(&emulator->mutex);
+	for(line = 0 ; line < FRAME_LINES ; line++) {
+		for(col = 0 ; col < FRAME_COLUMNS ; col++) {
+			lcd_cell_t cell = frame->cells[line][col];
+			unsigned char shown = screen[line][col];
+
+			if(cell < LCD_GLYPH_BASE) {
+				errors += shown != cell;
+				continue;
+			}
+
+			/* A glyph shows a slot which no other glyph of the frame shows, holding its bitmap */
+			for(g = 0 ; g < GLYPH_COUNT && glyphCells[g] != cell ; g++)
+				;
+			if(shown >= LCD_CGRAM_SLOTS || (slotGlyph[shown] >= 0 && slotGlyph[shown] != (int)g)) {
+				errors++;
+				continue;
+			}
+			slotGlyph[shown] = g;
+			if(!g_rowsKnown[g]) {
+				memcpy(g_rows[g], emulator->cgram[shown], LCD_GLYPH_ROWS);
+				g_rowsKnown[g] = 1;
+			}
+			errors += memcmp(g_rows[g], emulator->cgram[shown], LCD_GLYPH_ROWS) != 0;
+		}
+	}
+	pthread_mutex_unlock(&emulator->mutex);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	static lcd_emulator_t emulator;
+	lcd_frame_t frame;
+	lcd_cell_t glyphCells[GLYPH_COUNT];
+	unsigned int frames = argc > 1 ? (unsigned int)atoi(argv[1]) : 200, i, mismatched = 0;
+	uint32_t seed = 0x5EED1CD, startFrames;
+	uint64_t bytes = 0, startStableUs;
+	double stableMs, wireMs;
+	size_t g;
+	int sent;
+
+	for(g = 0 ; g < GLYPH_COUNT ; g++) {
+		glyphCells[g] = (lcd_cell_t)glyphCell_LCD(g_codePoints[g]);
+		if(g_codePoints[g] > BAR_CODE_POINT) {
+			barRows(g_codePoints[g] - BAR_CODE_POINT, g_rows[g]);
+			g_rowsKnown[g] = 1;
+		}
+	}
+
+	if(startLCDEmulator(&emulator) < 0 || openSerial_LCD(emulator.path) < 0)
+		return 1;
+	setType_LCD(FRAME_LINES, FRAME_COLUMNS);
+	waitFrame(&emulator);
+
+	pthread_mutex_lock(&emulator.mutex);
+	startFrames = emulator.frames;
+	startStableUs = emulator.stableUsTotal;
+	pthread_mutex_unlock(&emulator.mutex);
+
+	clearFrame(&frame);
+	for(i = 0 ; i < frames ; i++) {
+		mutateFrame(&frame, glyphCells, &seed);
+		sent = presentFrame_LCD(&frame);
+		if(sent < 0)
+			return 1;
+		bytes += sent;
+
+		if(waitFrame(&emulator) < 0)
+			printf("Frame %u was not stable after %d ms\n", i, STABLE_TIMEOUT_MS);
+		if(compareScreen(&emulator, &frame, glyphCells) > 0)
+			mismatched++;
+	}
+
+	pthread_mutex_lock(&emulator.mutex);
+	stableMs = emulator.frames > startFrames ? (emulator.stableUsTotal - startStableUs) / 1000.0 / (emulator.frames - startFrames) : 0.0;
+	wireMs = emulator.frames > startFrames ? bytes * LCD_BITS_PER_BYTE * 1000.0 / LCD_BAUD_RATE / (emulator.frames - startFrames) : 0.0;
+	pthread_mutex_unlock(&emulator.mutex);
+
+	printf("EmulatorBench: %u random %dx%d frames, %u matched the emulated screen\n", frames, FRAME_LINES, FRAME_COLUMNS,
+			frames - mismatched);
+	printf("  stable after %.1f ms on average, %.1f ms predicted from the bytes sent\n", stableMs, wireMs);
+	printFrameStatistics_LCD();
+	printLCDEmulatorReport(&emulator);
+
+	serialLCD_Close();
+	stopLCDEmulator(&emulator);
+	return mismatched == 0 && emulator.malformed == 0 && emulator.cgramWrites == 0 ? 0 : 1;
+}
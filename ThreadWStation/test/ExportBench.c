@@ -0,0 +1,205 @@
+/*
+ * ExportBench.c
+ *
+ * Throughput of a history export and the CPU time the server thread spends on it, for every format
+ * and for a copy of the native format through user space as readTimeSeries() and write() would make
+ * it. The client is a thread reading a Unix socket pair as fast as it can, the server end is
+ * non-blocking and polled like the station's.
+ *
+ *   ExportBench [days]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../HistoryExport.h"
+#include "../TimeSeriesStore.h"
+#include "../WeatherFrame.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define SAMPLE_PERIOD_MS	1000
+#define COPY_SAMPLES		8192
+
+static const sensor_channel_t g_channel = CHANNEL_PRESSURE;
+
+static uint64_t threadCpuNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* The client reads until the server shuts its end down */
+static void *drainThread(void *argument)
+{
+	static unsigned char buffer[65536];
+	int socket = *(int *)argument;
+	ssize_t bytes;
+
+	while((bytes = read(socket, buffer, sizeof(buffer))) > 0)
+		;
+	return NULL;
+}
+
+static int waitWritable(const int socket)
+{
+	struct pollfd pending = { socket, POLLOUT, 0 };
+
+	return poll(&pending, 1, -1) < 0 ? -1 : 0;
+}
+
+static int writeAll(const int socket, const void *data, size_t length)
+{
+	const unsigned char *bytes = data;
+	ssize_t written;
+
+	while(length > 0) {
+		written = write(socket, bytes, length);
+		if(written < 0) {
+			if(waitWritable(socket) < 0)
+				return -1;
+			continue;
+		}
+		bytes += written;
+		length -= written;
+	}
+	return 0;
+}
+
+/* The native chunks built in user space: the columns are read, then written to the socket */
+static int copyExport(time_series_store_t *store, const int socket, const uint64_t from, const uint64_t to, uint64_t *bytes)
+{
+	static uint64_t timestamps[COPY_SAMPLES];
+	static float values[COPY_SAMPLES];
+	unsigned char header[EXPORT_CHUNK_HEADER_SIZE] = { 'W', 'X', g_channel, EXPORT_CHUNK_VERSION };
+	series_cursor_t cursor;
+	int read, count, status = 0;
+
+	*bytes = 0;
+	if(seekTimeSeries(store, g_channel, from, &cursor) < 0)
+		return -1;
+	do {
+		read = readTimeSeries(&cursor, timestamps, values, COPY_SAMPLES);
+		for(count = 0 ; count < read && timestamps[count] < to ; count++)
+			;
+		header[4] = count >> 24;
+		header[5] = count >> 16;
+		header[6] = count >> 8;
+		header[7] = count;
+		if(writeAll(socket, header, sizeof(header)) < 0 || writeAll(socket, timestamps, count * sizeof(uint64_t)) < 0 ||
+				writeAll(socket, values, count * sizeof(float)) < 0) {
+			status = -1;
+			break;
+		}
+		*bytes += sizeof(header) + count * (sizeof(uint64_t) + sizeof(float));
+	} while(count > 0 && count == read);
+	closeTimeSeriesCursor(&cursor);
+
+	/* The range ended inside a chunk, the empty one is still to go */
+	if(status == 0 && count > 0) {
+		memset(header + 4, 0, 4);
+		status = writeAll(socket, header, sizeof(header));
+		*bytes += sizeof(header);
+	}
+	return status;
+}
+
+/* Runs one export, format -1 is the user space copy. Prints the bytes, the throughput and the CPU time. */
+static int runExport(time_series_store_t *store, frame_session_t *session, const int format, const uint64_t from,
+		const uint64_t to, const uint64_t samples)
+{
+	static history_export_t exporter;
+	unsigned char request[EXPORT_REQUEST_SIZE];
+	pthread_t drain;
+	uint64_t wallNs, cpuNs, bytes;
+	int sockets[2], status, i;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+		return -1;
+	fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+	if(pthread_create(&drain, NULL, drainThread, &sockets[1]) != 0)
+		return -1;
+
+	request[0] = g_channel;
+	for(i = 0 ; i < 8 ; i++) {
+		request[1 + i] = from >> (56 - 8 * i);
+		request[9 + i] = to >> (56 - 8 * i);
+	}
+	request[17] = format;
+
+	wallNs = benchNowNs();
+	cpuNs = threadCpuNs();
+	if(format < 0)
+		status = copyExport(store, sockets[0], from, to, &bytes);
+	else {
+		beginHistoryExport(&exporter, store, session, request);
+		while((status = continueHistoryExport(&exporter, sockets[0])) > 0) {
+			if(waitWritable(sockets[0]) < 0)
+				break;
+		}
+		bytes = exporter.bytes;
+		endHistoryExport(&exporter);
+	}
+	cpuNs = threadCpuNs() - cpuNs;
+	shutdown(sockets[0], SHUT_WR);
+	pthread_join(drain, NULL);
+	wallNs = benchNowNs() - wallNs;
+
+	printf("  %-12s %10llu bytes %7.1f ms %8.1f MB/s %8.1f M samples/s  CPU %6.1f ms (%3.0f %%)\n",
+			format < 0 ? "user copy" : format == EXPORT_FORMAT_NATIVE ? "native" : format == EXPORT_FORMAT_CSV ? "CSV" : "compressed",
+			(unsigned long long)bytes, wallNs / 1e6, bytes * 1e3 / wallNs, samples * 1e3 / wallNs, cpuNs / 1e6,
+			100.0 * cpuNs / wallNs);
+
+	close(sockets[0]);
+	close(sockets[1]);
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int formats[] = { EXPORT_FORMAT_NATIVE, -1, EXPORT_FORMAT_CSV, EXPORT_FORMAT_COMPRESSED };
+	time_series_store_t store;
+	frame_session_t session;
+	unsigned char hello[64];
+	char directory[256];
+	double days = argc > 1 ? atof(argv[1]) : 7.0;
+	uint64_t samples = (uint64_t)(days * 86400.0), i;
+	uint64_t from = SYNTHETIC_EPOCH_MS, to = SYNTHETIC_EPOCH_MS + samples * SAMPLE_PERIOD_MS;
+	size_t f;
+
+	if(samples == 0) {
+		printf("Usage: %s [days]\n", argv[0]);
+		return 1;
+	}
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+
+	for(i = 0 ; i < samples ; i++) {
+		if(timeSeriesAppend(&store, g_channel, from + i * SAMPLE_PERIOD_MS, syntheticSample(g_channel, i * SAMPLE_PERIOD_MS)) < 0)
+			return 1;
+	}
+	syncTimeSeriesStore(&store);
+
+	initFrameSession(&session);
+	negotiateFrameSession(&session, FRAME_VERSION | FRAME_FLAG_COMPRESSED, hello, sizeof(hello));
+
+	/* The first run reads the segments into the page cache, the exports all find them there */
+	printf("ExportBench: %llu samples of %s over a Unix socket pair\n", (unsigned long long)samples, channelName(g_channel));
+	runExport(&store, &session, EXPORT_FORMAT_NATIVE, from, to, samples);
+	for(f = 0 ; f < sizeof(formats) / sizeof(formats[0]) ; f++) {
+		if(runExport(&store, &session, formats[f], from, to, samples) < 0) {
+			printf("Export failed\n");
+			return 1;
+		}
+	}
+
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+	return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * HistoryExportTest.c
+ *
+ * Exports a synthetic day of history through a socket pair in the native, CSV and compressed formats.
+ * The compressed frames are decoded as a client would and compared with the store, and the export
+ * sizes of the formats are printed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../HistoryExport.h"
+#include "../TimeSeriesStore.h"
+#include "../WeatherFrame.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define DAY_SAMPLES			86400
+#define SAMPLE_PERIOD_MS	1000
+
+static unsigned int g_checks;
+static unsigned int g_failures;
+
+/* What the client received of one export */
+typedef struct received
+{
+	unsigned char *data;
+	size_t length;
+	size_t capacity;
+} received_t;
+
+static void check(int condition, const char *what)
+{
+	g_checks++;
+	if(!condition) {
+		g_failures++;
+		printf("FAIL %s\n", what);
+	}
+}
+
+static int drain(const int socket, received_t *received)
+{
+	ssize_t bytes;
+
+	for(;;) {
+		if(received->capacity - received->length < 65536) {
+			received->capacity = received->capacity * 2 + 65536;
+			received->data = realloc(received->data, received->capacity);
+			if(received->data == NULL)
+				return -1;
+		}
+		bytes = read(socket, received->data + received->length, received->capacity - received->length);
+		if(bytes < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		if(bytes == 0)
+			return 0;
+		received->length += bytes;
+	}
+}
+
+/* Runs the export as the server does, the client end is read whenever the socket is full */
+static int runExport(time_series_store_t *store, frame_session_t *session, const unsigned char *request, received_t *received)
+{
+	static history_export_t exporter;
+	int sockets[2], status;
+
+	received->length = 0;
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+		return -1;
+	fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+	fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+
+	beginHistoryExport(&exporter, store, session, request);
+	while((status = continueHistoryExport(&exporter, sockets[0])) > 0) {
+		if(drain(sockets[1], received) < 0)
+			break;
+	}
+	endHistoryExport(&exporter);
+	if(status == 0)
+		status = drain(sockets[1], received);
+
+	close(sockets[0]);
+	close(sockets[1]);
+	return status;
+}
+
+static void makeRequest(unsigned char *request, const unsigned char channel, const uint64_t from, const uint64_t to,
+		const unsigned char format)
+{
+	int i;
+
+	request[0] = channel;
+	for(i = 0 ; i < 8 ; i++) {
+		request[1 + i] = from >> (56 - 8 * i);
+		request[9 + i] = to >> (56 - 8 * i);
+	}
+	request[17] = format;
+}
+
+/* Decodes the frames of a compressed export. Returns the number of samples, -1 if the export is malformed. */
+static long decodeCompressedExport(const received_t *received, const unsigned char channel, uint64_t *timestamps, float *values,
+		size_t maxSamples, size_t *frames)
+{
+	frame_view_t frame;
+	unsigned char frameChannel, field;
+	size_t offset = 0, total = 0;
+	int length, count;
+
+	*frames = 0;
+	while(offset < received->length) {
+		length = decodeFrame(received->data + offset, received->length - offset, &frame);
+		if(length <= 0)
+			return -1;
+		count = decodeCompressedFrame(&frame, &frameChannel, &field, timestamps + total, values + total, maxSamples - total);
+		if(count < 0 || frameChannel != channel || field != SAMPLE_FIELD_CURRENT)
+			return -1;
+		offset += length;
+		total += count;
+		(*frames)++;
+
+		/* The empty frame is the last one */
+		if(count == 0)
+			return offset == received->length ? (long)total : -1;
+	}
+	return -1;
+}
+
+/* The samples of [from, to) as the store has them */
+static size_t storedRange(time_series_store_t *store, const sensor_channel_t channel, const uint64_t from, const uint64_t to,
+		uint64_t *timestamps, float *values, size_t maxSamples)
+{
+	series_cursor_t cursor;
+	size_t count = 0;
+	int read, i;
+
+	if(seekTimeSeries(store, channel, from, &cursor) < 0)
+		return 0;
+	while(count < maxSamples && (read = readTimeSeries(&cursor, timestamps + count, values + count, maxSamples - count)) > 0) {
+		for(i = 0 ; i < read && timestamps[count] < to ; i++)
+			count++;
+		if(i < read)
+			break;
+	}
+	closeTimeSeriesCursor(&cursor);
+	return count;
+}
+
+static void checkCompressedRange(time_series_store_t *store, frame_session_t *session, const sensor_channel_t channel,
+		const uint64_t from, const uint64_t to, received_t *received, const char *name)
+{
+	static uint64_t expectedTimestamps[DAY_SAMPLES + 1], timestamps[DAY_SAMPLES + 1];
+	static float expectedValues[DAY_SAMPLES + 1], values[DAY_SAMPLES + 1];
+	unsigned char request[EXPORT_REQUEST_SIZE];
+	size_t expected, frames;
+	long count;
+
+	expected = storedRange(store, channel, from, to, expectedTimestamps, expectedValues, DAY_SAMPLES + 1);
+	makeRequest(request, channel, from, to, EXPORT_FORMAT_COMPRESSED);
+	check(runExport(store, session, request, received) == 0, name);
+
+	count = decodeCompressedExport(received, channel, timestamps, values, DAY_SAMPLES + 1, &frames);
+	check(count == (long)expected, name);
+	check(count >= 0 && memcmp(timestamps, expectedTimestamps, expected * sizeof(uint64_t)) == 0 &&
+			memcmp(values, expectedValues, expected * sizeof(float)) == 0, name);
+
+	printf("  %-24s %6zu samples in %3zu frames, %8zu bytes, %5.2f bits/sample\n", name, expected, frames,
+			received->length, expected > 0 ? received->length * 8.0 / expected : 0.0);
+}
+
+int main(void)
+{
+	static const sensor_channel_t channels[] = { CHANNEL_MPL3115A2_TEMPERATURE, CHANNEL_PRESSURE, CHANNEL_HUMIDITY };
+	time_series_store_t store;
+	frame_session_t plain, compressed;
+	unsigned char hello[64], request[EXPORT_REQUEST_SIZE];
+	received_t received = { NULL, 0, 0 };
+	char directory[256];
+	size_t nativeLength;
+	uint64_t start = SYNTHETIC_EPOCH_MS, end = SYNTHETIC_EPOCH_MS + (uint64_t)DAY_SAMPLES * SAMPLE_PERIOD_MS;
+	size_t c, i;
+
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+
+	for(c = 0 ; c < sizeof(channels) / sizeof(channels[0]) ; c++) {
+		for(i = 0 ; i < DAY_SAMPLES ; i++)
+			timeSeriesAppend(&store, channels[c], start + i * SAMPLE_PERIOD_MS, syntheticSample(channels[c], i * SAMPLE_PERIOD_MS));
+	}
+
+	/* One session asks for compression, the other one doesn't */
+	initFrameSession(&plain);
+	initFrameSession(&compressed);
+	negotiateFrameSession(&plain, FRAME_VERSION, hello, sizeof(hello));
+	check(negotiateFrameSession(&compressed, FRAME_VERSION | FRAME_FLAG_COMPRESSED, hello, sizeof(hello)) > 0, "HELLO");
+	check(compressed.compressed && !plain.compressed, "compression negotiated");
+
+	printf("HistoryExportTest: a day at 1 Hz\n");
+	for(c = 0 ; c < sizeof(channels) / sizeof(channels[0]) ; c++) {
+		makeRequest(request, channels[c], start, end, EXPORT_FORMAT_NATIVE);
+		check(runExport(&store, &plain, request, &received) == 0, "native export");
+		check(received.length > DAY_SAMPLES * (sizeof(uint64_t) + sizeof(float)) &&
+				(received.length - DAY_SAMPLES * (sizeof(uint64_t) + sizeof(float))) % EXPORT_CHUNK_HEADER_SIZE == 0,
+				"native export length");
+		nativeLength = received.length;
+
+		makeRequest(request, channels[c], start, end, EXPORT_FORMAT_CSV);
+		check(runExport(&store, &plain, request, &received) == 0, "CSV export");
+		printf("  %-24s native %8zu bytes, CSV %8zu bytes\n", channelName(channels[c]), nativeLength, received.length);
+
+		checkCompressedRange(&store, &compressed, channels[c], start, end, &received, channelName(channels[c]));
+	}
+
+	/* A range starting and ending inside the batches and the segments, and an empty range */
+	checkCompressedRange(&store, &compressed, CHANNEL_HUMIDITY, start + 70000500, start + 70003500, &received, "3 s inside a segment");
+	checkCompressedRange(&store, &compressed, CHANNEL_HUMIDITY, start + 65000000, start + 67000000, &received, "across segments");
+	checkCompressedRange(&store, &compressed, CHANNEL_HUMIDITY, end + 1000, end + 5000, &received, "after the history");
+
+	/* Without the negotiated flag the export is an empty native one */
+	makeRequest(request, CHANNEL_HUMIDITY, start, end, EXPORT_FORMAT_COMPRESSED);
+	check(runExport(&store, &plain, request, &received) == 0, "compressed export without compression");
+	check(received.length == EXPORT_CHUNK_HEADER_SIZE && received.data[0] == 'W' && received.data[1] == 'X' &&
+			received.data[7] == 0, "empty native export without compression");
+
+	free(received.data);
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+
+	printf("HistoryExportTest: %u checks, %u failures\n", g_checks, g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
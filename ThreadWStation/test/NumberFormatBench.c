@@ -0,0 +1,94 @@
+/*
+ * NumberFormatBench.c
+ *
+ * Cost of the number formatting of the LCD and the CSV export against snprintf(), in nanoseconds per
+ * value: formatFixed and formatFloat against "%.2f%s" with a unit, as the dashboard writes a reading,
+ * and formatSignificant against "%.7g", as the CSV export writes a sample. The values are synthetic
+ * pressures and temperatures.
+ *
+ *   NumberFormatBench [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../NumberFormat.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define BENCH_VALUES		4096
+
+static float g_values[BENCH_VALUES];
+static int64_t g_fixed[BENCH_VALUES];
+
+static void printLine(const char *name, const char *against, const uint64_t oursNs, const uint64_t libcNs,
+		const unsigned long count)
+{
+	printf("  %-18s %7.1f  snprintf(%-10s %7.1f  %4.1fx\n", name, (double)oursNs / count, against,
+			(double)libcNs / count, (double)libcNs / oursNs);
+}
+
+int main(int argc, char *argv[])
+{
+	char buf[64];
+	unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 500, count, r;
+	uint64_t start, ours, libc;
+	size_t checksum = 0;
+	int i;
+
+	if(rounds == 0) {
+		printf("Usage: %s [rounds]\n", argv[0]);
+		return 1;
+	}
+	count = rounds * BENCH_VALUES;
+
+	for(i = 0 ; i < BENCH_VALUES ; i++) {
+		g_values[i] = syntheticSample(i & 1 ? CHANNEL_PRESSURE : CHANNEL_MPL3115A2_TEMPERATURE, i * 60000ULL);
+		g_fixed[i] = (int64_t)(g_values[i] * 1000.0f);
+	}
+
+	printf("NumberFormatBench: %lu values, ns per value\n", count);
+
+	start = benchNowNs();
+	for(r = 0 ; r < rounds ; r++) {
+		for(i = 0 ; i < BENCH_VALUES ; i++)
+			checksum += formatFixed(buf, sizeof(buf), g_fixed[i], 3, 2, "hPa", 0);
+	}
+	ours = benchNowNs() - start;
+	start = benchNowNs();
+	for(r = 0 ; r < rounds ; r++) {
+		for(i = 0 ; i < BENCH_VALUES ; i++)
+			checksum += snprintf(buf, sizeof(buf), "%.2f%s", g_fixed[i] / 1000.0, "hPa");
+	}
+	libc = benchNowNs() - start;
+	printLine("formatFixed", "\"%.2f%s\")", ours, libc, count);
+
+	start = benchNowNs();
+	for(r = 0 ; r < rounds ; r++) {
+		for(i = 0 ; i < BENCH_VALUES ; i++)
+			checksum += formatFloat(buf, sizeof(buf), g_values[i], 2, "hPa", 0);
+	}
+	ours = benchNowNs() - start;
+	start = benchNowNs();
+	for(r = 0 ; r < rounds ; r++) {
+		for(i = 0 ; i < BENCH_VALUES ; i++)
+			checksum += snprintf(buf, sizeof(buf), "%.2f%s", g_values[i], "hPa");
+	}
+	libc = benchNowNs() - start;
+	printLine("formatFloat", "\"%.2f%s\")", ours, libc, count);
+
+	start = benchNowNs();
+	for(r = 0 ; r < rounds ; r++) {
+		for(i = 0 ; i < BENCH_VALUES ; i++)
+			checksum += formatSignificant(buf, sizeof(buf), g_values[i], 7);
+	}
+	ours = benchNowNs() - start;
+	start = benchNowNs();
+	for(r = 0 ; r < rounds ; r++) {
+		for(i = 0 ; i < BENCH_VALUES ; i++)
+			checksum += snprintf(buf, sizeof(buf), "%.7g", g_values[i]);
+	}
+	libc = benchNowNs() - start;
+	printLine("formatSignificant", "\"%.7g\")", ours, libc, count);
+
+	printf("  (checksum %zu)\n", checksum);
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * NumberFormatTest.c
+ *
+ * The formatter against glibc, byte for byte: formatFloat against "%.0f" up to "%.6f" and
+ * formatSignificant against "%.1g" up to "%.9g" for edge cases, decimal ties, random bit patterns and
+ * random sensor-like values. formatFixed is compared on the values whose double is exact, and the
+ * unit and the padding against "%*.*f%s". The CSV lines of the history export rest on "%.7g".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "../NumberFormat.h"
+#include "BenchTimer.h"
+
+#define RANDOM_VALUES		200000
+#define MAX_REPORTED		10
+
+static unsigned int g_checks;
+static unsigned int g_failures;
+static unsigned int g_mismatches;
+
+static void check(int condition, const char *what)
+{
+	g_checks++;
+	if(!condition) {
+		g_failures++;
+		printf("FAIL %s\n", what);
+	}
+}
+
+/* Compares one result with glibc's, the first mismatches are printed. Returns 1 when they agree. */
+static int agree(const char *format, const double value, const char *ours, const size_t length, const char *expected)
+{
+	if(length == strlen(expected) && strcmp(ours, expected) == 0)
+		return 1;
+	if(g_mismatches++ < MAX_REPORTED)
+		printf("  %-6s %.9g: \"%s\" against \"%s\"\n", format, value, ours, expected);
+	return 0;
+}
+
+static int compareFloat(const float value)
+{
+	char ours[96], expected[96], format[8];
+	unsigned int decimals;
+	int same = 1;
+
+	for(decimals = 0 ; decimals <= 6 ; decimals++) {
+		size_t length = formatFloat(ours, sizeof(ours), value, decimals, NULL, 0);
+
+		snprintf(format, sizeof(format), "%%.%uf", decimals);
+		snprintf(expected, sizeof(expected), "%.*f", (int)decimals, value);
+		same &= agree(format, value, ours, length, expected);
+	}
+	return same;
+}
+
+static int compareSignificant(const float value)
+{
+	char ours[96], expected[96], format[8];
+	unsigned int digits;
+	int same = 1;
+
+	for(digits = 1 ; digits <= 9 ; digits++) {
+		size_t length = formatSignificant(ours, sizeof(ours), value, digits);
+
+		snprintf(format, sizeof(format), "%%.%ug", digits);
+		snprintf(expected, sizeof(expected), "%.*g", (int)digits, value);
+		same &= agree(format, value, ours, length, expected);
+	}
+	return same;
+}
+
+static int compareBoth(const float value)
+{
+	int same = compareFloat(value);
+
+	return compareSignificant(value) && same;
+}
+
+/* value / 10^scale, the multiples of 5^scale make the double exact so glibc rounds the same ties */
+static int compareFixed(const int64_t value, const unsigned int scale)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4 };
+	char ours[64], expected[64];
+	unsigned int decimals;
+	int same = 1;
+
+	for(decimals = 0 ; decimals <= 6 ; decimals++) {
+		size_t length = formatFixed(ours, sizeof(ours), value, scale, decimals, NULL, 0);
+
+		snprintf(expected, sizeof(expected), "%.*f", (int)decimals, value / powers[scale]);
+		same &= agree("fixed", value / powers[scale], ours, length, expected);
+	}
+	return same;
+}
+
+/* A float made of a random mantissa and a decimal exponent the sensors and the exports see */
+static float sensorValue(uint32_t *seed)
+{
+	static const float powers[] = { 1e-5f, 1e-4f, 1e-3f, 1e-2f, 1e-1f, 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f };
+	float value = (benchRandom(seed) & 0xFFFFFF) / (float)0x1000000 * powers[benchRandom(seed) % 15];
+
+	return benchRandom(seed) & 1 ? -value : value;
+}
+
+int main(void)
+{
+	static const float edges[] = {
+		0.0f, 0.5f, 1.5f, 2.5f, -2.5f, 0.125f, 0.375f, -0.0625f, 9.5f, 99.5f, 999999.5f,
+		1e-4f, 9.9999997e-5f, 0.00099999f, 1e9f, 999999936.0f, 16777216.0f, 16777217.0f,
+		1e19f, 1.8446743e19f, 1e20f, 3e38f, FLT_MAX, -FLT_MAX, FLT_MIN, -FLT_MIN, 1e-45f, -1e-45f,
+		0.1f, 0.2f, 0.3f, 1013.25f, -40.0f, 123456789.0f, 1e-10f, 4.9999999e-5f,
+	};
+	char ours[64], expected[64];
+	uint32_t seed = 0xF0E1D2C3, bits;
+	unsigned int i, m, d, scale;
+	float value;
+	int same;
+
+	/* Zero with both signs, NaN and infinity with both signs */
+	same = compareBoth(-0.0f) && compareBoth(NAN) && compareBoth(-NAN) && compareBoth(INFINITY) && compareBoth(-INFINITY);
+	check(same, "-0, nan and inf");
+
+	for(same = 1, i = 0 ; i < sizeof(edges) / sizeof(edges[0]) ; i++)
+		same &= compareBoth(edges[i]) & compareBoth(-edges[i]);
+	check(same, "edge cases");
+
+	/* Out of the 64 bits of scaled digits and of the %g range: the snprintf fallback */
+	same = compareFloat(1e19f) && compareFloat(3e38f) && compareSignificant(1e-10f) && compareSignificant(1e20f) &&
+			compareSignificant(123456789012.0f);
+	check(same, "snprintf fallback");
+
+	/* odd / 2^(d + 1) lies halfway between two values of d decimals */
+	for(same = 1, d = 0 ; d <= 8 ; d++) {
+		for(m = 1 ; m < 4000 ; m += 2)
+			same &= compareBoth(ldexpf((float)m, -(int)d - 1)) & compareBoth(-ldexpf((float)m, -(int)d - 1));
+	}
+	check(same, "decimal ties");
+
+	for(same = 1, i = 0 ; i < RANDOM_VALUES ; i++) {
+		bits = benchRandom(&seed);
+		memcpy(&value, &bits, sizeof(value));
+		same &= compareBoth(value);
+	}
+	check(same, "random bit patterns");
+
+	for(same = 1, i = 0 ; i < RANDOM_VALUES ; i++)
+		same &= compareBoth(sensorValue(&seed));
+	check(same, "random sensor values");
+
+	for(same = 1, scale = 0 ; scale <= 4 ; scale++) {
+		int64_t step = (int64_t)pow(5, scale);
+
+		for(i = 0 ; i < 20000 ; i++)
+			same &= compareFixed((int64_t)i * step, scale) & compareFixed(-(int64_t)i * step, scale);
+	}
+	check(same, "fixed point");
+
+	/* The unit and the padding of the field */
+	formatFloat(ours, sizeof(ours), 1013.25f, 1, "hPa", 12);
+	snprintf(expected, sizeof(expected), "%*.*f%s", 9, 1, 1013.25f, "hPa");
+	check(strcmp(ours, expected) == 0, "unit and width");
+	formatFixed(ours, sizeof(ours), -2325, 2, 1, "C", 8);
+	snprintf(expected, sizeof(expected), "%*.*f%s", 7, 1, -23.25, "C");
+	check(strcmp(ours, expected) == 0, "fixed unit and width");
+
+	/* A field which doesn't fit leaves the buffer empty */
+	check(formatFloat(ours, 6, 1013.25f, 2, NULL, 0) == 0 && ours[0] == '\0', "too small a buffer");
+
+	printf("NumberFormatTest: %u checks, %u failures, %u mismatches\n", g_checks, g_failures, g_mismatches);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * ScanBench.c
+ *
+ * The kernels the target flags switch on and the scaling of the raw history scans over the workers.
+ * aggregateValues() is timed against the same loop in plain C and crc32c() over frame sized buffers,
+ * the line of each names the implementation this build got: NEON and the CRC32 instructions with the
+ * flags of make PI=1, SSE2 and the lookup table on a PC. Then a few days of one channel are scanned in
+ * buckets with 1 up to the given number of threads.
+ *
+ *   ScanBench [days] [rate Hz] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../SeriesScan.h"
+#include "../TimeSeriesStore.h"
+#include "../WeatherFrame.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define KERNEL_VALUES		SEGMENT_BLOCK_SAMPLES
+#define KERNEL_ROUNDS		20000
+#define CRC_LENGTH			1024
+#define CRC_ROUNDS			20000
+#define SCAN_REPEATS		5
+#define MAX_BUCKETS			(1 << 16)
+
+static const sensor_channel_t g_channel = CHANNEL_MPL3115A2_TEMPERATURE;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static const char *g_kernelName = "NEON";
+#elif defined(__SSE2__)
+static const char *g_kernelName = "SSE2";
+#else
+static const char *g_kernelName = "scalar";
+#endif
+
+#ifdef __ARM_FEATURE_CRC32
+static const char *g_crcName = "CRC32 instructions";
+#else
+static const char *g_crcName = "lookup table";
+#endif
+
+/* aggregateValues() without the vector part */
+static void scalarValues(const float *values, size_t count, float *min, float *max, double *sum)
+{
+	const float base = values[0];
+	float lowest = base, highest = base, deviation = 0.0f;
+	size_t i;
+
+	for(i = 0 ; i < count ; i++) {
+		if(values[i] < lowest)
+			lowest = values[i];
+		if(values[i] > highest)
+			highest = values[i];
+		deviation += values[i] - base;
+	}
+
+	*min = lowest;
+	*max = highest;
+	*sum = (double)base * count + deviation;
+}
+
+static double kernelNs(void (*kernel)(const float *, size_t, float *, float *, double *), const float *values, double *checksum)
+{
+	uint64_t start = benchNowNs();
+	float min, max;
+	double sum;
+	int round;
+
+	for(round = 0 ; round < KERNEL_ROUNDS ; round++) {
+		kernel(values + round % 4, KERNEL_VALUES - 4, &min, &max, &sum);
+		*checksum += min + max + sum;
+	}
+	return (double)(benchNowNs() - start) / ((double)KERNEL_ROUNDS * (KERNEL_VALUES - 4));
+}
+
+static double scanMs(scan_pool_t *pool, time_series_store_t *store, const uint64_t bucketMs, int *buckets)
+{
+	static series_bucket_t results[MAX_BUCKETS];
+	uint64_t start;
+	int i;
+
+	/* The first scan of a pool warms up its threads' stacks */
+	scanTimeSeriesBuckets(pool, store, g_channel, 0, UINT64_MAX, bucketMs, results, MAX_BUCKETS);
+	start = benchNowNs();
+	for(i = 0 ; i < SCAN_REPEATS ; i++)
+		*buckets = scanTimeSeriesBuckets(pool, store, g_channel, 0, UINT64_MAX, bucketMs, results, MAX_BUCKETS);
+	return (benchNowNs() - start) / 1e6 / SCAN_REPEATS;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint64_t bucketSizes[] = { 37000, 60000, 3600000 };
+	static float values[KERNEL_VALUES];
+	static unsigned char frame[CRC_LENGTH];
+	time_series_store_t store;
+	scan_pool_t pool;
+	char directory[256];
+	double days = argc > 1 ? atof(argv[1]) : 2.0;
+	double rate = argc > 2 ? atof(argv[2]) : 10.0;
+	int maxThreads = argc > 3 ? atoi(argv[3]) : SCAN_MAX_WORKERS;
+	uint64_t period = (uint64_t)(1000.0 / rate), samples = (uint64_t)(days * 86400.0 * rate), i, start;
+	double checksum = 0.0, scalar, vector, single[sizeof(bucketSizes) / sizeof(bucketSizes[0])], ms;
+	uint32_t seed = 0x2545F491, crc = 0;
+	size_t b;
+	int threads, buckets, round;
+
+	if(period == 0 || samples == 0 || maxThreads < 1 || maxThreads > SCAN_MAX_WORKERS) {
+		printf("Usage: %s [days] [rate Hz up to 1000] [threads up to %d]\n", argv[0], SCAN_MAX_WORKERS);
+		return 1;
+	}
+
+	for(i = 0 ; i < KERNEL_VALUES ; i++)
+		values[i] = syntheticSample(g_channel, i * period);
+	for(i = 0 ; i < CRC_LENGTH ; i++)
+		frame[i] = benchRandom(&seed);
+
+	scalar = kernelNs(scalarValues, values, &checksum);
+	vector = kernelNs(aggregateValues, values, &checksum);
+	printf("ScanBench: kernels, ns per sample\n");
+	printf("  scalar min/max/sum   %6.2f\n", scalar);
+	printf("  %-6s min/max/sum   %6.2f  %4.1fx\n", g_kernelName, vector, scalar / vector);
+
+	start = benchNowNs();
+	for(round = 0 ; round < CRC_ROUNDS ; round++)
+		crc = crc32c(crc, frame, CRC_LENGTH);
+	ms = (benchNowNs() - start) / 1e6;
+	printf("  crc32c, %-18s %7.1f MB/s (crc %08X, checksum %.0f)\n", g_crcName,
+			(double)CRC_LENGTH * CRC_ROUNDS / ms / 1000.0, crc, checksum);
+
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+	for(i = 0 ; i < samples ; i++) {
+		if(timeSeriesAppend(&store, g_channel, SYNTHETIC_EPOCH_MS + i * period, syntheticSample(g_channel, i * period)) < 0)
+			return 1;
+	}
+	syncTimeSeriesStore(&store);
+
+	/* The speedups are against the single thread, the caller scans too so 1 thread is the caller alone */
+	printf("ScanBench: %llu samples at %g Hz, scan of the whole history in ms\n", (unsigned long long)samples, rate);
+	printf("  %7s", "threads");
+	for(b = 0 ; b < sizeof(bucketSizes) / sizeof(bucketSizes[0]) ; b++)
+		printf("  %8llu s buckets   ", (unsigned long long)bucketSizes[b] / 1000);
+	printf("\n");
+	for(threads = 1 ; threads <= maxThreads ; threads++) {
+		if(startScanPool(&pool, threads) < 0 || pool.workers != threads)
+			return 1;
+		printf("  %7d", threads);
+		for(b = 0 ; b < sizeof(bucketSizes) / sizeof(bucketSizes[0]) ; b++) {
+			ms = scanMs(&pool, &store, bucketSizes[b], &buckets);
+			if(threads == 1)
+				single[b] = ms;
+			printf("  %8.2f %5.2fx %5d", ms, single[b] / ms, buckets);
+		}
+		printf("\n");
+		stopScanPool(&pool);
+	}
+
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * SerializeBench.c
+ *
+ * Cost of serializing floats: the old normalizing encoder, serializeFloat and the block encoder
+ * serializeFloatArray, in nanoseconds per float. The values are sensor-like readings, so the old
+ * encoder's loops run the few exponent steps of the real data.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../SerializeDeserialize.h"
+#include "BenchTimer.h"
+
+#define BENCH_FLOATS		4096
+#define BENCH_ROUNDS		2000
+
+/* The encoder before the bit-cast */
+static unsigned int legacySerialize754Float(float f, unsigned int bits, unsigned int expbits)
+{
+    float fnorm;
+    int shift;
+    int sign, exp, significand;
+    unsigned int significandbits = bits - expbits - 1; // -1 for sign bit
+
+    if (f == 0.0) return 0;
+
+    if (f < 0) {
+    	sign = 1;
+    	fnorm = -f;
+    }
+    else {
+    	sign = 0;
+    	fnorm = f;
+    }
+
+    shift = 0;
+    while(fnorm >= 2.0) {
+    	fnorm /= 2.0;
+    	shift++;
+    }
+    while(fnorm < 1.0) {
+    	fnorm *= 2.0;
+    	shift--;
+    }
+    fnorm = fnorm - 1.0;
+
+    significand = fnorm * ((1<<significandbits) + 0.5f);
+    exp = shift + ((1<<(expbits-1)) - 1);
+
+    return (sign<<(bits-1)) | (exp<<(bits-expbits-1)) | significand;
+}
+
+static unsigned char *legacySerializeFloat(unsigned char *buffer, float FloatValue)
+{
+	int value;
+
+	value = legacySerialize754Float(FloatValue, 32, 8);
+
+    buffer[0] = value >> 24;
+    buffer[1] = value >> 16;
+    buffer[2] = value >> 8;
+    buffer[3] = value;
+
+    return buffer + 4;
+}
+
+static double nsPerFloat(uint64_t start, uint64_t end)
+{
+	return (double)(end - start) / ((double)BENCH_FLOATS * BENCH_ROUNDS);
+}
+
+int main(void)
+{
+	static float values[BENCH_FLOATS];
+	static unsigned char buffer[BENCH_FLOATS * 4];
+	uint32_t seed = 0x9E3779B9;
+	unsigned int checksum = 0;
+	uint64_t start;
+	double legacy, single, block, decode;
+	size_t i, round;
+
+	/* Temperatures, pressures in hPa and humidities */
+	for(i = 0 ; i < BENCH_FLOATS ; i++) {
+		float unit = (float)(benchRandom(&seed) & 0xFFFF) / 65536.0f;
+		switch(i % 3) {
+			case 0: values[i] = -20.0f + 60.0f * unit; break;
+			case 1: values[i] = 950.0f + 100.0f * unit; break;
+			default: values[i] = 100.0f * unit; break;
+		}
+	}
+
+	start = benchNowNs();
+	for(round = 0 ; round < BENCH_ROUNDS ; round++) {
+		unsigned char *p = buffer;
+		for(i = 0 ; i < BENCH_FLOATS ; i++)
+			p = legacySerializeFloat(p, values[i]);
+		checksum += buffer[round % sizeof(buffer)];
+	}
+	legacy = nsPerFloat(start, benchNowNs());
+
+	start = benchNowNs();
+	for(round = 0 ; round < BENCH_ROUNDS ; round++) {
+		unsigned char *p = buffer;
+		for(i = 0 ; i < BENCH_FLOATS ; i++)
+			p = serializeFloat(p, values[i]);
+		checksum += buffer[round % sizeof(buffer)];
+	}
+	single = nsPerFloat(start, benchNowNs());
+
+	start = benchNowNs();
+	for(round = 0 ; round < BENCH_ROUNDS ; round++) {
+		serializeFloatArray(buffer, values, BENCH_FLOATS);
+		checksum += buffer[round % sizeof(buffer)];
+	}
+	block = nsPerFloat(start, benchNowNs());
+
+	start = benchNowNs();
+	for(round = 0 ; round < BENCH_ROUNDS ; round++) {
+		deserializeFloatArray(values, buffer, BENCH_FLOATS);
+		serializeFloatArray(buffer, values, BENCH_FLOATS);
+		checksum += buffer[round % sizeof(buffer)];
+	}
+	decode = nsPerFloat(start, benchNowNs()) - block;
+
+	printf("SerializeBench: %u floats x %u rounds (checksum %u)\n", BENCH_FLOATS, BENCH_ROUNDS, checksum);
+	printf("  old encoder           %7.2f ns/float\n", legacy);
+	printf("  serializeFloat        %7.2f ns/float  %5.1fx\n", single, legacy / single);
+	printf("  serializeFloatArray   %7.2f ns/float  %5.1fx\n", block, legacy / block);
+	printf("  deserializeFloatArray %7.2f ns/float\n", decode);
+	return 0;
+}
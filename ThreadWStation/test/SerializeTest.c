@@ -0,0 +1,194 @@
+/*
+ * SerializeTest.c
+ *
+ * Round-trip test of the float serializer. A normal float must give the same bytes as the old
+ * normalizing encoder, which is kept here as the reference. Zeros, denormals, infinities and NaN,
+ * which the old encoder got wrong or never returned from, must keep their IEEE 754 bit pattern.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include "../SerializeDeserialize.h"
+#include "BenchTimer.h"
+
+#define RANDOM_NORMALS		1000000
+#define ARRAY_LENGTH		1027
+
+static unsigned int g_checks;
+static unsigned int g_failures;
+
+/* The encoder before the bit-cast, normal values only: it loops forever on an infinity */
+static unsigned int legacySerialize754Float(float f, unsigned int bits, unsigned int expbits)
+{
+    float fnorm;
+    int shift;
+    int sign, exp, significand;
+    unsigned int significandbits = bits - expbits - 1; // -1 for sign bit
+
+    if (f == 0.0) return 0;
+
+    // check sign and begin normalization
+    if (f < 0) {
+    	sign = 1;
+    	fnorm = -f;
+    }
+    else {
+    	sign = 0;
+    	fnorm = f;
+    }
+
+    // get the normalized form of f and track the exponent
+    shift = 0;
+    while(fnorm >= 2.0) {
+    	fnorm /= 2.0;
+    	shift++;
+    }
+    while(fnorm < 1.0) {
+    	fnorm *= 2.0;
+    	shift--;
+    }
+    fnorm = fnorm - 1.0;
+
+    // calculate the binary form (non-float) of the significant data
+    significand = fnorm * ((1<<significandbits) + 0.5f);
+
+    // get the biased exponent
+    exp = shift + ((1<<(expbits-1)) - 1); // shift + bias
+
+    // return the final answer
+    return (sign<<(bits-1)) | (exp<<(bits-expbits-1)) | significand;
+}
+
+static unsigned char *legacySerializeFloat(unsigned char *buffer, float FloatValue)
+{
+	int value;
+
+	value = legacySerialize754Float(FloatValue, 32, 8);
+
+    buffer[0] = value >> 24;
+    buffer[1] = value >> 16;
+    buffer[2] = value >> 8;
+    buffer[3] = value;
+
+    return buffer + 4;
+}
+
+static float fromBits(uint32_t bits)
+{
+	float value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static uint32_t toBits(float value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static void check(int condition, const char *what, uint32_t bits)
+{
+	g_checks++;
+	if(!condition) {
+		g_failures++;
+		if(g_failures <= 20)
+			printf("FAIL %s: 0x%08X\n", what, (unsigned int)bits);
+	}
+}
+
+/* The bytes are the big-endian bit pattern and decode back to the same bits */
+static void checkRoundTrip(uint32_t bits)
+{
+	unsigned char buffer[4];
+	float value = fromBits(bits);
+
+	serializeFloat(buffer, value);
+	check(buffer[0] == (unsigned char)(bits >> 24) && buffer[1] == (unsigned char)(bits >> 16) &&
+			buffer[2] == (unsigned char)(bits >> 8) && buffer[3] == (unsigned char)bits, "big-endian bit pattern", bits);
+	check(toBits(deserializeFloat(buffer)) == bits, "round trip", bits);
+}
+
+static void checkLegacyBytes(uint32_t bits)
+{
+	unsigned char expected[4], actual[4];
+	float value = fromBits(bits);
+
+	legacySerializeFloat(expected, value);
+	serializeFloat(actual, value);
+	check(memcmp(expected, actual, sizeof(actual)) == 0, "bytes of the old encoder", bits);
+}
+
+/* The block encoder gives the bytes of serializeFloat, at every alignment of the tail */
+static void checkArrays(uint32_t *seed)
+{
+	static float values[ARRAY_LENGTH], decoded[ARRAY_LENGTH];
+	static unsigned char expected[ARRAY_LENGTH * 4], actual[ARRAY_LENGTH * 4];
+	size_t count, i;
+
+	for(i = 0 ; i < ARRAY_LENGTH ; i++)
+		values[i] = fromBits(benchRandom(seed));
+
+	for(count = 0 ; count <= ARRAY_LENGTH ; count += count < 16 ? 1 : 101) {
+		for(i = 0 ; i < count ; i++)
+			serializeFloat(expected + i * 4, values[i]);
+		check(serializeFloatArray(actual, values, count) == actual + count * 4, "array end", (uint32_t)count);
+		check(memcmp(expected, actual, count * 4) == 0, "array bytes", (uint32_t)count);
+		check(deserializeFloatArray(decoded, actual, count) == actual + count * 4, "array read end", (uint32_t)count);
+		check(memcmp(values, decoded, count * 4) == 0, "array round trip", (uint32_t)count);
+	}
+}
+
+int main(void)
+{
+	static const uint32_t specials[] =
+	{
+		0x00000000, 0x80000000,				/* +0, -0 */
+		0x00000001, 0x80000001,				/* smallest denormals */
+		0x007FFFFF, 0x807FFFFF,				/* largest denormals */
+		0x00400000, 0x00012345,
+		0x7F800000, 0xFF800000,				/* +inf, -inf */
+		0x7FC00000, 0xFFC00000,				/* quiet NaN */
+		0x7F800001, 0x7FA5A5A5, 0xFFFFFFFF,	/* signaling NaN and NaN payloads */
+		0x00800000, 0x80800000,				/* FLT_MIN */
+		0x7F7FFFFF, 0xFF7FFFFF,				/* FLT_MAX */
+		0x3F800000, 0xBF800000,				/* 1, -1 */
+	};
+	uint32_t seed = 0x2545F491;
+	uint32_t bits, exponent;
+	size_t i;
+
+	for(i = 0 ; i < sizeof(specials) / sizeof(specials[0]) ; i++)
+		checkRoundTrip(specials[i]);
+
+	/* The old encoder wrote +0 as zero too, -0 lost its sign */
+	checkLegacyBytes(0x00000000);
+
+	/* Every exponent of the normal range with both ends of the significand */
+	for(exponent = 1 ; exponent < 255 ; exponent++) {
+		for(i = 0 ; i < 4 ; i++) {
+			bits = exponent << 23 | (i & 1 ? 0x007FFFFF : 0) | (i & 2 ? 0x80000000 : 0);
+			checkRoundTrip(bits);
+			checkLegacyBytes(bits);
+		}
+	}
+
+	for(i = 0 ; i < RANDOM_NORMALS ; i++) {
+		bits = benchRandom(&seed);
+		exponent = bits >> 23 & 0xFF;
+		if(exponent == 0 || exponent == 255) {
+			checkRoundTrip(bits);
+			continue;
+		}
+		checkRoundTrip(bits);
+		checkLegacyBytes(bits);
+	}
+
+	checkArrays(&seed);
+
+	printf("SerializeTest: %u checks, %u failures\n", g_checks, g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/*
+ * SeriesScanTest.c
+ *
+ * Bucketed scans of a history longer than the segments a query holds. The buckets of the scan are
+ * checked against the aggregates of the summary index over the same ranges.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../SeriesScan.h"
+#include "../TimeSeriesStore.h"
+#include "TestSupport.h"
+
+#define SAMPLE_PERIOD_MS	1000
+#define HISTORY_SAMPLES		((SCAN_MAX_SEGMENTS + 2) * SEGMENT_CAPACITY + 1000)
+#define MAX_BUCKETS			4096
+
+static const sensor_channel_t g_channel = CHANNEL_HUMIDITY;
+
+static unsigned int g_checks;
+static unsigned int g_failures;
+
+static void check(int condition, const char *what)
+{
+	g_checks++;
+	if(!condition) {
+		g_failures++;
+		printf("FAIL %s\n", what);
+	}
+}
+
+/* Every bucket agrees with the index aggregate of its range, and the buckets hold every sample of [from, to) */
+static void checkBuckets(time_series_store_t *store, const series_bucket_t *buckets, const int count, const uint64_t from,
+		const uint64_t to, const uint64_t bucketMs, const char *name)
+{
+	series_summary_t expected;
+	uint64_t samples = 0;
+	int i, agree = 1;
+
+	for(i = 0 ; i < count ; i++) {
+		uint64_t start = buckets[i].start > from ? buckets[i].start : from;
+		uint64_t end = buckets[i].start + bucketMs < to ? buckets[i].start + bucketMs : to;
+		const series_summary_t *summary = &buckets[i].summary;
+
+		if(timeSeriesAggregate(store, g_channel, start, end, &expected) < 0 || summary->count != expected.count ||
+				summary->min != expected.min || summary->max != expected.max ||
+				summary->firstTimestamp != expected.firstTimestamp || summary->lastTimestamp != expected.lastTimestamp ||
+				fabs(summary->sum - expected.sum) > 1e-3 * summary->count)
+			agree = 0;
+		samples += summary->count;
+	}
+	check(agree, name);
+
+	check(timeSeriesAggregate(store, g_channel, from, to, &expected) == 0 && samples == expected.count, name);
+}
+
+int main(void)
+{
+	static series_bucket_t buckets[MAX_BUCKETS];
+	time_series_store_t store;
+	scan_pool_t pool;
+	char directory[256];
+	uint64_t start = SYNTHETIC_EPOCH_MS, end = SYNTHETIC_EPOCH_MS + (uint64_t)HISTORY_SAMPLES * SAMPLE_PERIOD_MS;
+	uint32_t i;
+	int count;
+
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+	startScanPool(&pool, SCAN_MAX_WORKERS);
+
+	for(i = 0 ; i < HISTORY_SAMPLES ; i++)
+		timeSeriesAppend(&store, g_channel, start + (uint64_t)i * SAMPLE_PERIOD_MS, syntheticSample(g_channel, (uint64_t)i * SAMPLE_PERIOD_MS));
+
+	/* The whole history is more segments than one query holds */
+	count = scanTimeSeriesBuckets(&pool, &store, g_channel, 0, UINT64_MAX, SUMMARY_DAY_MS, buckets, MAX_BUCKETS);
+	check(count == (int)((end - 1) / SUMMARY_DAY_MS - start / SUMMARY_DAY_MS + 1), "days of the whole history");
+	checkBuckets(&store, buckets, count, 0, UINT64_MAX, SUMMARY_DAY_MS, "days of the whole history");
+
+	/* Buckets which don't divide the day, a range off the segment borders */
+	count = scanTimeSeriesBuckets(&pool, &store, g_channel, start + 1234567, end - 7654321, 37 * 60000, buckets, MAX_BUCKETS);
+	check(count > 0 && count < MAX_BUCKETS, "37 minute buckets");
+	checkBuckets(&store, buckets, count, start + 1234567, end - 7654321, 37 * 60000, "37 minute buckets");
+
+	/* Buckets as long as a segment, the range starts inside the first block */
+	count = scanTimeSeriesBuckets(&pool, &store, g_channel, start + 500, end, (uint64_t)SEGMENT_CAPACITY * SAMPLE_PERIOD_MS,
+			buckets, MAX_BUCKETS);
+	checkBuckets(&store, buckets, count, start + 500, end, (uint64_t)SEGMENT_CAPACITY * SAMPLE_PERIOD_MS, "segment long buckets");
+
+	/* The scan stops at maxBuckets */
+	count = scanTimeSeriesBuckets(&pool, &store, g_channel, 0, UINT64_MAX, 3600000, buckets, 10);
+	check(count == 10 && buckets[9].start == start + 9 * 3600000ULL, "maxBuckets");
+
+	stopScanPool(&pool);
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+
+	printf("SeriesScanTest: %u checks, %u failures\n", g_checks, g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+/*
+ * StatsBench.c
+ *
+ * Cost of the streaming statistics of a reading, in nanoseconds per sample: each window alone, the
+ * windows and the EWMAs combined, and publishSample itself with its lock, the extremes, the deadband
+ * and the hand-off to a history writer on a scratch store. The readings are a synthetic temperature a
+ * few times a second, long enough for the buckets and the sketches of the 24 h window to turn over.
+ * The cost of a query of every window is printed too.
+ *
+ *   StatsBench [samples] [period ms]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../StreamingStats.h"
+#include "../SamplePublisher.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define QUERIES				100000
+
+static const char *windowNames[NUMBER_OF_STATS_WINDOWS] = { "15 minutes", "1 hour", "24 hours" };
+
+int main(int argc, char *argv[])
+{
+	static float values[1 << 16];
+	window_stats_t windows[NUMBER_OF_STATS_WINDOWS];
+	ewma_stats_t ewma;
+	stats_snapshot_t snapshot;
+	static time_series_store_t store;
+	static history_writer_t writer;
+	history_writer_config_t config;
+	history_writer_status_t status;
+	char directory[256];
+	unsigned long samples = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	uint64_t period = argc > 2 ? strtoull(argv[2], NULL, 10) : 100;
+	uint64_t start, ns, all = 0, now = SYNTHETIC_EPOCH_MS + samples * period;
+	double checksum = 0.0;
+	unsigned long i, published = 0;
+	int w;
+
+	if(samples == 0 || period == 0) {
+		printf("Usage: %s [samples] [period ms]\n", argv[0]);
+		return 1;
+	}
+
+	/* The readings are made up front, so only the statistics are timed */
+	for(i = 0 ; i < sizeof(values) / sizeof(values[0]) ; i++)
+		values[i] = syntheticSample(CHANNEL_MPL3115A2_TEMPERATURE, i * period);
+
+	/* The writer of the publish path, started here so its start line doesn't split the table */
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+	defaultHistoryWriterConfig(&config);
+	if(startHistoryWriter(&writer, &store, &config) < 0)
+		return 1;
+
+	printf("StatsBench: %lu samples every %llu ms, ns per sample\n", samples, (unsigned long long)period);
+
+	for(w = 0 ; w < NUMBER_OF_STATS_WINDOWS ; w++) {
+		initWindowStats(&windows[w], statsWindowLength(w));
+		start = benchNowNs();
+		for(i = 0 ; i < samples ; i++)
+			updateWindowStats(&windows[w], SYNTHETIC_EPOCH_MS + i * period, values[i & 0xFFFF]);
+		ns = benchNowNs() - start;
+		all += ns;
+		getWindowStats(&windows[w], now, &snapshot);
+		checksum += snapshot.mean;
+		printf("  window %-12s %7.1f  (p5 %.2f p50 %.2f p95 %.2f)\n", windowNames[w], (double)ns / samples,
+				snapshot.quantiles[0], snapshot.quantiles[1], snapshot.quantiles[2]);
+	}
+
+	initEwmaStats(&ewma);
+	start = benchNowNs();
+	for(i = 0 ; i < samples ; i++)
+		updateEwmaStats(&ewma, SYNTHETIC_EPOCH_MS + i * period, values[i & 0xFFFF]);
+	ns = benchNowNs() - start;
+	all += ns;
+	printf("  EWMAs               %7.1f\n", (double)ns / samples);
+
+	/* Every window and the EWMAs in turn, as publishSample updates them */
+	for(w = 0 ; w < NUMBER_OF_STATS_WINDOWS ; w++)
+		initWindowStats(&windows[w], statsWindowLength(w));
+	initEwmaStats(&ewma);
+	start = benchNowNs();
+	for(i = 0 ; i < samples ; i++) {
+		for(w = 0 ; w < NUMBER_OF_STATS_WINDOWS ; w++)
+			updateWindowStats(&windows[w], SYNTHETIC_EPOCH_MS + i * period, values[i & 0xFFFF]);
+		updateEwmaStats(&ewma, SYNTHETIC_EPOCH_MS + i * period, values[i & 0xFFFF]);
+	}
+	ns = benchNowNs() - start;
+	printf("  windows + EWMAs     %7.1f  (%.1f as the sum of the parts)\n", (double)ns / samples, (double)all / samples);
+
+	/* The whole publish path, the writer drains its ring every 50 ms so a fast run drops readings there */
+	initSamplePublisher(&writer);
+	start = benchNowNs();
+	for(i = 0 ; i < samples ; i++)
+		published += publishSample(CHANNEL_MPL3115A2_TEMPERATURE, SYNTHETIC_EPOCH_MS + i * period, values[i & 0xFFFF]) > 0;
+	ns = benchNowNs() - start;
+	stopHistoryWriter(&writer);
+	readHistoryWriterStatus(&writer, &status);
+	printf("  publishSample       %7.1f  (%lu published, %u of them dropped by the ring)\n", (double)ns / samples,
+			published, status.dropped);
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+
+	start = benchNowNs();
+	for(i = 0 ; i < QUERIES ; i++) {
+		for(w = 0 ; w < NUMBER_OF_STATS_WINDOWS ; w++) {
+			getWindowStats(&windows[w], now, &snapshot);
+			checksum += snapshot.stddev;
+		}
+		getEwmaStats(&ewma, &snapshot);
+		checksum += snapshot.ewma[0];
+	}
+	ns = benchNowNs() - start;
+	printf("  query of a channel  %7.1f ns (checksum %.1f)\n", (double)ns / QUERIES, checksum);
+	return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * StoreBench.c
+ *
+ * A synthetic week of all the channels ingested into a history store and read back. The store is
+ * synced when the history writer would sync it: a channel has HISTORY_FLUSH_SAMPLES waiting or the
+ * oldest waits HISTORY_CRASH_WINDOW_MS of the synthetic time. The bytes the syncs wrote back are
+ * compared with the 12 bytes of a sample. Run it with TMPDIR on the card to measure the card, /tmp
+ * is usually a RAM disk.
+ *
+ *   StoreBench [days] [rate Hz]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../TimeSeriesStore.h"
+#include "../HistoryWriter.h"
+#include "TestSupport.h"
+#include "BenchTimer.h"
+
+#define SEEKS					10000
+
+int main(int argc, char *argv[])
+{
+	static uint64_t timestamps[8192];
+	static float values[8192];
+	time_series_store_t store;
+	series_cursor_t cursor;
+	char directory[256];
+	double days = argc > 1 ? atof(argv[1]) : 7.0;
+	double rate = argc > 2 ? atof(argv[2]) : 1.0;
+	uint64_t period = (uint64_t)(1000.0 / rate), samples = (uint64_t)(days * 86400.0 * rate);
+	uint64_t i, pendingSince = 0, pending = 0, appended = 0, scanned = 0, syncedBytes, syncedSamples, start, ingestNs, scanNs, seekNs;
+	uint32_t seed = 0x1234567;
+	float checksum = 0.0f;
+	int channel, read;
+
+	if(period == 0 || samples == 0) {
+		printf("Usage: %s [days] [rate Hz up to 1000]\n", argv[0]);
+		return 1;
+	}
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+
+	printf("StoreBench: %g days at %g Hz on %d channels in %s\n", days, rate, NUMBER_OF_CHANNELS, directory);
+
+	start = benchNowNs();
+	for(i = 0 ; i < samples ; i++) {
+		for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+			if(timeSeriesAppend(&store, channel, SYNTHETIC_EPOCH_MS + i * period, syntheticSample(channel, i * period)) < 0) {
+				printf("Append failed\n");
+				return 1;
+			}
+			appended++;
+		}
+		if(pending++ == 0)
+			pendingSince = i * period;
+		if(pending >= HISTORY_FLUSH_SAMPLES || i * period - pendingSince >= HISTORY_CRASH_WINDOW_MS) {
+			syncTimeSeriesStore(&store);
+			pending = 0;
+		}
+	}
+	syncTimeSeriesStore(&store);
+	ingestNs = benchNowNs() - start;
+	timeSeriesSyncStatistics(&store, &syncedBytes, &syncedSamples);
+
+	start = benchNowNs();
+	for(channel = 0 ; channel < NUMBER_OF_CHANNELS ; channel++) {
+		if(seekTimeSeries(&store, channel, 0, &cursor) < 0)
+			return 1;
+		while((read = readTimeSeries(&cursor, timestamps, values, 8192)) > 0) {
+			checksum += values[read - 1];
+			scanned += read;
+		}
+		closeTimeSeriesCursor(&cursor);
+	}
+	scanNs = benchNowNs() - start;
+
+	start = benchNowNs();
+	for(i = 0 ; i < SEEKS ; i++) {
+		channel = benchRandom(&seed) % NUMBER_OF_CHANNELS;
+		if(seekTimeSeries(&store, channel, SYNTHETIC_EPOCH_MS + benchRandom(&seed) % samples * period, &cursor) < 0)
+			return 1;
+		if(readTimeSeries(&cursor, timestamps, values, 1) == 1)
+			checksum += values[0];
+		closeTimeSeriesCursor(&cursor);
+	}
+	seekNs = benchNowNs() - start;
+
+	printf("  ingest   %10llu samples in %7.0f ms, %9.0f samples/s\n", (unsigned long long)appended, ingestNs / 1e6,
+			appended / (ingestNs / 1e9));
+	printf("  synced   %10llu bytes, %.1f bytes/sample, write amplification %.2f\n", (unsigned long long)syncedBytes,
+			syncedSamples > 0 ? (double)syncedBytes / syncedSamples : 0.0,
+			syncedSamples > 0 ? (double)syncedBytes / syncedSamples / (sizeof(uint64_t) + sizeof(float)) : 0.0);
+	printf("  scan     %10llu samples in %7.0f ms, %9.1f M samples/s\n", (unsigned long long)scanned, scanNs / 1e6,
+			scanned / (scanNs / 1e3));
+	printf("  seek     %10d seeks   in %7.0f ms, %9.1f us/seek (checksum %.1f)\n", SEEKS, seekNs / 1e6,
+			seekNs / 1e3 / SEEKS, checksum);
+
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+	return scanned == appended ? 0 : 1;
+}
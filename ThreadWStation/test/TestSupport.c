@@ -0,0 +1,109 @@
+/*
+ * TestSupport.c
+ *
+ * What the tests and the benchmarks need from the station without its hardware: the clock and the
+ * channel names of thread.c, a scratch directory for a history store and synthetic sensor readings.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "TestSupport.h"
+
+unsigned long long timestampMs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (unsigned long long)now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+uint64_t monotonicUs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+uint64_t monotonicMs(void)
+{
+	return monotonicUs() / 1000;
+}
+
+const char *channelName(const sensor_channel_t channel)
+{
+	static const char *names[NUMBER_OF_CHANNELS] =
+	{
+		[CHANNEL_MPL3115A2_TEMPERATURE]	= "MPL3115A2 temperature",
+		[CHANNEL_PRESSURE]				= "Pressure",
+		[CHANNEL_ALTITUDE]				= "Altitude",
+		[CHANNEL_TMP36_TEMPERATURE]		= "TMP36 temperature",
+		[CHANNEL_HUMIDITY]				= "Humidity",
+	};
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return "Unknown";
+	return names[channel];
+}
+
+/* Creates an empty directory under TMPDIR, /tmp by default */
+int makeTestDirectory(char *path, size_t size)
+{
+	const char *base = getenv("TMPDIR");
+
+	snprintf(path, size, "%s/wstation-XXXXXX", base != NULL ? base : "/tmp");
+	if(mkdtemp(path) == NULL) {
+		perror("Could not create a test directory");
+		return -1;
+	}
+	return 0;
+}
+
+/* Removes the files of the directory and the directory, the stores don't make subdirectories */
+void removeTestDirectory(const char *path)
+{
+	char file[512];
+	struct dirent *entry;
+	DIR *directory = opendir(path);
+
+	if(directory == NULL)
+		return;
+	while((entry = readdir(directory)) != NULL) {
+		if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+		unlink(file);
+	}
+	closedir(directory);
+	rmdir(path);
+}
+
+/*
+ * A reading as the sensor would give it: a daily cycle with some noise, quantized to the sensor's
+ * resolution. The MPL3115A2 has 1/16 C and 1/4 Pa steps, the HIH4030 and the TMP36 are read through
+ * the 10 bit MCP3002.
+ */
+float syntheticSample(const sensor_channel_t channel, const uint64_t offsetMs)
+{
+	double day = (double)(offsetMs % 86400000ULL) / 86400000.0;
+	double cycle = sin(2.0 * M_PI * (day - 0.375));
+	double noise = (double)((offsetMs * 2654435761ULL >> 16) % 1000) / 1000.0 - 0.5;
+
+	switch(channel) {
+		case CHANNEL_MPL3115A2_TEMPERATURE:
+			return (float)(floor((12.0 + 6.0 * cycle + 0.1 * noise) * 16.0) / 16.0);
+		case CHANNEL_PRESSURE:
+			return (float)(floor((101325.0 - 150.0 * cycle + 8.0 * noise) * 4.0) / 4.0 / 100.0);
+		case CHANNEL_ALTITUDE:
+			return (float)(floor((35.0 + 12.5 * cycle + 0.7 * noise) * 16.0) / 16.0);
+		case CHANNEL_TMP36_TEMPERATURE:
+			return (float)((floor((0.5 + (12.5 + 6.0 * cycle) * 0.01) / 3.3 * 1024.0 + noise) * 3.3 / 1024.0 - 0.5) * 100.0);
+		case CHANNEL_HUMIDITY:
+		default:
+			return (float)((floor((0.958 + 0.0307 * (60.0 - 20.0 * cycle)) / 5.0 * 1024.0 + 2.0 * noise) * 5.0 / 1024.0 - 0.958) / 0.0307);
+	}
+}
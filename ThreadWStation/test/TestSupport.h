@@ -0,0 +1,20 @@
+/*
+ * TestSupport.h
+ */
+
+#ifndef TESTSUPPORT_H_
+#define TESTSUPPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../thread.h"
+
+/* A synthetic day starts at midnight UTC of 2026-01-01 */
+#define SYNTHETIC_EPOCH_MS			1767225600000ULL
+
+/* Function prototypes */
+int makeTestDirectory(char *path, size_t size);
+void removeTestDirectory(const char *path);
+float syntheticSample(const sensor_channel_t channel, const uint64_t offsetMs);
+
+#endif /* TESTSUPPORT_H_ */
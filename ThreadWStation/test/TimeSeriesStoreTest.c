@@ -0,0 +1,163 @@
+/*
+ * TimeSeriesStoreTest.c
+ *
+ * Recovery of the newest segment after a crash. The segment file is damaged the way a partial
+ * write-back leaves it, the store is reopened and the samples it keeps are checked. The retention
+ * drop is checked on a segment boundary inside an hour.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../TimeSeriesStore.h"
+#include "TestSupport.h"
+
+#define SAMPLE_PERIOD_MS	1000
+#define HOUR_SAMPLES		(SUMMARY_HOUR_MS / SAMPLE_PERIOD_MS)
+
+static unsigned int g_checks;
+static unsigned int g_failures;
+
+static void check(int condition, const char *what)
+{
+	g_checks++;
+	if(!condition) {
+		g_failures++;
+		printf("FAIL %s\n", what);
+	}
+}
+
+static void appendSamples(time_series_store_t *store, const sensor_channel_t channel, const uint32_t first, const uint32_t count)
+{
+	uint32_t i;
+
+	for(i = first ; i < first + count ; i++)
+		timeSeriesAppend(store, channel, SYNTHETIC_EPOCH_MS + (uint64_t)i * SAMPLE_PERIOD_MS,
+				syntheticSample(channel, (uint64_t)i * SAMPLE_PERIOD_MS));
+}
+
+/* Maps the first segment of the channel as the card has it after the crash */
+static unsigned char *mapSegmentFile(const char *directory, const sensor_channel_t channel, int *fd)
+{
+	char path[512];
+	unsigned char *map;
+
+	snprintf(path, sizeof(path), "%s/ch%d-%08u.seg", directory, channel, 1);
+	*fd = open(path, O_RDWR);
+	if(*fd < 0)
+		return NULL;
+	map = mmap(NULL, SEGMENT_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	return map == MAP_FAILED ? NULL : map;
+}
+
+static void unmapSegmentFile(unsigned char *map, const int fd)
+{
+	munmap(map, SEGMENT_FILE_SIZE);
+	close(fd);
+}
+
+/* Reads the channel back and checks every sample is the one appended */
+static uint32_t verifiedSamples(time_series_store_t *store, const sensor_channel_t channel)
+{
+	static uint64_t timestamps[4096];
+	static float values[4096];
+	series_cursor_t cursor;
+	uint32_t count = 0;
+	int read, i;
+
+	if(seekTimeSeries(store, channel, 0, &cursor) < 0)
+		return 0;
+	while((read = readTimeSeries(&cursor, timestamps, values, 4096)) > 0) {
+		for(i = 0 ; i < read ; i++, count++) {
+			if(timestamps[i] != SYNTHETIC_EPOCH_MS + (uint64_t)count * SAMPLE_PERIOD_MS ||
+					values[i] != syntheticSample(channel, (uint64_t)count * SAMPLE_PERIOD_MS)) {
+				closeTimeSeriesCursor(&cursor);
+				return UINT32_MAX;
+			}
+		}
+	}
+	closeTimeSeriesCursor(&cursor);
+	return count;
+}
+
+int main(void)
+{
+	time_series_store_t store;
+	segment_header_t *header;
+	series_summary_t stale, aggregate;
+	unsigned char *map;
+	char directory[256];
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	off_t page;
+	int fd;
+
+	if(makeTestDirectory(directory, sizeof(directory)) < 0 || openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+
+	/* Lost value page: the samples read back as zeros, the blocks from the page on are dropped */
+	appendSamples(&store, CHANNEL_MPL3115A2_TEMPERATURE, 0, 3000);
+
+	/* The header pages got out, the tail of the timestamp column didn't */
+	appendSamples(&store, CHANNEL_PRESSURE, 0, 1500);
+
+	/* The summary page of block 3 is older than the samples */
+	appendSamples(&store, CHANNEL_HUMIDITY, 0, 1600);
+	stale = store.channels[CHANNEL_HUMIDITY].header->blocks[3];
+	appendSamples(&store, CHANNEL_HUMIDITY, 1600, 100);
+
+	/* The last block is intact */
+	appendSamples(&store, CHANNEL_ALTITUDE, 0, 1700);
+	closeTimeSeriesStore(&store);
+
+	map = mapSegmentFile(directory, CHANNEL_MPL3115A2_TEMPERATURE, &fd);
+	check(map != NULL, "map the temperature segment");
+	page = (SEGMENT_VALUE_OFFSET + 2000 * sizeof(float)) / pageSize * pageSize;
+	memset(map + page, 0, pageSize);
+	unmapSegmentFile(map, fd);
+
+	map = mapSegmentFile(directory, CHANNEL_PRESSURE, &fd);
+	check(map != NULL, "map the pressure segment");
+	memset(map + SEGMENT_TIMESTAMP_OFFSET + 1200 * sizeof(uint64_t), 0, 300 * sizeof(uint64_t));
+	unmapSegmentFile(map, fd);
+
+	map = mapSegmentFile(directory, CHANNEL_HUMIDITY, &fd);
+	check(map != NULL, "map the humidity segment");
+	header = (segment_header_t *)map;
+	header->blocks[3] = stale;
+	unmapSegmentFile(map, fd);
+
+	if(openTimeSeriesStore(&store, directory) < 0)
+		return 1;
+
+	/* The zeroed page holds the samples from 1024 on for 4 KB pages */
+	check(verifiedSamples(&store, CHANNEL_MPL3115A2_TEMPERATURE) == (uint32_t)((page - SEGMENT_VALUE_OFFSET) / sizeof(float)) /
+			SEGMENT_BLOCK_SAMPLES * SEGMENT_BLOCK_SAMPLES, "lost value page");
+	check(verifiedSamples(&store, CHANNEL_PRESSURE) == 1024, "lost timestamp tail");
+	check(verifiedSamples(&store, CHANNEL_HUMIDITY) == 1600, "stale block summary");
+	check(verifiedSamples(&store, CHANNEL_ALTITUDE) == 1700, "intact segment");
+
+	/* The rebuilt summaries agree with the samples kept */
+	check(timeSeriesAggregate(&store, CHANNEL_PRESSURE, 0, UINT64_MAX, &aggregate) == 0 && aggregate.count == 1024,
+			"aggregate of the cut segment");
+
+	/* Appending goes on after the recovered tail */
+	appendSamples(&store, CHANNEL_HUMIDITY, 1600, 10);
+	check(verifiedSamples(&store, CHANNEL_HUMIDITY) == 1610, "append after the recovery");
+
+	/* The first segment ends inside an hour, the rest of that hour is in the kept segment */
+	appendSamples(&store, CHANNEL_TMP36_TEMPERATURE, 0, SEGMENT_CAPACITY + 20000);
+	check(timeSeriesDropBefore(&store, CHANNEL_TMP36_TEMPERATURE, SYNTHETIC_EPOCH_MS + (uint64_t)SEGMENT_CAPACITY * SAMPLE_PERIOD_MS) == 1,
+			"drop the first segment");
+	check(timeSeriesAggregate(&store, CHANNEL_TMP36_TEMPERATURE, 0, UINT64_MAX, &aggregate) == 0 && aggregate.count == 20000,
+			"aggregate after the drop");
+	check(timeSeriesAggregate(&store, CHANNEL_TMP36_TEMPERATURE, SYNTHETIC_EPOCH_MS + SEGMENT_CAPACITY / HOUR_SAMPLES * SUMMARY_HOUR_MS,
+			SYNTHETIC_EPOCH_MS + (SEGMENT_CAPACITY / HOUR_SAMPLES + 1) * SUMMARY_HOUR_MS, &aggregate) == 0 &&
+			aggregate.count == HOUR_SAMPLES - SEGMENT_CAPACITY % HOUR_SAMPLES, "aggregate of the hour cut by the drop");
+
+	closeTimeSeriesStore(&store);
+	removeTestDirectory(directory);
+
+	printf("TimeSeriesStoreTest: %u checks, %u failures\n", g_checks, g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
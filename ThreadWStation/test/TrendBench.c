@@ -0,0 +1,148 @@
+/*
+ * TrendBench.c
+ *
+ * Bytes per refresh of the trend view, the way the dashboard shows it: a synthetic pressure refreshed
+ * every LCD_TREND_REFRESH_MS with the mean of its current 15 minute bucket, the screen presented
+ * through the frame diff to a pty. The refreshes within a bucket and the ones which shift the bars are
+ * counted apart and checked against the bound maxTrendRefreshBytes() gives for the display, on a 4x16
+ * and a 4x20 display in turn. The pty is drained as fast as it fills, the bytes are what the 9600 baud
+ * line would carry.
+ *
+ *   TrendBench [hours]
+ */
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../LCD.h"
+#include "../LCDFrame.h"
+#include "../LCDTrend.h"
+#include "TestSupport.h"
+
+/* The dashboard's scale and decimals of the pressure */
+#define PRESSURE_TREND_SPAN		1.0f
+#define PRESSURE_DECIMALS		1
+
+static const sensor_channel_t g_channel = CHANNEL_PRESSURE;
+
+/* What the trend view sent, the refreshes in a bucket and the ones starting a bucket */
+typedef struct refresh_bytes
+{
+	uint32_t count;
+	uint64_t total;
+	int max;
+} refresh_bytes_t;
+
+static volatile int g_draining = 1;
+
+static void *drainThread(void *argument)
+{
+	unsigned char buffer[4096];
+	int master = *(int *)argument;
+
+	while(g_draining) {
+		if(read(master, buffer, sizeof(buffer)) <= 0)
+			usleep(1000);
+	}
+	return NULL;
+}
+
+static void addRefresh(refresh_bytes_t *refreshes, const int bytes)
+{
+	refreshes->count++;
+	refreshes->total += bytes;
+	if(bytes > refreshes->max)
+		refreshes->max = bytes;
+}
+
+static void printRefreshes(const char *name, const refresh_bytes_t *refreshes)
+{
+	double mean = refreshes->count > 0 ? (double)refreshes->total / refreshes->count : 0.0;
+
+	printf("  %-16s %6u refreshes, %6.1f bytes (%5.1f ms) on average, %3d bytes at most\n", name, refreshes->count,
+			mean, mean * LCD_BITS_PER_BYTE * 1000.0 / LCD_BAUD_RATE, refreshes->max);
+}
+
+/* Refreshes the trend view on a display of the size, returns the refreshes over the bound */
+static uint32_t runTrend(const unsigned char lines, const unsigned char columns, const double hours)
+{
+	lcd_trend_t trend;
+	lcd_frame_t frame;
+	refresh_bytes_t first = { 0, 0, 0 }, inBucket = { 0, 0, 0 }, shifts = { 0, 0, 0 };
+	uint64_t refreshes = (uint64_t)(hours * 3600000.0 / LCD_TREND_REFRESH_MS), i, offset, bucket, lastBucket = 0;
+	uint32_t count = 0, over = 0;
+	double sum = 0.0;
+	float value;
+	int bound, bytes;
+
+	setType_LCD(lines, columns);
+	bound = maxTrendRefreshBytes();
+	initTrend(&trend, columns, LCD_TREND_RESOLUTION_MS, PRESSURE_TREND_SPAN);
+
+	for(i = 0 ; i < refreshes ; i++) {
+		offset = i * LCD_TREND_REFRESH_MS;
+		value = syntheticSample(g_channel, offset);
+
+		/* The rollup of the current bucket is the mean of its readings so far */
+		bucket = (SYNTHETIC_EPOCH_MS + offset) / LCD_TREND_RESOLUTION_MS;
+		if(bucket != lastBucket) {
+			sum = 0.0;
+			count = 0;
+		}
+		sum += value;
+		count++;
+		pushTrendValue(&trend, bucket * LCD_TREND_RESOLUTION_MS, (float)(sum / count));
+
+		composeTrendView(&frame, "Pressure 4h", value, PRESSURE_DECIMALS, "hPa", &trend);
+		bytes = presentFrame_LCD(&frame);
+		if(bytes < 0)
+			return UINT32_MAX;
+		if(bytes > bound)
+			over++;
+
+		addRefresh(i == 0 ? &first : bucket != lastBucket ? &shifts : &inBucket, bytes);
+		lastBucket = bucket;
+	}
+
+	printf("TrendBench: %s on %ux%u refreshed every %d ms for %g hours, bound %d bytes\n", channelName(g_channel),
+			lines, columns, LCD_TREND_REFRESH_MS, hours, bound);
+	printRefreshes("first frame", &first);
+	printRefreshes("in a bucket", &inBucket);
+	printRefreshes("shifting bars", &shifts);
+	printf("  %u refreshes over the bound\n", over);
+	return over;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t drain;
+	double hours = argc > 1 ? atof(argv[1]) : 7.5;
+	uint32_t over;
+	int master;
+
+	if(hours * 3600000.0 < LCD_TREND_REFRESH_MS) {
+		printf("Usage: %s [hours]\n", argv[0]);
+		return 1;
+	}
+
+	master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || openSerial_LCD(ptsname(master)) < 0)
+		return 1;
+	if(pthread_create(&drain, NULL, drainThread, &master) != 0)
+		return 1;
+
+	over = runTrend(4, 16, hours);
+	if(over != UINT32_MAX)
+		over += runTrend(4, 20, hours);
+
+	g_draining = 0;
+	pthread_join(drain, NULL);
+	printFrameStatistics_LCD();
+
+	serialLCD_Close();
+	close(master);
+	return over == 0 ? 0 : 1;
+}
@@ -7,9 +7,14 @@
 #include "MCP3002SPI.h"
 #include "Bluetooth_RFCOMM.h"
 #include "TCP_Socket.h"
+#include "SamplePublisher.h"
+#include "LCDRenderer.h"
+#include "LCDDashboard.h"
 
 /* Static function declarations */
 static int GetKey(void);
+static void reportExtremes(const sensor_channel_t channel, pthread_mutex_t *mutex, float *min, float *max);
+static void printChannelStatistics(const sensor_channel_t channel, const char *title);
 
 /* Local flag for terminate the thread loops */
 static volatile sig_atomic_t thread_loop_flag = 0;
@@ -59,24 +64,92 @@ int initMutex(thread_data_t *init_mutex_t)
 	return 0;
 }
 
+/* Locks all the sensor data mutexes, always in the same order to avoid deadlocks */
+void lockSensorData(thread_data_t *sensorData)
+{
+	pthread_mutex_lock(&sensorData->mutex1);
+	pthread_mutex_lock(&sensorData->mutex2);
+	pthread_mutex_lock(&sensorData->mutex3);
+	pthread_mutex_lock(&sensorData->mutex4);
+	pthread_mutex_lock(&sensorData->mutex5);
+}
+
+void unlockSensorData(thread_data_t *sensorData)
+{
+	pthread_mutex_unlock(&sensorData->mutex5);
+	pthread_mutex_unlock(&sensorData->mutex4);
+	pthread_mutex_unlock(&sensorData->mutex3);
+	pthread_mutex_unlock(&sensorData->mutex2);
+	pthread_mutex_unlock(&sensorData->mutex1);
+}
+
+/* Returns the wall clock time in milliseconds since the epoch */
+unsigned long long timestampMs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (unsigned long long)now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+/* The clock of the timeouts and the latencies, it doesn't jump when the wall clock is set */
+uint64_t monotonicUs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+uint64_t monotonicMs(void)
+{
+	return monotonicUs() / 1000;
+}
+
+/* Returns a printable name of the measurement channel */
+const char *channelName(const sensor_channel_t channel)
+{
+	static const char *names[NUMBER_OF_CHANNELS] =
+	{
+		[CHANNEL_MPL3115A2_TEMPERATURE]	= "MPL3115A2 temperature",
+		[CHANNEL_PRESSURE]				= "Pressure",
+		[CHANNEL_ALTITUDE]				= "Altitude",
+		[CHANNEL_TMP36_TEMPERATURE]		= "TMP36 temperature",
+		[CHANNEL_HUMIDITY]				= "Humidity",
+	};
+
+	if(channel >= NUMBER_OF_CHANNELS)
+		return "Unknown";
+	return names[channel];
+}
+
 /* This thread reads the I2C MPL3115A2 sensor */
 void *measureMPL3115A2(void *arg)
 {
 	while(!thread_loop_flag)
 	{
 		thread_data_t *sensorData = (thread_data_t*)arg;
+		float value;
 
 		pthread_mutex_lock(&sensorData->mutex1);
 		readTemperature(sensorData);
+		value = sensorData->MPL3115A2temperature;
 		pthread_mutex_unlock(&sensorData->mutex1);
+		publishSample(CHANNEL_MPL3115A2_TEMPERATURE, timestampMs(), value);
+		reportExtremes(CHANNEL_MPL3115A2_TEMPERATURE, &sensorData->mutex1,
+				&sensorData->minMPL3115A2temperature, &sensorData->maxMPL3115A2temperature);
 
 		pthread_mutex_lock(&sensorData->mutex2);
 		readPressure(&sensorData->pressure);
+		value = sensorData->pressure;
 		pthread_mutex_unlock(&sensorData->mutex2);
+		publishSample(CHANNEL_PRESSURE, timestampMs(), value);
 
 		pthread_mutex_lock(&sensorData->mutex3);
 		readAltitude(&sensorData->altitude);
+		value = sensorData->altitude;
 		pthread_mutex_unlock(&sensorData->mutex3);
+		publishSample(CHANNEL_ALTITUDE, timestampMs(), value);
 	}
 	pthread_exit(NULL);
 }
@@ -87,18 +160,49 @@ void *measureMCP3002(void *arg)
 	while(!thread_loop_flag)
 	{
 		thread_data_t *sensorData = (thread_data_t*)arg;
+		float value;
 
 		pthread_mutex_lock(&sensorData->mutex4);
 		readTMP36Temperature(&sensorData->TMP36temperature);
+		value = sensorData->TMP36temperature;
 		pthread_mutex_unlock(&sensorData->mutex4);
+		publishSample(CHANNEL_TMP36_TEMPERATURE, timestampMs(), value);
 
 		pthread_mutex_lock(&sensorData->mutex5);
 		readHIH4030Humidity(sensorData);
+		value = sensorData->humidity;
 		pthread_mutex_unlock(&sensorData->mutex5);
+		publishSample(CHANNEL_HUMIDITY, timestampMs(), value);
+		reportExtremes(CHANNEL_HUMIDITY, &sensorData->mutex5, &sensorData->minHumidity, &sensorData->maxHumidity);
 	}
 	pthread_exit(NULL);
 }
 
+/* Copies the extremes of the reported window into the sensor data the 'T' reply is built from */
+static void reportExtremes(const sensor_channel_t channel, pthread_mutex_t *mutex, float *min, float *max)
+{
+	float windowMin, windowMax;
+
+	if(readWindowedExtremes(channel, EXTREMES_REPORT_WINDOW, &windowMin, &windowMax) < 0)
+		return;
+
+	pthread_mutex_lock(mutex);
+	*min = windowMin;
+	*max = windowMax;
+	pthread_mutex_unlock(mutex);
+}
+
+/* Shows the statistics of the last hour of the channel */
+static void printChannelStatistics(const sensor_channel_t channel, const char *title)
+{
+	stats_snapshot_t stats;
+
+	if(readChannelStatistics(channel, STATS_WINDOW_1_HOUR, &stats) < 0)
+		return;
+
+	printStatistics_LCD(title, stats.mean, stats.stddev, stats.quantiles[0], stats.quantiles[1], stats.quantiles[2]);
+}
+
 /* This thread polls the stdin for pressed keyboard keys */
 void *printToLCD(void *arg)
 {
@@ -107,60 +211,97 @@ void *printToLCD(void *arg)
 	while(!thread_loop_flag)
 	{
 		int key;
+		float value;
 		key = GetKey();
 
+		/* Between the key presses the dashboard has the screen */
+		runDashboard_LCD();
+
 		/*
-		 * Print the measurement values by pressing the particular keyboard key
+		 * Print the measurement values by pressing the particular keyboard key,
+		 * the dashboard goes on when the value's time is up
 		 */
 
 		/* Press t for MPL3115A2 temperature */
 		if(key == 't')
 		{
 			pthread_mutex_lock(&sensorData->mutex1);
-			printMPL3115A2Temperature_LCD(sensorData->MPL3115A2temperature);
+			value = sensorData->MPL3115A2temperature;
 			pthread_mutex_unlock(&sensorData->mutex1);
-			sleep(1);
-			clear_LCD();
+			printMPL3115A2Temperature_LCD(value);
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
 		}
 
 		/* Press p for pressure */
 		if(key == 'p')
 		{
 			pthread_mutex_lock(&sensorData->mutex2);
-			printPressure_LCD(sensorData->pressure);
+			value = sensorData->pressure;
 			pthread_mutex_unlock(&sensorData->mutex2);
-			sleep(1);
-			clear_LCD();
+			printPressure_LCD(value);
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
 		}
 
 		/* Press a for altitude */
 		if(key == 'a')
 		{
 			pthread_mutex_lock(&sensorData->mutex3);
-			printAltitude_LCD(sensorData->altitude);
+			value = sensorData->altitude;
 			pthread_mutex_unlock(&sensorData->mutex3);
-			sleep(1);
-			clear_LCD();
+			printAltitude_LCD(value);
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
 		}
 
 		/* Press y for TMP36 temperature */
 		if(key == 'y')
 		{
 			pthread_mutex_lock(&sensorData->mutex4);
-			printTMP36Temperature_LCD(sensorData->TMP36temperature);
+			value = sensorData->TMP36temperature;
 			pthread_mutex_unlock(&sensorData->mutex4);
-			sleep(1);
-			clear_LCD();
+			printTMP36Temperature_LCD(value);
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
 		}
 
 		/* Press h for humidity */
 		if(key == 'h')
 		{
 			pthread_mutex_lock(&sensorData->mutex5);
-			printHumidity_LCD(sensorData->humidity);
+			value = sensorData->humidity;
 			pthread_mutex_unlock(&sensorData->mutex5);
-			sleep(1);
-			clear_LCD();
+			printHumidity_LCD(value);
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
+		}
+
+		/* Press T for the MPL3115A2 temperature statistics of the last hour */
+		if(key == 'T')
+		{
+			printChannelStatistics(CHANNEL_MPL3115A2_TEMPERATURE, "MPL tmp 1h");
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
+		}
+
+		/* Press H for the humidity statistics of the last hour */
+		if(key == 'H')
+		{
+			printChannelStatistics(CHANNEL_HUMIDITY, "Humidity 1h");
+			pauseDashboard_LCD(LCD_VALUE_HOLD_MS);
+		}
+
+		/* Press P for the pressure trend of the last four hours, it stays until d is pressed */
+		if(key == 'P')
+		{
+			holdDashboardPage_LCD(DASHBOARD_TREND, CHANNEL_PRESSURE);
+		}
+
+		/* Press U for the humidity trend of the last four hours, it stays until d is pressed */
+		if(key == 'U')
+		{
+			holdDashboardPage_LCD(DASHBOARD_TREND, CHANNEL_HUMIDITY);
+		}
+
+		/* Press d to go back to the rotating dashboard */
+		if(key == 'd')
+		{
+			resumeDashboard_LCD();
 		}
 	}
 	pthread_mutex_destroy(&sensorData->mutex1);
@@ -182,9 +323,10 @@ void *bluetoothRFCOMM(void *arg)
 		if(bluetoothRFCOMM_Server(sensorData) == 0);
 				thread_loop_flag = 1;
 */
-		if(TCP_SocketPollingServer(sensorData) <= 0);
+		if(TCP_SocketPollingServer(sensorData) < 0)
 			thread_loop_flag = 1;
 	}
+	TCP_SocketClose();
 	pthread_exit(NULL);
 }
 
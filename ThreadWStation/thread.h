@@ -8,7 +8,20 @@
 #include <pthread.h>
 #include <termios.h>
 #include <signal.h>
+#include <stdint.h>
 #include <float.h>
+#include <time.h>
+
+/* Measurement channels of the weather station */
+typedef enum
+{
+	CHANNEL_MPL3115A2_TEMPERATURE	= 0,
+	CHANNEL_PRESSURE				= 1,
+	CHANNEL_ALTITUDE				= 2,
+	CHANNEL_TMP36_TEMPERATURE		= 3,
+	CHANNEL_HUMIDITY				= 4,
+	NUMBER_OF_CHANNELS
+} sensor_channel_t;
 
 typedef struct thread_data
 {
@@ -17,6 +30,7 @@ typedef struct thread_data
 	float altitude;
 	float TMP36temperature;
 	float humidity;
+	/* Extremes over EXTREMES_REPORT_WINDOW, kept by the sample publisher */
 	float maxMPL3115A2temperature;
 	float minMPL3115A2temperature;
 	float maxHumidity;
@@ -32,6 +46,12 @@ typedef struct thread_data
 /* Function prototypes */
 void sigHandler(int sig);
 int initMutex(thread_data_t *init_mutex_t);
+void lockSensorData(thread_data_t *sensorData);
+void unlockSensorData(thread_data_t *sensorData);
+unsigned long long timestampMs(void);
+uint64_t monotonicUs(void);
+uint64_t monotonicMs(void);
+const char *channelName(const sensor_channel_t channel);
 void *measureMPL3115A2(void *arg);
 void *measureMCP3002(void *arg);
 void *printToLCD(void *arg);
@@ -8,7 +8,8 @@ QML_IMPORT_PATH =
 
 # The .cpp file which was generated for your project. Feel free to hack it.
 SOURCES += main.cpp \
-    tcpsocketclient.cpp
+    tcpsocketclient.cpp \
+    weatherframe.cpp
 
 # Installation path
 # target.path =
@@ -22,4 +23,5 @@ RESOURCES +=
 OTHER_FILES +=
 
 HEADERS += \
-    tcpsocketclient.h
+    tcpsocketclient.h \
+    weatherframe.h
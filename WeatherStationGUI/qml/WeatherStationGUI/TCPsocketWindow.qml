@@ -14,14 +14,14 @@ Window {
         anchors.centerIn: parent
     }
 
-    //Global flag to avoid multiple connections
-    property bool socketConnected: false
-
     property string ipAddress: "10.42.0.2"
     property int portNumber: 51000
 
     TCPsocketClient {
         id: clientSocket
+
+        onConnectedChanged: console.log(connected ? "Connected, frame format " + frameVersion : "Disconnected")
+        onErrorOccurred: console.log(message)
     }
 
     Rectangle {
@@ -53,13 +53,9 @@ Window {
             MouseArea {
                 anchors.fill: connectButton
                 onClicked: {
-                    if(!socketConnected) {
-                        //clientSocket.createConnection("10.42.0.2", 51000);
+                    //Returns at once, a second connection is refused while the first one is open
+                    if(!clientSocket.connected)
                         clientSocket.createConnection(ipAddress, portNumber);
-                    }
-
-                    //Set the flag to allow one connection
-                    socketConnected = true;
                 }
             }
         }
@@ -123,9 +119,8 @@ Window {
             MouseArea {
                 anchors.fill: dataButton
                 onClicked: {
-                    if(clientSocket.readData())
-                        console.log("Data read ok!");
-                    else
+                    //The fields follow the properties when the response arrives
+                    if(!clientSocket.readData())
                         console.log("Reading data failed!");
                 }
             }
@@ -158,9 +153,7 @@ Window {
             MouseArea {
                 anchors.fill: maxminDataButton
                 onClicked: {
-                    if(clientSocket.readMaxAndMinValues())
-                        console.log("Max and min data read ok!");
-                    else
+                    if(!clientSocket.readMaxAndMinValues())
                         console.log("Reading max and min data failed!")
                 }
             }
@@ -182,6 +175,8 @@ Window {
 
         TextField {
             id: temperatureField
+            text: clientSocket.temperature.toFixed(2)
+            readOnly: true
             anchors {
                 top: parent.top
                 topMargin: 70
@@ -217,6 +212,8 @@ Window {
 
         TextField {
             id: humidityField
+            text: clientSocket.humidity.toFixed(2)
+            readOnly: true
             anchors {
                 top: parent.top
                 topMargin: 175
@@ -252,6 +249,8 @@ Window {
 
         TextField {
             id: minTemperatureField
+            text: clientSocket.minTemperature.toFixed(2)
+            readOnly: true
             anchors {
                 top: parent.top
                 topMargin: 280
@@ -287,6 +286,8 @@ Window {
 
         TextField {
             id: maxTemperatureField
+            text: clientSocket.maxTemperature.toFixed(2)
+            readOnly: true
             anchors {
                 top: parent.top
                 topMargin: 385
@@ -323,6 +324,8 @@ Window {
 
         TextField {
             id: minHumidityField
+            text: clientSocket.minHumidity.toFixed(2)
+            readOnly: true
             anchors {
                 top: parent.top
                 topMargin: 490
@@ -358,6 +361,8 @@ Window {
 
         TextField {
             id: maxHumidityField
+            text: clientSocket.maxHumidity.toFixed(2)
+            readOnly: true
             anchors {
                 top: parent.top
                 topMargin: 595
@@ -1,12 +1,29 @@
 #include "tcpsocketclient.h"
 
-TCPsocketClient::TCPsocketClient(QObject *parent) : QObject(parent)
+TCPsocketClient::TCPsocketClient(QObject *parent) : QObject(parent),
+    m_state(Disconnected), m_writtenRequests(0), m_receiveOffset(0), m_frameVersion(0),
+    m_temperature(0), m_humidity(0), m_minTemperature(0), m_maxTemperature(0),
+    m_minHumidity(0), m_maxHumidity(0)
 {
-
+    m_timer.setSingleShot(true);
+
+    connect(&clientSocket, &QTcpSocket::connected, this, &TCPsocketClient::onConnected);
+    connect(&clientSocket, &QTcpSocket::disconnected, this, &TCPsocketClient::onDisconnected);
+    connect(&clientSocket, &QTcpSocket::readyRead, this, &TCPsocketClient::onReadyRead);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(&clientSocket, &QAbstractSocket::errorOccurred, this, &TCPsocketClient::onSocketError);
+#else
+    connect(&clientSocket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+            this, &TCPsocketClient::onSocketError);
+#endif
+    connect(&m_timer, &QTimer::timeout, this, &TCPsocketClient::onTimeout);
 }
 
 TCPsocketClient::~TCPsocketClient()
 {
+    /* Nothing is reported to QML while it is torn down */
+    disconnect(&clientSocket, 0, this, 0);
+
     clientSocket.disconnectFromHost();
     if(clientSocket.state() == QAbstractSocket::UnconnectedState || clientSocket.waitForDisconnected(2000))
         qDebug() << "Disconnected from the host!";
@@ -15,104 +32,423 @@ TCPsocketClient::~TCPsocketClient()
     qDebug() << "Socket closed!";
 }
 
+/*
+ * Starts connecting and returns at once, connectedChanged tells when the station can be asked.
+ * Requests made before that are sent once the frame format is negotiated.
+ */
 bool TCPsocketClient::createConnection(const QString &addr, const quint16 port)
 {
     QHostAddress hostAddr(addr);
 
-    clientSocket.connectToHost(hostAddr, port);
-    if(clientSocket.waitForConnected(5000)) {
-        qDebug("Connected!");
-        return true;
-    }
-    else
+    if(m_state != Disconnected)
         return false;
+    if(hostAddr.isNull()) {
+        emit errorOccurred(QStringLiteral("Invalid station address %1").arg(addr));
+        return false;
+    }
+
+    m_state = Connecting;
+    m_frameVersion = 0;
+    m_receiveBuffer.clear();
+    m_receiveOffset = 0;
+    clientSocket.connectToHost(hostAddr, port);
+    m_timer.start(ConnectTimeoutMs);
+    return true;
 }
 
-bool TCPsocketClient::sendByte(const char *commandByte)
+/* Tells the station to close the connection, connectedChanged follows */
+void TCPsocketClient::closeConnection()
 {
-    if(clientSocket.write(commandByte, 1) == 1)
-        return true;
-    else
-        return false;
+    if(m_state == Connecting) {
+        clientSocket.abort();
+        m_timer.stop();
+        m_state = Disconnected;
+        failRequests(QStringLiteral("Connection cancelled"));
+        return;
+    }
+
+    if(m_state != Disconnected) {
+        clientSocket.write("Q", 1);
+        clientSocket.disconnectFromHost();
+    }
 }
 
 bool TCPsocketClient::readData()
 {
-    const char commandByte[1] = { 'S' };
-    quint8 dataArray[8];
+    return enqueueRequest(CurrentValues, QByteArray(1, 'S'), -1);
+}
 
-    if(sendByte(commandByte) == true) {
-        clientSocket.read((char*)dataArray, 8);
+bool TCPsocketClient::readMaxAndMinValues()
+{
+    return enqueueRequest(Extremes, QByteArray(1, 'T'), -1);
+}
 
-        quint32 tempRawData, humRawData;
-        float temperature, humidity;
+/*
+ * Asks the station for a series already reduced to about one point per pixel of the chart, so a long
+ * time range costs width points on the wire instead of every stored sample. The time range is in
+ * milliseconds since the epoch and mode is a WeatherFrame::DownsampleMode. The points come with
+ * seriesReceived.
+ */
+bool TCPsocketClient::requestDownsampledSeries(int channel, qint64 from, qint64 to, int width, int mode)
+{
+    QByteArray command(1 + WeatherFrame::DownsampleRequestSize, 0);
 
-        /* Parse the data to unsigned int and then to ieee 754 float */
-        tempRawData = parseData(dataArray, true);
-        char *pul_t = (char *)&tempRawData;
-        char *pf_t = (char *)&temperature;
-        memcpy(pf_t, pul_t, sizeof(float));
-        qDebug("Temperature: %0.2f", temperature);
+    command[0] = 'D';
+    command[1] = char(channel);
+    for(int i = 0 ; i < 8 ; i++) {
+        command[2 + i] = char(quint64(from) >> (56 - 8 * i));
+        command[10 + i] = char(quint64(to) >> (56 - 8 * i));
+    }
+    command[18] = char(width >> 8);
+    command[19] = char(width);
+    command[20] = char(mode);
 
-        humRawData = parseData(dataArray, false);
-        char *pul_h = (char *)&humRawData;
-        char *pf_h = (char *)&humidity;
-        memcpy(pf_h, pul_h, sizeof(float));
-        qDebug("Humidity: %0.2f", humidity);
+    return enqueueRequest(DownsampledSeries, command, channel);
+}
 
-        return true;
+bool TCPsocketClient::isConnected() const
+{
+    return m_state == Ready;
+}
+
+int TCPsocketClient::frameVersion() const
+{
+    return m_frameVersion;
+}
+
+int TCPsocketClient::pendingRequests() const
+{
+    return m_requests.size();
+}
+
+/* Asks the station to switch to the framed format, a station without it doesn't answer */
+void TCPsocketClient::onConnected()
+{
+    const char command[2] = { 'V', WeatherFrame::Version };
+
+    qDebug("Connected!");
+    clientSocket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    m_state = Negotiating;
+    m_timer.start(NegotiationTimeoutMs);
+    if(clientSocket.write(command, sizeof(command)) != sizeof(command))
+        finishNegotiation(0);
+}
+
+void TCPsocketClient::onDisconnected()
+{
+    qDebug() << "Disconnected from the host!";
+    m_timer.stop();
+    m_state = Disconnected;
+    m_frameVersion = 0;
+    failRequests(QStringLiteral("Disconnected from the station"));
+    emit connectedChanged();
+}
+
+/* Parses every complete response of the bytes received so far, a partial one waits for the rest */
+void TCPsocketClient::onReadyRead()
+{
+    m_receiveBuffer.append(clientSocket.readAll());
+
+    while(m_receiveOffset < m_receiveBuffer.size()) {
+        bool parsed = m_state == Negotiating || m_frameVersion > 0 ? parseFrame() : parseLegacyResponse();
+        if(!parsed)
+            break;
+    }
+
+    /* The parsed bytes are dropped once per read, not once per response */
+    m_receiveBuffer.remove(0, m_receiveOffset);
+    m_receiveOffset = 0;
+}
+
+void TCPsocketClient::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError);
+
+    emit errorOccurred(clientSocket.errorString());
+
+    /* A refused or unreachable connection never gets disconnected */
+    if(m_state == Connecting) {
+        m_timer.stop();
+        m_state = Disconnected;
+        failRequests(QStringLiteral("Could not connect to the station"));
+    }
+}
+
+void TCPsocketClient::onTimeout()
+{
+    switch(m_state)
+    {
+        case Connecting:
+            clientSocket.abort();
+            m_state = Disconnected;
+            emit errorOccurred(QStringLiteral("Could not connect to the station"));
+            failRequests(QStringLiteral("Could not connect to the station"));
+            break;
+
+        case Negotiating:
+            qDebug("Station talks the legacy format");
+            finishNegotiation(0);
+            break;
+
+        case Ready:
+            /* The bytes of the late responses can't be told apart any more */
+            failRequests(QStringLiteral("The station didn't answer"));
+            m_receiveBuffer.clear();
+            m_receiveOffset = 0;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Queues the request, it is written right away once the frame format is known */
+bool TCPsocketClient::enqueueRequest(RequestType type, const QByteArray &command, int channel)
+{
+    Request request = { type, command, channel };
+
+    if(m_state == Disconnected) {
+        emit errorOccurred(QStringLiteral("Not connected to the station"));
+        return false;
     }
-    else {
-        qDebug("Failed to send data!");
+    if(m_requests.size() >= MaxPendingRequests) {
+        emit errorOccurred(QStringLiteral("Too many requests waiting for the station"));
         return false;
     }
+
+    m_requests.enqueue(request);
+    emit pendingRequestsChanged();
+
+    if(m_state == Ready)
+        writeRequests();
+    return true;
+}
+
+/* Writes the queued requests, the station answers them in this order */
+void TCPsocketClient::writeRequests()
+{
+    while(m_writtenRequests < m_requests.size()) {
+        const QByteArray &command = m_requests.at(m_writtenRequests).command;
+
+        if(clientSocket.write(command) != command.size()) {
+            failRequests(QStringLiteral("Failed to send data!"));
+            return;
+        }
+        if(m_writtenRequests++ == 0)
+            m_timer.start(ResponseTimeoutMs);
+    }
 }
 
-bool TCPsocketClient::readMaxAndMinValues()
+void TCPsocketClient::finishNegotiation(quint8 version)
 {
-    const char commandByte[1] = { 'T' };
-    quint8 dataArray[16];
+    m_timer.stop();
+    m_frameVersion = version;
+    m_state = Ready;
+    if(version > 0)
+        qDebug("Frame format version %d", version);
+
+    emit connectedChanged();
+    writeRequests();
+}
 
-    if(sendByte(commandByte) == true) {
-        clientSocket.read((char*)dataArray, 16);
+/* The oldest request got its response, the timeout now runs for the next one */
+void TCPsocketClient::completeRequest()
+{
+    m_requests.dequeue();
+    m_writtenRequests--;
 
-        quint32 minTempRawData, maxTempRawData, minHumRawData, maxHumRawData;
-        float minTemperature, maxTemperature, minHumidity, maxHumidity;
+    if(m_writtenRequests > 0)
+        m_timer.start(ResponseTimeoutMs);
+    else
+        m_timer.stop();
+    emit pendingRequestsChanged();
+}
 
-        /* Parse the data to unsigned int and then to ieee 754 float */
-        minTempRawData = parseData(dataArray, 0);
-        char *pul_tMin = (char *)&minTempRawData;
-        char *pf_tMin = (char *)&minTemperature;
-        memcpy(pf_tMin, pul_tMin, sizeof(float));
-        qDebug("Min temperature: %0.2f", minTemperature);
+void TCPsocketClient::failRequests(const QString &message)
+{
+    if(m_state == Ready)
+        m_timer.stop();
+    if(m_requests.isEmpty())
+        return;
+
+    m_requests.clear();
+    m_writtenRequests = 0;
+    emit pendingRequestsChanged();
+    emit errorOccurred(message);
+}
 
-        maxTempRawData = parseData(dataArray, 1);
-        char *pul_tMax = (char *)&maxTempRawData;
-        char *pf_tMax = (char *)&maxTemperature;
-        memcpy(pf_tMax, pul_tMax, sizeof(float));
-        qDebug("Max temperature: %0.2f", maxTemperature);
+/*
+ * Handles the frame at the parse offset. Returns false when the frame isn't complete yet.
+ * Garbage before a frame is skipped.
+ */
+bool TCPsocketClient::parseFrame()
+{
+    const quint8 *data = reinterpret_cast<const quint8 *>(m_receiveBuffer.constData()) + m_receiveOffset;
+    qint64 available = m_receiveBuffer.size() - m_receiveOffset;
+    WeatherFrameView frame;
+    qint64 length = WeatherFrame::decode(data, available, &frame);
 
-        minHumRawData = parseData(dataArray, 2);
-        char *pul_hMin = (char *)&minHumRawData;
-        char *pf_hMin = (char *)&minHumidity;
-        memcpy(pf_hMin, pul_hMin, sizeof(float));
-        qDebug("Min humidity: %0.2f", minHumidity);
+    if(length == 0)
+        return false;
+    if(length < 0) {
+        m_receiveOffset += WeatherFrame::findStart(data, available);
+        return true;
+    }
 
-        maxHumRawData = parseData(dataArray, 3);
-        char *pul_hMax = (char *)&maxHumRawData;
-        char *pf_hMax = (char *)&maxHumidity;
-        memcpy(pf_hMax, pul_hMax, sizeof(float));
-        qDebug("Max humidity: %0.2f", maxHumidity);
+    /* The view stays valid, the buffer is only compacted after the parsing */
+    m_receiveOffset += length;
 
+    if(m_state == Negotiating) {
+        if(frame.type == WeatherFrame::Hello && frame.payloadLength >= 1)
+            finishNegotiation(frame.payload[0]);
         return true;
     }
-    else {
-        qDebug("Failed to send data!");
+
+    /* A push answers no request, it only updates the values */
+    if(frame.type == WeatherFrame::Push) {
+        applySamples(frame);
+    }
+    else if(frame.type == WeatherFrame::Samples) {
+        applySamples(frame);
+        if(m_writtenRequests > 0 && m_requests.head().type != DownsampledSeries)
+            completeRequest();
+    }
+    else if(frame.type == WeatherFrame::Series) {
+        if(m_writtenRequests > 0 && m_requests.head().type == DownsampledSeries) {
+            int channel = m_requests.head().channel;
+            QVariantList points = seriesPoints(frame.payload, frame.payloadLength);
+
+            completeRequest();
+            emit seriesReceived(channel, points);
+        }
+    }
+    else if(frame.type == WeatherFrame::Error) {
+        if(m_writtenRequests > 0)
+            completeRequest();
+        emit errorOccurred(QStringLiteral("The station refused the request"));
+    }
+    return true;
+}
+
+/*
+ * The legacy responses have no header, their length follows from the request: the raw floats and
+ * the 0xEE end character. Bytes nobody asked for are dropped.
+ */
+bool TCPsocketClient::parseLegacyResponse()
+{
+    const quint8 *data = reinterpret_cast<const quint8 *>(m_receiveBuffer.constData()) + m_receiveOffset;
+    int available = m_receiveBuffer.size() - m_receiveOffset;
+    int length;
+
+    if(m_writtenRequests == 0) {
+        m_receiveOffset = m_receiveBuffer.size();
         return false;
     }
+
+    RequestType type = m_requests.head().type;
+    if(type == DownsampledSeries)
+        return parseLegacySeries(data, available);
+
+    length = type == CurrentValues ? 8 : 16;
+    if(available < length + 1)
+        return false;
+
+    applyLegacyValues(type, data);
+    m_receiveOffset += length + 1;
+    completeRequest();
+    return true;
+}
+
+/* The series header tells how long the response is, the payload ends with the 0xEE end character */
+bool TCPsocketClient::parseLegacySeries(const quint8 *data, int available)
+{
+    if(available < WeatherFrame::SeriesHeaderSize)
+        return false;
+
+    int pointSize = data[1] == WeatherFrame::LargestTriangle ? WeatherFrame::SeriesPointSize : WeatherFrame::SeriesBucketSize;
+    int length = WeatherFrame::SeriesHeaderSize + (data[2] << 8 | data[3]) * pointSize;
+
+    if(available < length + 1)
+        return false;
+
+    int channel = m_requests.head().channel;
+    QVariantList points = seriesPoints(data, length);
+
+    m_receiveOffset += length + 1;
+    completeRequest();
+    emit seriesReceived(channel, points);
+    return true;
 }
 
-quint32 TCPsocketClient::parseData(quint8 *rawData, bool tempOrHum)
+/* Stores the values of a samples frame */
+void TCPsocketClient::applySamples(const WeatherFrameView &frame)
+{
+    int count = WeatherFrame::sampleCount(frame);
+
+    for(int i = 0 ; i < count ; i++) {
+        quint8 channel, field;
+        float value;
+
+        WeatherFrame::readSample(frame, i, &channel, &field, &value);
+
+        if(channel == WeatherFrame::MPL3115A2Temperature) {
+            if(field == WeatherFrame::Current)
+                setTemperature(value);
+            else if(field == WeatherFrame::Min)
+                setMinTemperature(value);
+            else if(field == WeatherFrame::Max)
+                setMaxTemperature(value);
+        }
+        else if(channel == WeatherFrame::Humidity) {
+            if(field == WeatherFrame::Current)
+                setHumidity(value);
+            else if(field == WeatherFrame::Min)
+                setMinHumidity(value);
+            else if(field == WeatherFrame::Max)
+                setMaxHumidity(value);
+        }
+    }
+}
+
+/* The 'S' response is the temperature and the humidity, the 'T' response their min and max */
+void TCPsocketClient::applyLegacyValues(RequestType type, const quint8 *data)
+{
+    if(type == CurrentValues) {
+        setTemperature(toFloat(parseData(data, true)));
+        setHumidity(toFloat(parseData(data, false)));
+        qDebug("Temperature: %0.2f", m_temperature);
+        qDebug("Humidity: %0.2f", m_humidity);
+        return;
+    }
+
+    setMinTemperature(toFloat(parseMaxMinData(data, 0)));
+    setMaxTemperature(toFloat(parseMaxMinData(data, 1)));
+    setMinHumidity(toFloat(parseMaxMinData(data, 2)));
+    setMaxHumidity(toFloat(parseMaxMinData(data, 3)));
+}
+
+/* Converts a series payload to a list of { time, min, max, mean } maps for the chart */
+QVariantList TCPsocketClient::seriesPoints(const quint8 *payload, qint64 length)
+{
+    QVariantList points;
+    int count = WeatherFrame::seriesPointCount(payload, length);
+
+    for(int i = 0 ; i < count ; i++) {
+        WeatherSeriesPoint point;
+        QVariantMap map;
+
+        WeatherFrame::readSeriesPoint(payload, length, i, &point);
+        map.insert("time", QDateTime::fromMSecsSinceEpoch(qint64(point.timestamp)));
+        map.insert("min", point.min);
+        map.insert("max", point.max);
+        map.insert("mean", point.mean);
+        points.append(map);
+    }
+    return points;
+}
+
+quint32 TCPsocketClient::parseData(const quint8 *rawData, bool tempOrHum)
 {
     quint32 data;
     if(tempOrHum)
@@ -122,7 +458,7 @@ quint32 TCPsocketClient::parseData(quint8 *rawData, bool tempOrHum)
     return data;
 }
 
-quint32 TCPsocketClient::parseMaxMinData(quint8 *rawData, qint32 chooseParse)
+quint32 TCPsocketClient::parseMaxMinData(const quint8 *rawData, qint32 chooseParse)
 {
     quint32 data;
     switch(chooseParse)
@@ -150,62 +486,89 @@ quint32 TCPsocketClient::parseMaxMinData(quint8 *rawData, qint32 chooseParse)
     return data;
 }
 
+/* The raw data is the ieee 754 float */
+float TCPsocketClient::toFloat(quint32 rawData)
+{
+    float value;
+
+    memcpy(&value, &rawData, sizeof(float));
+    return value;
+}
+
 void TCPsocketClient::setTemperature(float temperature)
 {
+    if(m_temperature == temperature)
+        return;
     m_temperature = temperature;
+    emit temperatureChanged();
 }
 
-float TCPsocketClient::getTemperature()
+float TCPsocketClient::getTemperature() const
 {
     return m_temperature;
 }
 
 void TCPsocketClient::setHumidity(float humidity)
 {
+    if(m_humidity == humidity)
+        return;
     m_humidity = humidity;
+    emit humidityChanged();
 }
 
-float TCPsocketClient::getHumidity()
+float TCPsocketClient::getHumidity() const
 {
     return m_humidity;
 }
 
 void TCPsocketClient::setMinTemperature(float minTemperature)
 {
+    if(m_minTemperature == minTemperature)
+        return;
     m_minTemperature = minTemperature;
+    emit minTemperatureChanged();
 }
 
-float TCPsocketClient::getMinTemperature()
+float TCPsocketClient::getMinTemperature() const
 {
     return m_minTemperature;
 }
 
 void TCPsocketClient::setMaxTemperature(float maxTemperature)
 {
+    if(m_maxTemperature == maxTemperature)
+        return;
     m_maxTemperature = maxTemperature;
+    emit maxTemperatureChanged();
 }
 
-float TCPsocketClient::getMaxTemperature()
+float TCPsocketClient::getMaxTemperature() const
 {
     return m_maxTemperature;
 }
 
 void TCPsocketClient::setMinHumidity(float minHumidity)
 {
+    if(m_minHumidity == minHumidity)
+        return;
     m_minHumidity = minHumidity;
+    emit minHumidityChanged();
 }
 
-float TCPsocketClient::getMinHumidity()
+float TCPsocketClient::getMinHumidity() const
 {
     return m_minHumidity;
 }
 
 void TCPsocketClient::setMaxHumidity(float maxHumidity)
 {
+    if(m_maxHumidity == maxHumidity)
+        return;
     m_maxHumidity = maxHumidity;
+    emit maxHumidityChanged();
 }
 
-float TCPsocketClient::getMaxHumidity()
+float TCPsocketClient::getMaxHumidity() const
 {
     return m_maxHumidity;
 }
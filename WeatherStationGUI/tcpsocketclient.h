@@ -6,28 +6,122 @@
 #include <QString>
 #include <QtNetwork>
 #include <QtDebug>
+#include <QVariantList>
+#include <QQueue>
+#include <QTimer>
+#include "weatherframe.h"
 
+/*
+ * Client of the weather station which never blocks the GUI thread. The requests are queued and
+ * written once the frame format is negotiated, the responses are parsed as their bytes arrive and
+ * the values come out through the properties' NOTIFY signals. The station answers in the order it
+ * was asked, so the response at the front of the receive buffer belongs to the oldest request.
+ */
 class TCPsocketClient: public QObject
 {
 Q_OBJECT
+    Q_PROPERTY(bool connected READ isConnected NOTIFY connectedChanged)
+    Q_PROPERTY(int frameVersion READ frameVersion NOTIFY connectedChanged)
+    Q_PROPERTY(int pendingRequests READ pendingRequests NOTIFY pendingRequestsChanged)
+    Q_PROPERTY(float temperature READ getTemperature NOTIFY temperatureChanged)
+    Q_PROPERTY(float humidity READ getHumidity NOTIFY humidityChanged)
+    Q_PROPERTY(float minTemperature READ getMinTemperature NOTIFY minTemperatureChanged)
+    Q_PROPERTY(float maxTemperature READ getMaxTemperature NOTIFY maxTemperatureChanged)
+    Q_PROPERTY(float minHumidity READ getMinHumidity NOTIFY minHumidityChanged)
+    Q_PROPERTY(float maxHumidity READ getMaxHumidity NOTIFY maxHumidityChanged)
 public:
+    /* A response not complete after ResponseTimeoutMs fails its request, and the ones behind it */
+    enum Constants {
+        ConnectTimeoutMs = 5000,
+        NegotiationTimeoutMs = 2000,
+        ResponseTimeoutMs = 2000,
+        MaxPendingRequests = 16
+    };
+
     explicit TCPsocketClient(QObject *parent = 0);
     ~TCPsocketClient();
     Q_INVOKABLE bool createConnection(const QString &addr, const quint16 port);
+    Q_INVOKABLE void closeConnection();
     Q_INVOKABLE bool readData();
     Q_INVOKABLE bool readMaxAndMinValues();
-    Q_INVOKABLE float getTemperature();
-    Q_INVOKABLE float getHumidity();
-    Q_INVOKABLE float getMinTemperature();
-    Q_INVOKABLE float getMaxTemperature();
-    Q_INVOKABLE float getMinHumidity();
-    Q_INVOKABLE float getMaxHumidity();
+    Q_INVOKABLE bool requestDownsampledSeries(int channel, qint64 from, qint64 to, int width, int mode);
+    bool isConnected() const;
+    int frameVersion() const;
+    int pendingRequests() const;
+    float getTemperature() const;
+    float getHumidity() const;
+    float getMinTemperature() const;
+    float getMaxTemperature() const;
+    float getMinHumidity() const;
+    float getMaxHumidity() const;
+
+signals:
+    void connectedChanged();
+    void pendingRequestsChanged();
+    void temperatureChanged();
+    void humidityChanged();
+    void minTemperatureChanged();
+    void maxTemperatureChanged();
+    void minHumidityChanged();
+    void maxHumidityChanged();
+    void seriesReceived(int channel, const QVariantList &points);
+    void errorOccurred(const QString &message);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onReadyRead();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+    void onTimeout();
 
 private:
+    enum ConnectionState {
+        Disconnected,
+        Connecting,
+        Negotiating,
+        Ready
+    };
+
+    enum RequestType {
+        CurrentValues,
+        Extremes,
+        DownsampledSeries
+    };
+
+    struct Request
+    {
+        RequestType type;
+        QByteArray command;
+        int channel;
+    };
+
     QTcpSocket clientSocket;
-    bool sendByte(const char *commandByte);
-    quint32 parseData(quint8 *rawData, bool tempOrhum);
-    quint32 parseMaxMinData(quint8 *rawData, qint32 chooseParse);
+    QTimer m_timer;
+    ConnectionState m_state;
+
+    /* The requests in the order they were asked, the first m_writtenRequests of them are on the wire */
+    QQueue<Request> m_requests;
+    int m_writtenRequests;
+
+    /* Bytes received and not parsed yet start at m_receiveOffset */
+    QByteArray m_receiveBuffer;
+    int m_receiveOffset;
+    quint8 m_frameVersion;
+
+    bool enqueueRequest(RequestType type, const QByteArray &command, int channel);
+    void writeRequests();
+    void finishNegotiation(quint8 version);
+    void completeRequest();
+    void failRequests(const QString &message);
+    bool parseFrame();
+    bool parseLegacyResponse();
+    bool parseLegacySeries(const quint8 *data, int available);
+    void applySamples(const WeatherFrameView &frame);
+    void applyLegacyValues(RequestType type, const quint8 *data);
+    QVariantList seriesPoints(const quint8 *payload, qint64 length);
+    quint32 parseData(const quint8 *rawData, bool tempOrhum);
+    quint32 parseMaxMinData(const quint8 *rawData, qint32 chooseParse);
+    float toFloat(quint32 rawData);
     void setTemperature(float temperature);
     void setHumidity(float humidity);
     void setMinTemperature(float minTemperature);
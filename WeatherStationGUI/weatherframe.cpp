@@ -0,0 +1,262 @@
+#include "weatherframe.h"
+#include <cstring>
+
+/* CRC32C (Castagnoli) lookup table of the reflected polynomial 0x82F63B78 */
+static const quint32 crc32cTable[256] = {
+    0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C,
+    0x26A1E7E8, 0xD4CA64EB, 0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+    0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24, 0x105EC76F, 0xE235446C,
+    0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+    0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC,
+    0xBC267848, 0x4E4DFB4B, 0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+    0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35, 0xAA64D611, 0x580F5512,
+    0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+    0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD,
+    0x1642AE59, 0xE4292D5A, 0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+    0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595, 0x417B1DBC, 0xB3109EBF,
+    0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+    0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F,
+    0xED03A29B, 0x1F682198, 0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+    0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38, 0xDBFC821C, 0x2997011F,
+    0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+    0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E,
+    0x4767748A, 0xB50CF789, 0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+    0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46, 0x7198540D, 0x83F3D70E,
+    0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+    0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE,
+    0xDDE0EB2A, 0x2F8B6829, 0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+    0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93, 0x082F63B7, 0xFA44E0B4,
+    0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+    0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B,
+    0xB4091BFF, 0x466298FC, 0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+    0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033, 0xA24BB5A6, 0x502036A5,
+    0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+    0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975,
+    0x0E330A81, 0xFC588982, 0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+    0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622, 0x38CC2A06, 0xCAA7A905,
+    0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+    0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8,
+    0xE52CC12C, 0x1747422F, 0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+    0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0, 0xD3D3E1AB, 0x21B862A8,
+    0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+    0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78,
+    0x7FAB5E8C, 0x8DC0DD8F, 0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+    0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1, 0x69E9F0D5, 0x9B8273D6,
+    0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+    0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69,
+    0xD5CF889D, 0x27A40B9E, 0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+    0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351
+};
+
+static void writeUint16(quint8 *buffer, quint16 value)
+{
+    buffer[0] = value >> 8;
+    buffer[1] = value;
+}
+
+static void writeUint32(quint8 *buffer, quint32 value)
+{
+    buffer[0] = value >> 24;
+    buffer[1] = value >> 16;
+    buffer[2] = value >> 8;
+    buffer[3] = value;
+}
+
+static quint16 readUint16(const quint8 *buffer)
+{
+    return quint16(buffer[0] << 8 | buffer[1]);
+}
+
+static quint32 readUint32(const quint8 *buffer)
+{
+    return quint32(buffer[0]) << 24 | quint32(buffer[1]) << 16 | quint32(buffer[2]) << 8 | buffer[3];
+}
+
+quint32 WeatherFrame::crc32c(quint32 crc, const quint8 *data, qint64 length)
+{
+    crc = ~crc;
+    while(length-- > 0)
+        crc = crc32cTable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/*
+ * Decodes the frame at the beginning of the data without copying the payload.
+ * Returns the length of the frame, 0 if more bytes are needed and -1 if the bytes are not a valid frame.
+ */
+qint64 WeatherFrame::decode(const quint8 *data, qint64 length, WeatherFrameView *frame)
+{
+    if(length >= 1 && data[0] != Magic0)
+        return -1;
+    if(length >= 2 && data[1] != Magic1)
+        return -1;
+    if(length < HeaderSize)
+        return 0;
+    if(data[2] == 0 || data[2] > Version)
+        return -1;
+
+    quint16 payloadLength = readUint16(data + 4);
+    qint64 frameLength = Overhead + payloadLength;
+    if(length < frameLength)
+        return 0;
+
+    if(crc32c(0, data, frameLength - CrcSize) != readUint32(data + frameLength - CrcSize))
+        return -1;
+
+    frame->version = data[2];
+    frame->type = data[3];
+    frame->payloadLength = payloadLength;
+    frame->sequence = readUint32(data + 6);
+    frame->timestamp = quint64(readUint32(data + 10)) << 32 | readUint32(data + 14);
+    frame->payload = data + HeaderSize;
+
+    return frameLength;
+}
+
+/* Returns the offset of the next possible frame start after an invalid frame */
+qint64 WeatherFrame::findStart(const quint8 *data, qint64 length)
+{
+    for(qint64 i = 1 ; i < length ; i++) {
+        if(data[i] == Magic0 && (i + 1 == length || data[i + 1] == Magic1))
+            return i;
+    }
+    return length;
+}
+
+int WeatherFrame::sampleCount(const WeatherFrameView &frame)
+{
+    if((frame.type != Samples && frame.type != Push) || frame.payloadLength < SampleCountSize)
+        return -1;
+
+    int count = readUint16(frame.payload);
+    if(SampleCountSize + count * SampleSize > frame.payloadLength)
+        return -1;
+
+    return count;
+}
+
+bool WeatherFrame::readSample(const WeatherFrameView &frame, int index, quint8 *channel, quint8 *field, float *value)
+{
+    if(index < 0 || index >= sampleCount(frame))
+        return false;
+
+    const quint8 *sample = frame.payload + SampleCountSize + index * SampleSize;
+    quint32 rawData = readUint32(sample + 2);
+
+    *channel = sample[0];
+    *field = sample[1];
+    memcpy(value, &rawData, sizeof(float));
+    return true;
+}
+
+/*
+ * The series payload is the channel, the mode and the point count (2) followed by the points: the timestamp (8)
+ * and the min, max and mean of a bucket, or only the value of a largest-triangle-three-buckets point.
+ * The same payload is the legacy response, so it is parsed without the frame around it.
+ */
+int WeatherFrame::seriesPointCount(const quint8 *payload, qint64 length)
+{
+    if(length < SeriesHeaderSize)
+        return -1;
+
+    int count = readUint16(payload + 2);
+    int pointSize = payload[1] == LargestTriangle ? SeriesPointSize : SeriesBucketSize;
+    if(SeriesHeaderSize + qint64(count) * pointSize > length)
+        return -1;
+
+    return count;
+}
+
+bool WeatherFrame::readSeriesPoint(const quint8 *payload, qint64 length, int index, WeatherSeriesPoint *point)
+{
+    if(index < 0 || index >= seriesPointCount(payload, length))
+        return false;
+
+    bool lttb = payload[1] == LargestTriangle;
+    const quint8 *data = payload + SeriesHeaderSize + index * (lttb ? SeriesPointSize : SeriesBucketSize);
+    quint32 rawData[3];
+
+    point->timestamp = quint64(readUint32(data)) << 32 | readUint32(data + 4);
+    for(int i = 0 ; i < (lttb ? 1 : 3) ; i++)
+        rawData[i] = readUint32(data + 8 + i * 4);
+
+    if(lttb) {
+        memcpy(&point->mean, &rawData[0], sizeof(float));
+        point->min = point->max = point->mean;
+    }
+    else {
+        memcpy(&point->min, &rawData[0], sizeof(float));
+        memcpy(&point->max, &rawData[1], sizeof(float));
+        memcpy(&point->mean, &rawData[2], sizeof(float));
+    }
+    return true;
+}
+
+WeatherFrameEncoder::WeatherFrameEncoder(quint8 *buffer, qint64 capacity, quint8 type, quint32 sequence, quint64 timestamp) :
+    m_buffer(buffer), m_capacity(capacity), m_length(WeatherFrame::HeaderSize), m_sampleCount(0), m_overflow(false)
+{
+    if(capacity < WeatherFrame::Overhead) {
+        m_overflow = true;
+        return;
+    }
+
+    buffer[0] = WeatherFrame::Magic0;
+    buffer[1] = WeatherFrame::Magic1;
+    buffer[2] = WeatherFrame::Version;
+    buffer[3] = type;
+    writeUint16(buffer + 4, 0);
+    writeUint32(buffer + 6, sequence);
+    writeUint32(buffer + 10, quint32(timestamp >> 32));
+    writeUint32(buffer + 14, quint32(timestamp));
+
+    /* Reserve the sample count of a samples payload */
+    if(type == WeatherFrame::Samples) {
+        const quint8 count[WeatherFrame::SampleCountSize] = { 0, 0 };
+        appendPayload(count, sizeof(count));
+    }
+}
+
+bool WeatherFrameEncoder::appendPayload(const quint8 *data, qint64 length)
+{
+    if(m_overflow || m_length + length + WeatherFrame::CrcSize > m_capacity ||
+            m_length + length - WeatherFrame::HeaderSize > 0xFFFF) {
+        m_overflow = true;
+        return false;
+    }
+
+    memcpy(m_buffer + m_length, data, length);
+    m_length += length;
+    return true;
+}
+
+bool WeatherFrameEncoder::appendSample(quint8 channel, quint8 field, float value)
+{
+    quint8 sample[WeatherFrame::SampleSize];
+    quint32 rawData;
+
+    memcpy(&rawData, &value, sizeof(float));
+    sample[0] = channel;
+    sample[1] = field;
+    writeUint32(sample + 2, rawData);
+
+    if(!appendPayload(sample, sizeof(sample)))
+        return false;
+
+    m_sampleCount++;
+    return true;
+}
+
+/* Fills in the length, the sample count and the checksum. Returns the frame length or -1 on overflow. */
+qint64 WeatherFrameEncoder::finish()
+{
+    if(m_overflow)
+        return -1;
+
+    writeUint16(m_buffer + 4, quint16(m_length - WeatherFrame::HeaderSize));
+    if(m_buffer[3] == WeatherFrame::Samples)
+        writeUint16(m_buffer + WeatherFrame::HeaderSize, m_sampleCount);
+
+    writeUint32(m_buffer + m_length, WeatherFrame::crc32c(0, m_buffer, m_length));
+    m_length += WeatherFrame::CrcSize;
+    return m_length;
+}
@@ -0,0 +1,103 @@
+#ifndef WEATHERFRAME_H
+#define WEATHERFRAME_H
+
+#include <QtGlobal>
+
+/*
+ * Length-prefixed, versioned and CRC32C checked frame of the weather station.
+ * The layout is the same as in ThreadWStation/WeatherFrame.h, all fields big-endian:
+ * magic 'W' 'F', version, type, payload length (2), sequence (4), timestamp ms (8), payload, CRC32C (4).
+ */
+
+/* Points into the receive buffer, nothing is copied */
+struct WeatherFrameView
+{
+    quint8 version;
+    quint8 type;
+    quint16 payloadLength;
+    quint32 sequence;
+    quint64 timestamp;
+    const quint8 *payload;
+};
+
+/* A point of a downsampled series, a largest-triangle-three-buckets point only has the mean */
+struct WeatherSeriesPoint
+{
+    quint64 timestamp;
+    float min;
+    float max;
+    float mean;
+};
+
+class WeatherFrame
+{
+public:
+    enum Constants {
+        Magic0 = 'W',
+        Magic1 = 'F',
+        Version = 1,
+        HeaderSize = 18,
+        CrcSize = 4,
+        Overhead = HeaderSize + CrcSize,
+        SampleCountSize = 2,
+        SampleSize = 6,
+        SeriesHeaderSize = 4,
+        SeriesBucketSize = 20,
+        SeriesPointSize = 12,
+        DownsampleRequestSize = 20
+    };
+
+    enum Type {
+        Hello = 0x01,
+        Samples = 0x02,
+        Series = 0x05,
+        Push = 0x06,
+        Error = 0x7F
+    };
+
+    enum Field {
+        Current = 0x00,
+        Min = 0x01,
+        Max = 0x02
+    };
+
+    enum DownsampleMode {
+        MinMaxMean = 0,
+        LargestTriangle = 1
+    };
+
+    enum Channel {
+        MPL3115A2Temperature = 0,
+        Pressure = 1,
+        Altitude = 2,
+        TMP36Temperature = 3,
+        Humidity = 4
+    };
+
+    static quint32 crc32c(quint32 crc, const quint8 *data, qint64 length);
+    static qint64 decode(const quint8 *data, qint64 length, WeatherFrameView *frame);
+    static qint64 findStart(const quint8 *data, qint64 length);
+    static int sampleCount(const WeatherFrameView &frame);
+    static bool readSample(const WeatherFrameView &frame, int index, quint8 *channel, quint8 *field, float *value);
+    static int seriesPointCount(const quint8 *payload, qint64 length);
+    static bool readSeriesPoint(const quint8 *payload, qint64 length, int index, WeatherSeriesPoint *point);
+};
+
+/* Writes a frame straight into the caller's buffer */
+class WeatherFrameEncoder
+{
+public:
+    WeatherFrameEncoder(quint8 *buffer, qint64 capacity, quint8 type, quint32 sequence, quint64 timestamp);
+    bool appendPayload(const quint8 *data, qint64 length);
+    bool appendSample(quint8 channel, quint8 field, float value);
+    qint64 finish();
+
+private:
+    quint8 *m_buffer;
+    qint64 m_capacity;
+    qint64 m_length;
+    quint16 m_sampleCount;
+    bool m_overflow;
+};
+
+#endif // WEATHERFRAME_H